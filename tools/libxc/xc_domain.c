@@ -575,6 +575,48 @@ int xc_shadow_control(xc_interface *xch,
     return (rc == 0) ? domctl.u.shadow_op.pages : rc;
 }
 
+int xc_shadow_clean_ranges(xc_interface *xch,
+                           uint32_t domid,
+                           unsigned long *first_pfn,
+                           unsigned long pages,
+                           xen_domctl_dirty_range_t *ranges,
+                           unsigned int nr_ranges,
+                           xc_shadow_op_stats_t *stats)
+{
+    int rc;
+    DECLARE_DOMCTL;
+    DECLARE_HYPERCALL_BOUNCE(ranges, nr_ranges * sizeof(*ranges),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, ranges) )
+        return -1;
+
+    memset(&domctl, 0, sizeof(domctl));
+
+    domctl.cmd = XEN_DOMCTL_shadow_op;
+    domctl.domain = (domid_t)domid;
+    domctl.u.shadow_op.op        = XEN_DOMCTL_SHADOW_OP_CLEAN_RANGES;
+    domctl.u.shadow_op.pages     = pages;
+    domctl.u.shadow_op.first_pfn = *first_pfn;
+    domctl.u.shadow_op.nr_ranges = nr_ranges;
+    set_xen_guest_handle(domctl.u.shadow_op.dirty_ranges, ranges);
+
+    rc = do_domctl(xch, &domctl);
+
+    xc_hypercall_bounce_post(xch, ranges);
+
+    if ( rc )
+        return rc;
+
+    if ( stats )
+        memcpy(stats, &domctl.u.shadow_op.stats,
+               sizeof(xc_shadow_op_stats_t));
+
+    *first_pfn = domctl.u.shadow_op.first_pfn;
+
+    return domctl.u.shadow_op.nr_ranges;
+}
+
 int xc_domain_setmaxmem(xc_interface *xch,
                         uint32_t domid,
                         unsigned int max_memkb)
@@ -53,6 +53,7 @@ struct save_ctx {
     xen_pfn_t *live_m2p; /* Live mapping of system MFN to PFN table. */
     unsigned long m2p_mfn0;
     struct domain_info_context dinfo;
+    int no_dirty_ranges; /* Xen cannot report dirty pages as ranges */
 };
 
 /* buffer for output */
@@ -325,6 +326,58 @@ static int print_stats(xc_interface *xch, uint32_t domid, int pages_sent,
 }
 
 
+#define DIRTY_RANGES_BATCH 256
+
+/*
+ * Fetch the pages dirtied since the last call into to_send, and clean the
+ * log-dirty state.  Xen is asked for runs of dirty pages rather than the
+ * whole bitmap, which for HAP guests also spares write-protecting the
+ * whole p2m again; older hypervisors only support the bitmap.
+ */
+static int clean_dirty_log(xc_interface *xch, uint32_t dom,
+                           struct save_ctx *ctx,
+                           xc_hypercall_buffer_t *to_send_buf,
+                           unsigned long *to_send,
+                           xc_shadow_op_stats_t *stats)
+{
+    struct domain_info_context *dinfo = &ctx->dinfo;
+    xen_domctl_dirty_range_t ranges[DIRTY_RANGES_BATCH];
+    xc_shadow_op_stats_t more;
+    unsigned long pfn = 0, i;
+    int n;
+
+    if ( !ctx->no_dirty_ranges )
+    {
+        memset(to_send, 0, bitmap_size(dinfo->p2m_size));
+
+        while ( pfn < dinfo->p2m_size )
+        {
+            n = xc_shadow_clean_ranges(xch, dom, &pfn, dinfo->p2m_size,
+                                       ranges, DIRTY_RANGES_BATCH,
+                                       pfn ? &more : stats);
+            if ( n < 0 )
+                break;
+            while ( n-- )
+                for ( i = 0; i < ranges[n].nr_pfns; i++ )
+                    set_bit(ranges[n].first_pfn + i, to_send);
+        }
+        if ( pfn >= dinfo->p2m_size )
+            return 0;
+        if ( pfn != 0 || errno != EINVAL )
+            return -1;
+
+        DPRINTF("Dirty ranges not supported: using the bitmap\n");
+        ctx->no_dirty_ranges = 1;
+    }
+
+    if ( xc_shadow_control(xch, dom, XEN_DOMCTL_SHADOW_OP_CLEAN, to_send_buf,
+                           dinfo->p2m_size, NULL, 0,
+                           stats) != dinfo->p2m_size )
+        return -1;
+
+    return 0;
+}
+
 static int analysis_phase(xc_interface *xch, uint32_t domid, struct save_ctx *ctx,
                           xc_hypercall_buffer_t *arr, int runs)
 {
@@ -1568,9 +1621,8 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
 
             }
 
-            if ( xc_shadow_control(xch, dom,
-                                   XEN_DOMCTL_SHADOW_OP_CLEAN, HYPERCALL_BUFFER(to_send),
-                                   dinfo->p2m_size, NULL, 0, &shadow_stats) != dinfo->p2m_size )
+            if ( clean_dirty_log(xch, dom, ctx, HYPERCALL_BUFFER(to_send),
+                                 to_send, &shadow_stats) )
             {
                 PERROR("Error flushing shadow PT");
                 goto out;
@@ -2097,9 +2149,8 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
         DPRINTF("SUSPEND shinfo %08lx\n", info.shared_info_frame);
         print_stats(xch, dom, 0, &time_stats, &shadow_stats, 1);
 
-        if ( xc_shadow_control(xch, dom,
-                               XEN_DOMCTL_SHADOW_OP_CLEAN, HYPERCALL_BUFFER(to_send),
-                               dinfo->p2m_size, NULL, 0, &shadow_stats) != dinfo->p2m_size )
+        if ( clean_dirty_log(xch, dom, ctx, HYPERCALL_BUFFER(to_send),
+                             to_send, &shadow_stats) )
         {
             PERROR("Error flushing shadow PT");
         }
@@ -22,10 +22,17 @@
  */
 
 #include "xc_private.h"
+#include "xc_bitops.h"
 
 
 int xc_mem_paging_enable(xc_interface *xch, domid_t domain_id,
                          uint32_t *port)
+{
+    return xc_mem_paging_enable_frames(xch, domain_id, 1, port);
+}
+
+int xc_mem_paging_enable_frames(xc_interface *xch, domid_t domain_id,
+                                unsigned int nr_frames, uint32_t *port)
 {
     if ( !port )
     {
@@ -36,7 +43,7 @@ int xc_mem_paging_enable(xc_interface *xch, domid_t domain_id,
     return xc_mem_event_control(xch, domain_id,
                                 XEN_DOMCTL_MEM_EVENT_OP_PAGING_ENABLE,
                                 XEN_DOMCTL_MEM_EVENT_OP_PAGING,
-                                port);
+                                nr_frames, port);
 }
 
 int xc_mem_paging_disable(xc_interface *xch, domid_t domain_id)
@@ -44,7 +51,7 @@ int xc_mem_paging_disable(xc_interface *xch, domid_t domain_id)
     return xc_mem_event_control(xch, domain_id,
                                 XEN_DOMCTL_MEM_EVENT_OP_PAGING_DISABLE,
                                 XEN_DOMCTL_MEM_EVENT_OP_PAGING,
-                                NULL);
+                                0, NULL);
 }
 
 int xc_mem_paging_nominate(xc_interface *xch, domid_t domain_id, unsigned long gfn)
@@ -99,6 +106,34 @@ int xc_mem_paging_load(xc_interface *xch, domid_t domain_id,
     return rc;
 }
 
+int xc_mem_paging_scan_accessed(xc_interface *xch, domid_t domain_id,
+                                unsigned long gfn, unsigned int nr,
+                                uint8_t *bitmap)
+{
+    xen_mem_event_op_t meo;
+    size_t size = (nr + 7) / 8;
+    int rc, old_errno;
+
+    if ( mlock(bitmap, size) )
+        return -1;
+
+    memset(&meo, 0, sizeof(meo));
+
+    meo.op      = XENMEM_paging_op_scan_accessed;
+    meo.domain  = domain_id;
+    meo.gfn     = gfn;
+    meo.nr      = nr;
+    meo.buffer  = (unsigned long) bitmap;
+
+    rc = do_memory_op(xch, XENMEM_paging_op, &meo, sizeof(meo));
+
+    old_errno = errno;
+    munlock(bitmap, size);
+    errno = old_errno;
+
+    return rc;
+}
+
 
 /*
  * Local variables:
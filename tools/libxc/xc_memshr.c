@@ -55,7 +55,7 @@ int xc_memshr_ring_enable(xc_interface *xch,
     return xc_mem_event_control(xch, domid,
                                 XEN_DOMCTL_MEM_EVENT_OP_SHARING_ENABLE,
                                 XEN_DOMCTL_MEM_EVENT_OP_SHARING,
-                                port);
+                                1, port);
 }
 
 int xc_memshr_ring_disable(xc_interface *xch, 
@@ -64,7 +64,7 @@ int xc_memshr_ring_disable(xc_interface *xch,
     return xc_mem_event_control(xch, domid,
                                 XEN_DOMCTL_MEM_EVENT_OP_SHARING_DISABLE,
                                 XEN_DOMCTL_MEM_EVENT_OP_SHARING,
-                                NULL);
+                                0, NULL);
 }
 
 static int xc_memshr_memop(xc_interface *xch, domid_t domid, 
@@ -161,6 +161,60 @@ int xc_memshr_share_grefs(xc_interface *xch,
     return xc_memshr_memop(xch, source_domain, &mso);
 }
 
+int xc_memshr_nominate_range(xc_interface *xch,
+                             domid_t domid,
+                             unsigned long first_gfn,
+                             unsigned int nr,
+                             uint64_t *handles)
+{
+    int rc;
+    xen_mem_sharing_op_t mso;
+    DECLARE_HYPERCALL_BOUNCE(handles, nr * sizeof(*handles),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, handles) )
+        return -1;
+
+    memset(&mso, 0, sizeof(mso));
+
+    mso.op = XENMEM_sharing_op_nominate_range;
+    mso.u.range.first_gfn = first_gfn;
+    mso.u.range.nr        = nr;
+    set_xen_guest_handle(mso.u.range.handles, handles);
+
+    rc = xc_memshr_memop(xch, domid, &mso);
+
+    xc_hypercall_bounce_post(xch, handles);
+
+    return rc;
+}
+
+int xc_memshr_share_batch(xc_interface *xch,
+                          domid_t source_domain,
+                          xen_mem_sharing_batch_entry_t *entries,
+                          unsigned int nr)
+{
+    int rc;
+    xen_mem_sharing_op_t mso;
+    DECLARE_HYPERCALL_BOUNCE(entries, nr * sizeof(*entries),
+                             XC_HYPERCALL_BUFFER_BOUNCE_BOTH);
+
+    if ( xc_hypercall_bounce_pre(xch, entries) )
+        return -1;
+
+    memset(&mso, 0, sizeof(mso));
+
+    mso.op = XENMEM_sharing_op_share_batch;
+    mso.u.batch.nr = nr;
+    set_xen_guest_handle(mso.u.batch.entries, entries);
+
+    rc = xc_memshr_memop(xch, source_domain, &mso);
+
+    xc_hypercall_bounce_post(xch, entries);
+
+    return rc;
+}
+
 int xc_memshr_add_to_physmap(xc_interface *xch,
                     domid_t source_domain,
                     unsigned long source_gfn,
@@ -0,0 +1,144 @@
+/******************************************************************************
+ * xc_page_is_zero.c
+ *
+ * Detection of all-zero pages, for callers deciding whether a page needs
+ * to be kept, sent or shared.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "xc_private.h"
+
+#if defined(__x86_64__)
+
+static int page_is_zero_sse2(const void *page)
+{
+    const char *p = page;
+    unsigned int i, mask;
+
+    for ( i = 0; i < XC_PAGE_SIZE; i += 64 )
+    {
+        asm ( "movdqa   (%1), %%xmm0\n\t"
+              "movdqa   16(%1), %%xmm1\n\t"
+              "por      32(%1), %%xmm0\n\t"
+              "por      48(%1), %%xmm1\n\t"
+              "por      %%xmm1, %%xmm0\n\t"
+              "pxor     %%xmm1, %%xmm1\n\t"
+              "pcmpeqb  %%xmm1, %%xmm0\n\t"
+              "pmovmskb %%xmm0, %0"
+              : "=r" (mask) : "r" (p + i), "m" (*(const char (*)[64])(p + i))
+              : "xmm0", "xmm1" );
+        if ( mask != 0xffff )
+            return 0;
+    }
+
+    return 1;
+}
+
+static int page_is_zero_avx2(const void *page)
+{
+    const char *p = page;
+    unsigned int i;
+    unsigned char nonzero = 0;
+
+    for ( i = 0; !nonzero && (i < XC_PAGE_SIZE); i += 128 )
+        asm ( "vmovdqa  (%1), %%ymm0\n\t"
+              "vmovdqa  32(%1), %%ymm1\n\t"
+              "vpor     64(%1), %%ymm0, %%ymm0\n\t"
+              "vpor     96(%1), %%ymm1, %%ymm1\n\t"
+              "vpor     %%ymm1, %%ymm0, %%ymm0\n\t"
+              "vptest   %%ymm0, %%ymm0\n\t"
+              "setnz    %0"
+              : "=q" (nonzero) : "r" (p + i),
+                "m" (*(const char (*)[128])(p + i))
+              : "xmm0", "xmm1" );
+
+    /* Avoid AVX to SSE transition penalties in the caller. */
+    asm volatile ( "vzeroupper" );
+
+    return !nonzero;
+}
+
+static int cpu_has_avx2(void)
+{
+    unsigned int eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+
+    asm ( "cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+          : "0" (0) );
+    if ( eax < 7 )
+        return 0;
+
+    /* AVX, and the OS using XSAVE to manage YMM state. */
+    asm ( "cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+          : "0" (1) );
+    if ( (ecx & ((1u << 27) | (1u << 28))) != ((1u << 27) | (1u << 28)) )
+        return 0;
+    asm ( "xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0) );
+    if ( (xcr0_lo & 6) != 6 )
+        return 0;
+
+    asm ( "cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+          : "0" (7), "2" (0) );
+    return !!(ebx & (1u << 5));
+}
+
+static int (*select_page_is_zero(void))(const void *)
+{
+    return cpu_has_avx2() ? page_is_zero_avx2 : page_is_zero_sse2;
+}
+
+#else
+
+/* Eight words at a time, so as to stop early at the first non-zero line. */
+static int page_is_zero_words(const void *page)
+{
+    const unsigned long *p = page;
+    unsigned int i;
+
+    for ( i = 0; i < XC_PAGE_SIZE / sizeof(*p); i += 8 )
+        if ( p[i] | p[i + 1] | p[i + 2] | p[i + 3] |
+             p[i + 4] | p[i + 5] | p[i + 6] | p[i + 7] )
+            return 0;
+
+    return 1;
+}
+
+static int (*select_page_is_zero(void))(const void *)
+{
+    return page_is_zero_words;
+}
+
+#endif
+
+int xc_page_is_zero(const void *page)
+{
+    /* Racing first callers all make the same choice. */
+    static int (*page_is_zero)(const void *);
+
+    if ( page_is_zero == NULL )
+        page_is_zero = select_page_is_zero();
+
+    return page_is_zero(page);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
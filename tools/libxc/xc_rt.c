@@ -0,0 +1,114 @@
+/****************************************************************************
+ *
+ *        File: xc_rt.c
+ *
+ * Description: XC Interface to the RTDS scheduler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "xc_private.h"
+
+int
+xc_sched_rtds_domain_set(
+    xc_interface *xch,
+    uint32_t domid,
+    struct xen_domctl_sched_rtds *sdom)
+{
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_scheduler_op;
+    domctl.domain = (domid_t) domid;
+    domctl.u.scheduler_op.sched_id = XEN_SCHEDULER_RTDS;
+    domctl.u.scheduler_op.cmd = XEN_DOMCTL_SCHEDOP_putinfo;
+    domctl.u.scheduler_op.u.rtds = *sdom;
+
+    return do_domctl(xch, &domctl);
+}
+
+int
+xc_sched_rtds_domain_get(
+    xc_interface *xch,
+    uint32_t domid,
+    struct xen_domctl_sched_rtds *sdom)
+{
+    DECLARE_DOMCTL;
+    int err;
+
+    domctl.cmd = XEN_DOMCTL_scheduler_op;
+    domctl.domain = (domid_t) domid;
+    domctl.u.scheduler_op.sched_id = XEN_SCHEDULER_RTDS;
+    domctl.u.scheduler_op.cmd = XEN_DOMCTL_SCHEDOP_getinfo;
+
+    err = do_domctl(xch, &domctl);
+    if ( err == 0 )
+        *sdom = domctl.u.scheduler_op.u.rtds;
+
+    return err;
+}
+
+static int
+xc_sched_rtds_vcpu_op(
+    xc_interface *xch,
+    uint32_t domid,
+    uint32_t cmd,
+    struct xen_domctl_schedparam_vcpu *vcpus,
+    uint32_t num_vcpus)
+{
+    int rc;
+    DECLARE_DOMCTL;
+    DECLARE_HYPERCALL_BOUNCE(vcpus, sizeof(*vcpus) * num_vcpus,
+                             cmd == XEN_DOMCTL_SCHEDOP_putvcpuinfo ?
+                             XC_HYPERCALL_BUFFER_BOUNCE_IN :
+                             XC_HYPERCALL_BUFFER_BOUNCE_BOTH);
+
+    if ( xc_hypercall_bounce_pre(xch, vcpus) )
+        return -1;
+
+    domctl.cmd = XEN_DOMCTL_scheduler_op;
+    domctl.domain = (domid_t) domid;
+    domctl.u.scheduler_op.sched_id = XEN_SCHEDULER_RTDS;
+    domctl.u.scheduler_op.cmd = cmd;
+    domctl.u.scheduler_op.u.v.nr_vcpus = num_vcpus;
+    set_xen_guest_handle(domctl.u.scheduler_op.u.v.vcpus, vcpus);
+
+    rc = do_domctl(xch, &domctl);
+
+    xc_hypercall_bounce_post(xch, vcpus);
+
+    return rc;
+}
+
+int
+xc_sched_rtds_vcpu_set(
+    xc_interface *xch,
+    uint32_t domid,
+    struct xen_domctl_schedparam_vcpu *vcpus,
+    uint32_t num_vcpus)
+{
+    return xc_sched_rtds_vcpu_op(xch, domid, XEN_DOMCTL_SCHEDOP_putvcpuinfo,
+                                 vcpus, num_vcpus);
+}
+
+int
+xc_sched_rtds_vcpu_get(
+    xc_interface *xch,
+    uint32_t domid,
+    struct xen_domctl_schedparam_vcpu *vcpus,
+    uint32_t num_vcpus)
+{
+    return xc_sched_rtds_vcpu_op(xch, domid, XEN_DOMCTL_SCHEDOP_getvcpuinfo,
+                                 vcpus, num_vcpus);
+}
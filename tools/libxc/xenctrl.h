@@ -763,6 +763,22 @@ int xc_shadow_control(xc_interface *xch,
                       uint32_t mode,
                       xc_shadow_op_stats_t *stats);
 
+/*
+ * Fetch and clean the log-dirty state of a domain as runs of dirty pfns,
+ * rather than as a bitmap: for HAP guests, only the pages found dirty are
+ * write-protected again.  Fills in up to nr_ranges ranges of the dirty
+ * pfns from *first_pfn up to pages, and advances *first_pfn past them.
+ * Call again until *first_pfn reaches pages; the stats are reset by the
+ * first call.  Returns the number of ranges filled in, or -1 on error.
+ */
+int xc_shadow_clean_ranges(xc_interface *xch,
+                           uint32_t domid,
+                           unsigned long *first_pfn,
+                           unsigned long pages,
+                           xen_domctl_dirty_range_t *ranges,
+                           unsigned int nr_ranges,
+                           xc_shadow_op_stats_t *stats);
+
 int xc_sedf_domain_set(xc_interface *xch,
                        uint32_t domid,
                        uint64_t period, uint64_t slice,
@@ -796,6 +812,22 @@ int xc_sched_credit2_domain_get(xc_interface *xch,
                                uint32_t domid,
                                struct xen_domctl_sched_credit2 *sdom);
 
+int xc_sched_rtds_domain_set(xc_interface *xch,
+                             uint32_t domid,
+                             struct xen_domctl_sched_rtds *sdom);
+int xc_sched_rtds_domain_get(xc_interface *xch,
+                             uint32_t domid,
+                             struct xen_domctl_sched_rtds *sdom);
+/* Per-vcpu parameters: each entry of vcpus[] names the vcpu in vcpuid. */
+int xc_sched_rtds_vcpu_set(xc_interface *xch,
+                           uint32_t domid,
+                           struct xen_domctl_schedparam_vcpu *vcpus,
+                           uint32_t num_vcpus);
+int xc_sched_rtds_vcpu_get(xc_interface *xch,
+                           uint32_t domid,
+                           struct xen_domctl_schedparam_vcpu *vcpus,
+                           uint32_t num_vcpus);
+
 int
 xc_sched_arinc653_schedule_set(
     xc_interface *xch,
@@ -1369,6 +1401,12 @@ void *xc_map_foreign_batch(xc_interface *xch, uint32_t dom, int prot,
 void *xc_map_foreign_bulk(xc_interface *xch, uint32_t dom, int prot,
                           const xen_pfn_t *arr, int *err, unsigned int num);
 
+/**
+ * Returns 1 if the page at @page, which must be page aligned, is all
+ * zeroes, else 0.  Uses the widest vector instructions the CPU has.
+ */
+int xc_page_is_zero(const void *page);
+
 /**
  * Translates a virtual address in the context of a given domain and
  * vcpu returning the GFN containing the address (that is, an MFN for 
@@ -2019,7 +2057,8 @@ int xc_tmem_restore_extra(xc_interface *xch, int dom, int fd);
  * mem_event operations. Internal use only.
  */
 int xc_mem_event_control(xc_interface *xch, domid_t domain_id, unsigned int op,
-                         unsigned int mode, uint32_t *port);
+                         unsigned int mode, unsigned int nr_frames,
+                         uint32_t *port);
 int xc_mem_event_memop(xc_interface *xch, domid_t domain_id, 
                         unsigned int op, unsigned int mode,
                         uint64_t gfn, void *buffer);
@@ -2031,6 +2070,12 @@ int xc_mem_event_memop(xc_interface *xch, domid_t domain_id,
  * support is considered experimental.
  */
 int xc_mem_paging_enable(xc_interface *xch, domid_t domain_id, uint32_t *port);
+/*
+ * As xc_mem_paging_enable(), with a ring of nr_frames (at most
+ * MEM_EVENT_RING_MAX_FRAMES) consecutive gfns from HVM_PARAM_PAGING_RING_PFN.
+ */
+int xc_mem_paging_enable_frames(xc_interface *xch, domid_t domain_id,
+                                unsigned int nr_frames, uint32_t *port);
 int xc_mem_paging_disable(xc_interface *xch, domid_t domain_id);
 int xc_mem_paging_nominate(xc_interface *xch, domid_t domain_id,
                            unsigned long gfn);
@@ -2038,12 +2083,27 @@ int xc_mem_paging_evict(xc_interface *xch, domid_t domain_id, unsigned long gfn)
 int xc_mem_paging_prep(xc_interface *xch, domid_t domain_id, unsigned long gfn);
 int xc_mem_paging_load(xc_interface *xch, domid_t domain_id, 
                         unsigned long gfn, void *buffer);
+/*
+ * Set in bitmap which of the nr (at most XENMEM_paging_scan_max) gfns
+ * from gfn on were accessed since they were last scanned, and clear their
+ * accessed state.  bitmap holds (nr + 7) / 8 bytes, gfn + i in bit (i % 8)
+ * of byte (i / 8).  Fails with EOPNOTSUPP where accesses are not tracked.
+ */
+int xc_mem_paging_scan_accessed(xc_interface *xch, domid_t domain_id,
+                                unsigned long gfn, unsigned int nr,
+                                uint8_t *bitmap);
 
 /** 
  * Access tracking operations.
  * Supported only on Intel EPT 64 bit processors.
  */
 int xc_mem_access_enable(xc_interface *xch, domid_t domain_id, uint32_t *port);
+/*
+ * As xc_mem_access_enable(), with a ring of nr_frames (at most
+ * MEM_EVENT_RING_MAX_FRAMES) consecutive gfns from HVM_PARAM_ACCESS_RING_PFN.
+ */
+int xc_mem_access_enable_frames(xc_interface *xch, domid_t domain_id,
+                                unsigned int nr_frames, uint32_t *port);
 int xc_mem_access_disable(xc_interface *xch, domid_t domain_id);
 int xc_mem_access_resume(xc_interface *xch, domid_t domain_id);
 
@@ -2200,6 +2260,29 @@ int xc_memshr_share_grefs(xc_interface *xch,
                     grant_ref_t client_gref,
                     uint64_t client_handle);
 
+/* Batched versions of the nominate and share calls, for tools sharing many
+ * pages at once.  The hypervisor preempts and continues them as needed.
+ *
+ * xc_memshr_nominate_range() nominates the nr gfns from first_gfn, filling in
+ * handles[] with their handles, or with 0 for gfns that could not be
+ * nominated.
+ *
+ * xc_memshr_share_batch() shares each pair in entries[], as
+ * xc_memshr_share_gfns() would, and sets its rc field to the result.  Grant
+ * references are not accepted.
+ *
+ * Both fail as a whole only if the arguments themselves are invalid.
+ */
+int xc_memshr_nominate_range(xc_interface *xch,
+                             domid_t domid,
+                             unsigned long first_gfn,
+                             unsigned int nr,
+                             uint64_t *handles);
+int xc_memshr_share_batch(xc_interface *xch,
+                          domid_t source_domain,
+                          xen_mem_sharing_batch_entry_t *entries,
+                          unsigned int nr);
+
 /* Allows to add to the guest physmap of the client domain a shared frame
  * directly.
  *
@@ -4998,6 +4998,179 @@ static int sched_sedf_domain_set(libxl__gc *gc, uint32_t domid,
     return 0;
 }
 
+/* Xen's minimum rtds period and budget, in microseconds */
+#define RTDS_MIN_PERIOD 10
+#define RTDS_MIN_BUDGET 10
+
+static int sched_rtds_validate(libxl__gc *gc, int period, int budget)
+{
+    if (period < RTDS_MIN_PERIOD || budget < RTDS_MIN_BUDGET ||
+        budget > period) {
+        LOG(ERROR, "Invalid rtds parameters: period %d, budget %d; "
+                   "period must be at least %dus, budget at least %dus "
+                   "and no larger than period",
+            period, budget, RTDS_MIN_PERIOD, RTDS_MIN_BUDGET);
+        return ERROR_INVAL;
+    }
+
+    return 0;
+}
+
+static int sched_rtds_domain_get(libxl__gc *gc, uint32_t domid,
+                                 libxl_domain_sched_params *scinfo)
+{
+    struct xen_domctl_sched_rtds sdom;
+    int rc;
+
+    rc = xc_sched_rtds_domain_get(CTX->xch, domid, &sdom);
+    if (rc != 0) {
+        LOGE(ERROR, "getting domain sched rtds");
+        return ERROR_FAIL;
+    }
+
+    libxl_domain_sched_params_init(scinfo);
+    scinfo->sched = LIBXL_SCHEDULER_RTDS;
+    scinfo->period = sdom.period;
+    scinfo->budget = sdom.budget;
+
+    return 0;
+}
+
+static int sched_rtds_domain_set(libxl__gc *gc, uint32_t domid,
+                                 const libxl_domain_sched_params *scinfo)
+{
+    struct xen_domctl_sched_rtds sdom;
+    int rc;
+
+    rc = xc_sched_rtds_domain_get(CTX->xch, domid, &sdom);
+    if (rc != 0) {
+        LOGE(ERROR, "getting domain sched rtds");
+        return ERROR_FAIL;
+    }
+
+    if (scinfo->period != LIBXL_DOMAIN_SCHED_PARAM_PERIOD_DEFAULT)
+        sdom.period = scinfo->period;
+    if (scinfo->budget != LIBXL_DOMAIN_SCHED_PARAM_BUDGET_DEFAULT)
+        sdom.budget = scinfo->budget;
+
+    rc = sched_rtds_validate(gc, sdom.period, sdom.budget);
+    if (rc)
+        return rc;
+
+    rc = xc_sched_rtds_domain_set(CTX->xch, domid, &sdom);
+    if (rc < 0) {
+        LOGE(ERROR, "setting domain sched rtds");
+        return ERROR_FAIL;
+    }
+
+    return 0;
+}
+
+static int sched_rtds_vcpu_get(libxl__gc *gc, uint32_t domid,
+                               libxl_vcpu_sched_params *scinfo)
+{
+    struct xen_domctl_schedparam_vcpu *vcpus;
+    libxl_dominfo info;
+    int num_vcpus, i, rc;
+
+    libxl_dominfo_init(&info);
+    rc = libxl_domain_info(CTX, &info, domid);
+    if (rc) {
+        LOG(ERROR, "getting domain info");
+        goto out;
+    }
+
+    /* An empty array asks for every vcpu of the domain. */
+    if (scinfo->num_vcpus == 0) {
+        num_vcpus = info.vcpu_max_id + 1;
+        scinfo->vcpus = libxl__calloc(NOGC, num_vcpus,
+                                      sizeof(*scinfo->vcpus));
+        for (i = 0; i < num_vcpus; i++) {
+            libxl_sched_params_init(&scinfo->vcpus[i]);
+            scinfo->vcpus[i].vcpuid = i;
+        }
+        scinfo->num_vcpus = num_vcpus;
+    }
+    num_vcpus = scinfo->num_vcpus;
+
+    vcpus = libxl__calloc(gc, num_vcpus, sizeof(*vcpus));
+    for (i = 0; i < num_vcpus; i++) {
+        if (scinfo->vcpus[i].vcpuid < 0 ||
+            scinfo->vcpus[i].vcpuid > info.vcpu_max_id) {
+            LOG(ERROR, "Invalid vcpu %d", scinfo->vcpus[i].vcpuid);
+            rc = ERROR_INVAL;
+            goto out;
+        }
+        vcpus[i].vcpuid = scinfo->vcpus[i].vcpuid;
+    }
+
+    rc = xc_sched_rtds_vcpu_get(CTX->xch, domid, vcpus, num_vcpus);
+    if (rc != 0) {
+        LOGE(ERROR, "getting vcpu sched rtds");
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    scinfo->sched = LIBXL_SCHEDULER_RTDS;
+    for (i = 0; i < num_vcpus; i++) {
+        scinfo->vcpus[i].period = vcpus[i].u.rtds.period;
+        scinfo->vcpus[i].budget = vcpus[i].u.rtds.budget;
+    }
+
+ out:
+    libxl_dominfo_dispose(&info);
+    return rc;
+}
+
+static int sched_rtds_vcpu_set(libxl__gc *gc, uint32_t domid,
+                               const libxl_vcpu_sched_params *scinfo)
+{
+    struct xen_domctl_schedparam_vcpu *vcpus;
+    libxl_dominfo info;
+    int i, rc;
+
+    libxl_dominfo_init(&info);
+    rc = libxl_domain_info(CTX, &info, domid);
+    if (rc) {
+        LOG(ERROR, "getting domain info");
+        goto out;
+    }
+
+    if (scinfo->num_vcpus <= 0) {
+        rc = ERROR_INVAL;
+        goto out;
+    }
+
+    vcpus = libxl__calloc(gc, scinfo->num_vcpus, sizeof(*vcpus));
+    for (i = 0; i < scinfo->num_vcpus; i++) {
+        const libxl_sched_params *p = &scinfo->vcpus[i];
+
+        if (p->vcpuid < 0 || p->vcpuid > info.vcpu_max_id) {
+            LOG(ERROR, "Invalid vcpu %d", p->vcpuid);
+            rc = ERROR_INVAL;
+            goto out;
+        }
+        rc = sched_rtds_validate(gc, p->period, p->budget);
+        if (rc)
+            goto out;
+
+        vcpus[i].vcpuid = p->vcpuid;
+        vcpus[i].u.rtds.period = p->period;
+        vcpus[i].u.rtds.budget = p->budget;
+    }
+
+    rc = xc_sched_rtds_vcpu_set(CTX->xch, domid, vcpus, scinfo->num_vcpus);
+    if (rc != 0) {
+        LOGE(ERROR, "setting vcpu sched rtds");
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+ out:
+    libxl_dominfo_dispose(&info);
+    return rc;
+}
+
 int libxl_domain_sched_params_set(libxl_ctx *ctx, uint32_t domid,
                                   const libxl_domain_sched_params *scinfo)
 {
@@ -5021,6 +5194,9 @@ int libxl_domain_sched_params_set(libxl_ctx *ctx, uint32_t domid,
     case LIBXL_SCHEDULER_ARINC653:
         ret=sched_arinc653_domain_set(gc, domid, scinfo);
         break;
+    case LIBXL_SCHEDULER_RTDS:
+        ret=sched_rtds_domain_set(gc, domid, scinfo);
+        break;
     default:
         LOG(ERROR, "Unknown scheduler");
         ret=ERROR_INVAL;
@@ -5051,6 +5227,9 @@ int libxl_domain_sched_params_get(libxl_ctx *ctx, uint32_t domid,
     case LIBXL_SCHEDULER_CREDIT2:
         ret=sched_credit2_domain_get(gc, domid, scinfo);
         break;
+    case LIBXL_SCHEDULER_RTDS:
+        ret=sched_rtds_domain_get(gc, domid, scinfo);
+        break;
     default:
         LOG(ERROR, "Unknown scheduler");
         ret=ERROR_INVAL;
@@ -5061,6 +5240,50 @@ int libxl_domain_sched_params_get(libxl_ctx *ctx, uint32_t domid,
     return ret;
 }
 
+int libxl_vcpu_sched_params_get(libxl_ctx *ctx, uint32_t domid,
+                                libxl_vcpu_sched_params *scinfo)
+{
+    GC_INIT(ctx);
+    int ret;
+
+    switch (libxl__domain_scheduler(gc, domid)) {
+    case LIBXL_SCHEDULER_RTDS:
+        ret=sched_rtds_vcpu_get(gc, domid, scinfo);
+        break;
+    default:
+        LOG(ERROR, "Per-vcpu parameters not supported by this scheduler");
+        ret=ERROR_INVAL;
+        break;
+    }
+
+    GC_FREE;
+    return ret;
+}
+
+int libxl_vcpu_sched_params_set(libxl_ctx *ctx, uint32_t domid,
+                                const libxl_vcpu_sched_params *scinfo)
+{
+    GC_INIT(ctx);
+    libxl_scheduler sched = scinfo->sched;
+    int ret;
+
+    if (sched == LIBXL_SCHEDULER_UNKNOWN)
+        sched = libxl__domain_scheduler(gc, domid);
+
+    switch (sched) {
+    case LIBXL_SCHEDULER_RTDS:
+        ret=sched_rtds_vcpu_set(gc, domid, scinfo);
+        break;
+    default:
+        LOG(ERROR, "Per-vcpu parameters not supported by this scheduler");
+        ret=ERROR_INVAL;
+        break;
+    }
+
+    GC_FREE;
+    return ret;
+}
+
 static int libxl__domain_s3_resume(libxl__gc *gc, int domid)
 {
     int rc = 0;
@@ -406,6 +406,14 @@
  */
 #define LIBXL_HAVE_DOMAIN_CREATE_RESTORE_PARAMS 1
 
+/*
+ * LIBXL_HAVE_SCHED_RTDS indicates that the RTDS real-time scheduler is
+ * supported: LIBXL_SCHEDULER_RTDS, with its period and budget (in
+ * microseconds) in libxl_domain_sched_params, and per vcpu in
+ * libxl_vcpu_sched_params, through libxl_vcpu_sched_params_{get,set}.
+ */
+#define LIBXL_HAVE_SCHED_RTDS 1
+
 /*
  * LIBXL_HAVE_CREATEINFO_PVH
  * If this is defined, then libxl supports creation of a PVH guest.
@@ -1107,12 +1115,26 @@ int libxl_sched_credit_params_set(libxl_ctx *ctx, uint32_t poolid,
 #define LIBXL_DOMAIN_SCHED_PARAM_SLICE_DEFAULT     -1
 #define LIBXL_DOMAIN_SCHED_PARAM_LATENCY_DEFAULT   -1
 #define LIBXL_DOMAIN_SCHED_PARAM_EXTRATIME_DEFAULT -1
+#define LIBXL_DOMAIN_SCHED_PARAM_BUDGET_DEFAULT    -1
 
 int libxl_domain_sched_params_get(libxl_ctx *ctx, uint32_t domid,
                                   libxl_domain_sched_params *params);
 int libxl_domain_sched_params_set(libxl_ctx *ctx, uint32_t domid,
                                   const libxl_domain_sched_params *params);
 
+/*
+ * Scheduler per-vcpu parameters.  On get, an empty vcpus array is filled
+ * in with every vcpu of the domain; otherwise, and on set, only the vcpus
+ * listed are retrieved or modified.
+ */
+
+#define LIBXL_SCHED_PARAM_VCPU_INDEX_DEFAULT       -1
+
+int libxl_vcpu_sched_params_get(libxl_ctx *ctx, uint32_t domid,
+                                libxl_vcpu_sched_params *params);
+int libxl_vcpu_sched_params_set(libxl_ctx *ctx, uint32_t domid,
+                                const libxl_vcpu_sched_params *params);
+
 int libxl_send_trigger(libxl_ctx *ctx, uint32_t domid,
                        libxl_trigger trigger, uint32_t vcpuid);
 int libxl_send_sysrq(libxl_ctx *ctx, uint32_t domid, char sysrq);
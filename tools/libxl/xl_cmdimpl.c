@@ -842,6 +842,8 @@ static void parse_config_data(const char *config_source,
         b_info->sched_params.latency = l;
     if (!xlu_cfg_get_long (config, "extratime", &l, 0))
         b_info->sched_params.extratime = l;
+    if (!xlu_cfg_get_long (config, "budget", &l, 0))
+        b_info->sched_params.budget = l;
 
     if (!xlu_cfg_get_long (config, "vcpus", &l, 0)) {
         b_info->max_vcpus = l;
@@ -5202,6 +5204,68 @@ static int sched_sedf_domain_output(
     return 0;
 }
 
+static int sched_rtds_domain_output(
+    int domid)
+{
+    char *domname;
+    libxl_domain_sched_params scinfo;
+    int rc;
+
+    if (domid < 0) {
+        printf("%-33s %4s %9s %9s\n", "Name", "ID", "Period", "Budget");
+        return 0;
+    }
+    rc = sched_domain_get(LIBXL_SCHEDULER_RTDS, domid, &scinfo);
+    if (rc)
+        return rc;
+    domname = libxl_domid_to_name(ctx, domid);
+    printf("%-33s %4d %9d %9d\n",
+        domname,
+        domid,
+        scinfo.period,
+        scinfo.budget);
+    free(domname);
+    libxl_domain_sched_params_dispose(&scinfo);
+    return 0;
+}
+
+/* vcpuid < 0 lists every vcpu of the domain */
+static int sched_rtds_vcpu_output(int domid, int vcpuid)
+{
+    char *domname;
+    libxl_vcpu_sched_params scinfo;
+    int i, rc;
+
+    libxl_vcpu_sched_params_init(&scinfo);
+    if (vcpuid >= 0) {
+        scinfo.num_vcpus = 1;
+        scinfo.vcpus = xmalloc(sizeof(*scinfo.vcpus));
+        libxl_sched_params_init(&scinfo.vcpus[0]);
+        scinfo.vcpus[0].vcpuid = vcpuid;
+    }
+    rc = libxl_vcpu_sched_params_get(ctx, domid, &scinfo);
+    if (rc) {
+        fprintf(stderr, "libxl_vcpu_sched_params_get failed.\n");
+        goto out;
+    }
+
+    domname = libxl_domid_to_name(ctx, domid);
+    printf("%-33s %4s %4s %9s %9s\n", "Name", "ID", "VCPU", "Period",
+           "Budget");
+    for (i = 0; i < scinfo.num_vcpus; i++)
+        printf("%-33s %4d %4d %9d %9d\n",
+               domname,
+               domid,
+               scinfo.vcpus[i].vcpuid,
+               scinfo.vcpus[i].period,
+               scinfo.vcpus[i].budget);
+    free(domname);
+
+ out:
+    libxl_vcpu_sched_params_dispose(&scinfo);
+    return rc;
+}
+
 static int sched_default_pool_output(uint32_t poolid)
 {
     char *poolname;
@@ -5568,6 +5632,126 @@ int main_sched_sedf(int argc, char **argv)
     return 0;
 }
 
+/*
+ * <nothing>                  : List all domain params from all rtds pools
+ * -d [domid]                 : List domain params for domain
+ * -d [domid] -v [vcpuid|all] : List vcpu params for domain
+ * -d [domid] [params]        : Set params for every vcpu of the domain
+ * -d [domid] -v [vcpuid] [params] : Set params for one vcpu of the domain
+ */
+int main_sched_rtds(int argc, char **argv)
+{
+    const char *dom = NULL;
+    const char *cpupool = NULL;
+    const char *vcpu = NULL;
+    int period = 0, opt_p = 0;
+    int budget = 0, opt_b = 0;
+    int vcpuid = -1;
+    int opt, rc;
+    static struct option opts[] = {
+        {"domain", 1, 0, 'd'},
+        {"period", 1, 0, 'p'},
+        {"budget", 1, 0, 'b'},
+        {"vcpuid", 1, 0, 'v'},
+        {"cpupool", 1, 0, 'c'},
+        COMMON_LONG_OPTS,
+        {0, 0, 0, 0}
+    };
+
+    SWITCH_FOREACH_OPT(opt, "d:p:b:v:c:h", opts, "sched-rtds", 0) {
+    case 'd':
+        dom = optarg;
+        break;
+    case 'p':
+        period = strtol(optarg, NULL, 10);
+        opt_p = 1;
+        break;
+    case 'b':
+        budget = strtol(optarg, NULL, 10);
+        opt_b = 1;
+        break;
+    case 'v':
+        vcpu = optarg;
+        break;
+    case 'c':
+        cpupool = optarg;
+        break;
+    }
+
+    if (cpupool && (dom || vcpu || opt_p || opt_b)) {
+        fprintf(stderr, "Specifying a cpupool is not allowed with other "
+                "options.\n");
+        return 1;
+    }
+    if (!dom && (vcpu || opt_p || opt_b)) {
+        fprintf(stderr, "Must specify a domain.\n");
+        return 1;
+    }
+    if (vcpu && strcmp(vcpu, "all")) {
+        char *endptr;
+
+        vcpuid = strtol(vcpu, &endptr, 10);
+        if (*endptr || vcpuid < 0) {
+            fprintf(stderr, "Invalid vcpu \'%s\'.\n", vcpu);
+            return 1;
+        }
+    }
+    if (vcpu && vcpuid < 0 && (opt_p || opt_b)) {
+        fprintf(stderr, "Setting \'all\' vcpus is done without -v.\n");
+        return 1;
+    }
+    if (vcpuid >= 0 && opt_p != opt_b) {
+        fprintf(stderr, "Both period and budget are needed for a vcpu.\n");
+        return 1;
+    }
+
+    if (!dom) { /* list all domain's rtds scheduler info */
+        return -sched_domain_output(LIBXL_SCHEDULER_RTDS,
+                                    sched_rtds_domain_output,
+                                    sched_default_pool_output,
+                                    cpupool);
+    } else {
+        uint32_t domid = find_domain(dom);
+
+        if (!opt_p && !opt_b) { /* output rtds scheduler info */
+            if (vcpu)
+                return -sched_rtds_vcpu_output(domid, vcpuid);
+            sched_rtds_domain_output(-1);
+            return -sched_rtds_domain_output(domid);
+        } else if (vcpuid >= 0) { /* set rtds parameters of one vcpu */
+            libxl_vcpu_sched_params scinfo;
+            libxl_vcpu_sched_params_init(&scinfo);
+            scinfo.sched = LIBXL_SCHEDULER_RTDS;
+            scinfo.num_vcpus = 1;
+            scinfo.vcpus = xmalloc(sizeof(*scinfo.vcpus));
+            libxl_sched_params_init(&scinfo.vcpus[0]);
+            scinfo.vcpus[0].vcpuid = vcpuid;
+            scinfo.vcpus[0].period = period;
+            scinfo.vcpus[0].budget = budget;
+            rc = libxl_vcpu_sched_params_set(ctx, domid, &scinfo);
+            if (rc)
+                fprintf(stderr, "libxl_vcpu_sched_params_set failed.\n");
+            libxl_vcpu_sched_params_dispose(&scinfo);
+            if (rc)
+                return -rc;
+        } else { /* set rtds parameters of the whole domain */
+            libxl_domain_sched_params scinfo;
+            libxl_domain_sched_params_init(&scinfo);
+            scinfo.sched = LIBXL_SCHEDULER_RTDS;
+            if (opt_p)
+                scinfo.period = period;
+            if (opt_b)
+                scinfo.budget = budget;
+            rc = sched_domain_set(domid, &scinfo);
+            libxl_domain_sched_params_dispose(&scinfo);
+            if (rc)
+                return -rc;
+        }
+    }
+
+    return 0;
+}
+
 int main_domid(int argc, char **argv)
 {
     uint32_t domid;
@@ -0,0 +1,458 @@
+/*
+ * xen-memshrd: share identical pages between (and within) HVM guests.
+ *
+ * Scans guest memory in batches, hashing each page, and looks the hashes
+ * up in a fixed-size direct-mapped table of pages seen earlier in the same
+ * pass.  A page whose hash matches another's is a candidate: both are
+ * nominated for sharing, which makes them read-only, then compared byte for
+ * byte, and shared, a batch at a time, if they are still identical.
+ * All-zero pages are found without hashing and all share one table slot.
+ *
+ * The daemon limits itself to a share of one CPU, sleeping between batches
+ * as needed, and sleeps between passes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <xenctrl.h>
+
+#define BATCH           1024    /* gfns mapped and hashed at a time */
+#define MAX_DOMS        1024
+
+/* Table keys: 0 is an empty slot, and 1 stands for the zero page. */
+#define EMPTY_HASH      0
+#define ZERO_HASH       1
+
+struct page_ref {
+    uint64_t        hash;
+    unsigned long   gfn;
+    domid_t         domid;
+};
+
+/* A page matching a page seen earlier, with that page's table entry. */
+struct candidate {
+    struct page_ref source;
+    unsigned long   gfn;
+};
+
+static xc_interface *xch;
+static struct page_ref *table;
+static unsigned long table_size = 1UL << 20;
+static unsigned int cpu_budget = 10;
+static unsigned int interval = 60;
+static int verbose;
+static volatile sig_atomic_t stop;
+
+static struct {
+    unsigned long scanned, zero, candidates, shared, mismatched, failed;
+} stats;
+
+static void handle_signal(int sig)
+{
+    stop = 1;
+}
+
+/*
+ * Eight independent 32-bit lanes, each mixing every eighth word of the
+ * page, so that the compiler can keep the lanes in one vector register.
+ */
+#define HASH_LANES 8
+
+static uint64_t hash_page(const void *page)
+{
+    const uint32_t *p = page;
+    uint32_t h[HASH_LANES];
+    uint64_t hash = 0;
+    unsigned int i, l;
+
+    for ( l = 0; l < HASH_LANES; l++ )
+        h[l] = 0x9e3779b9u * (l + 1);
+
+    for ( i = 0; i < XC_PAGE_SIZE / sizeof(*p); i += HASH_LANES )
+        for ( l = 0; l < HASH_LANES; l++ )
+        {
+            h[l] = (h[l] ^ p[i + l]) * 0x85ebca6bu;
+            h[l] ^= h[l] >> 13;
+        }
+
+    for ( l = 0; l < HASH_LANES; l++ )
+    {
+        hash = (hash ^ h[l]) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+    }
+
+    return (hash > ZERO_HASH) ? hash : hash + 2;
+}
+
+static double now(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Sleep as long as needed to keep our CPU use within cpu_budget percent. */
+static void throttle(void)
+{
+    static double last_cpu, last_wall;
+    double cpu = now(CLOCK_PROCESS_CPUTIME_ID), wall = now(CLOCK_MONOTONIC);
+    double owed = (cpu - last_cpu) * 100 / cpu_budget - (wall - last_wall);
+
+    if ( owed > 0 )
+    {
+        struct timespec ts = {
+            .tv_sec = owed, .tv_nsec = (owed - (time_t)owed) * 1e9
+        };
+
+        nanosleep(&ts, NULL);
+        wall = now(CLOCK_MONOTONIC);
+    }
+
+    last_cpu = cpu;
+    last_wall = wall;
+}
+
+static int pages_equal(const struct page_ref *a, domid_t domid,
+                       unsigned long gfn)
+{
+    void *pa, *pb;
+    int equal = 0;
+
+    pa = xc_map_foreign_range(xch, a->domid, XC_PAGE_SIZE, PROT_READ, a->gfn);
+    pb = xc_map_foreign_range(xch, domid, XC_PAGE_SIZE, PROT_READ, gfn);
+    if ( pa && pb )
+        equal = !memcmp(pa, pb, XC_PAGE_SIZE);
+    if ( pa )
+        munmap(pa, XC_PAGE_SIZE);
+    if ( pb )
+        munmap(pb, XC_PAGE_SIZE);
+
+    return equal;
+}
+
+/* The page in @source can no longer be shared: let @gfn take its place. */
+static void replace_source(const struct page_ref *source, domid_t domid,
+                           unsigned long gfn)
+{
+    struct page_ref *slot = &table[source->hash % table_size];
+
+    if ( (slot->hash == source->hash) && (slot->domid == source->domid) &&
+         (slot->gfn == source->gfn) )
+    {
+        slot->domid = domid;
+        slot->gfn = gfn;
+    }
+}
+
+/* Pairs of identical, nominated pages waiting to be shared. */
+static xen_mem_sharing_batch_entry_t share_entries[BATCH];
+static struct page_ref share_sources[BATCH];
+static unsigned int nr_share;
+
+/* Share the pending pairs, all of which have sources in the same domain. */
+static void flush_shares(void)
+{
+    unsigned int i;
+
+    if ( nr_share == 0 )
+        return;
+
+    if ( xc_memshr_share_batch(xch, share_sources[0].domid, share_entries,
+                               nr_share) )
+    {
+        stats.failed += nr_share;
+        nr_share = 0;
+        return;
+    }
+
+    for ( i = 0; i < nr_share; i++ )
+    {
+        const xen_mem_sharing_batch_entry_t *e = &share_entries[i];
+
+        if ( e->rc == 0 )
+        {
+            stats.shared++;
+            continue;
+        }
+
+        /* The source was written to since we nominated it. */
+        if ( e->rc == XENMEM_SHARING_OP_S_HANDLE_INVALID )
+            replace_source(&share_sources[i], e->client_domain,
+                           e->client_gfn);
+        stats.failed++;
+    }
+
+    nr_share = 0;
+}
+
+/*
+ * Pages are nominated only once the batch is unmapped: nomination fails
+ * on pages with references other than the guest's own.
+ */
+static void share_candidates(domid_t domid, struct candidate *cand,
+                             unsigned int nr)
+{
+    xen_mem_sharing_batch_entry_t *e;
+    uint64_t sh, ch[BATCH];
+    unsigned int i, run;
+
+    /*
+     * Nominate the candidates, which are in gfn order, a run of consecutive
+     * gfns at a time.  A handle of 0 means the gfn could not be nominated.
+     */
+    for ( i = 0; i < nr; i += run )
+    {
+        for ( run = 1; (i + run < nr) &&
+                       (cand[i + run].gfn == cand[i].gfn + run); run++ )
+            continue;
+        if ( xc_memshr_nominate_range(xch, domid, cand[i].gfn, run,
+                                      &ch[i]) )
+            memset(&ch[i], 0, run * sizeof(*ch));
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        const struct page_ref *s = &cand[i].source;
+
+        if ( ch[i] == 0 )
+        {
+            stats.failed++;
+            continue;
+        }
+        if ( xc_memshr_nominate_gfn(xch, s->domid, s->gfn, &sh) )
+        {
+            replace_source(s, domid, cand[i].gfn);
+            stats.failed++;
+            continue;
+        }
+
+        /* Both are read-only now: check that they really are the same. */
+        if ( !pages_equal(s, domid, cand[i].gfn) )
+        {
+            stats.mismatched++;
+            continue;
+        }
+
+        if ( (nr_share != 0) && (share_sources[0].domid != s->domid) )
+            flush_shares();
+
+        e = &share_entries[nr_share];
+        e->source_gfn = s->gfn;
+        e->source_handle = sh;
+        e->client_gfn = cand[i].gfn;
+        e->client_handle = ch[i];
+        e->client_domain = domid;
+        e->pad = 0;
+        share_sources[nr_share++] = *s;
+    }
+
+    flush_shares();
+}
+
+static void scan_batch(domid_t domid, unsigned long start, unsigned int nr)
+{
+    xen_pfn_t gfns[BATCH];
+    int err[BATCH];
+    struct candidate cand[BATCH];
+    struct page_ref *slot;
+    unsigned int i, nr_cand = 0;
+    const char *page;
+    uint64_t hash;
+    char *map;
+
+    /* Fill the whole array: the compiler cannot tell that nr <= BATCH. */
+    for ( i = 0; i < BATCH; i++ )
+        gfns[i] = start + i;
+
+    map = xc_map_foreign_bulk(xch, domid, PROT_READ, gfns, err, nr);
+    if ( map == NULL )
+        return;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( err[i] )
+            continue;
+
+        page = map + i * XC_PAGE_SIZE;
+        if ( xc_page_is_zero(page) )
+        {
+            hash = ZERO_HASH;
+            stats.zero++;
+        }
+        else
+            hash = hash_page(page);
+        stats.scanned++;
+
+        slot = &table[hash % table_size];
+        if ( slot->hash != hash )
+        {
+            slot->hash = hash;
+            slot->domid = domid;
+            slot->gfn = gfns[i];
+        }
+        else if ( (slot->domid != domid) || (slot->gfn != gfns[i]) )
+        {
+            cand[nr_cand].source = *slot;
+            cand[nr_cand].gfn = gfns[i];
+            nr_cand++;
+        }
+    }
+
+    munmap(map, nr * XC_PAGE_SIZE);
+
+    stats.candidates += nr_cand;
+    share_candidates(domid, cand, nr_cand);
+}
+
+static void scan_domain(domid_t domid)
+{
+    int max_gpfn = xc_domain_maximum_gpfn(xch, domid);
+    unsigned long gfn;
+
+    if ( max_gpfn < 0 )
+        return;
+
+    if ( xc_memshr_control(xch, domid, 1) )
+    {
+        if ( verbose )
+            fprintf(stderr, "dom%u: cannot enable sharing: %s\n",
+                    domid, strerror(errno));
+        return;
+    }
+
+    for ( gfn = 0; !stop && (gfn <= max_gpfn); gfn += BATCH )
+    {
+        scan_batch(domid, gfn, ((max_gpfn - gfn) >= BATCH)
+                               ? BATCH : (max_gpfn - gfn + 1));
+        throttle();
+    }
+}
+
+/* Fill @doms with the domains to scan: those given, or all HVM guests. */
+static unsigned int get_domains(int argc, char **argv, domid_t *doms)
+{
+    static xc_dominfo_t info[MAX_DOMS];
+    unsigned int i, nr = 0;
+    int n;
+
+    if ( strcmp(argv[0], "all") )
+    {
+        for ( i = 0; (i < argc) && (i < MAX_DOMS); i++ )
+            doms[nr++] = strtoul(argv[i], NULL, 0);
+        return nr;
+    }
+
+    n = xc_domain_getinfo(xch, 1, MAX_DOMS, info);
+    for ( i = 0; i < n; i++ )
+        if ( info[i].hvm && !info[i].dying && !info[i].shutdown )
+            doms[nr++] = info[i].domid;
+
+    return nr;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: xen-memshrd [options] <domid>... | all\n"
+            "  -c <percent>  CPU budget, as a percentage of one CPU "
+            "(default 10)\n"
+            "  -i <seconds>  interval between passes (default 60)\n"
+            "  -t <entries>  size of the page hash table (default 1M)\n"
+            "  -1            make one pass, then exit\n"
+            "  -v            report each pass\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    domid_t doms[MAX_DOMS];
+    unsigned int i, nr;
+    int opt, once = 0;
+
+    while ( (opt = getopt(argc, argv, "c:i:t:1v")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'c':
+            cpu_budget = strtoul(optarg, NULL, 0);
+            if ( (cpu_budget == 0) || (cpu_budget > 100) )
+                usage();
+            break;
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            table_size = strtoul(optarg, NULL, 0);
+            if ( table_size == 0 )
+                usage();
+            break;
+        case '1':
+            once = 1;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if ( optind == argc )
+        usage();
+
+    table = calloc(table_size, sizeof(*table));
+    xch = xc_interface_open(NULL, NULL, 0);
+    if ( (table == NULL) || (xch == NULL) )
+    {
+        perror("xen-memshrd");
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    while ( !stop )
+    {
+        /* Only pages seen in the same pass are compared. */
+        memset(table, 0, table_size * sizeof(*table));
+        memset(&stats, 0, sizeof(stats));
+
+        nr = get_domains(argc - optind, argv + optind, doms);
+        for ( i = 0; !stop && (i < nr); i++ )
+            scan_domain(doms[i]);
+
+        if ( verbose )
+            printf("scanned %lu pages (%lu zero): %lu candidates, "
+                   "%lu shared, %lu differed, %lu failed; "
+                   "%ld pages freed by sharing\n",
+                   stats.scanned, stats.zero, stats.candidates,
+                   stats.shared, stats.mismatched, stats.failed,
+                   xc_sharing_freed_pages(xch));
+
+        if ( once )
+            break;
+        for ( i = 0; !stop && (i < interval); i++ )
+            sleep(1);
+    }
+
+    xc_interface_close(xch);
+    free(table);
+
+    return 0;
+}
@@ -21,8 +21,12 @@ static int usage(const char* prog)
     printf("  enable                  - Enable sharing on a domain.\n");
     printf("  disable                 - Disable sharing on a domain.\n");
     printf("  nominate <domid> <gfn>  - Nominate a page for sharing.\n");
+    printf("  nominate-range <domid> <gfn> <nr>\n");
+    printf("                          - Nominate nr pages from gfn for sharing.\n");
     printf("  share <domid> <gfn> <handle> <source> <source-gfn> <source-handle>\n");
     printf("                          - Share two pages.\n");
+    printf("  share-range <domid> <gfn> <source> <source-gfn> <nr>\n");
+    printf("                          - Nominate and share nr pairs of pages.\n");
     printf("  unshare <domid> <gfn>   - Unshare a page by grabbing a writable map.\n");
     printf("  add-to-physmap <domid> <gfn> <source> <source-gfn> <source-handle>\n");
     printf("                          - Populate a page in a domain with a shared page.\n");
@@ -95,6 +99,28 @@ int main(int argc, const char** argv)
         R(xc_memshr_nominate_gfn(xch, domid, gfn, &handle));
         printf("handle = 0x%08llx\n", (unsigned long long) handle);
     }
+    else if( !strcasecmp(cmd, "nominate-range") )
+    {
+        domid_t domid;
+        unsigned long gfn;
+        unsigned int i, nr;
+        uint64_t *handles;
+
+        if( argc != 5 )
+            return usage(argv[0]);
+
+        domid = strtol(argv[2], NULL, 0);
+        gfn = strtol(argv[3], NULL, 0);
+        nr = strtol(argv[4], NULL, 0);
+        handles = calloc(nr, sizeof(*handles));
+        if( !handles )
+            return 1;
+        R(xc_memshr_nominate_range(xch, domid, gfn, nr, handles));
+        for( i = 0; i < nr; i++ )
+            printf("gfn 0x%lx: handle = 0x%08llx\n", gfn + i,
+                   (unsigned long long) handles[i]);
+        free(handles);
+    }
     else if( !strcasecmp(cmd, "share") )
     {
         domid_t domid;
@@ -115,6 +141,53 @@ int main(int argc, const char** argv)
         source_handle = strtol(argv[7], NULL, 0);
         R(xc_memshr_share_gfns(xch, source_domid, source_gfn, source_handle, domid, gfn, handle));
     }
+    else if( !strcasecmp(cmd, "share-range") )
+    {
+        domid_t domid;
+        unsigned long gfn;
+        domid_t source_domid;
+        unsigned long source_gfn;
+        unsigned int i, nr, shared = 0;
+        uint64_t *handles, *source_handles;
+        xen_mem_sharing_batch_entry_t *entries;
+
+        if( argc != 7 )
+            return usage(argv[0]);
+
+        domid = strtol(argv[2], NULL, 0);
+        gfn = strtol(argv[3], NULL, 0);
+        source_domid = strtol(argv[4], NULL, 0);
+        source_gfn = strtol(argv[5], NULL, 0);
+        nr = strtol(argv[6], NULL, 0);
+        handles = calloc(nr, sizeof(*handles));
+        source_handles = calloc(nr, sizeof(*source_handles));
+        entries = calloc(nr, sizeof(*entries));
+        if( !handles || !source_handles || !entries )
+            return 1;
+        R(xc_memshr_nominate_range(xch, source_domid, source_gfn, nr,
+                                   source_handles));
+        R(xc_memshr_nominate_range(xch, domid, gfn, nr, handles));
+        for( i = 0; i < nr; i++ )
+        {
+            entries[i].source_gfn = source_gfn + i;
+            entries[i].source_handle = source_handles[i];
+            entries[i].client_gfn = gfn + i;
+            entries[i].client_handle = handles[i];
+            entries[i].client_domain = domid;
+        }
+        R(xc_memshr_share_batch(xch, source_domid, entries, nr));
+        for( i = 0; i < nr; i++ )
+        {
+            if( entries[i].rc )
+                printf("gfn 0x%lx: %s\n", gfn + i, strerror(-entries[i].rc));
+            else
+                shared++;
+        }
+        printf("shared %u of %u pages\n", shared, nr);
+        free(entries);
+        free(source_handles);
+        free(handles);
+    }
     else if( !strcasecmp(cmd, "unshare") )
     {
         domid_t domid;
@@ -0,0 +1,83 @@
+/*
+ * Xen emulation for building rangeset.c and rbtree.c in userspace.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TEST_RANGESET_HARNESS_H__
+#define __TEST_RANGESET_HARNESS_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define ASSERT(p)       assert(p)
+#define BUG_ON(p)       assert(!(p))
+#define EXPORT_SYMBOL(sym)
+#define __must_check    __attribute__((warn_unused_result))
+
+#define min(x, y)       ((x) < (y) ? (x) : (y))
+#define max(x, y)       ((x) > (y) ? (x) : (y))
+
+#define printk          printf
+#define safe_strcpy(d, s) \
+    (strncpy(d, s, sizeof(d) - 1), (d)[sizeof(d) - 1] = '\0')
+
+#define xmalloc(type)   ((type *)malloc(sizeof(type)))
+#define xfree(p)        free(p)
+
+/* Single threaded: locks are no-ops. */
+typedef int spinlock_t;
+#define spin_lock_init(l)   (*(l) = 0)
+#define spin_lock(l)        ((void)(l))
+#define spin_unlock(l)      ((void)(l))
+
+struct list_head {
+    struct list_head *next, *prev;
+};
+
+#define INIT_LIST_HEAD(l)   ((l)->next = (l)->prev = (l))
+#define list_empty(l)       ((l)->next == (l))
+#define list_entry(p, type, member) container_of(p, type, member)
+#define list_for_each_entry(pos, head, member)                          \
+    for ( pos = list_entry((head)->next, typeof(*pos), member);         \
+          &pos->member != (head);                                       \
+          pos = list_entry(pos->member.next, typeof(*pos), member) )
+
+static inline void list_add(struct list_head *n, struct list_head *head)
+{
+    n->next = head->next;
+    n->prev = head;
+    head->next->prev = n;
+    head->next = n;
+}
+
+static inline void list_del(struct list_head *n)
+{
+    n->next->prev = n->prev;
+    n->prev->next = n->next;
+}
+
+struct domain {
+    unsigned int     domain_id;
+    struct list_head rangesets;
+    spinlock_t       rangesets_lock;
+};
+
+#include "rbtree.h"
+#include "rangeset.h"
+
+#endif /* __TEST_RANGESET_HARNESS_H__ */
@@ -0,0 +1,252 @@
+/*
+ * Userspace test harness for xen/common/rangeset.c.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The hypervisor's rangeset.c and rbtree.c are built against harness.h.
+ *
+ * Usage:
+ *
+ *   test_rangeset fuzz <iterations> <seed>
+ *     Apply random adds and removes, checking the set after each one
+ *     against a bitmap of the same universe.  Odd seeds also limit the
+ *     number of ranges.
+ *
+ *   test_rangeset bench <ranges> <lookups>
+ *     Time random lookups in a set of the given number of ranges, and the
+ *     same lookups by walking a sorted linked list of the ranges, as the
+ *     rangeset implementation used to.
+ *
+ * make -C tools/tests/rangeset run
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include "harness.h"
+
+#define UNIVERSE 1024
+
+static unsigned char model[UNIVERSE];
+
+/* Expected maximal runs of the model, consumed by check_cb(). */
+static unsigned long next_pos;
+static unsigned int failures;
+
+static void fail(const char *what, unsigned long s, unsigned long e)
+{
+    printf("FAIL: %s [%lu,%lu]\n", what, s, e);
+    if ( ++failures > 10 )
+        exit(1);
+}
+
+/* Return the next run [*s,*e] of set elements at or after pos. */
+static int model_next_run(unsigned long pos, unsigned long *s,
+                          unsigned long *e)
+{
+    while ( (pos < UNIVERSE) && !model[pos] )
+        pos++;
+    if ( pos == UNIVERSE )
+        return 0;
+    *s = pos;
+    while ( (pos < UNIVERSE) && model[pos] )
+        pos++;
+    *e = pos - 1;
+    return 1;
+}
+
+static int check_cb(unsigned long s, unsigned long e, void *ctxt)
+{
+    unsigned long ms, me;
+
+    if ( !model_next_run(next_pos, &ms, &me) || (ms != s) || (me != e) )
+        fail("reported range", s, e);
+    next_pos = e + 1;
+
+    return 0;
+}
+
+static void check(struct rangeset *r)
+{
+    unsigned long s, e, i;
+    int contains, overlaps;
+    unsigned int q;
+
+    next_pos = 0;
+    rangeset_report_ranges(r, 0, UNIVERSE - 1, check_cb, NULL);
+    if ( model_next_run(next_pos, &s, &e) )
+        fail("unreported range", s, e);
+
+    if ( rangeset_is_empty(r) != !model_next_run(0, &s, &e) )
+        fail("emptiness", 0, 0);
+
+    for ( q = 0; q < 16; q++ )
+    {
+        s = rand() % UNIVERSE;
+        e = s + rand() % min(UNIVERSE - s, 32UL);
+
+        contains = overlaps = model[s];
+        for ( i = s; i <= e; i++ )
+        {
+            contains &= model[i];
+            overlaps |= model[i];
+        }
+
+        if ( !!rangeset_contains_range(r, s, e) != contains )
+            fail("contains", s, e);
+        if ( !!rangeset_overlaps_range(r, s, e) != overlaps )
+            fail("overlaps", s, e);
+        if ( !!rangeset_contains_singleton(r, s) != model[s] )
+            fail("contains singleton", s, s);
+    }
+}
+
+static void fuzz(unsigned long iterations, unsigned int seed)
+{
+    struct rangeset *r = rangeset_new(NULL, "fuzz", 0);
+    struct rangeset *t = rangeset_new(NULL, "swap", 0);
+    unsigned long n, s, e, i;
+    int rc, add;
+
+    srand(seed);
+
+    /* With odd seeds, run with a limit to exercise -ENOMEM. */
+    if ( seed & 1 )
+        rangeset_limit(r, 16);
+
+    for ( n = 0; n < iterations; n++ )
+    {
+        s = rand() % UNIVERSE;
+        switch ( rand() % 4 )
+        {
+        case 0:
+            e = s;
+            break;
+        case 1:
+            e = s + rand() % min(UNIVERSE - s, 8UL);
+            break;
+        default:
+            e = s + rand() % (UNIVERSE - s);
+            break;
+        }
+        add = rand() & 1;
+
+        rc = add ? rangeset_add_range(r, s, e)
+                 : rangeset_remove_range(r, s, e);
+        if ( rc == 0 )
+            for ( i = s; i <= e; i++ )
+                model[i] = add;
+        else if ( rc != -ENOMEM )
+            fail(add ? "add rc" : "remove rc", s, e);
+
+        if ( !(n % 97) )
+        {
+            rangeset_swap(r, t);
+            if ( !rangeset_is_empty(r) )
+                fail("swap", 0, 0);
+            rangeset_swap(r, t);
+        }
+
+        check(r);
+    }
+
+    rangeset_destroy(t);
+    rangeset_destroy(r);
+
+    printf("fuzz: %lu iterations, seed %u: %s\n", iterations, seed,
+           failures ? "FAILED" : "passed");
+}
+
+/* A sorted singly linked list of ranges, walked from the start. */
+struct list_range {
+    struct list_range *next;
+    unsigned long s, e;
+};
+
+static int list_contains(struct list_range *l, unsigned long x)
+{
+    struct list_range *found = NULL;
+
+    for ( ; l != NULL && l->s <= x; l = l->next )
+        found = l;
+
+    return found && (found->e >= x);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(unsigned long nr, unsigned long lookups)
+{
+    struct rangeset *r = rangeset_new(NULL, "bench", 0);
+    struct list_range *head = NULL, **tail = &head, *l;
+    unsigned long i, *keys, hits[2] = { 0, 0 };
+    /* The list walk is linear: keep its run time in check. */
+    unsigned long list_lookups = (nr > 10000) ? lookups / 100 : lookups;
+    double t0, t1, t2;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( rangeset_add_range(r, i * 4, i * 4 + 1) )
+            fail("bench add", i * 4, i * 4 + 1);
+        l = malloc(sizeof(*l));
+        l->s = i * 4;
+        l->e = i * 4 + 1;
+        l->next = NULL;
+        *tail = l;
+        tail = &l->next;
+    }
+
+    keys = malloc(lookups * sizeof(*keys));
+    for ( i = 0; i < lookups; i++ )
+        keys[i] = ((unsigned long)rand() * RAND_MAX + rand()) % (nr * 4);
+
+    t0 = now_ns();
+    for ( i = 0; i < lookups; i++ )
+        hits[0] += rangeset_contains_singleton(r, keys[i]);
+    t1 = now_ns();
+    for ( i = 0; i < list_lookups; i++ )
+        hits[1] += list_contains(head, keys[i]);
+    t2 = now_ns();
+
+    printf("bench: %lu ranges: rbtree %.1f ns/lookup, list %.1f ns/lookup\n",
+           nr, (t1 - t0) / lookups, (t2 - t1) / list_lookups);
+
+    while ( head != NULL )
+    {
+        l = head->next;
+        free(head);
+        head = l;
+    }
+    free(keys);
+    rangeset_destroy(r);
+}
+
+int main(int argc, char **argv)
+{
+    if ( (argc == 4) && !strcmp(argv[1], "fuzz") )
+        fuzz(strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0));
+    else if ( (argc == 4) && !strcmp(argv[1], "bench") )
+        bench(strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0));
+    else
+    {
+        fprintf(stderr, "usage: %s fuzz <iterations> <seed>\n"
+                "       %s bench <ranges> <lookups>\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    return failures ? 1 : 0;
+}
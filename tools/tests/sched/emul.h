@@ -0,0 +1,581 @@
+/*
+ * Xen emulation for building the schedulers in xen/common/sched_*.c in
+ * userspace, on a simulated topology of CPUs driven by a simulated clock.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TEST_SCHED_EMUL_H__
+#define __TEST_SCHED_EMUL_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+
+#define __XEN_TOOLS__
+#include <xen/xen.h>
+#include <xen/domctl.h>
+#include <xen/sysctl.h>
+#include <xen/trace.h>
+#include <xen/vcpu.h>
+
+#define NR_CPUS     256
+#define MAX_NUMNODES 64
+
+typedef int64_t s_time_t;
+typedef char bool_t;
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define STIME_MAX ((s_time_t)((uint64_t)~0ull>>1))
+#define PRI_stime PRId64
+
+#define SECONDS(_s)     ((s_time_t)((_s)  * 1000000000ULL))
+#define MILLISECS(_ms)  ((s_time_t)((_ms) * 1000000ULL))
+#define MICROSECS(_us)  ((s_time_t)((_us) * 1000ULL))
+
+/* Simulated system time, and the CPU the simulation is running code on. */
+extern s_time_t emul_now;
+extern unsigned int emul_cpu;
+#define NOW()               (emul_now)
+#define smp_processor_id()  (emul_cpu)
+
+#define __init
+#define __initdata
+#define __read_mostly
+#define __cacheline_aligned
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define ASSERT(p)   assert(p)
+#define BUG()       abort()
+#define BUG_ON(p)   assert(!(p))
+#define WARN_ON(p)  ((void)(p))
+#define panic(fmt, args...) do { printf(fmt, ## args); abort(); } while ( 0 )
+#define printk      emul_printk
+#define cpu_relax() ((void)0)
+#define smp_mb()    ((void)0)
+#define smp_wmb()   ((void)0)
+#define smp_rmb()   ((void)0)
+#define barrier()   ((void)0)
+
+/* Scheduler chatter would swamp the report; main.c decides. */
+extern bool_t emul_verbose;
+#define emul_printk(fmt, args...) \
+    do { if ( emul_verbose ) printf(fmt, ## args); } while ( 0 )
+
+#define min(x, y) ({ typeof(x) x_ = (x); typeof(y) y_ = (y); x_ < y_ ? x_ : y_; })
+#define max(x, y) ({ typeof(x) x_ = (x); typeof(y) y_ = (y); x_ > y_ ? x_ : y_; })
+#define min_t(type, x, y) ({ type x_ = (x); type y_ = (y); x_ < y_ ? x_ : y_; })
+#define max_t(type, x, y) ({ type x_ = (x); type y_ = (y); x_ > y_ ? x_ : y_; })
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define ARRAY_SIZE(a)   (sizeof(a) / sizeof((a)[0]))
+
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define do_div(n, base) ({                          \
+    uint32_t rem_ = (uint64_t)(n) % (base);         \
+    (n) = (uint64_t)(n) / (base);                   \
+    rem_;                                           \
+})
+
+#define EXPORT_SYMBOL(s)
+
+/* Command line parameters: exported, for main.c to set. */
+#define boolean_param(_name, _var) bool_t *boolean_param_##_var = &(_var)
+#define integer_param(_name, _var) typeof(_var) *integer_param_##_var = &(_var)
+#define string_param(_name, _var)  char *string_param_##_var = (_var)
+#define custom_param(_name, _fn)
+
+#define xmalloc(type)               ((type *)calloc(1, sizeof(type)))
+#define xzalloc(type)               ((type *)calloc(1, sizeof(type)))
+#define xmalloc_array(type, n)      ((type *)calloc(n, sizeof(type)))
+#define xzalloc_array(type, n)      ((type *)calloc(n, sizeof(type)))
+#define xfree(p)                    free(p)
+
+/* Single threaded, so locks only need to keep count. */
+typedef struct { int held; } spinlock_t;
+#define DEFINE_SPINLOCK(l)              spinlock_t l = { 0 }
+#define spin_lock_init(l)               ((l)->held = 0)
+#define spin_is_locked(l)               ((l)->held)
+#define spin_lock(l)                    (++(l)->held)
+#define spin_unlock(l)                  (--(l)->held)
+#define spin_trylock(l)                 ((l)->held ? 0 : ++(l)->held)
+#define spin_lock_irq(l)                spin_lock(l)
+#define spin_unlock_irq(l)              spin_unlock(l)
+#define spin_lock_irqsave(l, f)         ((f) = 0, spin_lock(l))
+#define spin_unlock_irqrestore(l, f)    ((void)(f), spin_unlock(l))
+#define local_irq_save(f)               ((f) = 0)
+#define local_irq_restore(f)            ((void)(f))
+#define local_irq_disable()             ((void)0)
+#define local_irq_enable()              ((void)0)
+
+typedef struct { int counter; } atomic_t;
+#define ATOMIC_INIT(i)      { (i) }
+#define atomic_read(v)      ((v)->counter)
+#define atomic_set(v, i)    ((v)->counter = (i))
+#define atomic_inc(v)       ((v)->counter++)
+#define atomic_dec(v)       ((v)->counter--)
+#define atomic_add(i, v)    ((v)->counter += (i))
+#define atomic_sub(i, v)    ((v)->counter -= (i))
+
+#define DEFINE_PER_CPU(type, name)  __typeof__(type) per_cpu__##name[NR_CPUS]
+#define DECLARE_PER_CPU(type, name) extern __typeof__(type) per_cpu__##name[NR_CPUS]
+#define per_cpu(name, cpu)          (per_cpu__##name[cpu])
+#define this_cpu(name)              per_cpu(name, smp_processor_id())
+
+/* Bitops */
+
+#define BITS_PER_LONG       (sizeof(long) * 8)
+#define BITS_TO_LONGS(bits) (((bits) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define BIT_WORD(nr)        ((nr) / BITS_PER_LONG)
+#define BIT_MASK(nr)        (1UL << ((nr) % BITS_PER_LONG))
+
+#define __set_bit(nr, addr)     ((addr)[BIT_WORD(nr)] |= BIT_MASK(nr))
+#define __clear_bit(nr, addr)   ((addr)[BIT_WORD(nr)] &= ~BIT_MASK(nr))
+#define __test_bit(nr, addr)    (!!((addr)[BIT_WORD(nr)] & BIT_MASK(nr)))
+
+/*
+ * Like x86's, the atomic flavours work on 32-bit words, as some of their
+ * users (e.g. credit2's svc->flags) are only an unsigned int wide.
+ */
+#define set_bit(nr, addr)       ((void)(((uint32_t *)(addr))[(nr) / 32] |= 1U << ((nr) % 32)))
+#define clear_bit(nr, addr)     ((void)(((uint32_t *)(addr))[(nr) / 32] &= ~(1U << ((nr) % 32))))
+#define test_bit(nr, addr)      (!!(((const uint32_t *)(addr))[(nr) / 32] & (1U << ((nr) % 32))))
+
+static inline int test_and_set_bit(int nr, volatile void *addr)
+{
+    int old = test_bit(nr, addr);
+
+    set_bit(nr, addr);
+    return old;
+}
+
+static inline int test_and_clear_bit(int nr, volatile void *addr)
+{
+    int old = test_bit(nr, addr);
+
+    clear_bit(nr, addr);
+    return old;
+}
+
+static inline unsigned int find_next_bit(
+    const unsigned long *addr, unsigned int size, unsigned int off)
+{
+    unsigned long word;
+
+    while ( off < size )
+    {
+        word = addr[off / BITS_PER_LONG] >> (off % BITS_PER_LONG);
+        if ( word )
+            return min_t(unsigned int, size, off + __builtin_ctzl(word));
+        off = (off | (BITS_PER_LONG - 1)) + 1;
+    }
+    return size;
+}
+
+/* Cpumasks, over the nr_cpu_ids CPUs of the simulated topology. */
+
+extern unsigned int nr_cpu_ids;
+
+typedef struct cpumask {
+    unsigned long bits[BITS_TO_LONGS(NR_CPUS)];
+} cpumask_t;
+typedef cpumask_t cpumask_var_t[1];
+
+#define cpumask_bits(m)             ((m)->bits)
+
+static inline bool_t alloc_cpumask_var(cpumask_var_t *mask) { return 1; }
+static inline bool_t zalloc_cpumask_var(cpumask_var_t *mask)
+{
+    memset(*mask, 0, sizeof(cpumask_t));
+    return 1;
+}
+static inline void free_cpumask_var(cpumask_var_t mask) { }
+
+#define cpumask_set_cpu(c, m)       __set_bit(c, (m)->bits)
+#define cpumask_clear_cpu(c, m)     __clear_bit(c, (m)->bits)
+#define cpumask_test_cpu(c, m)      __test_bit(c, (m)->bits)
+#define cpumask_test_and_set_cpu(c, m)      test_and_set_bit(c, (m)->bits)
+#define cpumask_test_and_clear_cpu(c, m)    test_and_clear_bit(c, (m)->bits)
+
+#define CPUMASK_OP2(name, expr)                                         \
+static inline void cpumask_##name(cpumask_t *d, const cpumask_t *s1,    \
+                                  const cpumask_t *s2)                  \
+{                                                                       \
+    unsigned int i;                                                     \
+    for ( i = 0; i < BITS_TO_LONGS(NR_CPUS); i++ )                      \
+        d->bits[i] = (expr);                                            \
+}
+CPUMASK_OP2(and,    s1->bits[i] & s2->bits[i])
+CPUMASK_OP2(or,     s1->bits[i] | s2->bits[i])
+CPUMASK_OP2(xor,    s1->bits[i] ^ s2->bits[i])
+CPUMASK_OP2(andnot, s1->bits[i] & ~s2->bits[i])
+#undef CPUMASK_OP2
+
+static inline void cpumask_copy(cpumask_t *d, const cpumask_t *s)
+{
+    *d = *s;
+}
+
+static inline void cpumask_clear(cpumask_t *m)
+{
+    memset(m, 0, sizeof(*m));
+}
+
+static inline void cpumask_setall(cpumask_t *m)
+{
+    unsigned int i;
+
+    cpumask_clear(m);
+    for ( i = 0; i < nr_cpu_ids; i++ )
+        cpumask_set_cpu(i, m);
+}
+
+static inline unsigned int cpumask_next(int n, const cpumask_t *m)
+{
+    return find_next_bit(m->bits, nr_cpu_ids, n + 1);
+}
+
+#define cpumask_first(m)            cpumask_next(-1, m)
+#define cpumask_any(m)              cpumask_first(m)
+
+static inline unsigned int cpumask_last(const cpumask_t *m)
+{
+    int i;
+
+    for ( i = nr_cpu_ids - 1; i >= 0; i-- )
+        if ( cpumask_test_cpu(i, m) )
+            return i;
+    return nr_cpu_ids;
+}
+
+static inline unsigned int cpumask_cycle(int n, const cpumask_t *m)
+{
+    unsigned int nxt = cpumask_next(n, m);
+
+    if ( nxt == nr_cpu_ids )
+        nxt = cpumask_first(m);
+    return nxt;
+}
+
+static inline unsigned int cpumask_weight(const cpumask_t *m)
+{
+    unsigned int i, w = 0;
+
+    for ( i = 0; i < BITS_TO_LONGS(NR_CPUS); i++ )
+        w += __builtin_popcountl(m->bits[i]);
+    return w;
+}
+
+static inline bool_t cpumask_empty(const cpumask_t *m)
+{
+    return cpumask_first(m) >= nr_cpu_ids;
+}
+
+static inline bool_t cpumask_full(const cpumask_t *m)
+{
+    return cpumask_weight(m) == nr_cpu_ids;
+}
+
+static inline bool_t cpumask_equal(const cpumask_t *a, const cpumask_t *b)
+{
+    return !memcmp(a, b, sizeof(*a));
+}
+
+static inline bool_t cpumask_intersects(const cpumask_t *a,
+                                        const cpumask_t *b)
+{
+    unsigned int i;
+
+    for ( i = 0; i < BITS_TO_LONGS(NR_CPUS); i++ )
+        if ( a->bits[i] & b->bits[i] )
+            return 1;
+    return 0;
+}
+
+static inline bool_t cpumask_subset(const cpumask_t *a, const cpumask_t *b)
+{
+    unsigned int i;
+
+    for ( i = 0; i < BITS_TO_LONGS(NR_CPUS); i++ )
+        if ( a->bits[i] & ~b->bits[i] )
+            return 0;
+    return 1;
+}
+
+int cpumask_scnprintf(char *buf, int len, const cpumask_t *m);
+
+#define for_each_cpu(cpu, m)                    \
+    for ( (cpu) = cpumask_first(m);             \
+          (cpu) < nr_cpu_ids;                   \
+          (cpu) = cpumask_next(cpu, m) )
+
+extern cpumask_t cpu_online_map;
+extern cpumask_t emul_cpumask_of[NR_CPUS];
+#define cpumask_of(c)               (&emul_cpumask_of[c])
+#define cpu_online(c)               cpumask_test_cpu(c, &cpu_online_map)
+#define for_each_online_cpu(c)      for_each_cpu(c, &cpu_online_map)
+
+/* Topology: sockets double up as NUMA nodes. */
+DECLARE_PER_CPU(cpumask_var_t, cpu_sibling_mask);
+DECLARE_PER_CPU(cpumask_var_t, cpu_core_mask);
+extern int emul_cpu_to_socket[NR_CPUS];
+#define cpu_to_socket(c)            (emul_cpu_to_socket[c])
+#define cpu_to_core(c)              ((c) / cpumask_weight(per_cpu(cpu_sibling_mask, c)))
+#define cpu_to_node(c)              (emul_cpu_to_socket[c])
+
+typedef struct { unsigned long bits[BITS_TO_LONGS(MAX_NUMNODES)]; } nodemask_t;
+extern nodemask_t node_online_map;
+extern cpumask_t emul_node_to_cpumask[MAX_NUMNODES];
+#define node_to_cpumask(n)          (emul_node_to_cpumask[n])
+#define for_each_node_mask(n, mask)                                     \
+    for ( (n) = find_next_bit((mask).bits, MAX_NUMNODES, 0);            \
+          (n) < MAX_NUMNODES;                                           \
+          (n) = find_next_bit((mask).bits, MAX_NUMNODES, (n) + 1) )
+
+static inline int cycle_node(int n, nodemask_t mask)
+{
+    int nxt = find_next_bit(mask.bits, MAX_NUMNODES, n + 1);
+
+    if ( nxt == MAX_NUMNODES )
+        nxt = find_next_bit(mask.bits, MAX_NUMNODES, 0);
+    return nxt;
+}
+
+/* Lists */
+
+struct list_head {
+    struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(n)   { &(n), &(n) }
+#define LIST_HEAD(n)        struct list_head n = LIST_HEAD_INIT(n)
+#define INIT_LIST_HEAD(l)   ((l)->next = (l)->prev = (l))
+#define list_empty(l)       ((l)->next == (l))
+#define list_entry(p, type, member) container_of(p, type, member)
+#define list_for_each(pos, head) \
+    for ( pos = (head)->next; pos != (head); pos = pos->next )
+#define list_for_each_safe(pos, n, head) \
+    for ( pos = (head)->next, n = pos->next; pos != (head); \
+          pos = n, n = pos->next )
+#define list_for_each_entry(pos, head, member)                          \
+    for ( pos = list_entry((head)->next, typeof(*pos), member);         \
+          &pos->member != (head);                                       \
+          pos = list_entry(pos->member.next, typeof(*pos), member) )
+
+static inline void __list_add(struct list_head *n, struct list_head *prev,
+                              struct list_head *next)
+{
+    next->prev = n;
+    n->next = next;
+    n->prev = prev;
+    prev->next = n;
+}
+#define list_add(n, head)       __list_add(n, head, (head)->next)
+#define list_add_tail(n, head)  __list_add(n, (head)->prev, head)
+
+static inline void list_del(struct list_head *n)
+{
+    n->next->prev = n->prev;
+    n->prev->next = n->next;
+}
+
+static inline void list_del_init(struct list_head *n)
+{
+    list_del(n);
+    INIT_LIST_HEAD(n);
+}
+
+static inline void list_splice_init(struct list_head *l, struct list_head *head)
+{
+    if ( !list_empty(l) )
+    {
+        l->next->prev = head;
+        l->prev->next = head->next;
+        head->next->prev = l->prev;
+        head->next = l->next;
+        INIT_LIST_HEAD(l);
+    }
+}
+
+/* Softirqs: main.c runs the pending ones on each CPU. */
+
+#define TIMER_SOFTIRQ       0
+#define SCHEDULE_SOFTIRQ    1
+void cpu_raise_softirq(unsigned int cpu, unsigned int nr);
+void cpumask_raise_softirq(const cpumask_t *mask, unsigned int nr);
+#define raise_softirq(nr)   cpu_raise_softirq(smp_processor_id(), nr)
+
+/* Timers, fired by main.c in expiry order on their CPU. */
+
+struct timer {
+    s_time_t expires;
+    void (*function)(void *);
+    void *data;
+    unsigned int cpu;
+    bool_t active, killed;
+    struct list_head list;
+};
+
+void init_timer(struct timer *timer, void (*function)(void *), void *data,
+                unsigned int cpu);
+void set_timer(struct timer *timer, s_time_t expires);
+void stop_timer(struct timer *timer);
+void migrate_timer(struct timer *timer, unsigned int new_cpu);
+void kill_timer(struct timer *timer);
+#define timer_is_active(t)  ((t)->active)
+
+struct notifier_block {
+    int (*notifier_call)(struct notifier_block *, unsigned long, void *);
+    int priority;
+};
+#define NOTIFY_DONE     0
+#define CPU_UP_PREPARE  1
+#define CPU_STARTING    2
+#define CPU_UP_CANCELED 3
+#define CPU_DEAD        4
+#define notifier_from_errno(e)      (0x8000 | -(e))
+#define register_cpu_notifier(nb)   ((void)(nb))
+
+struct keyhandler {
+    bool_t diagnostic;
+    union {
+        void (*fn)(unsigned char key);
+    } u;
+    const char *desc;
+};
+#define register_keyhandler(k, h)   ((void)(h))
+extern char keyhandler_scratch[1024];
+
+/* Guest handles in the tools' flavour of the public headers. */
+#define copy_from_guest(dst, hnd, nr) \
+    (memcpy(dst, (hnd).p, sizeof(*(dst)) * (nr)), 0)
+#define copy_to_guest(hnd, src, nr) \
+    (memcpy((hnd).p, src, sizeof(*(src)) * (nr)), 0)
+#define copy_from_guest_offset(dst, hnd, off, nr) \
+    (memcpy(dst, (hnd).p + (off), sizeof(*(dst)) * (nr)), 0)
+#define __copy_to_guest_offset(hnd, off, src, nr) \
+    (memcpy((hnd).p + (off), src, sizeof(*(src)) * (nr)), 0)
+
+/* Tracing and performance counters: counted, so main.c can report them. */
+
+extern unsigned long emul_nr_trace_records;
+extern int tb_init_done;
+static inline void __trace_var(u32 event, bool_t cycles, unsigned int extra,
+                               const void *extra_data)
+{
+    emul_nr_trace_records++;
+}
+#define trace_var(e, c, x, d)       __trace_var(e, c, x, d)
+#define TRACE_0D(e)                 trace_var(e, 1, 0, NULL)
+#define TRACE_1D(e, d1)             trace_var(e, 1, 0, NULL)
+#define TRACE_2D(e, d1, d2)         trace_var(e, 1, 0, NULL)
+#define TRACE_3D(e, d1, d2, d3)     trace_var(e, 1, 0, NULL)
+#define TRACE_4D(e, d1, d2, d3, d4) trace_var(e, 1, 0, NULL)
+#define TRACE_5D(e, d1, d2, d3, d4, d5) trace_var(e, 1, 0, NULL)
+
+#define perfc_incr(x)               ((void)0)
+#define perfc_add(x, v)             ((void)(v))
+#define perfc_incra(x, y)           ((void)(y))
+#define SCHED_STAT_CRANK(x)         ((void)0)
+
+/* Domains and vcpus, with just what the schedulers look at. */
+
+#define MAX_VIRT_CPUS       8192
+
+extern bool_t sched_smt_power_savings;
+
+#define _VPF_blocked        0
+#define VPF_blocked         (1UL<<_VPF_blocked)
+#define _VPF_down           1
+#define VPF_down            (1UL<<_VPF_down)
+#define _VPF_migrating      3
+#define VPF_migrating       (1UL<<_VPF_migrating)
+
+struct sim_vcpu;
+
+struct vcpu {
+    int vcpu_id;
+    int processor;
+    struct domain *domain;
+    struct vcpu *next_in_list;
+    void *sched_priv;
+    cpumask_var_t cpu_affinity;
+    bool_t is_running;
+    bool_t is_urgent;
+    unsigned long pause_flags;
+    int pause_count;
+    s_time_t last_run_time;
+    struct {
+        int state;
+        s_time_t state_entry_time;
+    } runstate;
+
+    struct sim_vcpu *sim;
+};
+
+struct domain {
+    domid_t domain_id;
+    xen_domain_handle_t handle;
+    void *sched_priv;
+    struct vcpu **vcpu;
+    unsigned int max_vcpus;
+    struct cpupool *cpupool;
+    struct domain *next_in_list;
+    nodemask_t node_affinity;
+    bool_t auto_node_affinity;
+    bool_t is_pinned;
+};
+
+extern struct vcpu *idle_vcpu[NR_CPUS];
+extern struct domain *domain_list;
+
+#define is_idle_domain(d)   ((d)->domain_id == DOMID_IDLE)
+#define is_idle_vcpu(v)     is_idle_domain((v)->domain)
+#define vcpu_runnable(v)    (!(v)->pause_flags && !(v)->pause_count)
+
+#define for_each_vcpu(d, v)                                             \
+    for ( (v) = (d)->vcpu ? (d)->vcpu[0] : NULL;                        \
+          (v) != NULL;                                                  \
+          (v) = (v)->next_in_list )
+#define for_each_domain(d)                                              \
+    for ( (d) = domain_list; (d) != NULL; (d) = (d)->next_in_list )
+#define for_each_domain_in_cpupool(d, c)                                \
+    for_each_domain(d) if ( (d)->cpupool == (c) )
+
+#define rcu_read_lock(l)            ((void)(l))
+#define rcu_read_unlock(l)          ((void)(l))
+extern int domlist_read_lock;
+
+void vcpu_wake(struct vcpu *v);
+void vcpu_sleep_nosync(struct vcpu *v);
+void vcpu_pause_nosync(struct vcpu *v);
+void vcpu_unpause(struct vcpu *v);
+
+#include "rbtree.h"
+#include "sched-if.h"
+
+#define current     (per_cpu(schedule_data, smp_processor_id()).curr)
+
+#endif /* __TEST_SCHED_EMUL_H__ */
@@ -0,0 +1,1316 @@
+/*
+ * Replay vcpu workloads against the schedulers in xen/common/sched_*.c,
+ * built in userspace on a simulated topology, to compare their fairness,
+ * wakeup latency and overhead without booting a host.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage:
+ *
+ *   test_sched gen <domains> <vcpus> <seconds> <seed> > workload
+ *     Write a synthetic workload: domains take turns at being cpu hogs,
+ *     interactive (1ms of work every 10ms) and bursty (random work at
+ *     random times), odd ones with twice the weight of even ones.
+ *
+ *   test_sched import <cpu_khz> < xentrace-output > workload
+ *     Turn a trace captured with "xentrace -e 0x0002f000" into a
+ *     workload: each wakeup of a vcpu, with the cpu time it used before it
+ *     next blocked.  Timestamps are converted at <cpu_khz>.
+ *
+ *   test_sched run [-s <scheduler>] [-t <sockets>x<cores>x<threads>] [-T]
+ *                  [-v] workload
+ *     Replay a workload on the simulated topology (default 1x4x2) with
+ *     the given scheduler (credit, credit2, sedf, arinc653 or rtds;
+ *     default credit), and report per domain cpu time against weight, wakeup
+ *     latency percentiles and the time spent in the scheduler.  -T turns
+ *     on the tickless mode of credit and credit2.
+ *
+ * A workload is a text file, with one item per line:
+ *
+ *   dom <domid> <vcpus> <weight>
+ *   <time> wake <domid>.<vcpu> <work>
+ *   end <time>
+ *
+ * Domains are declared first.  A wake gives the vcpu <work> more
+ * nanoseconds of cpu time to consume, waking it up if it was blocked; a
+ * vcpu blocks again when it has none left.  Times must not decrease.
+ * Lines starting with '#' are ignored.
+ *
+ * make -C tools/tests/sched run
+ */
+
+#include <time.h>
+#include <getopt.h>
+#include <math.h>
+#include "emul.h"
+
+#define MS 1000000LL
+
+s_time_t emul_now;
+unsigned int emul_cpu;
+bool_t emul_verbose;
+unsigned int nr_cpu_ids;
+cpumask_t cpu_online_map;
+cpumask_t emul_cpumask_of[NR_CPUS];
+int emul_cpu_to_socket[NR_CPUS];
+nodemask_t node_online_map;
+cpumask_t emul_node_to_cpumask[MAX_NUMNODES];
+DEFINE_PER_CPU(cpumask_var_t, cpu_sibling_mask);
+DEFINE_PER_CPU(cpumask_var_t, cpu_core_mask);
+DEFINE_PER_CPU(struct schedule_data, schedule_data);
+DEFINE_PER_CPU(struct scheduler *, scheduler);
+DEFINE_PER_CPU(struct cpupool *, cpupool);
+struct vcpu *idle_vcpu[NR_CPUS];
+struct domain *domain_list;
+int domlist_read_lock;
+int tb_init_done;
+unsigned long emul_nr_trace_records;
+char keyhandler_scratch[1024];
+bool_t sched_smt_power_savings;
+int sched_ratelimit_us = SCHED_DEFAULT_RATELIMIT_US;
+struct cpupool *cpupool0;
+cpumask_t cpupool_free_cpus;
+
+static struct scheduler ops;
+
+/*
+ * Wall clock time spent in the scheduler, per kind of entry point.
+ */
+enum { HOOK_SCHEDULE, HOOK_WAKE, HOOK_SLEEP, HOOK_SAVED, HOOK_MIGRATE,
+       HOOK_TIMER, NR_HOOKS };
+static const char *hook_names[NR_HOOKS] = {
+    "do_schedule", "wake", "sleep", "context_saved", "pick/migrate", "timers"
+};
+static unsigned long hook_calls[NR_HOOKS];
+static uint64_t hook_ns[NR_HOOKS], hook_max_ns[NR_HOOKS];
+
+static uint64_t wallclock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void hook_done(int hook, uint64_t t0)
+{
+    uint64_t ns = wallclock() - t0;
+
+    hook_ns[hook] += ns;
+    if ( ns > hook_max_ns[hook] )
+        hook_max_ns[hook] = ns;
+    hook_calls[hook]++;
+}
+
+#define SCHED_OP(hook, fn, ...) ({                                      \
+    uint64_t t_ = wallclock();                                          \
+    typeof(ops.fn(&ops, ##__VA_ARGS__)) r_ = ops.fn(&ops, ##__VA_ARGS__); \
+    hook_done(hook, t_);                                                \
+    r_;                                                                 \
+})
+
+#define SCHED_OP_VOID(hook, fn, ...) do {                               \
+    if ( ops.fn != NULL )                                               \
+    {                                                                   \
+        uint64_t t_ = wallclock();                                      \
+        ops.fn(&ops, ##__VA_ARGS__);                                    \
+        hook_done(hook, t_);                                            \
+    }                                                                   \
+} while ( 0 )
+
+/*
+ * Simulated state of each vcpu.
+ */
+struct sim_vcpu {
+    s_time_t work;          /* cpu time still to consume before blocking */
+    s_time_t woken;         /* when it was last woken, -1 once it ran */
+    s_time_t cpu_time;      /* cpu time consumed */
+    s_time_t work_total;    /* cpu time asked for */
+    int last_cpu;
+    unsigned long nr_migrations;
+};
+
+struct sim_dom {
+    struct domain *d;
+    unsigned int weight;
+};
+
+static struct sim_dom *doms;
+static unsigned int nr_doms;
+
+static s_time_t *latencies;
+static unsigned long nr_latencies, max_latencies;
+static unsigned long nr_switches, nr_migrations, nr_wakes;
+static unsigned long nr_remote_migrations;
+static unsigned long nr_timer_irqs;
+
+/*
+ * Misc. emulation
+ */
+
+int cpumask_scnprintf(char *buf, int len, const cpumask_t *m)
+{
+    int i, n = 0;
+
+    buf[0] = '\0';
+    for ( i = BITS_TO_LONGS(nr_cpu_ids) - 1; i >= 0 && n < len; i-- )
+        n += snprintf(buf + n, len - n, "%lx", m->bits[i]);
+    return n;
+}
+
+/*
+ * Softirqs
+ */
+
+static unsigned long softirq_pending[NR_CPUS];
+
+void cpu_raise_softirq(unsigned int cpu, unsigned int nr)
+{
+    __set_bit(nr, &softirq_pending[cpu]);
+}
+
+void cpumask_raise_softirq(const cpumask_t *mask, unsigned int nr)
+{
+    unsigned int cpu;
+
+    for_each_cpu ( cpu, mask )
+        cpu_raise_softirq(cpu, nr);
+}
+
+/*
+ * Timers: few enough that a list, scanned for the earliest, will do.
+ */
+
+static LIST_HEAD(active_timers);
+
+void init_timer(struct timer *timer, void (*function)(void *), void *data,
+                unsigned int cpu)
+{
+    memset(timer, 0, sizeof(*timer));
+    timer->function = function;
+    timer->data = data;
+    timer->cpu = cpu;
+}
+
+void set_timer(struct timer *timer, s_time_t expires)
+{
+    if ( timer->killed )
+        return;
+    if ( !timer->active )
+        list_add_tail(&timer->list, &active_timers);
+    timer->expires = expires;
+    timer->active = 1;
+}
+
+void stop_timer(struct timer *timer)
+{
+    if ( !timer->active )
+        return;
+    list_del(&timer->list);
+    timer->active = 0;
+}
+
+void migrate_timer(struct timer *timer, unsigned int new_cpu)
+{
+    timer->cpu = new_cpu;
+}
+
+void kill_timer(struct timer *timer)
+{
+    stop_timer(timer);
+    timer->killed = 1;
+}
+
+static struct timer *first_timer(int cpu)
+{
+    struct timer *t, *first = NULL;
+
+    list_for_each_entry ( t, &active_timers, list )
+        if ( (cpu < 0 || t->cpu == cpu) &&
+             (first == NULL || t->expires < first->expires) )
+            first = t;
+
+    return first;
+}
+
+static void s_timer_fn(void *unused)
+{
+    raise_softirq(SCHEDULE_SOFTIRQ);
+}
+
+static void timer_softirq(unsigned int cpu)
+{
+    struct timer *t;
+
+    while ( (t = first_timer(cpu)) != NULL && t->expires <= emul_now )
+    {
+        nr_timer_irqs++;
+        stop_timer(t);
+        if ( t->function == s_timer_fn )
+            t->function(t->data);
+        else
+        {
+            uint64_t t0 = wallclock();
+
+            t->function(t->data);
+            hook_done(HOOK_TIMER, t0);
+        }
+    }
+}
+
+/*
+ * The generic scheduler, after xen/common/schedule.c.
+ */
+
+static void runstate_change(struct vcpu *v, int new_state)
+{
+    v->runstate.state = new_state;
+    v->runstate.state_entry_time = emul_now;
+}
+
+void vcpu_sleep_nosync(struct vcpu *v)
+{
+    unsigned long flags;
+    spinlock_t *lock = vcpu_schedule_lock_irqsave(v, &flags);
+
+    if ( likely(!vcpu_runnable(v)) )
+    {
+        if ( v->runstate.state == RUNSTATE_runnable )
+            runstate_change(v, RUNSTATE_offline);
+
+        SCHED_OP_VOID(HOOK_SLEEP, sleep, v);
+    }
+
+    vcpu_schedule_unlock_irqrestore(lock, flags, v);
+}
+
+void vcpu_wake(struct vcpu *v)
+{
+    unsigned long flags;
+    spinlock_t *lock = vcpu_schedule_lock_irqsave(v, &flags);
+
+    if ( likely(vcpu_runnable(v)) )
+    {
+        if ( v->runstate.state >= RUNSTATE_blocked )
+            runstate_change(v, RUNSTATE_runnable);
+        SCHED_OP_VOID(HOOK_WAKE, wake, v);
+    }
+
+    vcpu_schedule_unlock_irqrestore(lock, flags, v);
+}
+
+void vcpu_pause_nosync(struct vcpu *v)
+{
+    v->pause_count++;
+    vcpu_sleep_nosync(v);
+}
+
+void vcpu_unpause(struct vcpu *v)
+{
+    if ( --v->pause_count == 0 )
+        vcpu_wake(v);
+}
+
+static void vcpu_migrate(struct vcpu *v)
+{
+    unsigned int new_cpu;
+    uint64_t t0;
+
+    if ( v->is_running || !test_and_clear_bit(_VPF_migrating, &v->pause_flags) )
+        return;
+
+    t0 = wallclock();
+    new_cpu = ops.pick_cpu(&ops, v);
+    if ( ops.migrate )
+        ops.migrate(&ops, v, new_cpu);
+    else
+        v->processor = new_cpu;
+    hook_done(HOOK_MIGRATE, t0);
+
+    vcpu_wake(v);
+}
+
+static void context_saved(struct vcpu *prev)
+{
+    prev->is_running = 0;
+
+    SCHED_OP_VOID(HOOK_SAVED, context_saved, prev);
+
+    if ( unlikely(test_bit(_VPF_migrating, &prev->pause_flags)) )
+        vcpu_migrate(prev);
+}
+
+static void record_latency(s_time_t lat)
+{
+    if ( nr_latencies == max_latencies )
+    {
+        max_latencies = max_latencies ? max_latencies * 2 : 4096;
+        latencies = realloc(latencies, max_latencies * sizeof(*latencies));
+        if ( !latencies )
+            abort();
+    }
+    latencies[nr_latencies++] = lat;
+}
+
+static void schedule(unsigned int cpu)
+{
+    struct schedule_data *sd = &per_cpu(schedule_data, cpu);
+    struct vcpu *prev = sd->curr, *next;
+    struct task_slice next_slice;
+    spinlock_t *lock;
+
+    lock = pcpu_schedule_lock_irq(cpu);
+
+    stop_timer(&sd->s_timer);
+
+    next_slice = SCHED_OP(HOOK_SCHEDULE, do_schedule, emul_now, 0);
+    next = next_slice.task;
+
+    sd->curr = next;
+
+    if ( next_slice.time >= 0 )
+        set_timer(&sd->s_timer, emul_now + next_slice.time);
+
+    if ( prev == next )
+    {
+        pcpu_schedule_unlock_irq(lock, cpu);
+        return;
+    }
+
+    runstate_change(prev,
+                    test_bit(_VPF_blocked, &prev->pause_flags) ?
+                    RUNSTATE_blocked :
+                    (vcpu_runnable(prev) ? RUNSTATE_runnable :
+                     RUNSTATE_offline));
+    prev->last_run_time = emul_now;
+
+    ASSERT(next->runstate.state != RUNSTATE_running);
+    runstate_change(next, RUNSTATE_running);
+
+    ASSERT(!next->is_running);
+    next->is_running = 1;
+
+    pcpu_schedule_unlock_irq(lock, cpu);
+
+    nr_switches++;
+    if ( next->sim )
+    {
+        if ( next->sim->woken >= 0 )
+        {
+            record_latency(emul_now - next->sim->woken);
+            next->sim->woken = -1;
+        }
+        if ( next->sim->last_cpu != cpu )
+        {
+            if ( next->sim->last_cpu >= 0 )
+            {
+                next->sim->nr_migrations++;
+                nr_migrations++;
+                if ( cpu_to_node(next->sim->last_cpu) != cpu_to_node(cpu) )
+                    nr_remote_migrations++;
+            }
+            next->sim->last_cpu = cpu;
+        }
+    }
+
+    context_saved(prev);
+}
+
+static void do_softirqs(void)
+{
+    unsigned int cpu, loops = 0;
+    bool_t pending;
+
+    do {
+        pending = 0;
+        for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+        {
+            emul_cpu = cpu;
+            if ( test_and_clear_bit(TIMER_SOFTIRQ, &softirq_pending[cpu]) )
+                timer_softirq(cpu);
+            if ( test_and_clear_bit(SCHEDULE_SOFTIRQ, &softirq_pending[cpu]) )
+                schedule(cpu);
+            pending |= !!softirq_pending[cpu];
+        }
+        if ( ++loops > 1000000 )
+        {
+            fprintf(stderr, "Livelock in the scheduler at %"PRI_stime"\n",
+                    emul_now);
+            exit(1);
+        }
+    } while ( pending );
+}
+
+/*
+ * Boot, and domain creation.
+ */
+
+static void set_topology(unsigned int sockets, unsigned int cores,
+                         unsigned int threads)
+{
+    unsigned int cpu, i;
+
+    nr_cpu_ids = sockets * cores * threads;
+    if ( !nr_cpu_ids || nr_cpu_ids > NR_CPUS || sockets > MAX_NUMNODES )
+    {
+        fprintf(stderr, "Unsupported topology %ux%ux%u\n",
+                sockets, cores, threads);
+        exit(1);
+    }
+
+    for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+    {
+        unsigned int socket = cpu / (cores * threads);
+        unsigned int core = cpu / threads;
+
+        cpumask_set_cpu(cpu, &cpu_online_map);
+        cpumask_set_cpu(cpu, &emul_cpumask_of[cpu]);
+        emul_cpu_to_socket[cpu] = socket;
+        __set_bit(socket, node_online_map.bits);
+        cpumask_set_cpu(cpu, &emul_node_to_cpumask[socket]);
+
+        for ( i = 0; i < nr_cpu_ids; i++ )
+        {
+            if ( i / threads == core )
+                cpumask_set_cpu(i, per_cpu(cpu_sibling_mask, cpu));
+            if ( i / (cores * threads) == socket )
+                cpumask_set_cpu(i, per_cpu(cpu_core_mask, cpu));
+        }
+    }
+}
+
+static struct domain *domain_create(domid_t domid, unsigned int nr_vcpus)
+{
+    struct domain *d = calloc(1, sizeof(*d)), **pd;
+    unsigned int i;
+
+    if ( !d || !(d->vcpu = calloc(nr_vcpus, sizeof(*d->vcpu))) )
+        abort();
+
+    d->domain_id = domid;
+    d->handle[0] = domid >> 8;
+    d->handle[1] = domid;
+    d->max_vcpus = nr_vcpus;
+    d->auto_node_affinity = 1;
+    d->node_affinity = node_online_map;
+    if ( !is_idle_domain(d) )
+        d->cpupool = cpupool0;
+
+    if ( ops.init_domain && ops.init_domain(&ops, d) )
+        abort();
+
+    for ( i = 0; i < nr_vcpus; i++ )
+    {
+        struct vcpu *v = calloc(1, sizeof(*v));
+
+        if ( !v )
+            abort();
+
+        v->vcpu_id = i;
+        v->domain = d;
+        d->vcpu[i] = v;
+        if ( i )
+            d->vcpu[i - 1]->next_in_list = v;
+
+        if ( is_idle_domain(d) )
+        {
+            v->processor = i;
+            cpumask_copy(v->cpu_affinity, cpumask_of(i));
+            per_cpu(schedule_data, i).curr = v;
+            v->is_running = 1;
+            runstate_change(v, RUNSTATE_running);
+            idle_vcpu[i] = v;
+        }
+        else
+        {
+            v->processor = (domid + i) % nr_cpu_ids;
+            cpumask_setall(v->cpu_affinity);
+            v->pause_flags = VPF_blocked;
+            runstate_change(v, RUNSTATE_blocked);
+            if ( !(v->sim = calloc(1, sizeof(*v->sim))) )
+                abort();
+            v->sim->woken = -1;
+            v->sim->last_cpu = -1;
+        }
+
+        v->sched_priv = ops.alloc_vdata(&ops, v, d->sched_priv);
+        if ( !v->sched_priv )
+            abort();
+        if ( ops.insert_vcpu )
+            ops.insert_vcpu(&ops, v);
+    }
+
+    if ( !is_idle_domain(d) )
+    {
+        for ( pd = &domain_list; *pd; pd = &(*pd)->next_in_list )
+            continue;
+        *pd = d;
+    }
+
+    return d;
+}
+
+static void scheduler_init(const char *name)
+{
+    static const struct scheduler *schedulers[] = {
+        &sched_sedf_def,
+        &sched_credit_def,
+        &sched_credit2_def,
+        &sched_arinc653_def,
+        &sched_rtds_def,
+    };
+    unsigned int i, cpu;
+
+    for ( i = 0; i < ARRAY_SIZE(schedulers); i++ )
+        if ( !strcmp(schedulers[i]->opt_name, name) )
+            ops = *schedulers[i];
+    if ( !ops.name )
+    {
+        fprintf(stderr, "Unknown scheduler %s\n", name);
+        exit(1);
+    }
+
+    cpupool0 = calloc(1, sizeof(*cpupool0));
+    if ( !cpupool0 )
+        abort();
+    cpumask_copy(cpupool0->cpu_valid, &cpu_online_map);
+    cpupool0->sched = &ops;
+
+    for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+    {
+        struct schedule_data *sd = &per_cpu(schedule_data, cpu);
+
+        per_cpu(scheduler, cpu) = &ops;
+        per_cpu(cpupool, cpu) = cpupool0;
+        spin_lock_init(&sd->_lock);
+        sd->schedule_lock = &sd->_lock;
+        init_timer(&sd->s_timer, s_timer_fn, NULL, cpu);
+    }
+
+    if ( ops.global_init && ops.global_init() < 0 )
+        abort();
+    if ( ops.init && ops.init(&ops) )
+        abort();
+
+    domain_create(DOMID_IDLE, nr_cpu_ids);
+
+    for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+    {
+        emul_cpu = cpu;
+        if ( ops.alloc_pdata &&
+             !(per_cpu(schedule_data, cpu).sched_priv =
+               ops.alloc_pdata(&ops, cpu)) )
+            abort();
+    }
+}
+
+static void set_weight(struct domain *d, unsigned int weight)
+{
+    struct xen_domctl_scheduler_op op = {
+        .sched_id = ops.sched_id,
+        .cmd = XEN_DOMCTL_SCHEDOP_putinfo,
+    };
+
+    switch ( ops.sched_id )
+    {
+    case XEN_SCHEDULER_CREDIT:
+        op.u.credit.weight = weight;
+        break;
+    case XEN_SCHEDULER_CREDIT2:
+        op.u.credit2.weight = weight;
+        break;
+    case XEN_SCHEDULER_SEDF:
+        /* Best effort, sharing extra time in proportion to weight. */
+        op.u.sedf.weight = weight;
+        op.u.sedf.extratime = 1;
+        break;
+    case XEN_SCHEDULER_RTDS:
+        /* Budget in proportion to weight: 256 gets 25% of a pcpu. */
+        op.u.rtds.period = 10000;
+        op.u.rtds.budget = min(weight * 10000 / 1024, 10000U);
+        break;
+    default:
+        return;
+    }
+
+    if ( ops.adjust(&ops, d, &op) )
+        fprintf(stderr, "Can't set weight %u for d%d\n",
+                weight, d->domain_id);
+}
+
+/* ARINC 653 has no notion of weight: give every vcpu an equal slot. */
+static void set_arinc653_schedule(void)
+{
+    static xen_sysctl_arinc653_schedule_t sched;
+    struct xen_sysctl_scheduler_op op = {
+        .sched_id = XEN_SCHEDULER_ARINC653,
+        .cmd = XEN_SYSCTL_SCHEDOP_putinfo,
+    };
+    struct domain *d;
+    struct vcpu *v;
+    unsigned int n = 0;
+
+    for_each_domain ( d )
+        for_each_vcpu ( d, v )
+        {
+            if ( n == ARINC653_MAX_DOMAINS_PER_SCHEDULE )
+            {
+                fprintf(stderr, "arinc653: d%dv%d left out of the schedule\n",
+                        d->domain_id, v->vcpu_id);
+                continue;
+            }
+            memcpy(sched.sched_entries[n].dom_handle, d->handle,
+                   sizeof(d->handle));
+            sched.sched_entries[n].vcpu_id = v->vcpu_id;
+            sched.sched_entries[n].runtime = MILLISECS(5);
+            n++;
+        }
+
+    sched.num_sched_entries = n;
+    sched.major_frame = n * MILLISECS(5);
+    set_xen_guest_handle(op.u.sched_arinc653.schedule, &sched);
+
+    if ( n && ops.adjust_global(&ops, &op) )
+        fprintf(stderr, "arinc653: can't install the schedule\n");
+}
+
+/*
+ * Workloads
+ */
+
+struct event {
+    s_time_t time;
+    unsigned int domid, vcpu;
+    s_time_t work;
+};
+
+static struct event *events;
+static unsigned long nr_events, max_events;
+
+static void add_event(s_time_t time, unsigned int domid, unsigned int vcpu,
+                      s_time_t work)
+{
+    if ( nr_events == max_events )
+    {
+        max_events = max_events ? max_events * 2 : 4096;
+        events = realloc(events, max_events * sizeof(*events));
+        if ( !events )
+            abort();
+    }
+    events[nr_events].time = time;
+    events[nr_events].domid = domid;
+    events[nr_events].vcpu = vcpu;
+    events[nr_events].work = work;
+    nr_events++;
+}
+
+static int cmp_event(const void *a, const void *b)
+{
+    const struct event *x = a, *y = b;
+
+    return (x->time > y->time) - (x->time < y->time);
+}
+
+static struct domain *find_domain(unsigned int domid)
+{
+    unsigned int i;
+
+    for ( i = 0; i < nr_doms; i++ )
+        if ( doms[i].d->domain_id == domid )
+            return doms[i].d;
+    return NULL;
+}
+
+static s_time_t load_workload(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+    unsigned int lineno = 0;
+    s_time_t end = 0, prev = 0;
+
+    if ( !f )
+    {
+        perror(path);
+        exit(1);
+    }
+
+    while ( fgets(line, sizeof(line), f) )
+    {
+        unsigned int domid, vcpus, weight;
+        long long time, work;
+
+        lineno++;
+        if ( line[0] == '#' || line[0] == '\n' )
+            continue;
+
+        if ( sscanf(line, "dom %u %u %u", &domid, &vcpus, &weight) == 3 )
+        {
+            if ( nr_events || find_domain(domid) || !vcpus )
+                goto bad;
+            doms = realloc(doms, (nr_doms + 1) * sizeof(*doms));
+            if ( !doms )
+                abort();
+            doms[nr_doms].d = domain_create(domid, vcpus);
+            doms[nr_doms].weight = weight;
+            set_weight(doms[nr_doms].d, weight);
+            nr_doms++;
+        }
+        else if ( sscanf(line, "%lld wake %u.%u %lld",
+                         &time, &domid, &vcpus, &work) == 4 )
+        {
+            struct domain *d = find_domain(domid);
+
+            if ( !d || vcpus >= d->max_vcpus || time < prev || work < 0 )
+                goto bad;
+            add_event(time, domid, vcpus, work);
+            prev = time;
+        }
+        else if ( sscanf(line, "end %lld", &time) == 1 )
+            end = time;
+        else
+            goto bad;
+    }
+
+    fclose(f);
+
+    if ( !end )
+        end = prev;
+    return end;
+
+ bad:
+    fprintf(stderr, "%s:%u: bad line: %s", path, lineno, line);
+    exit(1);
+}
+
+/*
+ * The simulation proper: advance from event to event, where an event is a
+ * wakeup from the workload, a timer expiring or a running vcpu running out
+ * of work, and let the softirqs run on every cpu in between.
+ */
+static void simulate(s_time_t end)
+{
+    unsigned long next_event = 0;
+    unsigned int cpu;
+
+    emul_now = 0;
+
+    for ( ; ; )
+    {
+        s_time_t next = end, delta;
+        struct timer *t;
+
+        do_softirqs();
+
+        if ( next_event < nr_events && events[next_event].time < next )
+            next = events[next_event].time;
+        if ( (t = first_timer(-1)) != NULL && t->expires < next )
+            next = t->expires;
+        for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+        {
+            struct vcpu *v = curr_on_cpu(cpu);
+
+            if ( v->sim && emul_now + v->sim->work < next )
+                next = emul_now + v->sim->work;
+        }
+        if ( next < emul_now )
+            next = emul_now;
+
+        delta = next - emul_now;
+        for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+        {
+            struct vcpu *v = curr_on_cpu(cpu);
+
+            if ( v->sim && vcpu_runnable(v) )
+            {
+                v->sim->work -= delta;
+                v->sim->cpu_time += delta;
+            }
+        }
+        emul_now = next;
+
+        if ( emul_now >= end )
+            break;
+
+        /* Running out of work: vcpu_block(). */
+        for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+        {
+            struct vcpu *v = curr_on_cpu(cpu);
+
+            if ( v->sim && v->sim->work <= 0 && vcpu_runnable(v) )
+            {
+                emul_cpu = cpu;
+                v->sim->work = 0;
+                set_bit(_VPF_blocked, &v->pause_flags);
+                vcpu_sleep_nosync(v);
+                raise_softirq(SCHEDULE_SOFTIRQ);
+            }
+        }
+
+        /* Wakeups: vcpu_unblock(), as if on the vcpu's processor. */
+        while ( next_event < nr_events && events[next_event].time <= emul_now )
+        {
+            struct event *e = &events[next_event++];
+            struct vcpu *v = find_domain(e->domid)->vcpu[e->vcpu];
+
+            v->sim->work += e->work;
+            v->sim->work_total += e->work;
+            if ( test_and_clear_bit(_VPF_blocked, &v->pause_flags) )
+            {
+                emul_cpu = v->processor;
+                v->sim->woken = emul_now;
+                nr_wakes++;
+                vcpu_wake(v);
+            }
+        }
+
+        /* Timer interrupts. */
+        list_for_each_entry ( t, &active_timers, list )
+            if ( t->expires <= emul_now )
+                cpu_raise_softirq(t->cpu, TIMER_SOFTIRQ);
+    }
+}
+
+/*
+ * Reporting
+ */
+
+static int cmp_stime(const void *a, const void *b)
+{
+    const s_time_t *x = a, *y = b;
+
+    return (*x > *y) - (*x < *y);
+}
+
+static double percentile(double p)
+{
+    unsigned long i;
+
+    if ( !nr_latencies )
+        return 0;
+    i = p * (nr_latencies - 1) / 100;
+    return latencies[i] / 1000.0;
+}
+
+static void report(s_time_t end)
+{
+    double sum = 0, sum2 = 0;
+    unsigned int i, n = 0;
+    uint64_t total_ns = 0;
+    s_time_t busy = 0;
+
+    printf("Scheduler %s, %u cpus, %.3fs simulated\n",
+           ops.opt_name, nr_cpu_ids, end / 1e9);
+
+    printf("\n%6s %6s %6s %12s %12s %8s %10s\n",
+           "domain", "vcpus", "weight", "asked (ms)", "got (ms)", "got %",
+           "migrations");
+    for ( i = 0; i < nr_doms; i++ )
+    {
+        struct domain *d = doms[i].d;
+        struct vcpu *v;
+        s_time_t asked = 0, got = 0;
+        unsigned long migrations = 0;
+
+        for_each_vcpu ( d, v )
+        {
+            asked += v->sim->work_total;
+            got += v->sim->cpu_time;
+            migrations += v->sim->nr_migrations;
+        }
+        busy += got;
+
+        printf("%6d %6u %6u %12.1f %12.1f %8.1f %10lu\n",
+               d->domain_id, d->max_vcpus, doms[i].weight,
+               asked / 1e6, got / 1e6,
+               asked ? 100.0 * got / asked : 100.0, migrations);
+
+        /*
+         * Fairness, as Jain's index over the cpu time per unit of weight
+         * of the domains which wanted more than they got.
+         */
+        if ( got < asked && doms[i].weight )
+        {
+            double x = (double)got / doms[i].weight;
+
+            sum += x;
+            sum2 += x * x;
+            n++;
+        }
+    }
+
+    printf("\nUtilisation: %.1f%%\n", 100.0 * busy / end / nr_cpu_ids);
+    if ( n )
+        printf("Fairness (Jain's index over %u backlogged domains): %.3f\n",
+               n, sum * sum / (n * sum2));
+
+    qsort(latencies, nr_latencies, sizeof(*latencies), cmp_stime);
+    printf("\nWakeup latency (us), %lu wakeups:\n", nr_latencies);
+    printf("  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           percentile(50), percentile(90), percentile(99), percentile(99.9),
+           nr_latencies ? latencies[nr_latencies - 1] / 1000.0 : 0);
+
+    printf("\nContext switches: %lu, migrations: %lu (%lu across sockets)\n",
+           nr_switches, nr_migrations, nr_remote_migrations);
+    printf("Timer interrupts: %lu\n", nr_timer_irqs);
+
+    printf("\nScheduler overhead:\n");
+    for ( i = 0; i < NR_HOOKS; i++ )
+    {
+        total_ns += hook_ns[i];
+        if ( hook_calls[i] )
+            printf("  %-14s %10lu calls %8.0f ns/call %8.1f us max\n",
+                   hook_names[i], hook_calls[i],
+                   (double)hook_ns[i] / hook_calls[i],
+                   hook_max_ns[i] / 1000.0);
+    }
+    printf("  %.3fms per simulated second per cpu\n",
+           total_ns / 1e6 / (end / 1e9) / nr_cpu_ids);
+}
+
+/* The scheduler boot parameters, see emul.h */
+extern bool_t *boolean_param_sched_credit_tickless;
+extern bool_t *boolean_param_opt_tickless;
+
+static int run(int argc, char **argv)
+{
+    const char *sched = "credit";
+    unsigned int sockets = 1, cores = 4, threads = 2;
+    s_time_t end;
+    int c;
+
+    while ( (c = getopt(argc, argv, "s:t:Tv")) != -1 )
+    {
+        switch ( c )
+        {
+        case 's':
+            sched = optarg;
+            break;
+        case 't':
+            if ( sscanf(optarg, "%ux%ux%u", &sockets, &cores, &threads) != 3 )
+                return 1;
+            break;
+        case 'T':
+            *boolean_param_sched_credit_tickless = 1;
+            *boolean_param_opt_tickless = 1;
+            break;
+        case 'v':
+            emul_verbose = 1;
+            break;
+        default:
+            return 1;
+        }
+    }
+    if ( optind != argc - 1 )
+        return 1;
+
+    set_topology(sockets, cores, threads);
+    scheduler_init(sched);
+    end = load_workload(argv[optind]);
+    if ( ops.sched_id == XEN_SCHEDULER_ARINC653 )
+        set_arinc653_schedule();
+
+    simulate(end);
+    report(end);
+
+    return 0;
+}
+
+/*
+ * Synthetic workloads
+ */
+
+static uint64_t rnd_state;
+
+static uint64_t rnd(void)
+{
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state;
+}
+
+/* Exponentially distributed, with the given mean. */
+static s_time_t rnd_exp(s_time_t mean)
+{
+    double u = (rnd() % 1000000 + 1) / 1000001.0;
+
+    return -mean * log(u);
+}
+
+static int gen(int argc, char **argv)
+{
+    unsigned int nr_doms, nr_vcpus, seed, d, v;
+    s_time_t end, t;
+    unsigned long i;
+
+    if ( argc != 5 )
+        return 1;
+    nr_doms = atoi(argv[1]);
+    nr_vcpus = atoi(argv[2]);
+    end = atoi(argv[3]) * 1000 * MS;
+    seed = atoi(argv[4]);
+    rnd_state = seed * 0x9e3779b97f4a7c15ULL + 1;
+
+    printf("# test_sched gen %u %u %u %u\n", nr_doms, nr_vcpus,
+           atoi(argv[3]), seed);
+
+    for ( d = 1; d <= nr_doms; d++ )
+    {
+        printf("dom %u %u %u\n", d, nr_vcpus, d & 1 ? 512 : 256);
+
+        for ( v = 0; v < nr_vcpus; v++ )
+        {
+            switch ( d % 3 )
+            {
+            case 0: /* Cpu hog */
+                add_event(rnd() % MS, d, v, end);
+                break;
+            case 1: /* Interactive */
+                for ( t = rnd() % (10 * MS); t < end; t += 10 * MS )
+                    add_event(t, d, v, MS / 2 + rnd() % MS);
+                break;
+            case 2: /* Bursty */
+                for ( t = rnd_exp(30 * MS); t < end; t += rnd_exp(30 * MS) )
+                    add_event(t, d, v, rnd_exp(10 * MS));
+                break;
+            }
+        }
+    }
+
+    qsort(events, nr_events, sizeof(*events), cmp_event);
+    for ( i = 0; i < nr_events; i++ )
+        printf("%"PRI_stime" wake %u.%u %"PRI_stime"\n", events[i].time,
+               events[i].domid, events[i].vcpu, events[i].work);
+    printf("end %"PRI_stime"\n", end);
+
+    return 0;
+}
+
+/*
+ * Importing xentrace output
+ */
+
+struct trace_rec {
+    uint64_t tsc;
+    uint32_t event;
+    uint32_t d[4];
+};
+
+static int cmp_trace_rec(const void *a, const void *b)
+{
+    const struct trace_rec *x = a, *y = b;
+
+    return (x->tsc > y->tsc) - (x->tsc < y->tsc);
+}
+
+struct import_vcpu {
+    unsigned int domid, vcpu;
+    bool_t awake, blocking, running;
+    s_time_t woken, work, running_since;
+};
+
+static struct import_vcpu *import_vcpus;
+static unsigned int nr_import_vcpus;
+
+static struct import_vcpu *import_vcpu(unsigned int domid, unsigned int vcpu)
+{
+    unsigned int i;
+
+    for ( i = 0; i < nr_import_vcpus; i++ )
+        if ( import_vcpus[i].domid == domid && import_vcpus[i].vcpu == vcpu )
+            return &import_vcpus[i];
+
+    import_vcpus = realloc(import_vcpus,
+                           (nr_import_vcpus + 1) * sizeof(*import_vcpus));
+    if ( !import_vcpus )
+        abort();
+    memset(&import_vcpus[i], 0, sizeof(import_vcpus[i]));
+    import_vcpus[i].domid = domid;
+    import_vcpus[i].vcpu = vcpu;
+    nr_import_vcpus++;
+    return &import_vcpus[i];
+}
+
+static void import_flush(struct import_vcpu *iv, s_time_t now)
+{
+    if ( iv->running )
+        iv->work += now - iv->running_since;
+    iv->running_since = now;
+    if ( iv->awake && iv->work )
+        add_event(iv->woken, iv->domid, iv->vcpu, iv->work);
+    iv->work = 0;
+    iv->awake = 0;
+    iv->blocking = 0;
+}
+
+static int import(int argc, char **argv)
+{
+    struct trace_rec *recs = NULL;
+    unsigned long nr_recs = 0, max_recs = 0, i;
+    uint64_t khz;
+    uint32_t hdr, data[9];
+    s_time_t end = 0;
+
+    if ( argc != 2 || !(khz = strtoull(argv[1], NULL, 0)) )
+        return 1;
+
+    /*
+     * Records come in per-cpu batches (each headed by a TRC_TRACE_CPU_CHANGE
+     * record), so read them all, then sort them by timestamp.
+     */
+    while ( fread(&hdr, sizeof(hdr), 1, stdin) == 1 )
+    {
+        unsigned int event = hdr & 0x0fffffff;
+        unsigned int extra = (hdr >> 28) & 7;
+        unsigned int cycles = hdr >> 31;
+        unsigned int n = extra + (cycles ? 2 : 0);
+
+        if ( n && fread(data, sizeof(uint32_t), n, stdin) != n )
+            break;
+
+        if ( !cycles ||
+             (event != TRC_SCHED_WAKE && event != TRC_SCHED_BLOCK &&
+              event != TRC_SCHED_SWITCH) )
+            continue;
+
+        if ( nr_recs == max_recs )
+        {
+            max_recs = max_recs ? max_recs * 2 : 4096;
+            recs = realloc(recs, max_recs * sizeof(*recs));
+            if ( !recs )
+                abort();
+        }
+        memset(&recs[nr_recs], 0, sizeof(recs[nr_recs]));
+        recs[nr_recs].tsc = ((uint64_t)data[1] << 32) | data[0];
+        recs[nr_recs].event = event;
+        memcpy(recs[nr_recs].d, &data[2], min(extra, 4U) * sizeof(uint32_t));
+        nr_recs++;
+    }
+
+    if ( !nr_recs )
+    {
+        fprintf(stderr, "No scheduler records with timestamps found\n");
+        return 1;
+    }
+
+    qsort(recs, nr_recs, sizeof(*recs), cmp_trace_rec);
+
+    for ( i = 0; i < nr_recs; i++ )
+    {
+        struct trace_rec *r = &recs[i];
+        s_time_t now = (r->tsc - recs[0].tsc) * 1000000 / khz;
+        struct import_vcpu *iv;
+
+        end = now;
+
+        switch ( r->event )
+        {
+        case TRC_SCHED_WAKE:
+            if ( r->d[0] == DOMID_IDLE )
+                break;
+            iv = import_vcpu(r->d[0], r->d[1]);
+            if ( !iv->awake )
+            {
+                iv->awake = 1;
+                iv->woken = now;
+            }
+            iv->blocking = 0;
+            break;
+
+        case TRC_SCHED_BLOCK:
+            if ( r->d[0] == DOMID_IDLE )
+                break;
+            import_vcpu(r->d[0], r->d[1])->blocking = 1;
+            break;
+
+        case TRC_SCHED_SWITCH:
+            if ( r->d[0] != DOMID_IDLE )
+            {
+                iv = import_vcpu(r->d[0], r->d[1]);
+                if ( iv->blocking )
+                {
+                    import_flush(iv, now);
+                    iv->running = 0;
+                }
+                else if ( iv->running )
+                {
+                    iv->work += now - iv->running_since;
+                    iv->running = 0;
+                }
+            }
+            if ( r->d[2] != DOMID_IDLE )
+            {
+                iv = import_vcpu(r->d[2], r->d[3]);
+                /* Running without us seeing it wake: awake all along. */
+                if ( !iv->awake )
+                {
+                    iv->awake = 1;
+                    iv->woken = now;
+                }
+                iv->running = 1;
+                iv->running_since = now;
+            }
+            break;
+        }
+    }
+
+    for ( i = 0; i < nr_import_vcpus; i++ )
+        import_flush(&import_vcpus[i], end);
+
+    printf("# test_sched import %s\n", argv[1]);
+    for ( i = 0; i < nr_import_vcpus; i++ )
+    {
+        unsigned int j, nr_vcpus = 0;
+
+        for ( j = 0; j < nr_import_vcpus; j++ )
+        {
+            if ( import_vcpus[j].domid != import_vcpus[i].domid )
+                continue;
+            if ( j < i )
+                break;
+            nr_vcpus = max(nr_vcpus, import_vcpus[j].vcpu + 1);
+        }
+        if ( nr_vcpus )
+            printf("dom %u %u 256\n", import_vcpus[i].domid, nr_vcpus);
+    }
+
+    qsort(events, nr_events, sizeof(*events), cmp_event);
+    for ( i = 0; i < nr_events; i++ )
+        printf("%"PRI_stime" wake %u.%u %"PRI_stime"\n", events[i].time,
+               events[i].domid, events[i].vcpu, events[i].work);
+    printf("end %"PRI_stime"\n", end);
+
+    free(recs);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rc = 1;
+
+    if ( argc > 1 && !strcmp(argv[1], "gen") )
+        rc = gen(argc - 1, argv + 1);
+    else if ( argc > 1 && !strcmp(argv[1], "import") )
+        rc = import(argc - 1, argv + 1);
+    else if ( argc > 1 && !strcmp(argv[1], "run") )
+        rc = run(argc - 1, argv + 1);
+
+    if ( rc )
+        fprintf(stderr,
+                "Usage: %s gen <domains> <vcpus> <seconds> <seed>\n"
+                "       %s import <cpu_khz> < xentrace-output\n"
+                "       %s run [-s <scheduler>] "
+                "[-t <sockets>x<cores>x<threads>] [-T] [-v] <workload>\n",
+                argv[0], argv[0], argv[0]);
+
+    return rc;
+}
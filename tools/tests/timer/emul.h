@@ -0,0 +1,188 @@
+/*
+ * Xen emulation for building xen/common/timer.c in userspace, on a single
+ * simulated CPU with a simulated clock.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TEST_TIMER_EMUL_H__
+#define __TEST_TIMER_EMUL_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#define NR_CPUS 1
+
+typedef int64_t s_time_t;
+typedef char bool_t;
+typedef uint16_t u16;
+
+#define STIME_MAX ((s_time_t)((uint64_t)~0ull>>1))
+
+/* Simulated system time, advanced by the trace replay. */
+extern s_time_t emul_now;
+#define NOW() (emul_now)
+
+#define __init
+#define __read_mostly
+#define __cacheline_aligned
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define ASSERT(p)   assert(p)
+#define BUG()       abort()
+#define BUG_ON(p)   assert(!(p))
+#define printk      printf
+#define cpu_relax() ((void)0)
+
+#define min(x, y) ({ typeof(x) x_ = (x); typeof(y) y_ = (y); x_ < y_ ? x_ : y_; })
+#define max(x, y) ({ typeof(x) x_ = (x); typeof(y) y_ = (y); x_ > y_ ? x_ : y_; })
+#define min_t(type, x, y) ({ type x_ = (x); type y_ = (y); x_ < y_ ? x_ : y_; })
+
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Command line parameters are exported, for main.c to set. */
+#define boolean_param(_name, _var) bool_t *boolean_param_##_var = &(_var)
+#define integer_param(_name, _var) unsigned int *integer_param_##_var = &(_var)
+
+#define xmalloc(type)           ((type *)malloc(sizeof(type)))
+#define xmalloc_array(type, n)  ((type *)malloc(sizeof(type) * (n)))
+#define xfree(p)                free(p)
+
+/* Single threaded, and nothing to mask. */
+typedef int spinlock_t;
+#define spin_lock_init(l)                   (*(l) = 0)
+#define spin_lock(l)                        ((void)(l))
+#define spin_unlock(l)                      ((void)(l))
+#define spin_lock_irq(l)                    ((void)(l))
+#define spin_unlock_irq(l)                  ((void)(l))
+#define spin_lock_irqsave(l, f)             ((void)(l), (f) = 0)
+#define spin_unlock_irqrestore(l, f)        ((void)(l), (void)(f))
+#define local_irq_save(f)                   ((f) = 0)
+#define local_irq_restore(f)                ((void)(f))
+#define DEFINE_RCU_READ_LOCK(x)             int x
+#define rcu_read_lock(x)                    ((void)(x))
+#define rcu_read_unlock(x)                  ((void)(x))
+#define read_atomic(p)                      (*(p))
+#define write_atomic(p, v)                  (*(p) = (v))
+
+#define DEFINE_PER_CPU(type, name)  __typeof__(type) per_cpu__##name[NR_CPUS]
+#define DECLARE_PER_CPU(type, name) extern __typeof__(type) per_cpu__##name[NR_CPUS]
+#define per_cpu(name, cpu)          (per_cpu__##name[cpu])
+#define this_cpu(name)              (per_cpu__##name[0])
+#define smp_processor_id()          0
+
+extern int cpu_online_map;
+#define cpumask_any(m)              0
+#define cpu_online(c)               ((c) == 0)
+#define for_each_online_cpu(c)      for ( (c) = 0; (c) < NR_CPUS; (c)++ )
+
+#define TIMER_SOFTIRQ 0
+void open_softirq(int nr, void (*fn)(void));
+void raise_softirq(unsigned int nr);
+#define cpu_raise_softirq(cpu, nr)  raise_softirq(nr)
+
+struct notifier_block {
+    int (*notifier_call)(struct notifier_block *, unsigned long, void *);
+    int priority;
+};
+#define NOTIFY_DONE     0
+#define CPU_UP_PREPARE  1
+#define CPU_UP_CANCELED 2
+#define CPU_DEAD        3
+#define notifier_from_errno(e)      (0x8000 | -(e))
+#define register_cpu_notifier(nb)   ((void)(nb))
+
+struct keyhandler {
+    bool_t diagnostic;
+    union {
+        void (*fn)(unsigned char key);
+    } u;
+    const char *desc;
+};
+#define register_keyhandler(k, h)   ((void)(h))
+
+#define BITS_PER_LONG       (sizeof(long) * 8)
+#define BITS_TO_LONGS(bits) (((bits) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+static inline unsigned int find_next_bit(
+    const unsigned long *addr, unsigned int size, unsigned int off)
+{
+    unsigned long word;
+
+    while ( off < size )
+    {
+        word = addr[off / BITS_PER_LONG] >> (off % BITS_PER_LONG);
+        if ( word )
+            return min_t(unsigned int, size, off + __builtin_ctzl(word));
+        off = (off | (BITS_PER_LONG - 1)) + 1;
+    }
+    return size;
+}
+#define find_first_bit(addr, size)  find_next_bit(addr, size, 0)
+#define __set_bit(nr, addr) \
+    ((addr)[(nr) / BITS_PER_LONG] |= 1UL << ((nr) % BITS_PER_LONG))
+#define __clear_bit(nr, addr) \
+    ((addr)[(nr) / BITS_PER_LONG] &= ~(1UL << ((nr) % BITS_PER_LONG)))
+#define bitmap_zero(addr, nbits) \
+    memset(addr, 0, BITS_TO_LONGS(nbits) * sizeof(long))
+
+struct list_head {
+    struct list_head *next, *prev;
+};
+
+#define LIST_HEAD(n)        struct list_head n = { &(n), &(n) }
+#define INIT_LIST_HEAD(l)   ((l)->next = (l)->prev = (l))
+#define list_empty(l)       ((l)->next == (l))
+#define list_entry(p, type, member) container_of(p, type, member)
+#define list_for_each_entry(pos, head, member)                          \
+    for ( pos = list_entry((head)->next, typeof(*pos), member);         \
+          &pos->member != (head);                                       \
+          pos = list_entry(pos->member.next, typeof(*pos), member) )
+
+static inline void __list_add(struct list_head *n, struct list_head *prev,
+                              struct list_head *next)
+{
+    next->prev = n;
+    n->next = next;
+    n->prev = prev;
+    prev->next = n;
+}
+#define list_add(n, head)       __list_add(n, head, (head)->next)
+#define list_add_tail(n, head)  __list_add(n, (head)->prev, head)
+
+static inline void list_del(struct list_head *n)
+{
+    n->next->prev = n->prev;
+    n->prev->next = n->next;
+}
+
+static inline void list_splice_init(struct list_head *list,
+                                    struct list_head *head)
+{
+    if ( !list_empty(list) )
+    {
+        list->next->prev = head;
+        list->prev->next = head->next;
+        head->next->prev = list->prev;
+        head->next = list->next;
+        INIT_LIST_HEAD(list);
+    }
+}
+
+#endif /* __TEST_TIMER_EMUL_H__ */
@@ -0,0 +1,291 @@
+/*
+ * Replay timer operation traces against xen/common/timer.c, built in
+ * userspace with either of its timer heap and timer wheel, to compare the
+ * cost of the operations and the accuracy of expiry.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage:
+ *
+ *   test_timer gen <vcpus> <seconds> <seed> > trace
+ *     Write a synthetic trace: per vcpu, a 10ms periodic timer, a 1ms
+ *     emulated platform timer stopped and restarted as the vcpu blocks and
+ *     wakes, and a scheduler timer re-armed for a random slice, usually
+ *     before it fires; plus a few long-period timers.
+ *
+ *   test_timer replay <heap|wheel> trace
+ *     Replay a trace on one simulated CPU, the timer interrupt arriving at
+ *     the deadline programmed by the timer softirq.
+ *
+ * Each line of a trace is one operation, at a time in nanoseconds:
+ *
+ *   <time> set <timer> <expires>
+ *   <time> stop <timer>
+ *
+ * Times must not decrease, and timers are numbered from 0.  Lines starting
+ * with '#' are ignored.
+ *
+ * make -C tools/tests/timer run
+ */
+
+#include <time.h>
+#include "emul.h"
+#include "timer.h"
+
+#define MS 1000000LL
+
+s_time_t emul_now;
+int cpu_online_map;
+
+extern bool_t *boolean_param_opt_timer_wheel;
+
+static void (*timer_softirq)(void);
+static bool_t softirq_pending;
+static s_time_t hw_deadline;
+
+void open_softirq(int nr, void (*fn)(void))
+{
+    timer_softirq = fn;
+}
+
+void raise_softirq(unsigned int nr)
+{
+    softirq_pending = 1;
+}
+
+int reprogram_timer(s_time_t timeout)
+{
+    hw_deadline = timeout;
+    return !timeout || (timeout > emul_now);
+}
+
+/* Per timer: number of times it fired, and by how much after expiry. */
+static struct timer *timers;
+static unsigned long nr_timers, nr_fired, nr_early;
+static s_time_t total_late, max_late;
+
+static void fire(void *data)
+{
+    struct timer *t = data;
+    s_time_t late = emul_now - t->expires;
+
+    nr_fired++;
+    if ( late < 0 )
+        nr_early++;
+    total_late += late;
+    if ( late > max_late )
+        max_late = late;
+}
+
+static double host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Host time spent in timer operations, and in the timer softirq. */
+static double op_ns, softirq_ns;
+static unsigned long nr_ops, nr_softirqs;
+
+/* Take timer interrupts and run softirqs up to simulated time @until. */
+static void run_until(s_time_t until)
+{
+    double t0;
+
+    while ( softirq_pending || (hw_deadline && (hw_deadline <= until)) )
+    {
+        if ( !softirq_pending )
+            emul_now = hw_deadline;
+        softirq_pending = 0;
+        t0 = host_ns();
+        timer_softirq();
+        softirq_ns += host_ns() - t0;
+        nr_softirqs++;
+    }
+
+    emul_now = until;
+}
+
+static int replay(const char *mode, const char *file)
+{
+    FILE *f = fopen(file, "r");
+    char line[128], op[8];
+    long long when, expires;
+    unsigned long id, lineno = 0;
+    double t0;
+
+    if ( f == NULL )
+    {
+        perror(file);
+        return 1;
+    }
+
+    *boolean_param_opt_timer_wheel = !strcmp(mode, "wheel");
+    timer_init();
+
+    /* Size the timer array first: timers cannot move once initialised. */
+    while ( fgets(line, sizeof(line), f) != NULL )
+        if ( (line[0] != '#') &&
+             (sscanf(line, "%lld %7s %lu", &when, op, &id) == 3) &&
+             (id >= nr_timers) )
+            nr_timers = id + 1;
+    timers = calloc(nr_timers ?: 1, sizeof(*timers));
+    for ( id = 0; id < nr_timers; id++ )
+        init_timer(&timers[id], fire, &timers[id], 0);
+    rewind(f);
+
+    while ( fgets(line, sizeof(line), f) != NULL )
+    {
+        lineno++;
+        if ( line[0] == '#' )
+            continue;
+        if ( (sscanf(line, "%lld %7s %lu %lld", &when, op, &id,
+                     &expires) < 3) || (when < emul_now) )
+        {
+            fprintf(stderr, "%s:%lu: bad operation\n", file, lineno);
+            return 1;
+        }
+
+        run_until(when);
+
+        t0 = host_ns();
+        if ( !strcmp(op, "set") )
+            set_timer(&timers[id], expires);
+        else
+            stop_timer(&timers[id]);
+        op_ns += host_ns() - t0;
+        nr_ops++;
+    }
+
+    fclose(f);
+
+    /* Let everything set to expire within the trace do so. */
+    run_until(emul_now);
+
+    printf("%s: %lu ops %.1f ns/op, %lu softirqs %.1f ns/softirq, "
+           "%lu fired, late avg %"PRId64"ns max %"PRId64"ns, %lu early\n",
+           mode, nr_ops, op_ns / (nr_ops ?: 1), nr_softirqs,
+           softirq_ns / (nr_softirqs ?: 1), nr_fired,
+           nr_fired ? total_late / (s_time_t)nr_fired : 0, max_late,
+           nr_early);
+
+    return nr_early ? 1 : 0;
+}
+
+/* Trace generation. */
+struct op {
+    s_time_t when, expires;
+    unsigned long id;
+    bool_t set;
+};
+
+static struct op *ops;
+static unsigned long nr_gen, max_gen;
+
+static void gen_op(s_time_t when, unsigned long id, bool_t set,
+                   s_time_t expires)
+{
+    if ( nr_gen == max_gen )
+    {
+        max_gen = max_gen ? max_gen * 2 : 1024;
+        ops = realloc(ops, max_gen * sizeof(*ops));
+    }
+    ops[nr_gen].when = when;
+    ops[nr_gen].id = id;
+    ops[nr_gen].set = set;
+    ops[nr_gen].expires = expires;
+    nr_gen++;
+}
+
+static int cmp_op(const void *a, const void *b)
+{
+    const struct op *x = a, *y = b;
+
+    return (x->when > y->when) - (x->when < y->when);
+}
+
+static s_time_t rnd(s_time_t lo, s_time_t hi)
+{
+    return lo + (s_time_t)((double)rand() / RAND_MAX * (hi - lo));
+}
+
+/* Delay from a timer's expiry to its handler re-arming it. */
+#define REARM rnd(100000, 200000)
+
+static int gen(unsigned int vcpus, unsigned int seconds, unsigned int seed)
+{
+    s_time_t end = seconds * 1000 * MS, t, run;
+    unsigned int v;
+    unsigned long i, id = 0;
+
+    srand(seed);
+
+    for ( v = 0; v < vcpus; v++, id += 3 )
+    {
+        /* Periodic timer: re-armed shortly after it fires. */
+        for ( t = rnd(0, 10 * MS); t < end; t += 10 * MS + REARM )
+            gen_op(t, id, 1, t + 10 * MS);
+
+        /* Platform timer: 1ms period while running, stopped while blocked. */
+        for ( t = rnd(0, MS); t < end; )
+        {
+            for ( run = t + rnd(MS, 50 * MS); (t < run) && (t < end);
+                  t += MS + REARM )
+                gen_op(t, id + 1, 1, t + MS);
+            gen_op(t, id + 1, 0, 0);
+            t += rnd(MS, 100 * MS);
+        }
+
+        /* Scheduler timer: usually pre-empted before the slice ends. */
+        for ( t = rnd(0, MS); t < end; )
+        {
+            run = rnd(MS / 10, 30 * MS);
+            gen_op(t, id + 2, 1, t + 30 * MS);
+            t += run;
+        }
+    }
+
+    /* Time calibration, watchdog, and similar. */
+    for ( t = 0; t < end; t += 1000 * MS + REARM )
+        gen_op(t, id, 1, t + 1000 * MS);
+    gen_op(0, id + 1, 1, end + 3600000 * MS);
+
+    qsort(ops, nr_gen, sizeof(*ops), cmp_op);
+
+    printf("# %u vcpus, %u seconds, seed %u\n", vcpus, seconds, seed);
+    for ( i = 0; i < nr_gen; i++ )
+    {
+        if ( ops[i].set )
+            printf("%"PRId64" set %lu %"PRId64"\n",
+                   ops[i].when, ops[i].id, ops[i].expires);
+        else
+            printf("%"PRId64" stop %lu\n", ops[i].when, ops[i].id);
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if ( (argc == 5) && !strcmp(argv[1], "gen") )
+        return gen(strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0),
+                   strtoul(argv[4], NULL, 0));
+    if ( (argc == 4) && !strcmp(argv[1], "replay") &&
+         (!strcmp(argv[2], "heap") || !strcmp(argv[2], "wheel")) )
+        return replay(argv[2], argv[3]);
+
+    fprintf(stderr, "usage: %s gen <vcpus> <seconds> <seed>\n"
+            "       %s replay <heap|wheel> <trace>\n", argv[0], argv[0]);
+    return 2;
+}
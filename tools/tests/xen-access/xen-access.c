@@ -102,6 +102,7 @@ typedef struct mem_event {
     mem_event_back_ring_t back_ring;
     uint32_t evtchn_port;
     void *ring_page;
+    unsigned int nr_frames;
     spinlock_t ring_lock;
 } mem_event_t;
 
@@ -171,7 +172,8 @@ int xenaccess_teardown(xc_interface *xch, xenaccess_t *xenaccess)
 
     /* Tear down domain xenaccess in Xen */
     if ( xenaccess->mem_event.ring_page )
-        munmap(xenaccess->mem_event.ring_page, XC_PAGE_SIZE);
+        munmap(xenaccess->mem_event.ring_page,
+               xenaccess->mem_event.nr_frames * XC_PAGE_SIZE);
 
     if ( mem_access_enable )
     {
@@ -218,12 +220,65 @@ int xenaccess_teardown(xc_interface *xch, xenaccess_t *xenaccess)
     return 0;
 }
 
-xenaccess_t *xenaccess_init(xc_interface **xch_r, domid_t domain_id)
+/*
+ * Find the ring's gfns.  A single page is the one the domain builder set
+ * aside; a larger ring is given fresh gfns above the guest's memory, with
+ * the domain's allowance raised to cover them.
+ */
+static int xenaccess_ring_pfns(xenaccess_t *xenaccess, xen_pfn_t *ring_pfns)
+{
+    xc_interface *xch = xenaccess->xc_handle;
+    domid_t domain_id = xenaccess->mem_event.domain_id;
+    unsigned int i, nr_frames = xenaccess->mem_event.nr_frames;
+    unsigned long ring_pfn;
+    int rc;
+
+    if ( nr_frames == 1 )
+    {
+        xc_get_hvm_param(xch, domain_id, HVM_PARAM_ACCESS_RING_PFN, &ring_pfn);
+        ring_pfns[0] = ring_pfn;
+        return 0;
+    }
+
+    rc = xc_domain_maximum_gpfn(xch, domain_id);
+    if ( rc < 0 )
+    {
+        PERROR("Failed to get the guest's highest gfn");
+        return -1;
+    }
+    ring_pfn = rc + 1;
+
+    rc = xc_domain_setmaxmem(xch, domain_id,
+                             (xenaccess->domain_info->max_pages + nr_frames) *
+                             (XC_PAGE_SIZE >> 10));
+    if ( rc != 0 )
+    {
+        PERROR("Failed to make room for the ring");
+        return -1;
+    }
+
+    rc = xc_set_hvm_param(xch, domain_id, HVM_PARAM_ACCESS_RING_PFN, ring_pfn);
+    if ( rc != 0 )
+    {
+        PERROR("Failed to set the ring gfn");
+        return -1;
+    }
+
+    for ( i = 0; i < nr_frames; i++ )
+        ring_pfns[i] = ring_pfn + i;
+
+    return 0;
+}
+
+xenaccess_t *xenaccess_init(xc_interface **xch_r, domid_t domain_id,
+                            unsigned int nr_frames)
 {
     xenaccess_t *xenaccess = 0;
     xc_interface *xch;
     int rc;
-    unsigned long ring_pfn, mmap_pfn;
+    unsigned int i;
+    xen_pfn_t ring_pfns[MEM_EVENT_RING_MAX_FRAMES];
+    xen_pfn_t mmap_pfns[MEM_EVENT_RING_MAX_FRAMES];
 
     xch = xc_interface_open(NULL, NULL, 0);
     if ( !xch )
@@ -241,43 +296,79 @@ xenaccess_t *xenaccess_init(xc_interface **xch_r, domid_t domain_id)
 
     /* Set domain id */
     xenaccess->mem_event.domain_id = domain_id;
+    xenaccess->mem_event.nr_frames = nr_frames;
 
     /* Initialise lock */
     mem_event_ring_lock_init(&xenaccess->mem_event);
 
-    /* Map the ring page */
-    xc_get_hvm_param(xch, xenaccess->mem_event.domain_id, 
-                        HVM_PARAM_ACCESS_RING_PFN, &ring_pfn);
-    mmap_pfn = ring_pfn;
+    /* Get domaininfo */
+    xenaccess->domain_info = malloc(sizeof(xc_domaininfo_t));
+    if ( xenaccess->domain_info == NULL )
+    {
+        ERROR("Error allocating memory for domain info");
+        goto err;
+    }
+
+    rc = xc_domain_getinfolist(xenaccess->xc_handle, domain_id, 1,
+                               xenaccess->domain_info);
+    if ( rc != 1 )
+    {
+        ERROR("Error getting domain info");
+        goto err;
+    }
+
+    DPRINTF("max_pages = %"PRIx64"\n", xenaccess->domain_info->max_pages);
+
+    /* Map the ring pages */
+    if ( xenaccess_ring_pfns(xenaccess, ring_pfns) )
+        goto err;
+    memcpy(mmap_pfns, ring_pfns, nr_frames * sizeof(*mmap_pfns));
     xenaccess->mem_event.ring_page = 
         xc_map_foreign_batch(xch, xenaccess->mem_event.domain_id, 
-                                PROT_READ | PROT_WRITE, &mmap_pfn, 1);
-    if ( mmap_pfn & XEN_DOMCTL_PFINFO_XTAB )
+                                PROT_READ | PROT_WRITE, mmap_pfns, nr_frames);
+    for ( i = 0; i < nr_frames; i++ )
+        if ( mmap_pfns[i] & XEN_DOMCTL_PFINFO_XTAB )
+            break;
+    if ( i < nr_frames )
     {
-        /* Map failed, populate ring page */
-        rc = xc_domain_populate_physmap_exact(xenaccess->xc_handle, 
-                                              xenaccess->mem_event.domain_id,
-                                              1, 0, 0, &ring_pfn);
-        if ( rc != 0 )
+        /* Map failed, populate ring pages */
+        if ( xenaccess->mem_event.ring_page )
+            munmap(xenaccess->mem_event.ring_page, nr_frames * XC_PAGE_SIZE);
+        xenaccess->mem_event.ring_page = NULL;
+
+        for ( i = 0; i < nr_frames; i++ )
         {
-            PERROR("Failed to populate ring gfn\n");
-            goto err;
+            if ( !(mmap_pfns[i] & XEN_DOMCTL_PFINFO_XTAB) )
+                continue;
+            rc = xc_domain_populate_physmap_exact(xenaccess->xc_handle, 
+                                                  xenaccess->mem_event.domain_id,
+                                                  1, 0, 0, &ring_pfns[i]);
+            if ( rc != 0 )
+            {
+                PERROR("Failed to populate ring gfn\n");
+                goto err;
+            }
         }
 
-        mmap_pfn = ring_pfn;
+        memcpy(mmap_pfns, ring_pfns, nr_frames * sizeof(*mmap_pfns));
         xenaccess->mem_event.ring_page = 
             xc_map_foreign_batch(xch, xenaccess->mem_event.domain_id, 
-                                    PROT_READ | PROT_WRITE, &mmap_pfn, 1);
-        if ( mmap_pfn & XEN_DOMCTL_PFINFO_XTAB )
+                                    PROT_READ | PROT_WRITE, mmap_pfns,
+                                    nr_frames);
+        for ( i = 0; i < nr_frames; i++ )
         {
-            PERROR("Could not map the ring page\n");
-            goto err;
+            if ( mmap_pfns[i] & XEN_DOMCTL_PFINFO_XTAB )
+            {
+                PERROR("Could not map the ring page\n");
+                goto err;
+            }
         }
     }
 
     /* Initialise Xen */
-    rc = xc_mem_access_enable(xenaccess->xc_handle, xenaccess->mem_event.domain_id,
-                             &xenaccess->mem_event.evtchn_port);
+    rc = xc_mem_access_enable_frames(xenaccess->xc_handle,
+                                     xenaccess->mem_event.domain_id, nr_frames,
+                                     &xenaccess->mem_event.evtchn_port);
     if ( rc != 0 )
     {
         switch ( errno ) {
@@ -320,31 +411,13 @@ xenaccess_t *xenaccess_init(xc_interface **xch_r, domid_t domain_id)
     SHARED_RING_INIT((mem_event_sring_t *)xenaccess->mem_event.ring_page);
     BACK_RING_INIT(&xenaccess->mem_event.back_ring,
                    (mem_event_sring_t *)xenaccess->mem_event.ring_page,
-                   XC_PAGE_SIZE);
+                   nr_frames * XC_PAGE_SIZE);
 
     /* Now that the ring is set, remove it from the guest's physmap */
     if ( xc_domain_decrease_reservation_exact(xch, 
-                    xenaccess->mem_event.domain_id, 1, 0, &ring_pfn) )
+                    xenaccess->mem_event.domain_id, nr_frames, 0, ring_pfns) )
         PERROR("Failed to remove ring from guest physmap");
 
-    /* Get domaininfo */
-    xenaccess->domain_info = malloc(sizeof(xc_domaininfo_t));
-    if ( xenaccess->domain_info == NULL )
-    {
-        ERROR("Error allocating memory for domain info");
-        goto err;
-    }
-
-    rc = xc_domain_getinfolist(xenaccess->xc_handle, domain_id, 1,
-                               xenaccess->domain_info);
-    if ( rc != 1 )
-    {
-        ERROR("Error getting domain info");
-        goto err;
-    }
-
-    DPRINTF("max_pages = %"PRIx64"\n", xenaccess->domain_info->max_pages);
-
     return xenaccess;
 
  err:
@@ -377,6 +450,7 @@ int get_request(mem_event_t *mem_event, mem_event_request_t *req)
     return 0;
 }
 
+/* Responses are only made visible to Xen by xenaccess_resume(). */
 static int put_response(mem_event_t *mem_event, mem_event_response_t *rsp)
 {
     mem_event_back_ring_t *back_ring;
@@ -393,40 +467,40 @@ static int put_response(mem_event_t *mem_event, mem_event_response_t *rsp)
 
     /* Update ring */
     back_ring->rsp_prod_pvt = rsp_prod;
-    RING_PUSH_RESPONSES(back_ring);
 
     mem_event_ring_unlock(mem_event);
 
     return 0;
 }
 
-static int xenaccess_resume_page(xenaccess_t *paging, mem_event_response_t *rsp)
+/* Hand Xen every response put since the last call, with a single kick. */
+static int xenaccess_resume(xenaccess_t *xenaccess)
 {
     int ret;
 
-    /* Put the page info on the ring */
-    ret = put_response(&paging->mem_event, rsp);
-    if ( ret != 0 )
-        goto out;
+    mem_event_ring_lock(&xenaccess->mem_event);
+    RING_PUSH_RESPONSES(&xenaccess->mem_event.back_ring);
+    mem_event_ring_unlock(&xenaccess->mem_event);
 
-    /* Tell Xen page is ready */
-    ret = xc_mem_access_resume(paging->xc_handle, paging->mem_event.domain_id);
-    ret = xc_evtchn_notify(paging->mem_event.xce_handle,
-                           paging->mem_event.port);
+    /* Tell Xen the pages are ready */
+    ret = xc_mem_access_resume(xenaccess->xc_handle,
+                               xenaccess->mem_event.domain_id);
+    ret = xc_evtchn_notify(xenaccess->mem_event.xce_handle,
+                           xenaccess->mem_event.port);
 
- out:
     return ret;
 }
 
 void usage(char* progname)
 {
     fprintf(stderr,
-            "Usage: %s [-m] <domain_id> write|exec|int3\n"
+            "Usage: %s [-m] [-r <pages>] <domain_id> write|exec|int3\n"
             "\n"
             "Logs first page writes, execs, or int3 traps that occur on the domain.\n"
             "\n"
-            "-m requires this program to run, or else the domain may pause\n",
-            progname);
+            "-m requires this program to run, or else the domain may pause\n"
+            "-r sets up a ring of <pages> pages (at most %d), rather than one\n",
+            progname, MEM_EVENT_RING_MAX_FRAMES);
 }
 
 int main(int argc, char *argv[])
@@ -444,15 +518,27 @@ int main(int argc, char *argv[])
     int required = 0;
     int int3 = 0;
     int shutting_down = 0;
+    unsigned int nr_frames = 1, responses;
 
     char* progname = argv[0];
     argv++;
     argc--;
 
-    if ( argc == 3 && argv[0][0] == '-' )
+    while ( argc > 2 && argv[0][0] == '-' )
     {
         if ( !strcmp(argv[0], "-m") )
             required = 1;
+        else if ( !strcmp(argv[0], "-r") && argc > 3 )
+        {
+            nr_frames = atoi(argv[1]);
+            if ( nr_frames < 1 || nr_frames > MEM_EVENT_RING_MAX_FRAMES )
+            {
+                usage(progname);
+                return -1;
+            }
+            argv++;
+            argc--;
+        }
         else
         {
             usage(progname);
@@ -492,7 +578,7 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    xenaccess = xenaccess_init(&xch, domain_id);
+    xenaccess = xenaccess_init(&xch, domain_id, nr_frames);
     if ( xenaccess == NULL )
     {
         ERROR("Error initialising xenaccess");
@@ -573,6 +659,8 @@ int main(int argc, char *argv[])
             DPRINTF("Got event from Xen\n");
         }
 
+        /* Answer everything on the ring before kicking Xen once. */
+        responses = 0;
         while ( RING_HAS_UNCONSUMED_REQUESTS(&xenaccess->mem_event.back_ring) )
         {
             xenmem_access_t access;
@@ -648,13 +736,24 @@ int main(int argc, char *argv[])
                 fprintf(stderr, "UNKNOWN REASON CODE %d\n", req.reason);
             }
 
-            rc = xenaccess_resume_page(xenaccess, &rsp);
+            rc = put_response(&xenaccess->mem_event, &rsp);
             if ( rc != 0 )
             {
-                ERROR("Error resuming page");
+                ERROR("Error putting response");
                 interrupted = -1;
                 continue;
             }
+            responses++;
+        }
+
+        if ( responses )
+        {
+            rc = xenaccess_resume(xenaccess);
+            if ( rc != 0 )
+            {
+                ERROR("Error resuming pages");
+                interrupted = -1;
+            }
         }
 
         if ( shutting_down )
@@ -0,0 +1,23 @@
+/*
+ * Environment for building libxc's xc_page_is_zero.c in a benchmark.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TEST_ZERO_PAGE_HARNESS_H__
+#define __TEST_ZERO_PAGE_HARNESS_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define XC_PAGE_SIZE 4096
+
+#endif /* __TEST_ZERO_PAGE_HARNESS_H__ */
@@ -0,0 +1,168 @@
+/*
+ * Check and benchmark the page-is-zero scans of the hypervisor
+ * (xen/arch/x86/page_is_zero.S) and libxc (tools/libxc/xc_page_is_zero.c)
+ * against the word-by-word loop they replace.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage:
+ *
+ *   test_zero_page check
+ *     Check every scan on a zero page, and on pages with each single byte
+ *     set.
+ *
+ *   test_zero_page bench <pages> <rounds>
+ *     Time each scan over <pages> zero pages, <rounds> times: all-zero
+ *     pages are the ones scanned in full.  A few hundred pages fit in the
+ *     cache; tens of thousands do not.
+ *
+ * make -C tools/tests/zero-page run
+ */
+
+#include <time.h>
+#include "xc_page_is_zero.c"
+
+int xen_page_is_zero_sse2(const void *);
+int xen_page_is_zero_avx2(const void *);
+
+/* As p2m_pod_zero_check() used to. */
+static int page_is_zero_loop(const void *page)
+{
+    const unsigned long *map = page;
+    unsigned int j;
+
+    for ( j = 0; j < XC_PAGE_SIZE / sizeof(*map); j++ )
+        if ( map[j] != 0 )
+            return 0;
+
+    return 1;
+}
+
+static const struct scan {
+    const char *name;
+    int (*fn)(const void *);
+    int avx2;
+} scans[] = {
+    { "word loop",    page_is_zero_loop,     0 },
+    { "xen sse2",     xen_page_is_zero_sse2, 0 },
+    { "xen avx2",     xen_page_is_zero_avx2, 1 },
+    { "libxc sse2",   page_is_zero_sse2,     0 },
+    { "libxc avx2",   page_is_zero_avx2,     1 },
+    { "libxc",        xc_page_is_zero,       0 },
+};
+
+#define NR_SCANS (sizeof(scans) / sizeof(scans[0]))
+
+static void *alloc_pages(unsigned long nr)
+{
+    void *p;
+
+    if ( posix_memalign(&p, XC_PAGE_SIZE, nr * XC_PAGE_SIZE) )
+    {
+        perror("posix_memalign");
+        exit(1);
+    }
+    memset(p, 0, nr * XC_PAGE_SIZE);
+
+    return p;
+}
+
+static int check(void)
+{
+    unsigned char *page = alloc_pages(1);
+    unsigned int i, pos, failures = 0;
+    int has_avx2 = cpu_has_avx2();
+
+    for ( i = 0; i < NR_SCANS; i++ )
+    {
+        if ( scans[i].avx2 && !has_avx2 )
+            continue;
+
+        if ( !scans[i].fn(page) )
+        {
+            printf("FAIL: %s: zero page\n", scans[i].name);
+            failures++;
+        }
+
+        for ( pos = 0; pos < XC_PAGE_SIZE; pos++ )
+        {
+            page[pos] = 1 << (pos % 8);
+            if ( scans[i].fn(page) )
+            {
+                printf("FAIL: %s: byte %u set\n", scans[i].name, pos);
+                failures++;
+            }
+            page[pos] = 0;
+        }
+    }
+
+    printf("check: %s\n", failures ? "FAILED" : "passed");
+    free(page);
+
+    return !!failures;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int bench(unsigned long nr, unsigned long rounds)
+{
+    char *pages = alloc_pages(nr);
+    unsigned long i, r, zero;
+    unsigned int s;
+    int has_avx2 = cpu_has_avx2();
+    double t0, t1;
+
+    for ( s = 0; s < NR_SCANS; s++ )
+    {
+        if ( scans[s].avx2 && !has_avx2 )
+            continue;
+
+        zero = 0;
+        t0 = now_ns();
+        for ( r = 0; r < rounds; r++ )
+            for ( i = 0; i < nr; i++ )
+                zero += scans[s].fn(pages + i * XC_PAGE_SIZE);
+        t1 = now_ns();
+
+        if ( zero != nr * rounds )
+        {
+            printf("FAIL: %s: zero pages missed\n", scans[s].name);
+            return 1;
+        }
+
+        printf("bench: %lu pages: %-10s %6.1f ns/page %6.2f GB/s\n",
+               nr, scans[s].name, (t1 - t0) / (nr * rounds),
+               (double)nr * rounds * XC_PAGE_SIZE / (t1 - t0));
+    }
+
+    free(pages);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if ( (argc == 2) && !strcmp(argv[1], "check") )
+        return check();
+    if ( (argc == 4) && !strcmp(argv[1], "bench") )
+        return bench(strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0));
+
+    fprintf(stderr, "usage: %s check\n"
+            "       %s bench <pages> <rounds>\n", argv[0], argv[0]);
+    return 2;
+}
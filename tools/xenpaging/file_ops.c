@@ -21,7 +21,12 @@
 
 
 #include <unistd.h>
+#include <libaio.h>
 #include <xc_private.h>
+#include "file_ops.h"
+
+static io_context_t io_ctx;
+static int io_ready;
 
 static int file_op(int fd, void *page, int i,
                    ssize_t (*fn)(int, void *, size_t))
@@ -61,6 +66,99 @@ int write_page(int fd, void *page, int i)
     return file_op(fd, page, i, &my_write);
 }
 
+int pages_io_init(void)
+{
+    if ( io_setup(PAGES_IO_DEPTH, &io_ctx) < 0 )
+        return -1;
+
+    io_ready = 1;
+    return 0;
+}
+
+/*
+ * Transfer the num pages in buffer from or to their slots, keeping up to
+ * PAGES_IO_DEPTH of them in flight at once.  Whatever cannot be done
+ * asynchronously is done synchronously.
+ */
+static int pages_op(int fd, void *buffer, const int *slots, int num,
+                    int write)
+{
+    struct iocb iocbs[PAGES_IO_DEPTH], *iocbps[PAGES_IO_DEPTH];
+    struct io_event events[PAGES_IO_DEPTH];
+    struct iocb *iocb;
+    void *page;
+    int i, j, n, submitted, done, rc;
+
+    for ( i = 0; i < num; i += n )
+    {
+        n = num - i < PAGES_IO_DEPTH ? num - i : PAGES_IO_DEPTH;
+        submitted = 0;
+
+        if ( io_ready )
+        {
+            for ( j = 0; j < n; j++ )
+            {
+                page = buffer + ((i + j) << PAGE_SHIFT);
+                if ( write )
+                    io_prep_pwrite(&iocbs[j], fd, page, PAGE_SIZE,
+                                   (off_t)slots[i + j] << PAGE_SHIFT);
+                else
+                    io_prep_pread(&iocbs[j], fd, page, PAGE_SIZE,
+                                  (off_t)slots[i + j] << PAGE_SHIFT);
+                iocbps[j] = &iocbs[j];
+            }
+
+            rc = io_submit(io_ctx, n, iocbps);
+            if ( rc > 0 )
+                submitted = rc;
+        }
+
+        for ( done = 0; done < submitted; done += rc )
+        {
+            rc = io_getevents(io_ctx, 1, submitted - done, events, NULL);
+            if ( rc == -EINTR )
+            {
+                rc = 0;
+                continue;
+            }
+            if ( rc < 0 )
+                return -1;
+
+            /* Retry short transfers synchronously */
+            for ( j = 0; j < rc; j++ )
+            {
+                if ( events[j].res == PAGE_SIZE )
+                    continue;
+                iocb = events[j].obj;
+                if ( (write ? write_page : read_page)(fd, iocb->u.c.buf,
+                                                      iocb->u.c.offset >>
+                                                      PAGE_SHIFT) )
+                    return -1;
+            }
+        }
+
+        /* Do anything which could not be submitted synchronously */
+        for ( j = submitted; j < n; j++ )
+        {
+            page = buffer + ((i + j) << PAGE_SHIFT);
+            if ( (write ? write_page : read_page)(fd, page, slots[i + j]) )
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+int read_pages(int fd, void *buffer, const int *slots, int num)
+{
+    return pages_op(fd, buffer, slots, num, 0);
+}
+
+int write_pages(int fd, void *buffer, const int *slots, int num)
+{
+    return pages_op(fd, buffer, slots, num, 1);
+}
+
 
 /*
  * Local variables:
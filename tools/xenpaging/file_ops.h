@@ -25,9 +25,18 @@
 #define __FILE_OPS_H__
 
 
+/* Number of page transfers kept in flight by read_pages()/write_pages() */
+#define PAGES_IO_DEPTH 64
+
 int read_page(int fd, void *page, int i);
 int write_page(int fd, void *page, int i);
 
+/* Set up asynchronous I/O, without which the batched calls are synchronous */
+int pages_io_init(void);
+/* Read or write the num contiguous pages in buffer from or to slots[] */
+int read_pages(int fd, void *buffer, const int *slots, int num);
+int write_pages(int fd, void *buffer, const int *slots, int num);
+
 
 #endif
 
@@ -25,6 +25,8 @@
 
 
 #define DEFAULT_MRU_SIZE (1024 * 16)
+/* Number of gfns whose accessed bits are fetched from Xen at once */
+#define ACCESSED_SCAN_SIZE XENMEM_paging_scan_max
 
 
 static unsigned long *mru;
@@ -35,6 +37,10 @@ static unsigned long *unconsumed;
 static unsigned int unconsumed_cleared;
 static unsigned long current_gfn;
 static unsigned long max_pages;
+static unsigned long *referenced;
+static uint8_t *accessed;
+static unsigned long accessed_start = INVALID_MFN;
+static int accessed_supported = 1;
 
 
 int policy_init(struct xenpaging *paging)
@@ -52,6 +58,14 @@ int policy_init(struct xenpaging *paging)
     unconsumed = bitmap_alloc(max_pages);
     if ( !unconsumed )
         goto out;
+    /* Allocate bitmap of paged in pages not yet passed by the clock hand */
+    referenced = bitmap_alloc(max_pages);
+    if ( !referenced )
+        goto out;
+    /* Allocate bitmap for accessed bits of the gfns ahead of the hand */
+    accessed = calloc(1, ACCESSED_SCAN_SIZE / 8);
+    if ( !accessed )
+        goto out;
 
     /* Initialise MRU list of paged in pages */
     if ( paging->policy_mru_size > 0 )
@@ -77,13 +91,57 @@ int policy_init(struct xenpaging *paging)
     return rc;
 }
 
+/*
+ * The victims are chosen by a clock: a gfn which has been accessed since
+ * the hand last came round gets a second chance.  Accesses are taken from
+ * the accessed bits Xen keeps in the p2m, where the hardware provides
+ * them, and from the gfns having been paged in.
+ */
+static int policy_test_and_clear_accessed(struct xenpaging *paging,
+                                          unsigned long gfn)
+{
+    xc_interface *xch = paging->xc_handle;
+    unsigned int nr;
+
+    if ( test_and_clear_bit(gfn, referenced) )
+        return 1;
+
+    if ( !accessed_supported )
+        return 0;
+
+    /* Fetch, and so clear, the accessed bits of the range the hand is in */
+    if ( gfn - accessed_start >= ACCESSED_SCAN_SIZE )
+    {
+        accessed_start = gfn & ~(ACCESSED_SCAN_SIZE - 1UL);
+        nr = max_pages - accessed_start < ACCESSED_SCAN_SIZE ?
+             max_pages - accessed_start : ACCESSED_SCAN_SIZE;
+
+        if ( xc_mem_paging_scan_accessed(xch, paging->mem_event.domain_id,
+                                         accessed_start, nr, accessed) < 0 )
+        {
+            if ( errno == EOPNOTSUPP || errno == ENOSYS )
+            {
+                DPRINTF("no accessed bits, using paged in gfns only\n");
+                accessed_supported = 0;
+            }
+            else
+                PERROR("Error scanning accessed gfns at %lx", accessed_start);
+            memset(accessed, 0, ACCESSED_SCAN_SIZE / 8);
+        }
+    }
+
+    gfn -= accessed_start;
+    return !!(accessed[gfn / 8] & (1 << (gfn % 8)));
+}
+
 unsigned long policy_choose_victim(struct xenpaging *paging)
 {
     xc_interface *xch = paging->xc_handle;
     unsigned long i;
 
-    /* One iteration over all possible gfns */
-    for ( i = 0; i < max_pages; i++ )
+    /* Two iterations over all possible gfns, as the first may only have
+     * used up second chances */
+    for ( i = 0; i < 2 * max_pages; i++ )
     {
         /* Try next gfn */
         current_gfn++;
@@ -111,12 +169,16 @@ unsigned long policy_choose_victim(struct xenpaging *paging)
         if ( test_bit(current_gfn, unconsumed) )
             continue;
 
+        /* gfn accessed since the hand last passed it */
+        if ( policy_test_and_clear_accessed(paging, current_gfn) )
+            continue;
+
         /* gfn found */
         break;
     }
 
     /* Could not nominate any gfn */
-    if ( i >= max_pages )
+    if ( i >= 2 * max_pages )
     {
         /* No more pages, wait in poll */
         paging->use_poll_timeout = 1;
@@ -152,6 +214,7 @@ static void policy_handle_paged_in(unsigned long gfn, int do_mru)
     
     if (do_mru) {
         mru[i_mru & (mru_size - 1)] = gfn;
+        set_bit(gfn, referenced);
     } else {
         clear_bit(gfn, bitmap);
         mru[i_mru & (mru_size - 1)] = INVALID_MFN;
@@ -175,6 +238,12 @@ void policy_notify_dropped(unsigned long gfn)
     clear_bit(gfn, bitmap);
 }
 
+void policy_notify_prefetched(unsigned long gfn)
+{
+    /* Not accessed yet, so the first to go again if it stays that way */
+    clear_bit(gfn, bitmap);
+}
+
 
 /*
  * Local variables:
@@ -180,17 +180,17 @@ static int xenpaging_get_tot_pages(struct xenpaging *paging)
     return domain_info.tot_pages;
 }
 
-static void *init_page(void)
+static void *init_pages(int num)
 {
     void *buffer;
 
     /* Allocated page memory */
-    errno = posix_memalign(&buffer, PAGE_SIZE, PAGE_SIZE);
+    errno = posix_memalign(&buffer, PAGE_SIZE, num * PAGE_SIZE);
     if ( errno != 0 )
         return NULL;
 
     /* Lock buffer in memory so it can't be paged out */
-    if ( mlock(buffer, PAGE_SIZE) < 0 )
+    if ( mlock(buffer, num * PAGE_SIZE) < 0 )
     {
         free(buffer);
         buffer = NULL;
@@ -210,6 +210,7 @@ static void usage(void)
     printf(" -f <file>      --pagefile=<file>        pagefile to use. This option is required.\n");
     printf(" -m <max_memkb> --max_memkb=<max_memkb>  maximum amount of memory to handle.\n");
     printf(" -r <num>       --mru_size=<num>         number of paged-in pages to keep in memory.\n");
+    printf(" -p <num>       --prefetch=<num>         number of following pages to page in with a faulting one.\n");
     printf(" -v             --verbose                enable debug output.\n");
     printf(" -h             --help                   this output.\n");
 }
@@ -217,13 +218,14 @@ static void usage(void)
 static int xenpaging_getopts(struct xenpaging *paging, int argc, char *argv[])
 {
     int ch;
-    static const char sopts[] = "hvd:f:m:r:";
+    static const char sopts[] = "hvd:f:m:r:p:";
     static const struct option lopts[] = {
         {"help", 0, NULL, 'h'},
         {"verbose", 0, NULL, 'v'},
         {"domain", 1, NULL, 'd'},
         {"pagefile", 1, NULL, 'f'},
         {"mru_size", 1, NULL, 'm'},
+        {"prefetch", 1, NULL, 'p'},
         { }
     };
 
@@ -243,6 +245,9 @@ static int xenpaging_getopts(struct xenpaging *paging, int argc, char *argv[])
         case 'r':
             paging->policy_mru_size = atoi(optarg);
             break;
+        case 'p':
+            paging->prefetch = atoi(optarg);
+            break;
         case 'v':
             paging->debug = 1;
             break;
@@ -288,6 +293,8 @@ static struct xenpaging *xenpaging_init(int argc, char *argv[])
     if ( !paging )
         goto err;
 
+    paging->prefetch = XENPAGING_PREFETCH_DEFAULT;
+
     /* Get cmdline options and domain_id */
     if ( xenpaging_getopts(paging, argc, argv) )
         goto err;
@@ -467,21 +474,29 @@ static struct xenpaging *xenpaging_init(int argc, char *argv[])
         goto err;
     }
 
-    paging->paging_buffer = init_page();
+    paging->paging_buffer = init_pages(XENPAGING_BATCH_SIZE);
     if ( !paging->paging_buffer )
     {
         PERROR("Creating page aligned load buffer");
         goto err;
     }
 
-    /* Open file */
-    paging->fd = open(filename, O_CREAT | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    /* Open file, bypassing the page cache where the filesystem allows */
+    paging->fd = open(filename, O_CREAT | O_TRUNC | O_RDWR | O_DIRECT,
+                      S_IRUSR | S_IWUSR);
+    if ( paging->fd < 0 && errno == EINVAL )
+        paging->fd = open(filename, O_CREAT | O_TRUNC | O_RDWR,
+                          S_IRUSR | S_IWUSR);
     if ( paging->fd < 0 )
     {
         PERROR("failed to open file");
         goto err;
     }
 
+    /* Without it, the page file is read and written synchronously */
+    if ( pages_io_init() < 0 )
+        DPRINTF("no asynchronous I/O for the pagefile\n");
+
     return paging;
 
  err:
@@ -493,7 +508,7 @@ static struct xenpaging *xenpaging_init(int argc, char *argv[])
             xc_interface_close(xch);
         if ( paging->paging_buffer )
         {
-            munlock(paging->paging_buffer, PAGE_SIZE);
+            munlock(paging->paging_buffer, XENPAGING_BATCH_SIZE * PAGE_SIZE);
             free(paging->paging_buffer);
         }
 
@@ -592,86 +607,91 @@ static void put_response(struct mem_event *mem_event, mem_event_response_t *rsp)
     RING_PUSH_RESPONSES(back_ring);
 }
 
-/* Evict a given gfn
+/* Evict a batch of nominated gfns, having written them to their slots
  * Returns < 0 on fatal error
- * Returns 0 on successful evict
- * Returns > 0 if gfn can not be evicted
+ * Returns the number of gfns evicted otherwise
  */
-static int xenpaging_evict_page(struct xenpaging *paging, unsigned long gfn, int slot)
+static int xenpaging_evict_pages(struct xenpaging *paging, xen_pfn_t *gfns,
+                                 int *slots, int num)
 {
     xc_interface *xch = paging->xc_handle;
-    void *page;
-    xen_pfn_t victim = gfn;
-    int ret;
-
-    DECLARE_DOMCTL;
-
-    /* Nominate page */
-    ret = xc_mem_paging_nominate(xch, paging->mem_event.domain_id, gfn);
-    if ( ret < 0 )
+    int err[XENPAGING_BATCH_SIZE];
+    void *pages;
+    int i, ret, evicted = 0;
+
+    /* Map pages */
+    pages = xc_map_foreign_bulk(xch, paging->mem_event.domain_id, PROT_READ,
+                                gfns, err, num);
+    if ( pages == NULL )
     {
-        /* unpageable gfn is indicated by EBUSY */
-        if ( errno == EBUSY )
-            ret = 1;
-        else
-            PERROR("Error nominating page %lx", gfn);
-        goto out;
+        PERROR("Error mapping %d pages from %"PRI_xen_pfn, num, gfns[0]);
+        return -1;
     }
 
-    /* Map page */
-    page = xc_map_foreign_pages(xch, paging->mem_event.domain_id, PROT_READ, &victim, 1);
-    if ( page == NULL )
+    /* Copy pages */
+    for ( i = 0; i < num; i++ )
     {
-        PERROR("Error mapping page %lx", gfn);
-        ret = -1;
-        goto out;
+        if ( err[i] )
+        {
+            errno = -err[i];
+            PERROR("Error mapping page %"PRI_xen_pfn, gfns[i]);
+            munmap(pages, num * PAGE_SIZE);
+            return -1;
+        }
+        memcpy(paging->paging_buffer + i * PAGE_SIZE,
+               pages + i * PAGE_SIZE, PAGE_SIZE);
     }
 
-    /* Copy page */
-    ret = write_page(paging->fd, page, slot);
+    /* Release pages */
+    munmap(pages, num * PAGE_SIZE);
+
+    ret = write_pages(paging->fd, paging->paging_buffer, slots, num);
     if ( ret < 0 )
     {
-        PERROR("Error copying page %lx", gfn);
-        munmap(page, PAGE_SIZE);
-        ret = -1;
-        goto out;
+        PERROR("Error copying %d pages", num);
+        return -1;
     }
 
-    /* Release page */
-    munmap(page, PAGE_SIZE);
-
-    /* Tell Xen to evict page */
-    ret = xc_mem_paging_evict(xch, paging->mem_event.domain_id, gfn);
-    if ( ret < 0 )
+    for ( i = 0; i < num; i++ )
     {
-        /* A gfn in use is indicated by EBUSY */
-        if ( errno == EBUSY )
+        /* Tell Xen to evict page */
+        ret = xc_mem_paging_evict(xch, paging->mem_event.domain_id, gfns[i]);
+        if ( ret < 0 )
         {
-                ret = 1;
-                DPRINTF("Nominated page %lx busy", gfn);
-        } else
-            PERROR("Error evicting page %lx", gfn);
-        goto out;
-    }
+            /* Release the slot */
+            paging->slot_to_gfn[slots[i]] = 0;
 
-    DPRINTF("evict_page > gfn %lx pageslot %d\n", gfn, slot);
-    /* Notify policy of page being paged out */
-    policy_notify_paged_out(gfn);
+            /* A gfn in use is indicated by EBUSY */
+            if ( errno == EBUSY )
+            {
+                DPRINTF("Nominated page %"PRI_xen_pfn" busy", gfns[i]);
+                continue;
+            }
+            PERROR("Error evicting page %"PRI_xen_pfn, gfns[i]);
+            return -1;
+        }
 
-    /* Update index */
-    paging->slot_to_gfn[slot] = gfn;
-    paging->gfn_to_slot[gfn] = slot;
+        DPRINTF("evict_page > gfn %"PRI_xen_pfn" pageslot %d\n",
+                gfns[i], slots[i]);
+        /* Notify policy of page being paged out */
+        policy_notify_paged_out(gfns[i]);
 
-    /* Record number of evicted pages */
-    paging->num_paged_out++;
+        /* Update index */
+        paging->gfn_to_slot[gfns[i]] = slots[i];
 
-    ret = 0;
+        /* Record number of evicted pages */
+        paging->num_paged_out++;
 
- out:
-    return ret;
+        if ( test_and_set_bit(gfns[i], paging->bitmap) )
+            ERROR("Page %"PRI_xen_pfn" has been evicted before", gfns[i]);
+
+        evicted++;
+    }
+
+    return evicted;
 }
 
-static int xenpaging_resume_page(struct xenpaging *paging, mem_event_response_t *rsp, int notify_policy)
+static void xenpaging_resume_page(struct xenpaging *paging, mem_event_response_t *rsp, int notify_policy)
 {
     /* Put the page info on the ring */
     put_response(&paging->mem_event, rsp);
@@ -691,52 +711,205 @@ static int xenpaging_resume_page(struct xenpaging *paging, mem_event_response_t
        /* Record number of resumed pages */
        paging->num_paged_out--;
     }
-
-    /* Tell Xen page is ready */
-    return xc_evtchn_notify(paging->mem_event.xce_handle, paging->mem_event.port);
 }
 
-static int xenpaging_populate_page(struct xenpaging *paging, unsigned long gfn, int i)
+/* Load a page read from the pagefile into the guest
+ * A failure to allocate memory for it is waited out, if wait is set
+ */
+static int xenpaging_populate_page(struct xenpaging *paging, unsigned long gfn, void *buffer, int wait)
 {
     xc_interface *xch = paging->xc_handle;
     int ret;
     unsigned char oom = 0;
 
-    DPRINTF("populate_page < gfn %lx pageslot %d\n", gfn, i);
-
-    /* Read page */
-    ret = read_page(paging->fd, paging->paging_buffer, i);
-    if ( ret != 0 )
-    {
-        PERROR("Error reading page");
-        goto out;
-    }
+    DPRINTF("populate_page < gfn %lx pageslot %d\n", gfn,
+            paging->gfn_to_slot[gfn]);
 
     do
     {
         /* Tell Xen to allocate a page for the domain */
-        ret = xc_mem_paging_load(xch, paging->mem_event.domain_id, gfn, paging->paging_buffer);
+        ret = xc_mem_paging_load(xch, paging->mem_event.domain_id, gfn, buffer);
         if ( ret < 0 )
         {
-            if ( errno == ENOMEM )
+            if ( errno == ENOMEM && wait )
             {
                 if ( oom++ == 0 )
                     DPRINTF("ENOMEM while preparing gfn %lx\n", gfn);
                 sleep(1);
                 continue;
             }
-            PERROR("Error loading %lx during page-in", gfn);
+            if ( wait )
+                PERROR("Error loading %lx during page-in", gfn);
             ret = -1;
             break;
         }
     }
     while ( ret && !interrupted );
 
-
- out:
     return ret;
 }
 
+/* Clear a pagefile slot, and record it as free */
+static void free_slot(struct xenpaging *paging, int slot)
+{
+    paging->slot_to_gfn[slot] = 0;
+    paging->free_slot_stack[paging->stack_count++] = slot;
+}
+
+/* Handle a batch of requests from the ring
+ * The pages of the batch are read from the pagefile together, along with
+ * paged-out pages following them, and the guest resumed once they are in.
+ * Returns < 0 on fatal error
+ */
+static int handle_requests(struct xenpaging *paging,
+                           mem_event_request_t *reqs, int num)
+{
+    xc_interface *xch = paging->xc_handle;
+    unsigned long gfns[XENPAGING_BATCH_SIZE], gfn;
+    int slots[XENPAGING_BATCH_SIZE];
+    unsigned char paged[XENPAGING_BATCH_SIZE];
+    mem_event_request_t *req;
+    mem_event_response_t rsp;
+    int i, slot, nr_faults, nr = 0;
+
+    /* Find the pages which have to come back from the pagefile */
+    for ( i = 0; i < num; i++ )
+    {
+        req = &reqs[i];
+
+        if ( req->gfn > paging->max_pages )
+        {
+            ERROR("Requested gfn %"PRIx64" higher than max_pages %x\n", req->gfn, paging->max_pages);
+            return -1;
+        }
+
+        /* Check if the page has already been paged in */
+        paged[i] = test_and_clear_bit(req->gfn, paging->bitmap);
+        if ( !paged[i] )
+            continue;
+
+        /* Find where in the paging file to read from */
+        slot = paging->gfn_to_slot[req->gfn];
+
+        /* Sanity check */
+        if ( paging->slot_to_gfn[slot] != req->gfn )
+        {
+            ERROR("Expected gfn %"PRIx64" in slot %d, but found gfn %lx\n", req->gfn, slot, paging->slot_to_gfn[slot]);
+            return -1;
+        }
+
+        if ( req->flags & MEM_EVENT_FLAG_DROP_PAGE )
+        {
+            DPRINTF("drop_page ^ gfn %"PRIx64" pageslot %d\n", req->gfn, slot);
+            /* Notify policy of page being dropped */
+            policy_notify_dropped(req->gfn);
+            continue;
+        }
+
+        gfns[nr] = req->gfn;
+        slots[nr] = slot;
+        nr++;
+    }
+    nr_faults = nr;
+
+    /* Prefetch the paged-out pages following the faulting ones */
+    for ( i = 0; i < nr_faults && !interrupted; i++ )
+        for ( gfn = gfns[i] + 1;
+              gfn <= gfns[i] + paging->prefetch && gfn < paging->max_pages &&
+              nr < XENPAGING_BATCH_SIZE;
+              gfn++ )
+        {
+            if ( !test_and_clear_bit(gfn, paging->bitmap) )
+                continue;
+            gfns[nr] = gfn;
+            slots[nr] = paging->gfn_to_slot[gfn];
+            nr++;
+        }
+
+    /* Read pages */
+    if ( nr && read_pages(paging->fd, paging->paging_buffer, slots, nr) < 0 )
+    {
+        PERROR("Error reading %d pages", nr);
+        return -1;
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        void *buffer = paging->paging_buffer + i * PAGE_SIZE;
+
+        if ( i < nr_faults )
+        {
+            /* Populate the page */
+            if ( xenpaging_populate_page(paging, gfns[i], buffer, 1) < 0 )
+            {
+                ERROR("Error populating page %lx", gfns[i]);
+                return -1;
+            }
+            continue;
+        }
+
+        if ( xenpaging_populate_page(paging, gfns[i], buffer, 0) < 0 )
+        {
+            /* A gfn dropped meanwhile is reported to be missing */
+            if ( errno != ENOENT )
+            {
+                /* Leave it paged out */
+                set_bit(gfns[i], paging->bitmap);
+                continue;
+            }
+            policy_notify_dropped(gfns[i]);
+        }
+        else
+            policy_notify_prefetched(gfns[i]);
+
+        /* Record number of resumed pages */
+        paging->num_paged_out--;
+
+        free_slot(paging, slots[i]);
+    }
+
+    /* Resume the guest, now that all pages are in */
+    for ( i = 0; i < num; i++ )
+    {
+        req = &reqs[i];
+
+        if ( paged[i] )
+        {
+            free_slot(paging, paging->gfn_to_slot[req->gfn]);
+        }
+        else
+        {
+            DPRINTF("page %s populated (domain = %d; vcpu = %d;"
+                    " gfn = %"PRIx64"; paused = %d; evict_fail = %d)\n",
+                    req->flags & MEM_EVENT_FLAG_EVICT_FAIL ? "not" : "already",
+                    paging->mem_event.domain_id, req->vcpu_id, req->gfn,
+                    !!(req->flags & MEM_EVENT_FLAG_VCPU_PAUSED) ,
+                    !!(req->flags & MEM_EVENT_FLAG_EVICT_FAIL) );
+
+            /* Only a paused vcpu or a failed evict needs a response */
+            if ( !(req->flags & MEM_EVENT_FLAG_VCPU_PAUSED) &&
+                 !(req->flags & MEM_EVENT_FLAG_EVICT_FAIL) )
+                continue;
+        }
+
+        /* Prepare the response */
+        rsp.gfn = req->gfn;
+        rsp.vcpu_id = req->vcpu_id;
+        rsp.flags = req->flags;
+
+        xenpaging_resume_page(paging, &rsp, paged[i]);
+    }
+
+    /* Tell Xen pages are ready */
+    if ( xc_evtchn_notify(paging->mem_event.xce_handle, paging->mem_event.port) < 0 )
+    {
+        PERROR("Error resuming pages");
+        return -1;
+    }
+
+    return 0;
+}
+
 /* Trigger a page-in for a batch of pages */
 static void resume_pages(struct xenpaging *paging, int num_pages)
 {
@@ -758,22 +931,21 @@ static void resume_pages(struct xenpaging *paging, int num_pages)
         page_in_trigger();
 }
 
-/* Evict one gfn and write it to the given slot
+/* Choose and nominate one gfn to evict
  * Returns < 0 on fatal error
- * Returns 0 on successful evict
- * Returns > 0 if no gfn can be evicted
+ * Returns 0 on successful nomination
+ * Returns > 0 if no gfn can be nominated
  */
-static int evict_victim(struct xenpaging *paging, int slot)
+static int nominate_victim(struct xenpaging *paging, unsigned long *gfn)
 {
     xc_interface *xch = paging->xc_handle;
-    unsigned long gfn;
     static int num_paged_out;
     int ret;
 
     do
     {
-        gfn = policy_choose_victim(paging);
-        if ( gfn == INVALID_MFN )
+        *gfn = policy_choose_victim(paging);
+        if ( *gfn == INVALID_MFN )
         {
             /* If the number did not change after last flush command then
              * the command did not reach qemu yet, or qemu still processes
@@ -786,29 +958,44 @@ static int evict_victim(struct xenpaging *paging, int slot)
                 xenpaging_mem_paging_flush_ioemu_cache(paging);
                 num_paged_out = paging->num_paged_out;
             }
-            ret = ENOSPC;
-            goto out;
+            return ENOSPC;
         }
 
         if ( interrupted )
-        {
-            ret = EINTR;
-            goto out;
-        }
+            return EINTR;
 
-        ret = xenpaging_evict_page(paging, gfn, slot);
+        /* Nominate page */
+        ret = xc_mem_paging_nominate(xch, paging->mem_event.domain_id, *gfn);
         if ( ret < 0 )
-            goto out;
+        {
+            /* unpageable gfn is indicated by EBUSY */
+            if ( errno != EBUSY )
+            {
+                PERROR("Error nominating page %lx", *gfn);
+                return -1;
+            }
+        }
     }
     while ( ret );
 
-    if ( test_and_set_bit(gfn, paging->bitmap) )
-        ERROR("Page %lx has been evicted before", gfn);
+    return 0;
+}
 
-    ret = 0;
+/* Find a free slot in the paging file
+ * Returns -1 if there is none
+ */
+static int get_free_slot(struct xenpaging *paging, int *scan)
+{
+    /* Reuse known free slots */
+    if ( paging->stack_count > 0 )
+        return paging->free_slot_stack[--paging->stack_count];
 
- out:
-    return ret;
+    /* Scan all slots slots for remainders */
+    for ( ; *scan < paging->max_pages; (*scan)++ )
+        if ( !paging->slot_to_gfn[*scan] )
+            return (*scan)++;
+
+    return -1;
 }
 
 /* Evict a batch of pages and write them to a free slot in the paging file
@@ -818,38 +1005,46 @@ static int evict_victim(struct xenpaging *paging, int slot)
  */
 static int evict_pages(struct xenpaging *paging, int num_pages)
 {
-    xc_interface *xch = paging->xc_handle;
-    int rc, slot, num = 0;
+    xen_pfn_t gfns[XENPAGING_BATCH_SIZE];
+    int slots[XENPAGING_BATCH_SIZE];
+    unsigned long gfn;
+    int rc = 0, n, scan = 0, num = 0;
 
-    /* Reuse known free slots */
-    while ( paging->stack_count > 0 && num < num_pages )
+    while ( !rc && num < num_pages )
     {
-        slot = paging->free_slot_stack[--paging->stack_count];
-        rc = evict_victim(paging, slot);
-        if ( rc )
+        /* Nominate a batch of victims, each with a slot to go to */
+        for ( n = 0; n < XENPAGING_BATCH_SIZE && num + n < num_pages; n++ )
         {
-            num = rc < 0 ? -1 : num;
-            return num;
-        }
-        num++;
-    }
+            slots[n] = get_free_slot(paging, &scan);
+            if ( slots[n] < 0 )
+            {
+                rc = ENOSPC;
+                break;
+            }
 
-    /* Scan all slots slots for remainders */
-    for ( slot = 0; slot < paging->max_pages && num < num_pages; slot++ )
-    {
-        /* Slot is allocated */
-        if ( paging->slot_to_gfn[slot] )
-            continue;
+            rc = nominate_victim(paging, &gfn);
+            if ( rc < 0 )
+                return -1;
+            if ( rc )
+            {
+                /* Give the slot back; it is found again by scanning */
+                break;
+            }
 
-        rc = evict_victim(paging, slot);
-        if ( rc )
-        {
-            num = rc < 0 ? -1 : num;
-            break;
+            /* Reserve the slot */
+            paging->slot_to_gfn[slots[n]] = gfn;
+            gfns[n] = gfn;
         }
 
-        num++;
+        if ( !n )
+            break;
+
+        n = xenpaging_evict_pages(paging, gfns, slots, n);
+        if ( n < 0 )
+            return -1;
+        num += n;
     }
+
     return num;
 }
 
@@ -857,10 +1052,8 @@ int main(int argc, char *argv[])
 {
     struct sigaction act;
     struct xenpaging *paging;
-    mem_event_request_t req;
-    mem_event_response_t rsp;
+    mem_event_request_t reqs[XENPAGING_BATCH_SIZE];
     int num, prev_num = 0;
-    int slot;
     int tot_pages;
     int rc;
     xc_interface *xch;
@@ -908,84 +1101,13 @@ int main(int argc, char *argv[])
             /* Indicate possible error */
             rc = 1;
 
-            get_request(&paging->mem_event, &req);
+            for ( num = 0; num < XENPAGING_BATCH_SIZE &&
+                  RING_HAS_UNCONSUMED_REQUESTS(&paging->mem_event.back_ring);
+                  num++ )
+                get_request(&paging->mem_event, &reqs[num]);
 
-            if ( req.gfn > paging->max_pages )
-            {
-                ERROR("Requested gfn %"PRIx64" higher than max_pages %lx\n", req.gfn, paging->max_pages);
+            if ( handle_requests(paging, reqs, num) < 0 )
                 goto out;
-            }
-
-            /* Check if the page has already been paged in */
-            if ( test_and_clear_bit(req.gfn, paging->bitmap) )
-            {
-                /* Find where in the paging file to read from */
-                slot = paging->gfn_to_slot[req.gfn];
-
-                /* Sanity check */
-                if ( paging->slot_to_gfn[slot] != req.gfn )
-                {
-                    ERROR("Expected gfn %"PRIx64" in slot %d, but found gfn %lx\n", req.gfn, slot, paging->slot_to_gfn[slot]);
-                    goto out;
-                }
-
-                if ( req.flags & MEM_EVENT_FLAG_DROP_PAGE )
-                {
-                    DPRINTF("drop_page ^ gfn %"PRIx64" pageslot %d\n", req.gfn, slot);
-                    /* Notify policy of page being dropped */
-                    policy_notify_dropped(req.gfn);
-                }
-                else
-                {
-                    /* Populate the page */
-                    if ( xenpaging_populate_page(paging, req.gfn, slot) < 0 )
-                    {
-                        ERROR("Error populating page %"PRIx64"", req.gfn);
-                        goto out;
-                    }
-                }
-
-                /* Prepare the response */
-                rsp.gfn = req.gfn;
-                rsp.vcpu_id = req.vcpu_id;
-                rsp.flags = req.flags;
-
-                if ( xenpaging_resume_page(paging, &rsp, 1) < 0 )
-                {
-                    PERROR("Error resuming page %"PRIx64"", req.gfn);
-                    goto out;
-                }
-
-                /* Clear this pagefile slot */
-                paging->slot_to_gfn[slot] = 0;
-
-                /* Record this free slot */
-                paging->free_slot_stack[paging->stack_count++] = slot;
-            }
-            else
-            {
-                DPRINTF("page %s populated (domain = %d; vcpu = %d;"
-                        " gfn = %"PRIx64"; paused = %d; evict_fail = %d)\n",
-                        req.flags & MEM_EVENT_FLAG_EVICT_FAIL ? "not" : "already",
-                        paging->mem_event.domain_id, req.vcpu_id, req.gfn,
-                        !!(req.flags & MEM_EVENT_FLAG_VCPU_PAUSED) ,
-                        !!(req.flags & MEM_EVENT_FLAG_EVICT_FAIL) );
-
-                /* Tell Xen to resume the vcpu */
-                if (( req.flags & MEM_EVENT_FLAG_VCPU_PAUSED ) || ( req.flags & MEM_EVENT_FLAG_EVICT_FAIL ))
-                {
-                    /* Prepare the response */
-                    rsp.gfn = req.gfn;
-                    rsp.vcpu_id = req.vcpu_id;
-                    rsp.flags = req.flags;
-
-                    if ( xenpaging_resume_page(paging, &rsp, 0) < 0 )
-                    {
-                        PERROR("Error resuming page %"PRIx64"", req.gfn);
-                        goto out;
-                    }
-                }
-            }
         }
 
         /* If interrupted, write all pages back into the guest */
@@ -30,6 +30,10 @@
 #include <xen/mem_event.h>
 
 #define XENPAGING_PAGEIN_QUEUE_SIZE 64
+/* Number of pages evicted, or paged in, with one batch of page file I/O */
+#define XENPAGING_BATCH_SIZE 64
+/* Number of gfns following a faulting one which are paged in with it */
+#define XENPAGING_PREFETCH_DEFAULT 4
 
 struct mem_event {
     domid_t domain_id;
@@ -58,6 +62,7 @@ struct xenpaging {
     int num_paged_out;
     int target_tot_pages;
     int policy_mru_size;
+    int prefetch;
     int use_poll_timeout;
     int debug;
     int stack_count;
@@ -758,6 +758,8 @@ void __init start_xen(unsigned long boot_phys_offset,
     printk("Brought up %ld CPUs\n", (long)num_online_cpus());
     /* TODO: smp_cpus_done(); */
 
+    heap_init_late();
+
     do_initcalls();
 
     /* Create initial domain 0. */
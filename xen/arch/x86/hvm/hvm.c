@@ -35,6 +35,7 @@
 #include <xen/paging.h>
 #include <xen/cpu.h>
 #include <xen/wait.h>
+#include <xen/vmap.h>
 #include <asm/shadow.h>
 #include <asm/hap.h>
 #include <asm/current.h>
@@ -330,6 +331,22 @@ void hvm_migrate_timers(struct vcpu *v)
     pt_migrate(v);
 }
 
+/*
+ * Have the machine MSI behind pirq_dpci arrive on the pcpu v runs on, so
+ * that delivering it to v takes no IPI.
+ */
+void hvm_migrate_pirq_to(struct hvm_pirq_dpci *pirq_dpci,
+                         const struct vcpu *v)
+{
+    struct irq_desc *desc = pirq_spin_lock_irq_desc(dpci_pirq(pirq_dpci), NULL);
+
+    if ( !desc )
+        return;
+    ASSERT(MSI_IRQ(desc - irq_desc));
+    irq_set_affinity(desc, cpumask_of(v->processor));
+    spin_unlock_irq(&desc->lock);
+}
+
 static int hvm_migrate_pirq(struct domain *d, struct hvm_pirq_dpci *pirq_dpci,
                             void *arg)
 {
@@ -337,16 +354,7 @@ static int hvm_migrate_pirq(struct domain *d, struct hvm_pirq_dpci *pirq_dpci,
 
     if ( (pirq_dpci->flags & HVM_IRQ_DPCI_MACH_MSI) &&
          (pirq_dpci->gmsi.dest_vcpu_id == v->vcpu_id) )
-    {
-        struct irq_desc *desc =
-            pirq_spin_lock_irq_desc(dpci_pirq(pirq_dpci), NULL);
-
-        if ( !desc )
-            return 0;
-        ASSERT(MSI_IRQ(desc - irq_desc));
-        irq_set_affinity(desc, cpumask_of(v->processor));
-        spin_unlock_irq(&desc->lock);
-    }
+        hvm_migrate_pirq_to(pirq_dpci, v);
 
     return 0;
 }
@@ -450,13 +458,11 @@ static void hvm_unmap_ioreq_page(struct hvm_ioreq_server *s, bool_t buf)
     destroy_ring_for_helper(&iorp->va, iorp->page);
 }
 
-int prepare_ring_for_helper(
-    struct domain *d, unsigned long gmfn, struct page_info **_page,
-    void **_va)
+static int get_ring_page_for_helper(
+    struct domain *d, unsigned long gmfn, struct page_info **_page)
 {
     struct page_info *page;
     p2m_type_t p2mt;
-    void *va;
 
     page = get_page_from_gfn(d, gmfn, &p2mt, P2M_UNSHARE);
     if ( p2m_is_paging(p2mt) )
@@ -481,6 +487,22 @@ int prepare_ring_for_helper(
         return -EINVAL;
     }
 
+    *_page = page;
+
+    return 0;
+}
+
+int prepare_ring_for_helper(
+    struct domain *d, unsigned long gmfn, struct page_info **_page,
+    void **_va)
+{
+    struct page_info *page;
+    void *va;
+    int rc;
+
+    if ( (rc = get_ring_page_for_helper(d, gmfn, &page)) )
+        return rc;
+
     va = __map_domain_page_global(page);
     if ( va == NULL )
     {
@@ -494,6 +516,61 @@ int prepare_ring_for_helper(
     return 0;
 }
 
+void destroy_ring_frames_for_helper(
+    void **_va, struct page_info **pages, unsigned int nr)
+{
+    void *va = *_va;
+    unsigned int i;
+
+    if ( nr == 1 )
+        destroy_ring_for_helper(_va, pages[0]);
+    else if ( va != NULL )
+    {
+        vunmap(va);
+        for ( i = 0; i < nr; i++ )
+            put_page_and_type(pages[i]);
+        *_va = NULL;
+    }
+}
+
+/* As prepare_ring_for_helper(), for a ring of nr consecutive gmfns. */
+int prepare_ring_frames_for_helper(
+    struct domain *d, unsigned long gmfn, unsigned int nr,
+    struct page_info **pages, void **_va)
+{
+    unsigned long *mfns;
+    unsigned int i;
+    void *va;
+    int rc = 0;
+
+    if ( nr == 1 )
+        return prepare_ring_for_helper(d, gmfn, &pages[0], _va);
+
+    mfns = xmalloc_array(unsigned long, nr);
+    if ( mfns == NULL )
+        return -ENOMEM;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( (rc = get_ring_page_for_helper(d, gmfn + i, &pages[i])) )
+            break;
+        mfns[i] = page_to_mfn(pages[i]);
+    }
+
+    va = rc ? NULL : vmap(mfns, nr);
+    xfree(mfns);
+    if ( va == NULL )
+    {
+        while ( i-- )
+            put_page_and_type(pages[i]);
+        return rc ?: -ENOMEM;
+    }
+
+    *_va = va;
+
+    return 0;
+}
+
 static int hvm_map_ioreq_page(
     struct hvm_ioreq_server *s, bool_t buf, unsigned long gmfn)
 {
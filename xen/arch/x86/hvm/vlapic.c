@@ -363,12 +363,18 @@ struct vlapic *vlapic_lowest_prio(
     if ( unlikely(!d->vcpu) || unlikely((v = d->vcpu[old]) == NULL) )
         return NULL;
 
+    /*
+     * Among the destinations with the lowest priority, device interrupts
+     * (no source) go to the one running on this pcpu, if any: this needs
+     * no IPI, and is where the physical interrupt arrived.
+     */
     do {
         v = v->next_in_list ? : d->vcpu[0];
         vlapic = vcpu_vlapic(v);
         if ( vlapic_match_dest(vlapic, source, short_hand, dest, dest_mode) &&
              vlapic_enabled(vlapic) &&
-             ((ppr = vlapic_get_ppr(vlapic)) < target_ppr) )
+             (((ppr = vlapic_get_ppr(vlapic)) < target_ppr) ||
+              (ppr == target_ppr && !source && v == current)) )
         {
             target = vlapic;
             target_ppr = ppr;
@@ -33,6 +33,7 @@
 #include <xen/errno.h>
 #include <xen/sched.h>
 #include <xen/irq.h>
+#include <xen/perfc.h>
 #include <public/hvm/ioreq.h>
 #include <asm/hvm/io.h>
 #include <asm/hvm/vpic.h>
@@ -65,27 +66,35 @@ static void vmsi_inj_irq(
     }
 }
 
+/* Returns the vlapic the interrupt went to, or NULL if none. */
+static struct vlapic *vmsi_deliver_lowest_prio(
+    struct domain *d, int vector,
+    uint8_t dest, uint8_t dest_mode, uint8_t trig_mode)
+{
+    struct vlapic *target = vlapic_lowest_prio(d, NULL, 0, dest, dest_mode);
+
+    if ( target != NULL )
+        vmsi_inj_irq(d, target, vector, trig_mode, dest_LowestPrio);
+    else
+        HVM_DBG_LOG(DBG_LEVEL_IOAPIC, "null round robin: "
+                    "vector=%x delivery_mode=%x\n",
+                    vector, dest_LowestPrio);
+
+    return target;
+}
+
 int vmsi_deliver(
     struct domain *d, int vector,
     uint8_t dest, uint8_t dest_mode,
     uint8_t delivery_mode, uint8_t trig_mode)
 {
-    struct vlapic *target;
     struct vcpu *v;
 
     switch ( delivery_mode )
     {
     case dest_LowestPrio:
-    {
-        target = vlapic_lowest_prio(d, NULL, 0, dest, dest_mode);
-        if ( target != NULL )
-            vmsi_inj_irq(d, target, vector, trig_mode, delivery_mode);
-        else
-            HVM_DBG_LOG(DBG_LEVEL_IOAPIC, "null round robin: "
-                        "vector=%x delivery_mode=%x\n",
-                        vector, dest_LowestPrio);
+        vmsi_deliver_lowest_prio(d, vector, dest, dest_mode, trig_mode);
         break;
-    }
 
     case dest_Fixed:
     case dest_ExtINT:
@@ -110,7 +119,7 @@ int vmsi_deliver(
     return 1;
 }
 
-void vmsi_deliver_pirq(struct domain *d, const struct hvm_pirq_dpci *pirq_dpci)
+void vmsi_deliver_pirq(struct domain *d, struct hvm_pirq_dpci *pirq_dpci)
 {
     uint32_t flags = pirq_dpci->gmsi.gflags;
     int vector = pirq_dpci->gmsi.gvec;
@@ -127,6 +136,46 @@ void vmsi_deliver_pirq(struct domain *d, const struct hvm_pirq_dpci *pirq_dpci)
 
     ASSERT(pirq_dpci->flags & HVM_IRQ_DPCI_GUEST_MSI);
 
+    /*
+     * With several possible destinations, a lowest priority interrupt goes
+     * wherever the arbitration sends it. If that is a vcpu running on
+     * another pcpu, have the machine interrupt follow it there, so that
+     * the next ones find it running locally. Single destination interrupts
+     * follow their vcpu already, see hvm_migrate_pirqs().
+     */
+    if ( delivery_mode == dest_LowestPrio && pirq_dpci->gmsi.dest_vcpu_id < 0 )
+    {
+        struct vlapic *target =
+            vmsi_deliver_lowest_prio(d, vector, dest, dest_mode, trig_mode);
+        struct vcpu *v;
+
+        if ( target == NULL )
+            return;
+
+        v = vlapic_vcpu(target);
+        if ( v->processor == smp_processor_id() )
+            perfc_incr(dpci_msi_local);
+        else
+        {
+            perfc_incr(dpci_msi_remote);
+            if ( v->is_running && (pirq_dpci->flags & HVM_IRQ_DPCI_MACH_MSI) )
+            {
+                perfc_incr(dpci_msi_follow);
+                hvm_migrate_pirq_to(pirq_dpci, v);
+            }
+        }
+        return;
+    }
+
+    if ( pirq_dpci->gmsi.dest_vcpu_id >= 0 )
+    {
+        if ( d->vcpu[pirq_dpci->gmsi.dest_vcpu_id]->processor ==
+             smp_processor_id() )
+            perfc_incr(dpci_msi_local);
+        else
+            perfc_incr(dpci_msi_remote);
+    }
+
     vmsi_deliver(d, vector, dest, dest_mode, delivery_mode, trig_mode);
 }
 
@@ -116,6 +116,18 @@ static int vmx_vcpu_initialise(struct vcpu *v)
         return rc;
     }
 
+    /*
+     * A vcpu may be added to a domain already in log-dirty mode, in which
+     * case it has to log its writes like the others.
+     */
+    if ( vmx_domain_pml_enabled(v->domain) &&
+         (rc = vmx_vcpu_enable_pml(v)) != 0 )
+    {
+        dprintk(XENLOG_ERR, "%pv: Failed to enable PML.\n", v);
+        vmx_destroy_vmcs(v);
+        return rc;
+    }
+
     vpmu_initialise(v);
 
     vmx_install_vlapic_mapping(v);
@@ -129,6 +141,7 @@ static int vmx_vcpu_initialise(struct vcpu *v)
 
 static void vmx_vcpu_destroy(struct vcpu *v)
 {
+    vmx_vcpu_disable_pml(v);
     vmx_destroy_vmcs(v);
     vpmu_destroy(v);
     passive_domain_destroy(v);
@@ -3072,6 +3085,10 @@ void vmx_vmexit_handler(struct cpu_user_regs *regs)
             hvm_inject_hw_exception(TRAP_gp_fault, 0);
         break;
 
+    case EXIT_REASON_PML_FULL:
+        vmx_vcpu_flush_pml_buffer(v);
+        break;
+
     case EXIT_REASON_ACCESS_GDTR_OR_IDTR:
     case EXIT_REASON_ACCESS_LDTR_OR_TR:
     case EXIT_REASON_VMX_PREEMPTION_TIMER_EXPIRED:
@@ -324,6 +324,41 @@ void vcpu_destroy_fpu(struct vcpu *v)
         xfree(v->arch.fpu_ctxt);
 }
 
+/*******************************/
+/*   Xen's Own Vector Use      */
+/*******************************/
+/*
+ * Check whether a page is all zeroes, with AVX2 if the CPU has it and the
+ * current XCR0 enables YMM but not ZMM state, otherwise with SSE2.  The
+ * scans preserve the registers they use, whoever's they are: VEX-encoded
+ * writes would zero the upper halves of the ZMM registers, which only 256
+ * bits are saved of, whereas legacy SSE leaves them alone.  CR0.TS may be
+ * set (lazily switched state, or a PV guest's own setting) and is cleared
+ * around them.
+ */
+bool_t page_is_zero(const void *p)
+{
+    unsigned long cr0 = read_cr0();
+    bool_t rc;
+
+    if ( cr0 & X86_CR0_TS )
+        clts();
+
+#ifdef HAVE_GAS_AVX2
+    if ( cpu_has_avx2 &&
+         (get_xcr0() & (XSTATE_YMM | XSTATE_ZMM | XSTATE_HI_ZMM)) ==
+         XSTATE_YMM )
+        rc = page_is_zero_avx2(p);
+    else
+#endif
+        rc = page_is_zero_sse2(p);
+
+    if ( cr0 & X86_CR0_TS )
+        stts();
+
+    return rc;
+}
+
 /*
  * Local variables:
  * mode: C
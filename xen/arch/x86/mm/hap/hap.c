@@ -194,6 +194,12 @@ static int hap_enable_log_dirty(struct domain *d, bool_t log_global)
 
     if ( log_global )
     {
+        /*
+         * Have the hardware log writes to clean pages, if it can.  Not for
+         * VRAM tracking, which never turns log-dirty mode off again.
+         */
+        p2m_enable_hardware_log_dirty(d);
+
         /* set l1e entries of P2M table to be read-only. */
         p2m_change_entry_type_global(d, p2m_ram_rw, p2m_ram_logdirty);
         flush_tlb_mask(d->domain_dirty_cpumask);
@@ -207,8 +213,14 @@ static int hap_disable_log_dirty(struct domain *d)
     d->arch.paging.mode &= ~PG_log_dirty;
     paging_unlock(d);
 
+    p2m_disable_hardware_log_dirty(d);
+
     /* set l1e entries of P2M table with normal mode */
     p2m_change_entry_type_global(d, p2m_ram_logdirty, p2m_ram_rw);
+
+    /* Undo the splitting of superpages by write faults. */
+    p2m_coalesce_superpages(d);
+
     return 0;
 }
 
@@ -733,7 +745,18 @@ hap_write_p2m_entry(struct domain *d, unsigned long gfn, l1_pgentry_t *p,
 
     safe_write_pte(p, new);
     if ( old_flags & _PAGE_PRESENT )
-        flush_tlb_mask(d->domain_dirty_cpumask);
+    {
+        struct p2m_domain *p2m = p2m_get_hostp2m(d);
+
+        /* Within a batch of updates, flush once at its end. */
+        if ( p2m->defer_flush )
+        {
+            p2m->need_flush = 1;
+            perfc_incr(p2m_flushes_deferred);
+        }
+        else
+            flush_tlb_mask(d->domain_dirty_cpumask);
+    }
 
     paging_unlock(d);
 
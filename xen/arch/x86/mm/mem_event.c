@@ -50,6 +50,7 @@ static int mem_event_enable(
 {
     int rc;
     unsigned long ring_gfn = d->arch.hvm_domain.params[param];
+    unsigned int nr_frames = mec->nr_frames ?: 1;
 
     /* Only one helper at a time. If the helper crashed,
      * the ring is in an undefined state and so is the guest.
@@ -62,17 +63,42 @@ static int mem_event_enable(
     if ( ring_gfn == 0 )
         return -ENOSYS;
 
+    if ( nr_frames > MEM_EVENT_RING_MAX_FRAMES )
+        return -EINVAL;
+
     mem_event_ring_lock_init(med);
     mem_event_ring_lock(med);
 
-    rc = prepare_ring_for_helper(d, ring_gfn, &med->ring_pg_struct, 
-                                    &med->ring_page);
+    med->nr_frames = nr_frames;
+    rc = prepare_ring_frames_for_helper(d, ring_gfn, nr_frames,
+                                        med->ring_pg_struct, &med->ring_page);
     if ( rc < 0 )
         goto err;
 
     /* Set the number of currently blocked vCPUs to 0. */
     med->blocked = 0;
 
+    /* Prepare ring buffer */
+    FRONT_RING_INIT(&med->front_ring,
+                    (mem_event_sring_t *)med->ring_page,
+                    nr_frames * PAGE_SIZE);
+
+    /*
+     * Give each vCPU a slot of its own if the ring has room for that and
+     * as many again for everyone else.  A single page keeps the shared
+     * claims it has always had.
+     */
+    if ( nr_frames > 1 &&
+         RING_SIZE(&med->front_ring) >= 2 * d->max_vcpus )
+    {
+        rc = -ENOMEM;
+        med->vcpu_claims = xzalloc_array(unsigned long,
+                                         BITS_TO_LONGS(d->max_vcpus));
+        if ( med->vcpu_claims == NULL )
+            goto err;
+        med->vcpu_slots = 1;
+    }
+
     /* Allocate event channel */
     rc = alloc_unbound_xen_event_channel(d->vcpu[0],
                                          current->domain->domain_id,
@@ -82,11 +108,6 @@ static int mem_event_enable(
 
     med->xen_port = mec->port = rc;
 
-    /* Prepare ring buffer */
-    FRONT_RING_INIT(&med->front_ring,
-                    (mem_event_sring_t *)med->ring_page,
-                    PAGE_SIZE);
-
     /* Save the pause flag for this particular ring. */
     med->pause_flag = pause_flag;
 
@@ -97,8 +118,11 @@ static int mem_event_enable(
     return 0;
 
  err:
-    destroy_ring_for_helper(&med->ring_page, 
-                            med->ring_pg_struct);
+    med->vcpu_slots = 0;
+    xfree(med->vcpu_claims);
+    med->vcpu_claims = NULL;
+    destroy_ring_frames_for_helper(&med->ring_page, med->ring_pg_struct,
+                                   med->nr_frames);
     mem_event_ring_unlock(med);
 
     return rc;
@@ -115,6 +139,23 @@ static unsigned int mem_event_ring_available(struct mem_event_domain *med)
     return avail_req;
 }
 
+/*
+ * The free slots a claim may take.  With per-vCPU slots, one is kept back
+ * for each vCPU not blocked on the ring, which it takes without claiming:
+ * see mem_event_claim_own_slot().
+ */
+static unsigned int mem_event_ring_claimable(struct domain *d,
+                                             struct mem_event_domain *med)
+{
+    unsigned int avail_req = mem_event_ring_available(med);
+    unsigned int reserved = 0;
+
+    if ( med->vcpu_slots )
+        reserved = d->max_vcpus - med->blocked;
+
+    return avail_req > reserved ? avail_req - reserved : 0;
+}
+
 /*
  * mem_event_wake_blocked() will wakeup vcpus waiting for room in the
  * ring. These vCPUs were paused on their way out after placing an event,
@@ -178,7 +219,7 @@ static void mem_event_wake_blocked(struct domain *d, struct mem_event_domain *me
  */
 static void mem_event_wake_queued(struct domain *d, struct mem_event_domain *med)
 {
-    unsigned int avail_req = mem_event_ring_available(med);
+    unsigned int avail_req = mem_event_ring_claimable(d, med);
 
     if ( avail_req > 0 )
         wake_up_nr(&med->wq, avail_req);
@@ -204,12 +245,22 @@ static int mem_event_disable(struct domain *d, struct mem_event_domain *med)
     if ( med->ring_page )
     {
         struct vcpu *v;
+        bool_t paused = med->vcpu_slots;
+
+        /*
+         * vCPUs take their own slots without the ring lock: let any which
+         * are between claiming one and using it get out first.
+         */
+        if ( paused )
+            domain_pause(d);
 
         mem_event_ring_lock(med);
 
         if ( !list_empty(&med->wq.list) )
         {
             mem_event_ring_unlock(med);
+            if ( paused )
+                domain_unpause(d);
             return -EBUSY;
         }
 
@@ -226,9 +277,15 @@ static int mem_event_disable(struct domain *d, struct mem_event_domain *med)
             }
         }
 
-        destroy_ring_for_helper(&med->ring_page, 
-                                med->ring_pg_struct);
+        destroy_ring_frames_for_helper(&med->ring_page, med->ring_pg_struct,
+                                       med->nr_frames);
+        med->vcpu_slots = 0;
+        xfree(med->vcpu_claims);
+        med->vcpu_claims = NULL;
         mem_event_ring_unlock(med);
+
+        if ( paused )
+            domain_unpause(d);
     }
 
     return 0;
@@ -239,7 +296,13 @@ static inline void mem_event_release_slot(struct domain *d,
 {
     /* Update the accounting */
     if ( current->domain == d )
+    {
+        /* A vCPU's own slot stays kept back for it. */
+        if ( med->vcpu_slots &&
+             test_and_clear_bit(current->vcpu_id, med->vcpu_claims) )
+            return;
         med->target_producers--;
+    }
     else
         med->foreign_producers--;
 
@@ -312,37 +375,48 @@ void mem_event_put_request(struct domain *d,
     notify_via_xen_event_channel(d, med->xen_port);
 }
 
-int mem_event_get_response(struct domain *d, struct mem_event_domain *med, mem_event_response_t *rsp)
+/*
+ * Copy up to nr responses off the ring, under one acquisition of the ring
+ * lock, and kick any waiters once for the lot.  Returns the number copied.
+ */
+unsigned int mem_event_get_response(struct domain *d,
+                                    struct mem_event_domain *med,
+                                    mem_event_response_t *rsp,
+                                    unsigned int nr)
 {
     mem_event_front_ring_t *front_ring;
     RING_IDX rsp_cons;
+    unsigned int i;
 
     mem_event_ring_lock(med);
 
     front_ring = &med->front_ring;
     rsp_cons = front_ring->rsp_cons;
 
-    if ( !RING_HAS_UNCONSUMED_RESPONSES(front_ring) )
+    /* Copy responses */
+    for ( i = 0; i < nr && RING_HAS_UNCONSUMED_RESPONSES(front_ring); i++ )
+    {
+        memcpy(&rsp[i], RING_GET_RESPONSE(front_ring, rsp_cons),
+               sizeof(*rsp));
+        front_ring->rsp_cons = ++rsp_cons;
+    }
+
+    if ( i == 0 )
     {
         mem_event_ring_unlock(med);
         return 0;
     }
 
-    /* Copy response */
-    memcpy(rsp, RING_GET_RESPONSE(front_ring, rsp_cons), sizeof(*rsp));
-    rsp_cons++;
-
     /* Update ring */
-    front_ring->rsp_cons = rsp_cons;
     front_ring->sring->rsp_event = rsp_cons + 1;
 
-    /* Kick any waiters -- since we've just consumed an event,
+    /* Kick any waiters -- since we've just consumed events,
      * there may be additional space available in the ring. */
     mem_event_wake(d, med);
 
     mem_event_ring_unlock(med);
 
-    return 1;
+    return i;
 }
 
 void mem_event_cancel_slot(struct domain *d, struct mem_event_domain *med)
@@ -352,7 +426,8 @@ void mem_event_cancel_slot(struct domain *d, struct mem_event_domain *med)
     mem_event_ring_unlock(med);
 }
 
-static int mem_event_grab_slot(struct mem_event_domain *med, int foreign)
+static int mem_event_grab_slot(struct domain *d, struct mem_event_domain *med,
+                               int foreign)
 {
     unsigned int avail_req;
 
@@ -361,7 +436,7 @@ static int mem_event_grab_slot(struct mem_event_domain *med, int foreign)
 
     mem_event_ring_lock(med);
 
-    avail_req = mem_event_ring_available(med);
+    avail_req = mem_event_ring_claimable(d, med);
     if ( avail_req == 0 )
     {
         mem_event_ring_unlock(med);
@@ -379,20 +454,39 @@ static int mem_event_grab_slot(struct mem_event_domain *med, int foreign)
 }
 
 /* Simple try_grab wrapper for use in the wait_event() macro. */
-static int mem_event_wait_try_grab(struct mem_event_domain *med, int *rc)
+static int mem_event_wait_try_grab(struct domain *d,
+                                   struct mem_event_domain *med, int *rc)
 {
-    *rc = mem_event_grab_slot(med, 0);
+    *rc = mem_event_grab_slot(d, med, 0);
     return *rc;
 }
 
 /* Call mem_event_grab_slot() until the ring doesn't exist, or is available. */
-static int mem_event_wait_slot(struct mem_event_domain *med)
+static int mem_event_wait_slot(struct domain *d, struct mem_event_domain *med)
 {
     int rc = -EBUSY;
-    wait_event(med->wq, mem_event_wait_try_grab(med, &rc) != -EBUSY);
+    wait_event(med->wq, mem_event_wait_try_grab(d, med, &rc) != -EBUSY);
     return rc;
 }
 
+/*
+ * With per-vCPU slots, a guest vCPU which is not blocked on the ring has
+ * one kept back for it (see mem_event_wake_blocked() and the black eye in
+ * mem_event_put_request()), and takes it without the ring lock.  A vCPU
+ * already blocked, e.g. one placing several requests in one hypercall,
+ * claims like everyone else.
+ */
+static bool_t mem_event_claim_own_slot(struct domain *d,
+                                       struct mem_event_domain *med)
+{
+    struct vcpu *curr = current;
+
+    if ( !med->vcpu_slots || test_bit(med->pause_flag, &curr->pause_flags) )
+        return 0;
+
+    return !test_and_set_bit(curr->vcpu_id, med->vcpu_claims);
+}
+
 bool_t mem_event_check_ring(struct mem_event_domain *med)
 {
     return (med->ring_page != NULL);
@@ -413,10 +507,12 @@ bool_t mem_event_check_ring(struct mem_event_domain *med)
 int __mem_event_claim_slot(struct domain *d, struct mem_event_domain *med,
                             bool_t allow_sleep)
 {
+    if ( (current->domain == d) && mem_event_claim_own_slot(d, med) )
+        return 0;
     if ( (current->domain == d) && allow_sleep )
-        return mem_event_wait_slot(med);
+        return mem_event_wait_slot(d, med);
     else
-        return mem_event_grab_slot(med, (current->domain != d));
+        return mem_event_grab_slot(d, med, (current->domain != d));
 }
 
 /* Registered with Xen-bound event channel for incoming notifications. */
@@ -53,6 +53,10 @@ int mem_paging_memop(struct domain *d, xen_mem_event_op_t *mec)
     }
     break;
 
+    case XENMEM_paging_op_scan_accessed:
+        return p2m_mem_paging_scan_accessed(d, mec->gfn, mec->nr,
+                                            mec->buffer);
+
     default:
         return -ENOSYS;
         break;
@@ -26,6 +26,7 @@
 #include <xen/spinlock.h>
 #include <xen/mm.h>
 #include <xen/grant_table.h>
+#include <xen/guest_access.h>
 #include <xen/sched.h>
 #include <asm/page.h>
 #include <asm/string.h>
@@ -591,16 +592,21 @@ unsigned int mem_sharing_get_nr_shared_mfns(void)
 
 int mem_sharing_sharing_resume(struct domain *d)
 {
-    mem_event_response_t rsp;
+    mem_event_response_t rsp[MEM_EVENT_RESPONSE_BATCH];
+    unsigned int i, nr;
 
     /* Get all requests off the ring */
-    while ( mem_event_get_response(d, &d->mem_event->share, &rsp) )
+    while ( (nr = mem_event_get_response(d, &d->mem_event->share, rsp,
+                                         ARRAY_SIZE(rsp))) )
     {
-        if ( rsp.flags & MEM_EVENT_FLAG_DUMMY )
-            continue;
-        /* Unpause domain/vcpu */
-        if ( rsp.flags & MEM_EVENT_FLAG_VCPU_PAUSED )
-            vcpu_unpause(d->vcpu[rsp.vcpu_id]);
+        for ( i = 0; i < nr; i++ )
+        {
+            if ( rsp[i].flags & MEM_EVENT_FLAG_DUMMY )
+                continue;
+            /* Unpause domain/vcpu */
+            if ( rsp[i].flags & MEM_EVENT_FLAG_VCPU_PAUSED )
+                vcpu_unpause(d->vcpu[rsp[i].vcpu_id]);
+        }
     }
 
     return 0;
@@ -1308,6 +1314,101 @@ int relinquish_shared_pages(struct domain *d)
     return rc;
 }
 
+/* Batched ops check for preemption every so many pages. */
+#define SHARING_BATCH_PREEMPT   64
+
+static int nominate_range(struct domain *d, struct mem_sharing_op_range *r)
+{
+    shr_handle_t handle;
+    unsigned int start = r->done;
+
+    if ( r->done > r->nr )
+        return -EINVAL;
+
+    for ( ; r->done < r->nr; r->done++ )
+    {
+        if ( (r->done != start) && !(r->done % SHARING_BATCH_PREEMPT) &&
+             hypercall_preempt_check() )
+            return -ERESTART;
+
+        if ( mem_sharing_nominate_page(d, r->first_gfn + r->done, 0,
+                                       &handle) )
+            handle = 0;
+        if ( copy_to_guest_offset(r->handles, r->done, &handle, 1) )
+            return -EFAULT;
+    }
+
+    return 0;
+}
+
+static int share_batch(struct domain *d, struct mem_sharing_op_batch *b)
+{
+    xen_mem_sharing_batch_entry_t e;
+    struct domain *cd = NULL;
+    unsigned int start = b->done;
+    int rc = 0;
+
+    if ( b->done > b->nr )
+        return -EINVAL;
+
+    for ( ; b->done < b->nr; b->done++ )
+    {
+        if ( (b->done != start) && !(b->done % SHARING_BATCH_PREEMPT) &&
+             hypercall_preempt_check() )
+        {
+            rc = -ERESTART;
+            break;
+        }
+
+        if ( copy_from_guest_offset(&e, b->entries, b->done, 1) )
+        {
+            rc = -EFAULT;
+            break;
+        }
+
+        /* Consecutive entries usually have the same client. */
+        if ( (cd != NULL) && (cd->domain_id != e.client_domain) )
+        {
+            rcu_unlock_domain(cd);
+            cd = NULL;
+        }
+        e.rc = 0;
+        if ( cd == NULL )
+        {
+            e.rc = rcu_lock_live_remote_domain_by_id(e.client_domain, &cd);
+            if ( !e.rc )
+            {
+                e.rc = xsm_mem_sharing_op(XSM_DM_PRIV, d, cd,
+                                          XENMEM_sharing_op_share_batch);
+                if ( e.rc )
+                    rcu_unlock_domain(cd);
+            }
+            if ( e.rc )
+                cd = NULL;
+        }
+
+        /* Grant references are not accepted in batches. */
+        if ( !e.rc && (!mem_sharing_enabled(cd) || e.pad ||
+                       XENMEM_SHARING_OP_FIELD_IS_GREF(e.source_gfn) ||
+                       XENMEM_SHARING_OP_FIELD_IS_GREF(e.client_gfn)) )
+            e.rc = -EINVAL;
+        if ( !e.rc )
+            e.rc = mem_sharing_share_pages(d, e.source_gfn, e.source_handle,
+                                           cd, e.client_gfn, e.client_handle);
+
+        if ( copy_to_guest_offset(b->entries, b->done, &e, 1) )
+        {
+            rc = -EFAULT;
+            break;
+        }
+    }
+
+    if ( cd != NULL )
+        rcu_unlock_domain(cd);
+
+    return rc;
+}
+
 int mem_sharing_memop(struct domain *d, xen_mem_sharing_op_t *mec)
 {
     int rc = 0;
@@ -1460,6 +1561,22 @@ int mem_sharing_memop(struct domain *d, xen_mem_sharing_op_t *mec)
         }
         break;
 
+        case XENMEM_sharing_op_nominate_range:
+        {
+            if ( !mem_sharing_enabled(d) )
+                return -EINVAL;
+            rc = nominate_range(d, &mec->u.range);
+        }
+        break;
+
+        case XENMEM_sharing_op_share_batch:
+        {
+            if ( !mem_sharing_enabled(d) )
+                return -EINVAL;
+            rc = share_batch(d, &mec->u.batch);
+        }
+        break;
+
         case XENMEM_sharing_op_debug_gfn:
         {
             unsigned long gfn = mec->u.debug.u.gfn;
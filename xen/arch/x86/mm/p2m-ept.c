@@ -29,6 +29,7 @@
 #include <xen/iommu.h>
 #include <asm/mtrr.h>
 #include <asm/hvm/cacheattr.h>
+#include <asm/hvm/nestedhvm.h>
 #include <xen/keyhandler.h>
 #include <xen/softirq.h>
 
@@ -46,7 +47,8 @@ static inline bool_t is_epte_valid(ept_entry_t *e)
     return (e->epte != 0 && e->sa_p2mt != p2m_invalid);
 }
 
-static void ept_p2m_type_to_flags(ept_entry_t *entry, p2m_type_t type, p2m_access_t access)
+static void ept_p2m_type_to_flags(struct p2m_domain *p2m, ept_entry_t *entry,
+                                  p2m_type_t type, p2m_access_t access)
 {
     /* First apply type permissions */
     switch(type)
@@ -69,6 +71,15 @@ static void ept_p2m_type_to_flags(ept_entry_t *entry, p2m_type_t type, p2m_acces
                                                     entry->mfn);
             break;
         case p2m_ram_logdirty:
+            entry->r = entry->x = 1;
+            /*
+             * With PML, 4k pages stay writable, and the CPU logs the first
+             * write to each.  Superpages are still write-protected, so that
+             * the fault splits them.
+             */
+            entry->w = vmx_domain_pml_enabled(p2m->domain) &&
+                       !is_epte_superpage(entry);
+            break;
         case p2m_ram_ro:
         case p2m_ram_shared:
             entry->r = entry->x = 1;
@@ -115,7 +126,16 @@ static void ept_p2m_type_to_flags(ept_entry_t *entry, p2m_type_t type, p2m_acces
         case p2m_access_rwx:
             break;
     }
-    
+
+    /*
+     * With A/D bits enabled, set them up front so that the CPU needn't,
+     * leaving the dirty bit clear only where writes are to be logged.
+     */
+    if ( p2m->ept.ad )
+    {
+        entry->a = 1;
+        entry->d = !(type == p2m_ram_logdirty && entry->w);
+    }
 }
 
 #define GUEST_TABLE_MAP_FAILED  0
@@ -187,10 +207,9 @@ static int ept_split_super_page(struct p2m_domain *p2m, ept_entry_t *ept_entry,
         epte->sp = (level > 1);
         epte->mfn += i * trunk;
         epte->snp = (iommu_enabled && iommu_snoop);
-        ASSERT(!epte->rsvd1);
         ASSERT(!epte->avail3);
 
-        ept_p2m_type_to_flags(epte, epte->sa_p2mt, epte->access);
+        ept_p2m_type_to_flags(p2m, epte, epte->sa_p2mt, epte->access);
 
         if ( (level - 1) == target )
             continue;
@@ -428,7 +447,7 @@ static int resolve_misconfig(struct p2m_domain *p2m, unsigned long gfn)
                     {
                          e.sa_p2mt = p2m_is_logdirty_range(p2m, gfn + i, gfn + i)
                                      ? p2m_ram_logdirty : p2m_ram_rw;
-                         ept_p2m_type_to_flags(&e, e.sa_p2mt, e.access);
+                         ept_p2m_type_to_flags(p2m, &e, e.sa_p2mt, e.access);
                     }
                     e.recalc = 0;
                     atomic_write_ept_entry(&epte[i], e);
@@ -478,7 +497,7 @@ static int resolve_misconfig(struct p2m_domain *p2m, unsigned long gfn)
                 e.ipat = ipat;
                 e.recalc = 0;
                 if ( recalc && p2m_is_changeable(e.sa_p2mt) )
-                    ept_p2m_type_to_flags(&e, e.sa_p2mt, e.access);
+                    ept_p2m_type_to_flags(p2m, &e, e.sa_p2mt, e.access);
                 atomic_write_ept_entry(&epte[i], e);
             }
 
@@ -536,6 +555,153 @@ bool_t ept_handle_misconfig(uint64_t gpa)
     return spurious ? (rc >= 0) : (rc > 0);
 }
 
+/*
+ * Check whether the level-@level table referenced by *@ept_entry, for the
+ * range starting at @gfn, maps contiguous and suitably aligned RAM with
+ * identical attributes throughout, and if so replace it with a superpage.
+ * The table page is returned in *@freed, to be freed by the caller once
+ * the change has been flushed.
+ */
+static bool_t ept_coalesce_entry(struct p2m_domain *p2m,
+                                 ept_entry_t *ept_entry, unsigned int level,
+                                 unsigned long gfn, struct page_info **freed)
+{
+    ept_entry_t *table, first, e, new_entry;
+    unsigned int i, child_order = (level - 1) * EPT_TABLE_ORDER;
+    uint8_t ipat = 0;
+    bool_t ok = 0;
+    int emt;
+
+    if ( !is_epte_present(ept_entry) || is_epte_superpage(ept_entry) ||
+         ept_entry->emt == MTRR_NUM_TYPES || ept_entry->recalc )
+        return 0;
+
+    table = map_domain_page(ept_entry->mfn);
+
+    first = atomic_read_ept_entry(&table[0]);
+    if ( first.sa_p2mt != p2m_ram_rw || !is_epte_present(&first) ||
+         first.emt == MTRR_NUM_TYPES || first.recalc ||
+         (level > 1 && !is_epte_superpage(&first)) ||
+         (first.mfn & ((1UL << (level * EPT_TABLE_ORDER)) - 1)) )
+        goto out;
+
+    /* Cheaply rule out a region still being filled in, in order. */
+    e = atomic_read_ept_entry(&table[EPT_PAGETABLE_ENTRIES - 1]);
+    if ( e.mfn != first.mfn + ((EPT_PAGETABLE_ENTRIES - 1UL) << child_order) )
+        goto out;
+
+    /* Leave out the bits the CPU sets, and the frame number. */
+    first.a = first.d = 0;
+    for ( i = 1; i < EPT_PAGETABLE_ENTRIES; i++ )
+    {
+        e = atomic_read_ept_entry(&table[i]);
+        if ( e.mfn != first.mfn + ((unsigned long)i << child_order) )
+            goto out;
+        e.a = e.d = 0;
+        e.mfn = first.mfn;
+        if ( e.epte != first.epte )
+            goto out;
+    }
+
+    /* The memory type has to be uniform across the superpage too. */
+    emt = epte_get_entry_emt(p2m->domain, gfn, _mfn(first.mfn),
+                             level * EPT_TABLE_ORDER, &ipat, 0);
+    if ( emt != first.emt || ipat != first.ipat )
+        goto out;
+
+    new_entry = first;
+    new_entry.sp = 1;
+    ept_p2m_type_to_flags(p2m, &new_entry, p2m_ram_rw, new_entry.access);
+
+    *freed = mfn_to_page(ept_entry->mfn);
+    atomic_write_ept_entry(ept_entry, new_entry);
+    ok = 1;
+
+ out:
+    unmap_domain_page(table);
+    return ok;
+}
+
+/*
+ * Try to promote the 2M region of the host p2m containing @gfn back to a
+ * superpage, and then, if that succeeded or @try_1g is set, its 1G region.
+ */
+static void ept_coalesce_gfn(struct p2m_domain *p2m, unsigned long gfn,
+                             bool_t try_1g)
+{
+    struct domain *d = p2m->domain;
+    struct page_info *freed[2];
+    ept_entry_t *table, *l1t, *ept_entry;
+    unsigned int i, nr = 0;
+
+    /*
+     * Tables shared with the IOMMU would need its TLBs flushing too.  Only
+     * global log-dirty mode stops all coalescing: VRAM tracking just keeps
+     * it out of the regions it tracks.
+     */
+    if ( !hvm_hap_has_2mb(d) || !opt_hap_2mb || iommu_use_hap_pt(d) ||
+         p2m->global_logdirty )
+        return;
+
+    table = map_domain_page(pagetable_get_pfn(p2m_get_pagetable(p2m)));
+    for ( i = ept_get_wl(&p2m->ept); i > 2; i-- )
+    {
+        ept_entry = table + ((gfn >> (i * EPT_TABLE_ORDER)) &
+                             (EPT_PAGETABLE_ENTRIES - 1));
+        if ( !is_epte_present(ept_entry) || is_epte_superpage(ept_entry) ||
+             ept_entry->emt == MTRR_NUM_TYPES || ept_entry->recalc )
+        {
+            unmap_domain_page(table);
+            return;
+        }
+        l1t = map_domain_page(ept_entry->mfn);
+        unmap_domain_page(table);
+        table = l1t;
+    }
+
+    /* table is now the level 2 table, ept_entry the level 2 entry. */
+    ept_entry = table + ((gfn >> (2 * EPT_TABLE_ORDER)) &
+                         (EPT_PAGETABLE_ENTRIES - 1));
+    if ( is_epte_present(ept_entry) && !is_epte_superpage(ept_entry) &&
+         ept_entry->emt != MTRR_NUM_TYPES && !ept_entry->recalc )
+    {
+        l1t = map_domain_page(ept_entry->mfn);
+        if ( !p2m_is_logdirty_range(p2m, gfn & ~((1UL << PAGE_ORDER_2M) - 1),
+                                    gfn | ((1UL << PAGE_ORDER_2M) - 1)) &&
+             ept_coalesce_entry(p2m,
+                                l1t + ((gfn >> EPT_TABLE_ORDER) &
+                                       (EPT_PAGETABLE_ENTRIES - 1)),
+                                1, gfn & ~((1UL << PAGE_ORDER_2M) - 1),
+                                &freed[nr]) )
+        {
+            perfc_incr(ept_coalesce_2m);
+            nr++;
+            try_1g = 1;
+        }
+        unmap_domain_page(l1t);
+
+        if ( try_1g && hvm_hap_has_1gb(d) && opt_hap_1gb &&
+             !p2m_is_logdirty_range(p2m, gfn & ~((1UL << PAGE_ORDER_1G) - 1),
+                                    gfn | ((1UL << PAGE_ORDER_1G) - 1)) &&
+             ept_coalesce_entry(p2m, ept_entry, 2,
+                                gfn & ~((1UL << PAGE_ORDER_1G) - 1),
+                                &freed[nr]) )
+        {
+            perfc_incr(ept_coalesce_1g);
+            nr++;
+        }
+    }
+    unmap_domain_page(table);
+
+    if ( !nr )
+        return;
+
+    /* The old tables may still be cached: flush before freeing them. */
+    ept_sync_domain(p2m);
+    while ( nr-- )
+        p2m_free_ptp(p2m, freed[nr]);
+}
+
 /*
  * ept_set_entry() computes 'need_modify_vtd_table' for itself,
  * by observing whether any gfn->mfn translations are modified.
@@ -651,6 +817,13 @@ ept_set_entry(struct p2m_domain *p2m, unsigned long gfn, mfn_t mfn,
         /* NB: please make sure domian is paused and no in-fly VT-d DMA. */
         atomic_write_ept_entry(ept_entry, split_ept_entry);
 
+        /* Remember global log-dirty's splits, to undo them when it ends. */
+        if ( !p2m_is_nestedp2m(p2m) && p2m->global_logdirty &&
+             rangeset_add_singleton(p2m->split_ranges,
+                                    gfn >> PAGE_ORDER_2M) )
+            /* Out of memory: the region just stays split. */
+            perfc_incr(ept_split_untracked);
+
         /* then move to the level we want to make real changes */
         for ( ; i > target; i-- )
             if ( !ept_next_level(p2m, 0, &table, &gfn_remainder, i) )
@@ -685,7 +858,7 @@ ept_set_entry(struct p2m_domain *p2m, unsigned long gfn, mfn_t mfn,
         if ( ept_entry->mfn == new_entry.mfn )
              need_modify_vtd_table = 0;
 
-        ept_p2m_type_to_flags(&new_entry, p2mt, p2ma);
+        ept_p2m_type_to_flags(p2m, &new_entry, p2mt, p2ma);
     }
 
     atomic_write_ept_entry(ept_entry, new_entry);
@@ -726,6 +899,11 @@ out:
     if ( is_epte_present(&old_entry) )
         ept_free_entry(p2m, &old_entry, target);
 
+    /* Filling in a 4k page may complete a superpage's worth of them. */
+    if ( rc == 0 && target == 0 && p2mt == p2m_ram_rw &&
+         !p2m_is_nestedp2m(p2m) )
+        ept_coalesce_gfn(p2m, gfn, 0);
+
     return rc;
 }
 
@@ -955,6 +1133,148 @@ static void ept_memory_type_changed(struct p2m_domain *p2m)
         ept_sync_domain(p2m);
 }
 
+/*
+ * Promote every region of the host p2m which is mapped by 4k (or 2M)
+ * entries, but could be mapped by a superpage, e.g. once log-dirty mode
+ * has shattered and then been turned off.
+ */
+static int ept_coalesce_range(unsigned long s, unsigned long e, void *arg)
+{
+    struct p2m_domain *p2m = arg;
+    unsigned long gfn;
+    int rc;
+
+    for ( ; s <= e; s++ )
+    {
+        gfn = s << PAGE_ORDER_2M;
+        /* Apply any type changes still pending in this region first. */
+        rc = resolve_misconfig(p2m, gfn);
+        if ( rc < 0 )
+            return rc;
+        /* The 1G region may have been split just down to 2M pages. */
+        ept_coalesce_gfn(p2m, gfn, 1);
+    }
+
+    return 0;
+}
+
+/* Only the regions split while in log-dirty mode are visited. */
+static void ept_coalesce_superpages(struct p2m_domain *p2m)
+{
+    rangeset_report_ranges(p2m->split_ranges, 0, ~0UL,
+                           ept_coalesce_range, p2m);
+    /* Removing everything never needs to allocate. */
+    if ( rangeset_remove_range(p2m->split_ranges, 0, ~0UL) )
+        BUG();
+}
+
+static void ept_enable_pml(struct p2m_domain *p2m)
+{
+    /* Writes through a nested guest's EPT tables would go unlogged. */
+    if ( nestedhvm_enabled(p2m->domain) ||
+         vmx_domain_enable_pml(p2m->domain) )
+        return;
+
+    /* The CPU only sets dirty bits, and so logs, with A/D bits enabled. */
+    p2m->ept.ad = 1;
+    vmx_domain_update_eptp(p2m->domain);
+}
+
+static void ept_disable_pml(struct p2m_domain *p2m)
+{
+    if ( !vmx_domain_pml_enabled(p2m->domain) )
+        return;
+
+    vmx_domain_disable_pml(p2m->domain);
+
+    p2m->ept.ad = 0;
+    vmx_domain_update_eptp(p2m->domain);
+}
+
+static void ept_flush_pml_buffers(struct p2m_domain *p2m)
+{
+    vmx_domain_flush_pml_buffers(p2m->domain);
+}
+
+/*
+ * With A/D bits enabled, the CPU sets the accessed bit of each entry it
+ * walks through, so the pager can tell which pages are in use.  They are
+ * also turned on by, and off again after, PML.
+ */
+static int ept_track_accessed(struct p2m_domain *p2m)
+{
+    struct domain *d = p2m->domain;
+
+    if ( p2m->ept.ad )
+        return 0;
+
+    domain_pause(d);
+    p2m_lock(p2m);
+    if ( !p2m->ept.ad )
+    {
+        p2m->ept.ad = 1;
+        vmx_domain_update_eptp(d);
+    }
+    p2m_unlock(p2m);
+    domain_unpause(d);
+
+    return 0;
+}
+
+static void ept_scan_accessed(struct p2m_domain *p2m, unsigned long gfn,
+                              unsigned int nr, unsigned long *bitmap)
+{
+    unsigned int i, n, level;
+    bool_t cleared = 0;
+
+    ASSERT(p2m_locked_by_me(p2m));
+
+    for ( i = 0; i < nr; i += n )
+    {
+        ept_entry_t *table =
+            map_domain_page(pagetable_get_pfn(p2m_get_pagetable(p2m)));
+        unsigned long gfn_remainder = gfn + i;
+        ept_entry_t *e;
+        int ret = GUEST_TABLE_NORMAL_PAGE;
+
+        n = 1;
+        for ( level = ept_get_wl(&p2m->ept); level > 0; level-- )
+        {
+            ret = ept_next_level(p2m, 1, &table, &gfn_remainder, level);
+            if ( ret != GUEST_TABLE_NORMAL_PAGE )
+                break;
+        }
+
+        if ( ret == GUEST_TABLE_NORMAL_PAGE || ret == GUEST_TABLE_SUPER_PAGE )
+        {
+            e = table + (gfn_remainder >> (level * EPT_TABLE_ORDER));
+
+            /* A superpage's accessed bit stands for all of its gfns. */
+            if ( level )
+                n = min(nr - i, (1U << (level * EPT_TABLE_ORDER)) -
+                        (unsigned int)(gfn_remainder &
+                                       ((1UL << (level * EPT_TABLE_ORDER)) -
+                                        1)));
+
+            if ( is_epte_present(e) &&
+                 test_and_clear_bit(EPTE_A_SHIFT, &e->epte) )
+            {
+                unsigned int j;
+
+                for ( j = i; j < i + n; j++ )
+                    __set_bit(j, bitmap);
+                cleared = 1;
+            }
+        }
+
+        unmap_domain_page(table);
+    }
+
+    /* Have the CPU set the bits again on the next access. */
+    if ( cleared )
+        ept_sync_domain(p2m);
+}
+
 static void __ept_sync_domain(void *info)
 {
     struct ept_data *ept = &((struct p2m_domain *)info)->ept;
@@ -970,6 +1290,14 @@ void ept_sync_domain(struct p2m_domain *p2m)
     if ( !paging_mode_hap(d) || !d->vcpu || !d->vcpu[0] )
         return;
 
+    /* Within a batch of updates, flush once at its end. */
+    if ( p2m->defer_flush && p2m_locked_by_me(p2m) )
+    {
+        p2m->need_flush = 1;
+        perfc_incr(p2m_flushes_deferred);
+        return;
+    }
+
     ASSERT(local_irq_is_enabled());
 
     /*
@@ -995,6 +1323,21 @@ int ept_p2m_init(struct p2m_domain *p2m)
     p2m->change_entry_type_range = ept_change_entry_type_range;
     p2m->memory_type_changed = ept_memory_type_changed;
     p2m->audit_p2m = NULL;
+    p2m->coalesce_superpages = ept_coalesce_superpages;
+    p2m->flush_tlb = ept_sync_domain;
+
+    if ( cpu_has_vmx_ept_ad )
+    {
+        p2m->track_accessed = ept_track_accessed;
+        p2m->scan_accessed = ept_scan_accessed;
+    }
+
+    if ( cpu_has_vmx_pml )
+    {
+        p2m->enable_hardware_log_dirty = ept_enable_pml;
+        p2m->disable_hardware_log_dirty = ept_disable_pml;
+        p2m->flush_hardware_cached_dirty = ept_flush_pml_buffers;
+    }
 
     /* Set the memory type used when accessing EPT paging structures. */
     ept->ept_mt = EPT_DEFAULT_MT;
@@ -1025,6 +1368,7 @@ static void ept_dump_p2m_table(unsigned char key)
     int ret = 0;
     unsigned long gfn, gfn_remainder;
     unsigned long record_counter = 0;
+    unsigned long mappings[3], ram;
     struct p2m_domain *p2m;
     struct ept_data *ept;
     static const char memory_types[8][2] = {
@@ -1045,6 +1389,7 @@ static void ept_dump_p2m_table(unsigned char key)
         p2m = p2m_get_hostp2m(d);
         ept = &p2m->ept;
         printk("\ndomain%d EPT p2m table:\n", d->domain_id);
+        memset(mappings, 0, sizeof(mappings));
 
         for ( gfn = 0; gfn <= p2m->max_mapped_pfn; gfn += 1UL << order )
         {
@@ -1080,11 +1425,21 @@ static void ept_dump_p2m_table(unsigned char key)
                            ?: ept_entry->emt + '0',
                            c ?: ept_entry->ipat ? '!' : ' ');
 
+                if ( ept_entry->sa_p2mt == p2m_ram_rw )
+                    mappings[order / EPT_TABLE_ORDER]++;
+
                 if ( !(record_counter++ % 100) )
                     process_pending_softirqs();
             }
             unmap_domain_page(table);
         }
+
+        ram = mappings[0] + (mappings[1] << PAGE_ORDER_2M) +
+              (mappings[2] << PAGE_ORDER_1G);
+        printk("domain%d RAM mappings: 4k: %lu 2M: %lu 1G: %lu"
+               " (%lu%% of RAM in superpages)\n", d->domain_id,
+               mappings[0], mappings[1], mappings[2],
+               ram ? (ram - mappings[0]) * 100 / ram : 0);
     }
 }
 
@@ -102,6 +102,14 @@ p2m_pod_cache_add(struct p2m_domain *p2m,
 
     ASSERT(pod_locked_by_me(p2m));
 
+    /*
+     * Within a batch of p2m updates, the page may still be in the TLBs.
+     * It must be out before it is scrubbed, and once cached it can be
+     * freed, under the PoD lock only, or reused.
+     */
+    if ( p2m_locked_by_me(p2m) && p2m->need_flush )
+        p2m_tlb_flush_sync(p2m);
+
     /*
      * Pages from domain_alloc and returned by the balloon driver aren't
      * guaranteed to be zero; but by reclaiming zero pages, we implicitly
@@ -300,6 +308,20 @@ out:
     return ret;
 }
 
+static void p2m_pod_reclaim(unsigned long data);
+static void p2m_pod_reclaim_timer_fn(void *data);
+
+void
+p2m_pod_init(struct p2m_domain *p2m)
+{
+    mm_lock_init(&p2m->pod.lock);
+    INIT_PAGE_LIST_HEAD(&p2m->pod.super);
+    INIT_PAGE_LIST_HEAD(&p2m->pod.single);
+    tasklet_init(&p2m->pod.reclaim_tasklet, p2m_pod_reclaim,
+                 (unsigned long)p2m);
+    init_timer(&p2m->pod.reclaim_timer, p2m_pod_reclaim_timer_fn, p2m, 0);
+}
+
 /*
  * The "right behavior" here requires some careful thought.  First, some
  * definitions:
@@ -384,6 +406,8 @@ p2m_pod_empty_cache(struct domain *d)
 
     /* After this barrier no new PoD activities can happen. */
     BUG_ON(!d->is_dying);
+    kill_timer(&p2m->pod.reclaim_timer);
+    tasklet_kill(&p2m->pod.reclaim_tasklet);
     spin_barrier(&p2m->pod.lock.lock);
 
     lock_page_alloc(p2m);
@@ -744,14 +768,7 @@ p2m_pod_zero_check_superpage(struct p2m_domain *p2m, unsigned long gfn)
     for ( i=0; i < SUPERPAGE_PAGES; i++ )
     {
         map = map_domain_page(mfn_x(mfn0) + i);
-
-        for ( j=0; j<PAGE_SIZE/sizeof(*map); j++ )
-            if( *(map+j) != 0 )
-            {
-                reset = 1;
-                break;
-            }
-
+        reset = !page_is_zero(map);
         unmap_domain_page(map);
 
         if ( reset )
@@ -798,6 +815,7 @@ p2m_pod_zero_check(struct p2m_domain *p2m, unsigned long *gfns, int count)
     struct domain *d = p2m->domain;
 
     int i, j;
+    bool_t zero;
     int max_ref = 1;
 
     /* Allow an extra refcount for one shadow pt mapping in shadowed domains */
@@ -863,15 +881,13 @@ p2m_pod_zero_check(struct p2m_domain *p2m, unsigned long *gfns, int count)
         if(!map[i])
             continue;
 
-        for ( j=0; j<PAGE_SIZE/sizeof(*map[i]); j++ )
-            if( *(map[i]+j) != 0 )
-                break;
+        zero = page_is_zero(map[i]);
 
         unmap_domain_page(map[i]);
 
         /* See comment in p2m_pod_zero_check_superpage() re gnttab
          * check timing.  */
-        if ( j < PAGE_SIZE/sizeof(*map[i]) )
+        if ( !zero )
         {
             p2m_set_entry(p2m, gfns[i], mfns[i], PAGE_ORDER_4K,
                 types[i], p2m->default_access);
@@ -976,6 +992,134 @@ p2m_pod_emergency_sweep(struct p2m_domain *p2m)
 
 }
 
+/*
+ * Background reclaim.  Rather than leave a fault to sweep for zeroed pages
+ * once the cache has run dry, refill the cache from a tasklet, in idle vcpu
+ * context, when it falls below POD_RECLAIM_LOW pages, up to POD_RECLAIM_HIGH.
+ * Each run scans at most POD_RECLAIM_BATCH gfns, a superpage-aligned chunk
+ * at a time down from where the last run stopped, and runs are at least
+ * POD_RECLAIM_INTERVAL apart.  A run which finds nothing waits for the next
+ * fault to start another.
+ */
+#define POD_RECLAIM_LOW       (SUPERPAGE_PAGES * 8)
+#define POD_RECLAIM_HIGH      (SUPERPAGE_PAGES * 16)
+#define POD_RECLAIM_BATCH     (SUPERPAGE_PAGES * 8)
+#define POD_RECLAIM_INTERVAL  MILLISECS(1)
+
+/* Must be called w/ pod lock held.  There is no point in caching more pages
+ * than there are outstanding PoD entries. */
+static int
+p2m_pod_reclaim_needed(struct p2m_domain *p2m, long watermark)
+{
+    return (p2m->pod.count < watermark) &&
+           (p2m->pod.count < p2m->pod.entry_count);
+}
+
+/* Must be called w/ pod lock held. */
+static void
+p2m_pod_reclaim_kick(struct p2m_domain *p2m)
+{
+    if ( NOW() >= p2m->pod.reclaim_next )
+        tasklet_schedule(&p2m->pod.reclaim_tasklet);
+    else
+        set_timer(&p2m->pod.reclaim_timer, p2m->pod.reclaim_next);
+}
+
+static void
+p2m_pod_reclaim_timer_fn(void *data)
+{
+    struct p2m_domain *p2m = data;
+
+    tasklet_schedule(&p2m->pod.reclaim_tasklet);
+}
+
+/* Reclaim what we can from the superpage-aligned chunk at @gfn.  Chunks
+ * mapped by a superpage are only reclaimed whole, so as not to shatter them
+ * for the sake of a few zero pages. */
+static void
+p2m_pod_reclaim_chunk(struct p2m_domain *p2m, unsigned long gfn)
+{
+    unsigned long gfns[POD_SWEEP_STRIDE];
+    unsigned int i, j = 0, order;
+    p2m_type_t t;
+    p2m_access_t a;
+
+    (void)p2m->get_entry(p2m, gfn, &t, &a, 0, &order);
+    if ( order >= PAGE_ORDER_2M && !p2m_is_ram(t) )
+        return;
+
+    if ( p2m_pod_zero_check_superpage(p2m, gfn) || order >= PAGE_ORDER_2M )
+        return;
+
+    for ( i = 0; i < SUPERPAGE_PAGES; i++ )
+    {
+        (void)p2m->get_entry(p2m, gfn + i, &t, &a, 0, NULL);
+        if ( !p2m_is_ram(t) )
+            continue;
+        gfns[j++] = gfn + i;
+        if ( j == POD_SWEEP_STRIDE )
+        {
+            p2m_pod_zero_check(p2m, gfns, j);
+            j = 0;
+        }
+    }
+
+    if ( j )
+        p2m_pod_zero_check(p2m, gfns, j);
+}
+
+static void
+p2m_pod_reclaim(unsigned long data)
+{
+    struct p2m_domain *p2m = (struct p2m_domain *)data;
+    unsigned long gfn, scanned;
+    long count;
+
+    p2m_lock(p2m);
+    pod_lock(p2m);
+
+    /* See p2m_pod_demand_populate() re checking d->is_dying. */
+    if ( p2m->domain->is_dying ||
+         !p2m_pod_reclaim_needed(p2m, POD_RECLAIM_HIGH) )
+        goto out;
+
+    perfc_incr(pod_reclaim_runs);
+    count = p2m->pod.count;
+    gfn = p2m->pod.reclaim_bg & ~(SUPERPAGE_PAGES - 1UL);
+
+    for ( scanned = 0; scanned < POD_RECLAIM_BATCH;
+          scanned += SUPERPAGE_PAGES )
+    {
+        if ( gfn == 0 )
+            gfn = p2m->pod.max_guest & ~(SUPERPAGE_PAGES - 1UL);
+        else
+            gfn -= SUPERPAGE_PAGES;
+
+        p2m_pod_reclaim_chunk(p2m, gfn);
+
+        if ( !p2m_pod_reclaim_needed(p2m, POD_RECLAIM_HIGH) ||
+             softirq_pending(smp_processor_id()) )
+            break;
+    }
+
+    p2m->pod.reclaim_bg = gfn;
+    p2m->pod.reclaim_next = NOW() + POD_RECLAIM_INTERVAL;
+
+    if ( p2m->pod.count > count )
+    {
+        perfc_add(pod_reclaim_pages, p2m->pod.count - count);
+        if ( p2m_pod_reclaim_needed(p2m, POD_RECLAIM_HIGH) )
+        {
+            migrate_timer(&p2m->pod.reclaim_timer, smp_processor_id());
+            set_timer(&p2m->pod.reclaim_timer, p2m->pod.reclaim_next);
+        }
+    }
+
+out:
+    pod_unlock(p2m);
+    p2m_unlock(p2m);
+}
+
 int
 p2m_pod_demand_populate(struct p2m_domain *p2m, unsigned long gfn,
                         unsigned int order,
@@ -1019,7 +1163,10 @@ p2m_pod_demand_populate(struct p2m_domain *p2m, unsigned long gfn,
     /* Only sweep if we're actually out of memory.  Doing anything else
      * causes unnecessary time and fragmentation of superpages in the p2m. */
     if ( p2m->pod.count == 0 )
+    {
+        perfc_incr(pod_emergency_sweeps);
         p2m_pod_emergency_sweep(p2m);
+    }
 
     /* If the sweep failed, give up. */
     if ( p2m->pod.count == 0 )
@@ -1052,6 +1199,10 @@ p2m_pod_demand_populate(struct p2m_domain *p2m, unsigned long gfn,
     p2m->pod.entry_count -= (1 << order);
     BUG_ON(p2m->pod.entry_count < 0);
 
+    /* Refill the cache in the background before the next fault needs to. */
+    if ( p2m_pod_reclaim_needed(p2m, POD_RECLAIM_LOW) )
+        p2m_pod_reclaim_kick(p2m);
+
     if ( tb_init_done )
     {
         struct {
@@ -62,11 +62,10 @@ static int p2m_initialise(struct domain *d, struct p2m_domain *p2m)
     int ret = 0;
 
     mm_rwlock_init(&p2m->lock);
-    mm_lock_init(&p2m->pod.lock);
     INIT_LIST_HEAD(&p2m->np2m_list);
     INIT_PAGE_LIST_HEAD(&p2m->pages);
-    INIT_PAGE_LIST_HEAD(&p2m->pod.super);
-    INIT_PAGE_LIST_HEAD(&p2m->pod.single);
+    INIT_PAGE_LIST_HEAD(&p2m->deferred_pages);
+    p2m_pod_init(p2m);
 
     p2m->domain = d;
     p2m->default_access = p2m_access_rwx;
@@ -104,6 +103,8 @@ free_p2m:
 
 static void p2m_free_one(struct p2m_domain *p2m)
 {
+    kill_timer(&p2m->pod.reclaim_timer);
+    tasklet_kill(&p2m->pod.reclaim_tasklet);
     if ( hap_enabled(p2m->domain) && cpu_has_vmx )
         ept_p2m_uninit(p2m);
     free_cpumask_var(p2m->dirty_cpumask);
@@ -118,11 +119,15 @@ static int p2m_init_hostp2m(struct domain *d)
     {
         p2m->logdirty_ranges = rangeset_new(d, "log-dirty",
                                             RANGESETF_prettyprint_hex);
-        if ( p2m->logdirty_ranges )
+        p2m->split_ranges = rangeset_new(d, "split 2M regions",
+                                         RANGESETF_prettyprint_hex);
+        if ( p2m->logdirty_ranges && p2m->split_ranges )
         {
             d->arch.p2m = p2m;
             return 0;
         }
+        rangeset_destroy(p2m->logdirty_ranges);
+        rangeset_destroy(p2m->split_ranges);
         p2m_free_one(p2m);
     }
     return -ENOMEM;
@@ -136,6 +141,7 @@ static void p2m_teardown_hostp2m(struct domain *d)
     if ( p2m )
     {
         rangeset_destroy(p2m->logdirty_ranges);
+        rangeset_destroy(p2m->split_ranges);
         p2m_free_one(p2m);
         d->arch.p2m = NULL;
     }
@@ -236,6 +242,100 @@ void p2m_memory_type_changed(struct domain *d)
     }
 }
 
+void p2m_enable_hardware_log_dirty(struct domain *d)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+
+    if ( p2m->enable_hardware_log_dirty )
+    {
+        p2m_lock(p2m);
+        p2m->enable_hardware_log_dirty(p2m);
+        p2m_unlock(p2m);
+    }
+}
+
+void p2m_disable_hardware_log_dirty(struct domain *d)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+
+    if ( p2m->disable_hardware_log_dirty )
+    {
+        p2m_lock(p2m);
+        p2m->disable_hardware_log_dirty(p2m);
+        p2m_unlock(p2m);
+    }
+}
+
+/* Move dirty state cached by the hardware into the log-dirty bitmap. */
+void p2m_flush_hardware_cached_dirty(struct domain *d)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+
+    if ( p2m->flush_hardware_cached_dirty )
+    {
+        p2m_lock(p2m);
+        p2m->flush_hardware_cached_dirty(p2m);
+        p2m_unlock(p2m);
+    }
+}
+
+void guest_physmap_batch_begin(struct domain *d)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+
+    if ( !paging_mode_translate(d) )
+        return;
+
+    p2m_lock(p2m);
+    p2m->defer_flush++;
+}
+
+void p2m_tlb_flush_sync(struct p2m_domain *p2m)
+{
+    struct domain *d = p2m->domain;
+    struct page_info *pg;
+
+    ASSERT(p2m_locked_by_me(p2m));
+
+    if ( p2m->need_flush )
+    {
+        p2m->need_flush = 0;
+        perfc_incr(p2m_batch_flushes);
+        if ( p2m->flush_tlb )
+            p2m->flush_tlb(p2m);
+        else
+            flush_tlb_mask(d->domain_dirty_cpumask);
+    }
+
+    while ( (pg = page_list_remove_head(&p2m->deferred_pages)) != NULL )
+        d->arch.paging.free_page(d, pg);
+}
+
+void guest_physmap_batch_end(struct domain *d)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+
+    if ( !paging_mode_translate(d) )
+        return;
+
+    ASSERT(p2m->defer_flush);
+    if ( !--p2m->defer_flush )
+        p2m_tlb_flush_sync(p2m);
+    p2m_unlock(p2m);
+}
+
+void p2m_coalesce_superpages(struct domain *d)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+
+    if ( p2m->coalesce_superpages )
+    {
+        p2m_lock(p2m);
+        p2m->coalesce_superpages(p2m);
+        p2m_unlock(p2m);
+    }
+}
+
 mfn_t __get_gfn_type_access(struct p2m_domain *p2m, unsigned long gfn,
                     p2m_type_t *t, p2m_access_t *a, p2m_query_t q,
                     unsigned int *page_order, bool_t locked)
@@ -403,7 +503,12 @@ void p2m_free_ptp(struct p2m_domain *p2m, struct page_info *pg)
     ASSERT(p2m->domain->arch.paging.free_page);
 
     page_list_del(pg, &p2m->pages);
-    p2m->domain->arch.paging.free_page(p2m->domain, pg);
+
+    /* Until a deferred flush is done, the TLBs may still walk the page. */
+    if ( p2m->defer_flush )
+        page_list_add(pg, &p2m->deferred_pages);
+    else
+        p2m->domain->arch.paging.free_page(p2m->domain, pg);
 
     return;
 }
@@ -778,7 +883,8 @@ void p2m_change_type_range(struct domain *d,
             rc = rangeset_remove_range(p2m->logdirty_ranges, start, end - 1);
         break;
     case p2m_ram_logdirty:
-        if ( ot == p2m_ram_rw )
+        /* Global log-dirty mode already covers the range. */
+        if ( ot == p2m_ram_rw && !p2m->global_logdirty )
             rc = rangeset_add_range(p2m->logdirty_ranges, start, end - 1);
         break;
     default:
@@ -1271,38 +1377,87 @@ int p2m_mem_paging_prep(struct domain *d, unsigned long gfn, uint64_t buffer)
 void p2m_mem_paging_resume(struct domain *d)
 {
     struct p2m_domain *p2m = p2m_get_hostp2m(d);
-    mem_event_response_t rsp;
+    mem_event_response_t rsp[MEM_EVENT_RESPONSE_BATCH];
+    unsigned int i, nr;
     p2m_type_t p2mt;
     p2m_access_t a;
     mfn_t mfn;
 
     /* Pull all responses off the ring */
-    while( mem_event_get_response(d, &d->mem_event->paging, &rsp) )
+    while ( (nr = mem_event_get_response(d, &d->mem_event->paging, rsp,
+                                         ARRAY_SIZE(rsp))) )
     {
-        if ( rsp.flags & MEM_EVENT_FLAG_DUMMY )
-            continue;
-        /* Fix p2m entry if the page was not dropped */
-        if ( !(rsp.flags & MEM_EVENT_FLAG_DROP_PAGE) )
+        for ( i = 0; i < nr; i++ )
         {
-            gfn_lock(p2m, rsp.gfn, 0);
-            mfn = p2m->get_entry(p2m, rsp.gfn, &p2mt, &a, 0, NULL);
-            /* Allow only pages which were prepared properly, or pages which
-             * were nominated but not evicted */
-            if ( mfn_valid(mfn) && (p2mt == p2m_ram_paging_in) )
+            if ( rsp[i].flags & MEM_EVENT_FLAG_DUMMY )
+                continue;
+            /* Fix p2m entry if the page was not dropped */
+            if ( !(rsp[i].flags & MEM_EVENT_FLAG_DROP_PAGE) )
             {
-                p2m_set_entry(p2m, rsp.gfn, mfn, PAGE_ORDER_4K,
-                              paging_mode_log_dirty(d) ? p2m_ram_logdirty :
-                              p2m_ram_rw, a);
-                set_gpfn_from_mfn(mfn_x(mfn), rsp.gfn);
+                unsigned long gfn = rsp[i].gfn;
+
+                gfn_lock(p2m, gfn, 0);
+                mfn = p2m->get_entry(p2m, gfn, &p2mt, &a, 0, NULL);
+                /* Allow only pages which were prepared properly, or pages
+                 * which were nominated but not evicted */
+                if ( mfn_valid(mfn) && (p2mt == p2m_ram_paging_in) )
+                {
+                    p2m_set_entry(p2m, gfn, mfn, PAGE_ORDER_4K,
+                                  paging_mode_log_dirty(d) ? p2m_ram_logdirty :
+                                  p2m_ram_rw, a);
+                    set_gpfn_from_mfn(mfn_x(mfn), gfn);
+                }
+                gfn_unlock(p2m, gfn, 0);
             }
-            gfn_unlock(p2m, rsp.gfn, 0);
+            /* Unpause domain */
+            if ( rsp[i].flags & MEM_EVENT_FLAG_VCPU_PAUSED )
+                vcpu_unpause(d->vcpu[rsp[i].vcpu_id]);
         }
-        /* Unpause domain */
-        if ( rsp.flags & MEM_EVENT_FLAG_VCPU_PAUSED )
-            vcpu_unpause(d->vcpu[rsp.vcpu_id]);
     }
 }
 
+/**
+ * p2m_mem_paging_scan_accessed - Find which frames the guest has accessed
+ * @d: guest domain
+ * @gfn: first guest page to scan
+ * @nr: number of guest pages to scan
+ * @buffer: pager's bitmap to fill in, (nr + 7) / 8 bytes long
+ *
+ * p2m_mem_paging_scan_accessed() reports which of the gfns were accessed
+ * since they were last scanned, and clears their accessed state, so that
+ * the pager can give them a second chance before choosing them for
+ * eviction.  It is called by the pager.
+ */
+int p2m_mem_paging_scan_accessed(struct domain *d, unsigned long gfn,
+                                 unsigned int nr, uint64_t buffer)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned long bitmap[XENMEM_paging_scan_max / BITS_PER_LONG];
+    /* Little endian: the bitmap's first bytes hold its first bits. */
+    unsigned int size = DIV_ROUND_UP(nr, 8);
+    void *user_ptr = (void *) buffer;
+    int rc;
+
+    if ( !p2m->scan_accessed )
+        return -EOPNOTSUPP;
+
+    if ( !nr || (nr > XENMEM_paging_scan_max) ||
+         (gfn + nr - 1 < gfn) || !access_ok(user_ptr, size) )
+        return -EINVAL;
+
+    /* Start the hardware recording accesses, the first time round. */
+    if ( p2m->track_accessed && (rc = p2m->track_accessed(p2m)) != 0 )
+        return rc;
+
+    memset(bitmap, 0, sizeof(bitmap));
+
+    p2m_lock(p2m);
+    p2m->scan_accessed(p2m, gfn, nr, bitmap);
+    p2m_unlock(p2m);
+
+    return copy_to_user(user_ptr, bitmap, size) ? -EFAULT : 0;
+}
+
 bool_t p2m_mem_access_check(paddr_t gpa, bool_t gla_valid, unsigned long gla, 
                           bool_t access_r, bool_t access_w, bool_t access_x,
                           mem_event_request_t **req_ptr)
@@ -1402,16 +1557,21 @@ bool_t p2m_mem_access_check(paddr_t gpa, bool_t gla_valid, unsigned long gla,
 
 void p2m_mem_access_resume(struct domain *d)
 {
-    mem_event_response_t rsp;
+    mem_event_response_t rsp[MEM_EVENT_RESPONSE_BATCH];
+    unsigned int i, nr;
 
     /* Pull all responses off the ring */
-    while( mem_event_get_response(d, &d->mem_event->access, &rsp) )
+    while ( (nr = mem_event_get_response(d, &d->mem_event->access, rsp,
+                                         ARRAY_SIZE(rsp))) )
     {
-        if ( rsp.flags & MEM_EVENT_FLAG_DUMMY )
-            continue;
-        /* Unpause domain */
-        if ( rsp.flags & MEM_EVENT_FLAG_VCPU_PAUSED )
-            vcpu_unpause(d->vcpu[rsp.vcpu_id]);
+        for ( i = 0; i < nr; i++ )
+        {
+            if ( rsp[i].flags & MEM_EVENT_FLAG_DUMMY )
+                continue;
+            /* Unpause domain */
+            if ( rsp[i].flags & MEM_EVENT_FLAG_VCPU_PAUSED )
+                vcpu_unpause(d->vcpu[rsp[i].vcpu_id]);
+        }
     }
 }
 
@@ -22,6 +22,7 @@
 
 #include <xen/init.h>
 #include <xen/guest_access.h>
+#include <xen/event.h>
 #include <asm/paging.h>
 #include <asm/shadow.h>
 #include <asm/p2m.h>
@@ -335,6 +336,10 @@ int paging_log_dirty_op(struct domain *d, struct xen_domctl_shadow_op *sc)
     int i4, i3, i2;
 
     domain_pause(d);
+
+    /* Pick up the writes the hardware has logged but not yet reported. */
+    p2m_flush_hardware_cached_dirty(d);
+
     paging_lock(d);
 
     clean = (sc->op == XEN_DOMCTL_SHADOW_OP_CLEAN);
@@ -447,6 +452,254 @@ int paging_log_dirty_op(struct domain *d, struct xen_domctl_shadow_op *sc)
     return rv;
 }
 
+/* Bits in a leaf of the log-dirty trie, and pfns under each node. */
+#define LOGDIRTY_LEAF_BITS  (1UL << (PAGE_SHIFT + 3))
+#define LOGDIRTY_L2_PFNS    (LOGDIRTY_LEAF_BITS * LOGDIRTY_NODE_ENTRIES)
+#define LOGDIRTY_L3_PFNS    (LOGDIRTY_L2_PFNS * LOGDIRTY_NODE_ENTRIES)
+#define LOGDIRTY_L4_PFNS    (LOGDIRTY_L3_PFNS * LOGDIRTY_NODE_ENTRIES)
+
+/* Dirty ranges gathered under the paging lock at a time. */
+#define LOGDIRTY_RANGES_BATCH 32
+/* Dirty pages of a shadow guest write-protected one by one per call, beyond
+ * which it is cheaper to drop all its shadows. */
+#define LOGDIRTY_SHADOW_CLEAN_PFNS 64
+
+static void log_dirty_clear_bits(unsigned long *l1, unsigned int start,
+                                 unsigned int end)
+{
+    while ( (start < end) && (start % BITS_PER_LONG) )
+        __clear_bit(start++, l1);
+    for ( ; end - start >= BITS_PER_LONG; start += BITS_PER_LONG )
+        l1[start / BITS_PER_LONG] = 0;
+    while ( start < end )
+        __clear_bit(start++, l1);
+}
+
+/* Gather up to max runs of dirty pfns from *pfn onwards, leaving the
+ * log-dirty trie untouched.  *pfn is left at the first pfn not gathered. */
+static unsigned int log_dirty_gather_ranges(struct domain *d,
+                                            unsigned long *pfn,
+                                            unsigned long end,
+                                            xen_domctl_dirty_range_t *r,
+                                            unsigned int max)
+{
+    mfn_t mfn, *l4, *l3, *l2;
+    unsigned long *l1, base = *pfn;
+    unsigned int n = 0, i1, limit, stop;
+
+    ASSERT(paging_locked_by_me(d));
+
+    l4 = paging_map_log_dirty_bitmap(d);
+    if ( !l4 )
+    {
+        *pfn = end;
+        return 0;
+    }
+
+    while ( base < end )
+    {
+        /* Find the leaf covering base, skipping over absent subtrees. */
+        mfn = l4[L4_LOGDIRTY_IDX(base)];
+        if ( !mfn_valid(mfn) )
+        {
+            base = (base | (LOGDIRTY_L4_PFNS - 1)) + 1;
+            continue;
+        }
+        l3 = map_domain_page(mfn_x(mfn));
+        mfn = l3[L3_LOGDIRTY_IDX(base)];
+        unmap_domain_page(l3);
+        if ( !mfn_valid(mfn) )
+        {
+            base = (base | (LOGDIRTY_L3_PFNS - 1)) + 1;
+            continue;
+        }
+        l2 = map_domain_page(mfn_x(mfn));
+        mfn = l2[L2_LOGDIRTY_IDX(base)];
+        unmap_domain_page(l2);
+        if ( !mfn_valid(mfn) )
+        {
+            base = (base | (LOGDIRTY_L2_PFNS - 1)) + 1;
+            continue;
+        }
+
+        i1 = L1_LOGDIRTY_IDX(base);
+        base -= i1;
+        limit = min(end - base, LOGDIRTY_LEAF_BITS);
+
+        l1 = map_domain_page(mfn_x(mfn));
+        while ( (i1 = find_next_bit(l1, limit, i1)) < limit )
+        {
+            stop = find_next_zero_bit(l1, limit, i1);
+            if ( n && (r[n - 1].first_pfn + r[n - 1].nr_pfns == base + i1) )
+                r[n - 1].nr_pfns += stop - i1;
+            else if ( n < max )
+            {
+                r[n].first_pfn = base + i1;
+                r[n].nr_pfns = stop - i1;
+                n++;
+            }
+            else
+                break;
+            i1 = stop;
+        }
+        unmap_domain_page(l1);
+
+        if ( i1 < limit )
+        {
+            /* Out of room: carry on from this run next time. */
+            base += i1;
+            break;
+        }
+        base += limit;
+    }
+
+    unmap_domain_page(l4);
+
+    *pfn = min(base, end);
+    return n;
+}
+
+/* Clear nr bits of the log-dirty trie from pfn onwards. */
+static void log_dirty_clear_range(struct domain *d, unsigned long pfn,
+                                  unsigned long nr)
+{
+    mfn_t mfn, *l4, *l3, *l2;
+    unsigned long *l1;
+    unsigned int i1, stop;
+
+    ASSERT(paging_locked_by_me(d));
+
+    l4 = paging_map_log_dirty_bitmap(d);
+    if ( !l4 )
+        return;
+
+    while ( nr )
+    {
+        i1 = L1_LOGDIRTY_IDX(pfn);
+        stop = min_t(unsigned long, LOGDIRTY_LEAF_BITS, i1 + nr);
+
+        mfn = l4[L4_LOGDIRTY_IDX(pfn)];
+        if ( mfn_valid(mfn) )
+        {
+            l3 = map_domain_page(mfn_x(mfn));
+            mfn = l3[L3_LOGDIRTY_IDX(pfn)];
+            unmap_domain_page(l3);
+        }
+        if ( mfn_valid(mfn) )
+        {
+            l2 = map_domain_page(mfn_x(mfn));
+            mfn = l2[L2_LOGDIRTY_IDX(pfn)];
+            unmap_domain_page(l2);
+        }
+        if ( mfn_valid(mfn) )
+        {
+            l1 = map_domain_page(mfn_x(mfn));
+            log_dirty_clear_bits(l1, i1, stop);
+            unmap_domain_page(l1);
+        }
+
+        pfn += stop - i1;
+        nr -= stop - i1;
+    }
+
+    unmap_domain_page(l4);
+}
+
+/* Report a domain's dirty pfns as a list of ranges, and clean them.  Only
+ * the ranges copied out to the caller are cleaned, and only the p2m entries
+ * of HAP guests which were dirtied are made read-only again, with a single
+ * TLB flush.  Shadow guests have the write access to a few dirtied pages
+ * revoked individually rather than having all their shadows dropped. */
+static int paging_log_dirty_ranges(struct domain *d,
+                                   struct xen_domctl_shadow_op *sc)
+{
+    xen_domctl_dirty_range_t r[LOGDIRTY_RANGES_BATCH];
+    unsigned long pfn = sc->first_pfn, next;
+    unsigned long budget = LOGDIRTY_SHADOW_CLEAN_PFNS;
+    unsigned int i, n, done = 0;
+    bool_t blow = 0;
+    int rv = 0;
+
+    if ( !paging_mode_log_dirty(d) )
+        return -EINVAL;
+
+    domain_pause(d);
+
+    p2m_flush_hardware_cached_dirty(d);
+
+    paging_lock(d);
+
+    sc->stats.fault_count = d->arch.paging.log_dirty.fault_count;
+    sc->stats.dirty_count = d->arch.paging.log_dirty.dirty_count;
+    d->arch.paging.log_dirty.fault_count = 0;
+    d->arch.paging.log_dirty.dirty_count = 0;
+
+    if ( unlikely(d->arch.paging.log_dirty.failed_allocs) )
+    {
+        printk("%s: %d failed page allocs while logging dirty pages\n",
+               __FUNCTION__, d->arch.paging.log_dirty.failed_allocs);
+        paging_unlock(d);
+        domain_unpause(d);
+        return -ENOMEM;
+    }
+
+    paging_unlock(d);
+
+    if ( hap_enabled(d) )
+        guest_physmap_batch_begin(d);
+
+    while ( (pfn < sc->pages) && (done < sc->nr_ranges) )
+    {
+        /* The caller carries on from first_pfn. */
+        if ( done && hypercall_preempt_check() )
+            break;
+
+        next = pfn;
+        paging_lock(d);
+        n = log_dirty_gather_ranges(d, &next, sc->pages, r,
+                                    min_t(unsigned int, sc->nr_ranges - done,
+                                          LOGDIRTY_RANGES_BATCH));
+        paging_unlock(d);
+
+        /* Only clean what the caller has been told about. */
+        if ( n && copy_to_guest_offset(sc->dirty_ranges, done, r, n) )
+        {
+            rv = -EFAULT;
+            break;
+        }
+        pfn = next;
+        done += n;
+
+        paging_lock(d);
+        for ( i = 0; i < n; i++ )
+            log_dirty_clear_range(d, r[i].first_pfn, r[i].nr_pfns);
+        paging_unlock(d);
+
+        /* The p2m lock, held across the loop, nests outside the paging
+         * lock; the flush is deferred to guest_physmap_batch_end(). */
+        if ( hap_enabled(d) )
+            for ( i = 0; i < n; i++ )
+                p2m_change_type_range(d, r[i].first_pfn,
+                                      r[i].first_pfn + r[i].nr_pfns,
+                                      p2m_ram_rw, p2m_ram_logdirty);
+        else if ( n && !blow )
+            blow = !shadow_clean_dirty_ranges(d, r, n, &budget);
+    }
+
+    if ( hap_enabled(d) )
+        guest_physmap_batch_end(d);
+    else if ( blow )
+        /* Safe because the domain is paused. */
+        d->arch.paging.log_dirty.clean_dirty_bitmap(d);
+
+    sc->first_pfn = pfn;
+    sc->nr_ranges = done;
+
+    domain_unpause(d);
+
+    return rv;
+}
+
 void paging_log_dirty_range(struct domain *d,
                            unsigned long begin_pfn,
                            unsigned long nr,
@@ -463,9 +716,12 @@ void paging_log_dirty_range(struct domain *d,
      * and on retry the write succeeds.
      *
      * We populate dirty_bitmap by looking for entries that have been
-     * switched to read-write.
+     * switched to read-write.  Writes logged by the hardware are
+     * flushed first, which switches their entries in the same way.
      */
 
+    p2m_flush_hardware_cached_dirty(d);
+
     p2m_lock(p2m);
 
     for ( i = 0, pfn = begin_pfn; pfn < begin_pfn + nr; i++, pfn++ )
@@ -598,6 +854,9 @@ int paging_domctl(struct domain *d, xen_domctl_shadow_op_t *sc,
     case XEN_DOMCTL_SHADOW_OP_CLEAN:
     case XEN_DOMCTL_SHADOW_OP_PEEK:
         return paging_log_dirty_op(d, sc);
+
+    case XEN_DOMCTL_SHADOW_OP_CLEAN_RANGES:
+        return paging_log_dirty_ranges(d, sc);
     }
 
     /* Here, dispatch domctl to the appropriate paging code */
@@ -1641,6 +1641,8 @@ shadow_free_p2m_page(struct domain *d, struct page_info *pg)
     paging_unlock(d);
 }
 
+static void shadow_hash_resize(struct domain *d);
+
 /* Set the pool of shadow pages to the required number of pages.
  * Input will be rounded up to at least shadow_min_acceptable_pages(),
  * plus space for the p2m table.
@@ -1718,6 +1720,10 @@ static unsigned int sh_set_allocation(struct domain *d,
         }
     }
 
+    /* Keep the hash table in proportion to the pool (unless tearing down) */
+    if ( d->arch.paging.shadow.hash_table && pages > 0 )
+        shadow_hash_resize(d);
+
     return 0;
 }
 
@@ -1735,18 +1741,29 @@ static unsigned int shadow_get_allocation(struct domain *d)
  * The table itself is an array of pointers to shadows; the shadows are then 
  * threaded on a singly-linked list of shadows with the same hash value */
 
-#define SHADOW_HASH_BUCKETS 251
-/* Other possibly useful primes are 509, 1021, 2039, 4093, 8191, 16381 */
+/* The table has a power-of-two number of buckets, about one for every
+ * SHADOW_HASH_PAGES_PER_BUCKET pages in the shadow pool, and is resized
+ * when the pool is. */
+#define SHADOW_HASH_PAGES_PER_BUCKET 2
+#define SHADOW_HASH_MIN_ORDER        8
+#define SHADOW_HASH_MAX_ORDER        16
 
-/* Hash function that takes a gfn or mfn, plus another byte of type info */
+static inline unsigned int sh_hash_buckets(const struct domain *d)
+{
+    return 1u << d->arch.paging.shadow.hash_order;
+}
+
+/* Hash function that takes a gfn or mfn, plus another byte of type info.
+ * Multiplying by 2^64/phi mixes the whole key into the top bits, which
+ * are the ones used, and spreads runs of consecutive frames evenly over
+ * the buckets whatever the size of the table. */
 typedef u32 key_t;
-static inline key_t sh_hash(unsigned long n, unsigned int t) 
+static inline key_t sh_hash(const struct domain *d,
+                            unsigned long n, unsigned int t)
 {
-    unsigned char *p = (unsigned char *)&n;
-    key_t k = t;
-    int i;
-    for ( i = 0; i < sizeof(n) ; i++ ) k = (u32)p[i] + (k<<6) + (k<<16) - k;
-    return k % SHADOW_HASH_BUCKETS;
+    uint64_t k = (((uint64_t)n << 5) | t) * 0x9e3779b97f4a7c15ULL;
+
+    return k >> (64 - d->arch.paging.shadow.hash_order);
 }
 
 #if SHADOW_AUDIT & (SHADOW_AUDIT_HASH|SHADOW_AUDIT_HASH_FULL)
@@ -1772,7 +1789,7 @@ static void sh_hash_audit_bucket(struct domain *d, int bucket)
         /* Wrong page of a multi-page shadow? */
         BUG_ON( !sp->u.sh.head );
         /* Wrong bucket? */
-        BUG_ON( sh_hash(__backpointer(sp), sp->u.sh.type) != bucket );
+        BUG_ON( sh_hash(d, __backpointer(sp), sp->u.sh.type) != bucket );
         /* Duplicate entry? */
         for ( x = next_shadow(sp); x; x = next_shadow(x) )
             BUG_ON( x->v.sh.back == sp->v.sh.back &&
@@ -1837,7 +1854,7 @@ static void sh_hash_audit(struct domain *d)
     if ( !(SHADOW_AUDIT_ENABLE) )
         return;
 
-    for ( i = 0; i < SHADOW_HASH_BUCKETS; i++ ) 
+    for ( i = 0; i < sh_hash_buckets(d); i++ ) 
     {
         sh_hash_audit_bucket(d, i);
     }
@@ -1847,21 +1864,78 @@ static void sh_hash_audit(struct domain *d)
 #define sh_hash_audit(_d) do {} while(0)
 #endif /* Hashtable bucket audit */
 
+/* The table size for the current size of the shadow pool. */
+static unsigned int shadow_hash_order(struct domain *d)
+{
+    unsigned int buckets = d->arch.paging.shadow.total_pages
+                           / SHADOW_HASH_PAGES_PER_BUCKET;
+    unsigned int order = SHADOW_HASH_MIN_ORDER;
+
+    while ( order < SHADOW_HASH_MAX_ORDER && (1u << order) < buckets )
+        order++;
+
+    return order;
+}
+
 /* Allocate and initialise the table itself.  
  * Returns 0 for success, 1 for error. */
 static int shadow_hash_alloc(struct domain *d)
 {
     struct page_info **table;
+    unsigned int order = shadow_hash_order(d);
 
     ASSERT(paging_locked_by_me(d));
     ASSERT(!d->arch.paging.shadow.hash_table);
 
-    table = xzalloc_array(struct page_info *, SHADOW_HASH_BUCKETS);
+    table = xzalloc_array(struct page_info *, 1u << order);
     if ( !table ) return 1;
     d->arch.paging.shadow.hash_table = table;
+    d->arch.paging.shadow.hash_order = order;
     return 0;
 }
 
+/* Move every entry to a table sized for the shadow pool.  If a new table
+ * cannot be allocated, the old one is kept: it is just slower. */
+static void shadow_hash_resize(struct domain *d)
+{
+    struct page_info **old = d->arch.paging.shadow.hash_table;
+    struct page_info **table, *sp;
+    unsigned int i, old_buckets = sh_hash_buckets(d);
+    unsigned int order = shadow_hash_order(d);
+    key_t key;
+
+    ASSERT(paging_locked_by_me(d));
+    ASSERT(old);
+    ASSERT(d->arch.paging.shadow.hash_walking == 0);
+
+    if ( order == d->arch.paging.shadow.hash_order )
+        return;
+
+    table = xzalloc_array(struct page_info *, 1u << order);
+    if ( !table )
+        return;
+
+    SHADOW_PRINTK("d%d: %u -> %u buckets\n",
+                  d->domain_id, old_buckets, 1u << order);
+    perfc_incr(shadow_hash_resizes);
+
+    d->arch.paging.shadow.hash_table = table;
+    d->arch.paging.shadow.hash_order = order;
+    for ( i = 0; i < old_buckets; i++ )
+    {
+        while ( (sp = old[i]) != NULL )
+        {
+            old[i] = next_shadow(sp);
+            key = sh_hash(d, __backpointer(sp), sp->u.sh.type);
+            set_next_shadow(sp, table[key]);
+            table[key] = sp;
+        }
+    }
+
+    xfree(old);
+    sh_hash_audit(d);
+}
+
 /* Tear down the hash table and return all memory to Xen.
  * This function does not care whether the table is populated. */
 static void shadow_hash_teardown(struct domain *d)
@@ -1889,13 +1963,14 @@ mfn_t shadow_hash_lookup(struct vcpu *v, unsigned long n, unsigned int t)
     sh_hash_audit(d);
 
     perfc_incr(shadow_hash_lookups);
-    key = sh_hash(n, t);
+    key = sh_hash(d, n, t);
     sh_hash_audit_bucket(d, key);
 
     sp = d->arch.paging.shadow.hash_table[key];
     prev = NULL;
     while(sp)
     {
+        perfc_incr(shadow_hash_lookup_steps);
         if ( __backpointer(sp) == n && sp->u.sh.type == t )
         {
             /* Pull-to-front if 'sp' isn't already the head item */
@@ -1943,7 +2018,7 @@ void shadow_hash_insert(struct vcpu *v, unsigned long n, unsigned int t,
     sh_hash_audit(d);
 
     perfc_incr(shadow_hash_inserts);
-    key = sh_hash(n, t);
+    key = sh_hash(d, n, t);
     sh_hash_audit_bucket(d, key);
     
     /* Insert this shadow at the top of the bucket */
@@ -1969,7 +2044,7 @@ void shadow_hash_delete(struct vcpu *v, unsigned long n, unsigned int t,
     sh_hash_audit(d);
 
     perfc_incr(shadow_hash_deletes);
-    key = sh_hash(n, t);
+    key = sh_hash(d, n, t);
     sh_hash_audit_bucket(d, key);
     
     sp = mfn_to_page(smfn);
@@ -2026,7 +2101,7 @@ static void hash_foreach(struct vcpu *v,
     ASSERT(d->arch.paging.shadow.hash_walking == 0);
     d->arch.paging.shadow.hash_walking = 1;
 
-    for ( i = 0; i < SHADOW_HASH_BUCKETS; i++ ) 
+    for ( i = 0; i < sh_hash_buckets(d); i++ ) 
     {
         /* WARNING: This is not safe against changes to the hash table.
          * The callback *must* return non-zero if it has inserted or
@@ -3471,6 +3546,50 @@ void shadow_clean_dirty_bitmap(struct domain *d)
     paging_unlock(d);
 }
 
+/* Revoke write access to the pages of a batch of dirty ranges reported by
+ * XEN_DOMCTL_SHADOW_OP_CLEAN_RANGES, charging them to *budget.  Returns 0
+ * if they are too many, or a mapping can't be found: the caller must then
+ * call shadow_clean_dirty_bitmap() instead. */
+int shadow_clean_dirty_ranges(struct domain *d,
+                              const xen_domctl_dirty_range_t *r,
+                              unsigned int n, unsigned long *budget)
+{
+    unsigned long gfn, nr = 0;
+    unsigned int i;
+    int rc, flush_tlb = 0;
+    p2m_type_t t;
+    mfn_t mfn;
+
+    for ( i = 0; i < n; i++ )
+        nr += r[i].nr_pfns;
+    /* The log-dirty bitmap of a PV guest is indexed by pfn, not mfn. */
+    if ( !paging_mode_translate(d) || nr > *budget )
+        return 0;
+    *budget -= nr;
+
+    paging_lock(d);
+    for ( i = 0; i < n; i++ )
+        for ( gfn = r[i].first_pfn; gfn < r[i].first_pfn + r[i].nr_pfns;
+              gfn++ )
+        {
+            mfn = get_gfn_query_unlocked(d, gfn, &t);
+            if ( !mfn_valid(mfn) )
+                continue;
+            rc = sh_remove_write_access(d->vcpu[0], mfn, 0, 0);
+            if ( rc < 0 )
+            {
+                paging_unlock(d);
+                return 0;
+            }
+            flush_tlb |= rc;
+        }
+    paging_unlock(d);
+
+    if ( flush_tlb )
+        flush_tlb_mask(d->domain_dirty_cpumask);
+
+    return 1;
+}
 
 /**************************************************************************/
 /* VRAM dirty tracking support */
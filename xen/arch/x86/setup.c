@@ -1337,6 +1337,8 @@ void __init noreturn __start_xen(unsigned long mbi_p)
     printk("Brought up %ld CPUs\n", (long)num_online_cpus());
     smp_cpus_done();
 
+    heap_init_late();
+
     do_initcalls();
 
     if ( opt_watchdog ) 
@@ -1060,8 +1060,12 @@ long subarch_memory_op(unsigned long cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
         if ( mso.op == XENMEM_sharing_op_audit )
             return mem_sharing_audit(); 
         rc = do_mem_event_op(op, mso.domain, (void *) &mso);
-        if ( !rc && __copy_to_guest(arg, &mso, 1) )
+        if ( (!rc || rc == -ERESTART) && __copy_to_guest(arg, &mso, 1) )
             return -EFAULT;
+        /* The batched ops record their progress in mso. */
+        if ( rc == -ERESTART )
+            rc = hypercall_create_continuation(
+                __HYPERVISOR_memory_op, "lh", op, arg);
         break;
     }
 
@@ -5,11 +5,14 @@
 #include <xen/config.h>
 #include <xen/types.h>
 #include <xen/multicall.h>
+#include <xen/hypercall.h>
 #include <xen/trace.h>
 
 #define COMPAT
 typedef int ret_t;
 #undef do_multicall_call
+#undef multicall_fast_call
+#define multicall_fast_call(_call) 0
 
 static inline void xlat_multicall_entry(struct mc_state *mcs)
 {
@@ -28,6 +28,9 @@ static inline event_word_t *evtchn_fifo_word_from_port(struct domain *d,
     if ( unlikely(port >= d->evtchn_fifo->num_evtchns) )
         return NULL;
 
+    /* Senders do not hold event_lock: see add_page_to_event_array(). */
+    smp_rmb();
+
     p = port / EVTCHN_FIFO_EVENT_WORDS_PER_PAGE;
     w = port % EVTCHN_FIFO_EVENT_WORDS_PER_PAGE;
 
@@ -472,10 +475,14 @@ static void setup_ports(struct domain *d)
 
         evtchn = evtchn_from_port(d, port);
 
+        spin_lock(&evtchn->lock);
+
         if ( test_bit(port, &shared_info(d, evtchn_pending)) )
             evtchn->pending = 1;
 
         evtchn_fifo_set_priority(d, evtchn, EVTCHN_FIFO_PRIORITY_DEFAULT);
+
+        spin_unlock(&evtchn->lock);
     }
 }
 
@@ -548,6 +555,10 @@ static int add_page_to_event_array(struct domain *d, unsigned long gfn)
         return rc;
 
     d->evtchn_fifo->event_array[slot] = virt;
+
+    /* Make sure that the page is visible before the ports it adds are. */
+    smp_wmb();
+
     d->evtchn_fifo->num_evtchns += EVTCHN_FIFO_EVENT_WORDS_PER_PAGE;
 
     /*
@@ -562,8 +573,11 @@ static int add_page_to_event_array(struct domain *d, unsigned long gfn)
             break;
 
         evtchn = evtchn_from_port(d, port);
+
+        spin_lock(&evtchn->lock);
         if ( evtchn->pending )
             evtchn_fifo_set_pending(d->vcpu[evtchn->notify_vcpu_id], evtchn);
+        spin_unlock(&evtchn->lock);
     }
 
     return 0;
@@ -92,11 +92,26 @@ static void increase_reservation(struct memop_args *a)
     a->nr_done = i;
 }
 
+/*
+ * populate_physmap() and decrease_reservation() handle extents in chunks
+ * of up to MEMOP_BATCH pages: the guest's extent list is read and pages
+ * are allocated outside the p2m lock, and the p2m updates for the whole
+ * chunk are then made as one batch, with a single TLB flush.
+ */
+#define MEMOP_BATCH 64
+
+static unsigned int memop_chunk(const struct memop_args *a, unsigned long i)
+{
+    unsigned long n = max(MEMOP_BATCH >> a->extent_order, 1);
+
+    return min(n, a->nr_extents - i);
+}
+
 static void populate_physmap(struct memop_args *a)
 {
-    struct page_info *page;
-    unsigned long i, j;
-    xen_pfn_t gpfn, mfn;
+    struct page_info *page, *pages[MEMOP_BATCH];
+    unsigned long i, j, k, n;
+    xen_pfn_t gpfns[MEMOP_BATCH], mfn;
     struct domain *d = a->domain;
 
     if ( !guest_handle_subrange_okay(a->extent_list, a->nr_done,
@@ -107,7 +122,7 @@ static void populate_physmap(struct memop_args *a)
          !multipage_allocation_permitted(current->domain, a->extent_order) )
         return;
 
-    for ( i = a->nr_done; i < a->nr_extents; i++ )
+    for ( i = a->nr_done; i < a->nr_extents; i += n )
     {
         if ( i != a->nr_done && hypercall_preempt_check() )
         {
@@ -115,25 +130,32 @@ static void populate_physmap(struct memop_args *a)
             goto out;
         }
 
-        if ( unlikely(__copy_from_guest_offset(&gpfn, a->extent_list, i, 1)) )
+        n = memop_chunk(a, i);
+        if ( unlikely(__copy_from_guest_offset(gpfns, a->extent_list, i, n)) )
             goto out;
 
         if ( a->memflags & MEMF_populate_on_demand )
         {
-            if ( guest_physmap_mark_populate_on_demand(d, gpfn,
-                                                       a->extent_order) < 0 )
-                goto out;
+            for ( k = 0; k < n; k++ )
+                if ( guest_physmap_mark_populate_on_demand(d, gpfns[k],
+                                                           a->extent_order) < 0 )
+                {
+                    i += k;
+                    goto out;
+                }
+            continue;
         }
-        else
+
+        for ( k = 0; k < n; k++ )
         {
             if ( is_domain_direct_mapped(d) )
             {
-                mfn = gpfn;
+                mfn = gpfns[k];
                 if ( !mfn_valid(mfn) )
                 {
                     gdprintk(XENLOG_INFO, "Invalid mfn %#"PRI_xen_pfn"\n",
                              mfn);
-                    goto out;
+                    break;
                 }
 
                 page = mfn_to_page(mfn);
@@ -142,7 +164,7 @@ static void populate_physmap(struct memop_args *a)
                     gdprintk(XENLOG_INFO,
                              "mfn %#"PRI_xen_pfn" doesn't belong to the"
                              " domain\n", mfn);
-                    goto out;
+                    break;
                 }
                 put_page(page);
             }
@@ -155,30 +177,58 @@ static void populate_physmap(struct memop_args *a)
                     gdprintk(XENLOG_INFO, "Could not allocate order=%d extent:"
                              " id=%d memflags=%x (%ld of %d)\n",
                              a->extent_order, d->domain_id, a->memflags,
-                             i, a->nr_extents);
-                goto out;
+                             i + k, a->nr_extents);
+                break;
             }
 
-            mfn = page_to_mfn(page);
-            guest_physmap_add_page(d, gpfn, mfn, a->extent_order);
+            pages[k] = page;
+        }
 
-            if ( !paging_mode_translate(d) )
+        guest_physmap_batch_begin(d);
+        for ( j = 0; j < k; j++ )
+            guest_physmap_add_page(d, gpfns[j], page_to_mfn(pages[j]),
+                                   a->extent_order);
+        guest_physmap_batch_end(d);
+
+        if ( !paging_mode_translate(d) )
+        {
+            for ( j = 0; j < k; j++ )
             {
-                for ( j = 0; j < (1 << a->extent_order); j++ )
-                    set_gpfn_from_mfn(mfn + j, gpfn + j);
+                unsigned long l;
+
+                mfn = page_to_mfn(pages[j]);
+                for ( l = 0; l < (1 << a->extent_order); l++ )
+                    set_gpfn_from_mfn(mfn + l, gpfns[j] + l);
 
                 /* Inform the domain of the new page's machine address. */ 
-                if ( unlikely(__copy_to_guest_offset(a->extent_list, i, &mfn, 1)) )
+                if ( unlikely(__copy_to_guest_offset(a->extent_list, i + j,
+                                                     &mfn, 1)) )
+                {
+                    i += j;
                     goto out;
+                }
             }
         }
+
+        if ( k < n )
+        {
+            i += k;
+            goto out;
+        }
     }
 
 out:
     a->nr_done = i;
 }
 
-int guest_remove_page(struct domain *d, unsigned long gmfn)
+/*
+ * Remove a page from a domain's physmap.  If @held is non-NULL, the
+ * reference which would finally free the page is instead returned in it
+ * (or NULL if there is none), to be dropped by the caller once the
+ * removal has been flushed from the TLBs.
+ */
+static int __guest_remove_page(struct domain *d, unsigned long gmfn,
+                               struct page_info **held)
 {
     struct page_info *page;
 #ifdef CONFIG_X86
@@ -202,6 +252,8 @@ int guest_remove_page(struct domain *d, unsigned long gmfn)
                 put_page(page);
         }
         p2m_mem_paging_drop_page(d, gmfn, p2mt);
+        if ( held )
+            *held = NULL;
         return 1;
     }
 #else
@@ -250,23 +302,35 @@ int guest_remove_page(struct domain *d, unsigned long gmfn)
 
     guest_physmap_remove_page(d, gmfn, mfn, 0);
 
-    put_page(page);
+    if ( held )
+        *held = page;
+    else
+        put_page(page);
     put_gfn(d, gmfn);
 
     return 1;
 }
 
+int guest_remove_page(struct domain *d, unsigned long gmfn)
+{
+    return __guest_remove_page(d, gmfn, NULL);
+}
+
 static void decrease_reservation(struct memop_args *a)
 {
-    unsigned long i, j;
-    xen_pfn_t gmfn;
+    struct page_info *held[MEMOP_BATCH];
+    unsigned long i, j, k, n;
+    unsigned int h, nr_held = 0;
+    xen_pfn_t gmfns[MEMOP_BATCH];
+    bool_t batch;
+    struct domain *d = a->domain;
 
     if ( !guest_handle_subrange_okay(a->extent_list, a->nr_done,
                                      a->nr_extents-1) ||
          a->extent_order > MAX_ORDER )
         return;
 
-    for ( i = a->nr_done; i < a->nr_extents; i++ )
+    for ( i = a->nr_done; i < a->nr_extents; i += n )
     {
         if ( i != a->nr_done && hypercall_preempt_check() )
         {
@@ -274,38 +338,88 @@ static void decrease_reservation(struct memop_args *a)
             goto out;
         }
 
-        if ( unlikely(__copy_from_guest_offset(&gmfn, a->extent_list, i, 1)) )
+        n = memop_chunk(a, i);
+        if ( unlikely(__copy_from_guest_offset(gmfns, a->extent_list, i, n)) )
             goto out;
 
-        if ( tb_init_done )
-        {
-            struct {
-                u64 gfn;
-                int d:16,order:16;
-            } t;
+        /*
+         * Dropping a paged-out gfn may have to wait for space on the pager's
+         * ring, which must not be done with the p2m lock held.  Nominating
+         * needs both the ring and the p2m lock, so no gfn can become paged
+         * out under a batch begun without a ring.
+         */
+        batch = !d->mem_event->paging.ring_page;
+        if ( batch )
+            guest_physmap_batch_begin(d);
 
-            t.gfn = gmfn;
-            t.d = a->domain->domain_id;
-            t.order = a->extent_order;
+        for ( k = 0; k < n; k++ )
+        {
+            if ( tb_init_done )
+            {
+                struct {
+                    u64 gfn;
+                    int d:16,order:16;
+                } t;
+
+                t.gfn = gmfns[k];
+                t.d = d->domain_id;
+                t.order = a->extent_order;
         
-            __trace_var(TRC_MEM_DECREASE_RESERVATION, 0, sizeof(t), &t);
-        }
+                __trace_var(TRC_MEM_DECREASE_RESERVATION, 0, sizeof(t), &t);
+            }
 
-        /* See if populate-on-demand wants to handle this */
-        if ( is_hvm_domain(a->domain)
-             && p2m_pod_decrease_reservation(a->domain, gmfn, a->extent_order) )
-            continue;
+            /* See if populate-on-demand wants to handle this */
+            if ( is_hvm_domain(d)
+                 && p2m_pod_decrease_reservation(d, gmfns[k],
+                                                 a->extent_order) )
+                continue;
 
-        /* With the lack for iommu on some ARM platform, domain with DMA-capable
-         * device must retrieve the same pfn when the hypercall
-         * populate_physmap is called.
-         */
-        if ( is_domain_direct_mapped(a->domain) )
-            continue;
+            /* With the lack for iommu on some ARM platform, domain with
+             * DMA-capable device must retrieve the same pfn when the
+             * hypercall populate_physmap is called.
+             */
+            if ( is_domain_direct_mapped(d) )
+                continue;
 
-        for ( j = 0; j < (1 << a->extent_order); j++ )
-            if ( !guest_remove_page(a->domain, gmfn + j) )
-                goto out;
+            for ( j = 0; j < (1 << a->extent_order); j++ )
+            {
+                if ( !batch )
+                {
+                    if ( !guest_remove_page(d, gmfns[k] + j) )
+                        break;
+                    continue;
+                }
+
+                /* Flush, and free what was removed so far, when full. */
+                if ( nr_held == MEMOP_BATCH )
+                {
+                    guest_physmap_batch_end(d);
+                    for ( h = 0; h < nr_held; h++ )
+                        put_page(held[h]);
+                    nr_held = 0;
+                    guest_physmap_batch_begin(d);
+                }
+
+                if ( !__guest_remove_page(d, gmfns[k] + j, &held[nr_held]) )
+                    break;
+                if ( held[nr_held] )
+                    nr_held++;
+            }
+            if ( j < (1 << a->extent_order) )
+                break;
+        }
+
+        if ( batch )
+            guest_physmap_batch_end(d);
+        for ( h = 0; h < nr_held; h++ )
+            put_page(held[h]);
+        nr_held = 0;
+
+        if ( k < n )
+        {
+            i += k;
+            goto out;
+        }
     }
 
  out:
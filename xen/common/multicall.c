@@ -10,6 +10,7 @@
 #include <xen/event.h>
 #include <xen/multicall.h>
 #include <xen/guest_access.h>
+#include <xen/hypercall.h>
 #include <xen/perfc.h>
 #include <xen/trace.h>
 #include <asm/current.h>
@@ -33,12 +34,16 @@ static void trace_multicall_call(multicall_entry_t *call)
     __trace_multicall_call(call);
 }
 
+/* Entries copied to and from the guest in one go. */
+#define MULTICALL_BATCH 16
+
 ret_t
 do_multicall(
     XEN_GUEST_HANDLE_PARAM(multicall_entry_t) call_list, uint32_t nr_calls)
 {
     struct mc_state *mcs = &current->mc_state;
-    uint32_t         i;
+    struct multicall_entry batch[MULTICALL_BATCH];
+    uint32_t         i, j, n;
     int              rc = 0;
 
     if ( unlikely(__test_and_set_bit(_MCSF_in_multicall, &mcs->flags)) )
@@ -50,36 +55,51 @@ do_multicall(
     if ( unlikely(!guest_handle_okay(call_list, nr_calls)) )
         rc = -EFAULT;
 
-    for ( i = 0; !rc && i < nr_calls; i++ )
+    for ( i = 0; !rc && i < nr_calls; )
     {
-        if ( i && hypercall_preempt_check() )
-            goto preempted;
+        n = min_t(uint32_t, nr_calls - i, MULTICALL_BATCH);
 
-        if ( unlikely(__copy_from_guest(&mcs->call, call_list, 1)) )
+        if ( unlikely(__copy_from_guest(batch, call_list, n)) )
         {
             rc = -EFAULT;
             break;
         }
 
-        trace_multicall_call(&mcs->call);
+        for ( j = 0; j < n; j++ )
+        {
+            if ( (i + j) && hypercall_preempt_check() )
+                break;
+
+            mcs->call = batch[j];
 
-        do_multicall_call(&mcs->call);
+            trace_multicall_call(&mcs->call);
+
+            if ( !multicall_fast_call(&mcs->call) )
+                do_multicall_call(&mcs->call);
 
 #ifndef NDEBUG
-        {
             /*
              * Deliberately corrupt the contents of the multicall structure.
              * The caller must depend only on the 'result' field on return.
              */
-            struct multicall_entry corrupt;
-            memset(&corrupt, 0xAA, sizeof(corrupt));
-            (void)__copy_to_guest(call_list, &corrupt, 1);
-        }
+            memset(&batch[j], 0xAA, sizeof(batch[j]));
 #endif
+            batch[j].result = mcs->call.result;
 
-        if ( unlikely(__copy_field_to_guest(call_list, &mcs->call, result)) )
+            if ( test_bit(_MCSF_call_preempted, &mcs->flags) )
+                break;
+        }
+
+        /* Copy back the entries completed so far. */
+        if ( unlikely(__copy_to_guest(call_list, batch, j)) )
+        {
             rc = -EFAULT;
-        else if ( test_bit(_MCSF_call_preempted, &mcs->flags) )
+            break;
+        }
+        guest_handle_add_offset(call_list, j);
+        i += j;
+
+        if ( test_bit(_MCSF_call_preempted, &mcs->flags) )
         {
             /* Translate sub-call continuation to guest layout */
             xlat_multicall_entry(mcs);
@@ -89,17 +109,21 @@ do_multicall(
                 goto preempted;
             rc = -EFAULT;
         }
-        else
-            guest_handle_add_offset(call_list, 1);
+        else if ( j < n )
+            goto preempted;
     }
 
     perfc_incr(calls_to_multicall);
     perfc_add(calls_from_multicall, i);
+    /* Count each multicall once, by its size, when it completes. */
+    perfc_incra(multicall_batch, min(fls(mcs->calls_done + i), 7));
+    mcs->calls_done = 0;
     mcs->flags = 0;
     return rc;
 
  preempted:
     perfc_add(calls_from_multicall, i);
+    mcs->calls_done += i;
     mcs->flags = 0;
     return hypercall_create_continuation(
         __HYPERVISOR_multicall, "hi", call_list, nr_calls-i);
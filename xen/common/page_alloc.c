@@ -27,6 +27,7 @@
 #include <xen/lib.h>
 #include <xen/sched.h>
 #include <xen/spinlock.h>
+#include <xen/cpu.h>
 #include <xen/mm.h>
 #include <xen/irq.h>
 #include <xen/softirq.h>
@@ -64,6 +65,12 @@ string_param("badpage", opt_badpage);
 static bool_t opt_bootscrub __initdata = 1;
 boolean_param("bootscrub", opt_bootscrub);
 
+/*
+ * no-pcp_cache -> All allocations and frees go through the global heap_lock.
+ */
+static bool_t __read_mostly opt_pcp_cache = 1;
+boolean_param("pcp_cache", opt_pcp_cache);
+
 /*
  * Bit width of the DMA heap -- used to override NUMA-node-first.
  * allocation strategy, which can otherwise exhaust low memory.
@@ -270,6 +277,24 @@ static heap_by_zone_and_order_t *_heap[MAX_NUMNODES];
 static unsigned long *avail[MAX_NUMNODES];
 static long total_avail_pages;
 
+/*
+ * Pages in the per-CPU caches are free too, but are not counted in avail[]
+ * and total_avail_pages, which only the heap_lock protects.  Summing them up
+ * means looking at every CPU's cache, so only do it when the answer matters.
+ */
+static unsigned long pcp_cached_pages(unsigned int node);
+
+/* Free pages still waiting to be scrubbed, per node. */
+static unsigned long node_need_scrub[MAX_NUMNODES];
+
+#define page_need_scrub(pg) (!!((pg)->count_info & PGC_need_scrub))
+
+/*
+ * Largest allocation which may be scrubbed synchronously (2MB with 4kB
+ * pages).  Larger ones are only satisfied from clean memory.
+ */
+#define SCRUB_INLINE_MAX_ORDER 9
+
 /* TMEM: Reserve a fraction of memory for mid-size (0<order<9) allocations.*/
 static long midsize_alloc_zone_pages;
 #define MIDSIZE_ALLOC_FRAC 128
@@ -277,6 +302,36 @@ static long midsize_alloc_zone_pages;
 static DEFINE_SPINLOCK(heap_lock);
 static long outstanding_claims; /* total outstanding claims by all domains */
 
+/*
+ * Free chunks whose contents still need scrubbing carry PGC_need_scrub on
+ * their head page and are kept at the tail of each free list, so that
+ * clean chunks are found at the head.
+ */
+static void heap_add(struct page_info *pg, unsigned int node,
+                     unsigned int zone, unsigned int order)
+{
+    ASSERT(spin_is_locked(&heap_lock));
+
+    PFN_ORDER(pg) = order;
+    if ( page_need_scrub(pg) )
+    {
+        node_need_scrub[node] += 1UL << order;
+        page_list_add_tail(pg, &heap(node, zone, order));
+    }
+    else
+        page_list_add(pg, &heap(node, zone, order));
+}
+
+static void heap_del(struct page_info *pg, unsigned int node,
+                     unsigned int zone, unsigned int order)
+{
+    ASSERT(spin_is_locked(&heap_lock));
+
+    if ( page_need_scrub(pg) )
+        node_need_scrub[node] -= 1UL << order;
+    page_list_del(pg, &heap(node, zone, order));
+}
+
 unsigned long domain_adjust_tot_pages(struct domain *d, long pages)
 {
     long dom_before, dom_after, dom_claimed, sys_before, sys_after;
@@ -347,7 +402,7 @@ int domain_set_outstanding_pages(struct domain *d, unsigned long pages)
     }
 
     /* how much memory is available? */
-    avail_pages = total_avail_pages;
+    avail_pages = total_avail_pages + pcp_cached_pages(-1);
 
     /* Note: The usage of claim means that allocation from a guest *might*
      * have to come from freeable memory. Using free memory is always better, if
@@ -430,7 +485,8 @@ static unsigned long init_node_heap(int node, unsigned long mfn,
     else if ( get_order_from_bytes(sizeof(**_heap)) ==
               get_order_from_pages(needed) )
     {
-        _heap[node] = alloc_xenheap_pages(get_order_from_pages(needed), 0);
+        _heap[node] = alloc_xenheap_pages(get_order_from_pages(needed),
+                                          MEMF_node(node));
         BUG_ON(!_heap[node]);
         avail[node] = (void *)_heap[node] + (needed << PAGE_SHIFT) -
                       sizeof(**avail) * NR_ZONES;
@@ -528,6 +584,11 @@ static void check_low_mem_virq(void)
     unsigned long avail_pages = total_avail_pages +
         (opt_tmem ? tmem_freeable_pages() : 0) - outstanding_claims;
 
+    if ( unlikely(avail_pages <= low_mem_virq_th) ||
+         unlikely((low_mem_virq_high != -1UL) &&
+                  (avail_pages < low_mem_virq_high)) )
+        avail_pages += pcp_cached_pages(-1);
+
     if ( unlikely(avail_pages <= low_mem_virq_th) )
     {
         send_global_virq(VIRQ_ENOMEM);
@@ -557,19 +618,454 @@ static void check_low_mem_virq(void)
     }
 }
 
+/*
+ * Halve a free chunk of order @j, already taken off the free lists, until
+ * it is of order @order.  The halves returned to the free lists, and the
+ * chunk handed back, inherit the chunk's need for scrubbing.
+ */
+static struct page_info *split_heap_chunk(
+    struct page_info *pg, unsigned int node, unsigned int zone,
+    unsigned int j, unsigned int order)
+{
+    unsigned long need_scrub = pg->count_info & PGC_need_scrub;
+
+    while ( j != order )
+    {
+        heap_add(pg, node, zone, --j);
+        pg += 1 << j;
+        pg->count_info = (pg->count_info & ~PGC_need_scrub) | need_scrub;
+    }
+
+    return pg;
+}
+
+/* Initialise fields of a page leaving the allocator for the first time. */
+static void init_alloc_page(
+    struct page_info *pg, bool_t *need_tlbflush, uint32_t *tlbflush_timestamp)
+{
+    if ( pg->u.free.need_tlbflush &&
+         (pg->tlbflush_timestamp <= tlbflush_current_time()) &&
+         (!*need_tlbflush ||
+          (pg->tlbflush_timestamp > *tlbflush_timestamp)) )
+    {
+        *need_tlbflush = 1;
+        *tlbflush_timestamp = pg->tlbflush_timestamp;
+    }
+
+    /* Initialise fields which have other uses for free pages. */
+    pg->u.inuse.type_info = 0;
+    page_set_owner(pg, NULL);
+
+    /* Ensure cache and RAM are consistent for platforms where the
+     * guest can control its own visibility of/through the cache.
+     */
+    flush_page_to_ram(page_to_mfn(pg));
+}
+
+static void flush_alloc_tlb(uint32_t tlbflush_timestamp)
+{
+    cpumask_t mask = cpu_online_map;
+
+    tlbflush_filter(mask, tlbflush_timestamp);
+    if ( !cpumask_empty(&mask) )
+    {
+        perfc_incr(need_flush_tlb_flush);
+        flush_tlb_mask(&mask);
+    }
+}
+
+static void merge_free_heap_pages(struct page_info *pg, unsigned int order,
+                                  unsigned int node, unsigned int zone,
+                                  bool_t tainted);
+
+/*************************
+ * PER-CPU PAGE CACHES
+ *
+ * Each CPU keeps a small cache of order-0 and superpage-sized chunks from
+ * its local node, so the allocations dominating domain construction,
+ * ballooning and paging pool refills don't serialise on heap_lock.  Caches
+ * are refilled from and drained to the heap in batches.  Cached chunks are
+ * accounted as allocated: they are in PGC_state_inuse (or offlining), have
+ * no owner, and keep their u.free TLB-flush information until handed out.
+ * The per-CPU lock only serialises against remote drains.
+ */
+
+#define PCP_SUPERPAGE_ORDER 9 /* 2MB with 4kB pages */
+#define PCP_NR_ORDERS       2
+
+static const unsigned int pcp_batch[PCP_NR_ORDERS] = { 32, 2 };
+static const unsigned int pcp_high[PCP_NR_ORDERS] = { 128, 4 };
+
+struct pcp_cache {
+    spinlock_t lock;
+    bool_t online;
+    unsigned int count[PCP_NR_ORDERS];
+    struct page_list_head list[PCP_NR_ORDERS];
+};
+
+static DEFINE_PER_CPU(struct pcp_cache, pcp_cache);
+
+static inline int pcp_index(unsigned int order)
+{
+    switch ( order )
+    {
+    case 0:
+        return 0;
+    case PCP_SUPERPAGE_ORDER:
+        return 1;
+    }
+
+    return -1;
+}
+
+/*
+ * Caches only come into use once boot has completed, so that no memory
+ * escapes the boot-time scrub by sitting in a cache.
+ */
+static inline struct pcp_cache *pcp_local(unsigned int node)
+{
+    struct pcp_cache *pcp = &this_cpu(pcp_cache);
+
+    if ( !opt_pcp_cache || (system_state != SYS_STATE_active) ||
+         !pcp->online || (node != cpu_to_node(smp_processor_id())) )
+        return NULL;
+
+    return pcp;
+}
+
+/* Return a list of cached chunks of order @order to the heap. */
+static void pcp_release(struct page_list_head *list, unsigned int order)
+{
+    struct page_info *pg;
+    unsigned int i;
+
+    if ( page_list_empty(list) )
+        return;
+
+    perfc_incr(pcp_drain);
+
+    spin_lock(&heap_lock);
+
+    while ( (pg = page_list_remove_head(list)) != NULL )
+    {
+        unsigned int node = phys_to_nid(page_to_maddr(pg));
+        unsigned int zone = page_to_zone(pg);
+        bool_t tainted = 0;
+
+        for ( i = 0; i < (1 << order); i++ )
+        {
+            ASSERT(page_get_owner(&pg[i]) == NULL);
+            pg[i].count_info =
+                ((pg[i].count_info & PGC_broken) |
+                 (page_state_is(&pg[i], offlining)
+                  ? PGC_state_offlined : PGC_state_free));
+            if ( page_state_is(&pg[i], offlined) )
+                tainted = 1;
+        }
+
+        merge_free_heap_pages(pg, order, node, zone, tainted);
+    }
+
+    spin_unlock(&heap_lock);
+}
+
+/* Hand all cached chunks of @cpu back to the heap. */
+static unsigned long pcp_drain(unsigned int cpu)
+{
+    struct pcp_cache *pcp = &per_cpu(pcp_cache, cpu);
+    struct page_list_head list[PCP_NR_ORDERS];
+    unsigned long nr = 0;
+    unsigned int idx;
+
+    spin_lock(&pcp->lock);
+    for ( idx = 0; idx < PCP_NR_ORDERS; idx++ )
+    {
+        INIT_PAGE_LIST_HEAD(&list[idx]);
+        page_list_move(&list[idx], &pcp->list[idx]);
+        nr += pcp->count[idx];
+        pcp->count[idx] = 0;
+    }
+    spin_unlock(&pcp->lock);
+
+    pcp_release(&list[0], 0);
+    pcp_release(&list[1], PCP_SUPERPAGE_ORDER);
+
+    return nr;
+}
+
+static unsigned long pcp_drain_all(void)
+{
+    unsigned int cpu;
+    unsigned long nr = 0;
+
+    if ( !opt_pcp_cache )
+        return 0;
+
+    for_each_online_cpu ( cpu )
+        if ( per_cpu(pcp_cache, cpu).online )
+            nr += pcp_drain(cpu);
+
+    return nr;
+}
+
+/* Number of pages sitting in per-CPU caches for @node (-1 for all nodes). */
+static unsigned long pcp_cached_pages(unsigned int node)
+{
+    unsigned int cpu;
+    unsigned long nr = 0;
+
+    for_each_online_cpu ( cpu )
+    {
+        const struct pcp_cache *pcp = &per_cpu(pcp_cache, cpu);
+
+        if ( !pcp->online ||
+             ((node != -1) && (cpu_to_node(cpu) != node)) )
+            continue;
+        nr += pcp->count[0] + (pcp->count[1] << PCP_SUPERPAGE_ORDER);
+    }
+
+    return nr;
+}
+
+static struct page_info *pcp_alloc(
+    unsigned int node, unsigned int zone_lo, unsigned int zone_hi,
+    unsigned int order, const struct domain *d)
+{
+    int idx = pcp_index(order);
+    struct pcp_cache *pcp;
+    struct page_info *pg;
+    unsigned int i, zone;
+
+    if ( (idx < 0) || ((pcp = pcp_local(node)) == NULL) )
+        return NULL;
+
+    /*
+     * Cached pages count as available to claims: while any are staked,
+     * leave them to the heap path to check, under the heap lock, unless
+     * the domain has enough claimed pages of its own.
+     */
+    if ( read_atomic(&outstanding_claims) &&
+         (d == NULL || d->outstanding_pages < (1U << order)) )
+        return NULL;
+
+    spin_lock(&pcp->lock);
+    pg = page_list_empty(&pcp->list[idx]) ? NULL
+                                          : page_list_first(&pcp->list[idx]);
+    if ( pg != NULL )
+    {
+        zone = page_to_zone(pg);
+        if ( (zone < zone_lo) || (zone > zone_hi) )
+            pg = NULL;
+        else
+        {
+            page_list_del(pg, &pcp->list[idx]);
+            pcp->count[idx]--;
+        }
+    }
+    spin_unlock(&pcp->lock);
+
+    if ( pg == NULL )
+        return NULL;
+
+    /* Chunks with pages being offlined go back to the heap to be reserved. */
+    for ( i = 0; i < (1 << order); i++ )
+    {
+        if ( (pg[i].count_info & PGC_broken) ||
+             !page_state_is(&pg[i], inuse) )
+        {
+            PAGE_LIST_HEAD(list);
+
+            page_list_add(pg, &list);
+            pcp_release(&list, order);
+            return NULL;
+        }
+    }
+
+    perfc_incr(pcp_alloc_hit);
+
+    return pg;
+}
+
+/* Take up to a batch of further chunks from the heap to refill a cache. */
+static unsigned int pcp_take_batch(
+    unsigned int node, unsigned int zone, unsigned int order,
+    struct page_list_head *list)
+{
+    int idx = pcp_index(order);
+    struct page_info *pg;
+    unsigned int i, j, n;
+
+    ASSERT(spin_is_locked(&heap_lock));
+
+    if ( (idx < 0) || !pcp_local(node) || outstanding_claims || opt_tmem )
+        return 0;
+
+    for ( n = 0; n < pcp_batch[idx] - 1; n++ )
+    {
+        /* Only clean chunks are cached; the heads of the lists are clean. */
+        for ( j = order; j <= MAX_ORDER; j++ )
+            if ( !page_list_empty(&heap(node, zone, j)) &&
+                 !page_need_scrub(page_list_first(&heap(node, zone, j))) )
+                break;
+        if ( j > MAX_ORDER )
+            break;
+
+        pg = page_list_first(&heap(node, zone, j));
+        heap_del(pg, node, zone, j);
+        pg = split_heap_chunk(pg, node, zone, j, order);
+
+        ASSERT(avail[node][zone] >= (1UL << order));
+        avail[node][zone] -= 1UL << order;
+        total_avail_pages -= 1UL << order;
+
+        for ( i = 0; i < (1 << order); i++ )
+        {
+            BUG_ON(pg[i].count_info != PGC_state_free);
+            pg[i].count_info = PGC_state_inuse;
+        }
+
+        page_list_add_tail(pg, list);
+    }
+
+    return n;
+}
+
+static void pcp_refill(struct page_list_head *list, unsigned int order,
+                       unsigned int nr)
+{
+    struct pcp_cache *pcp = &this_cpu(pcp_cache);
+    int idx = pcp_index(order);
+
+    if ( !nr )
+        return;
+
+    perfc_incr(pcp_refill);
+
+    spin_lock(&pcp->lock);
+    page_list_splice(list, &pcp->list[idx]);
+    pcp->count[idx] += nr;
+    spin_unlock(&pcp->lock);
+}
+
+/* Try to stash a freed chunk in the local cache rather than the heap. */
+static bool_t pcp_free(struct page_info *pg, unsigned int order)
+{
+    int idx = pcp_index(order);
+    struct pcp_cache *pcp;
+    unsigned long mfn = page_to_mfn(pg), x, y;
+    unsigned int i, n;
+    PAGE_LIST_HEAD(list);
+
+    if ( (idx < 0) ||
+         ((pcp = pcp_local(phys_to_nid(page_to_maddr(pg)))) == NULL) ||
+         (page_to_zone(pg) == MEMZONE_XEN) )
+        return 0;
+
+    /* Broken and offlining pages need the heap to get them reserved. */
+    for ( i = 0; i < (1 << order); i++ )
+        if ( (pg[i].count_info & PGC_broken) ||
+             !page_state_is(&pg[i], inuse) )
+            return 0;
+
+    for ( i = 0; i < (1 << order); i++ )
+    {
+        /* Drop the reference count, racing only with mark_page_offline(). */
+        y = pg[i].count_info;
+        do {
+            x = y;
+        } while ( (y = cmpxchg(&pg[i].count_info, x,
+                               x & (PGC_state | PGC_broken))) != x );
+
+        /* If a page has no owner it will need no safety TLB flush. */
+        pg[i].u.free.need_tlbflush = (page_get_owner(&pg[i]) != NULL);
+        if ( pg[i].u.free.need_tlbflush )
+            pg[i].tlbflush_timestamp = tlbflush_current_time();
+
+        /* This page is not a guest frame any more. */
+        page_set_owner(&pg[i], NULL); /* set_gpfn_from_mfn snoops pg owner */
+        set_gpfn_from_mfn(mfn + i, INVALID_M2P_ENTRY);
+    }
+
+    perfc_incr(pcp_free_hit);
+
+    spin_lock(&pcp->lock);
+    page_list_add(pg, &pcp->list[idx]);
+    if ( ++pcp->count[idx] > pcp_high[idx] )
+    {
+        for ( n = 0; n < pcp_batch[idx]; n++ )
+            page_list_add_tail(page_list_remove_head(&pcp->list[idx]), &list);
+        pcp->count[idx] -= n;
+    }
+    spin_unlock(&pcp->lock);
+
+    pcp_release(&list, order);
+
+    return 1;
+}
+
+static int cpu_pcp_callback(
+    struct notifier_block *nfb, unsigned long action, void *hcpu)
+{
+    unsigned int cpu = (unsigned long)hcpu, idx;
+    struct pcp_cache *pcp = &per_cpu(pcp_cache, cpu);
+
+    switch ( action )
+    {
+    case CPU_UP_PREPARE:
+        spin_lock_init(&pcp->lock);
+        for ( idx = 0; idx < PCP_NR_ORDERS; idx++ )
+        {
+            INIT_PAGE_LIST_HEAD(&pcp->list[idx]);
+            pcp->count[idx] = 0;
+        }
+        pcp->online = 1;
+        break;
+    case CPU_UP_CANCELED:
+    case CPU_DEAD:
+        if ( pcp->online )
+            pcp_drain(cpu);
+        pcp->online = 0;
+        break;
+    default:
+        break;
+    }
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block cpu_pcp_nfb = {
+    .notifier_call = cpu_pcp_callback
+};
+
+static int __init pcp_cache_init(void)
+{
+    unsigned int cpu;
+
+    if ( !opt_pcp_cache )
+        return 0;
+
+    for_each_online_cpu ( cpu )
+        cpu_pcp_callback(&cpu_pcp_nfb, CPU_UP_PREPARE, (void *)(long)cpu);
+    register_cpu_notifier(&cpu_pcp_nfb);
+
+    return 0;
+}
+__initcall(pcp_cache_init);
+
 /* Allocate 2^@order contiguous pages. */
-static struct page_info *alloc_heap_pages(
+static struct page_info *__alloc_heap_pages(
     unsigned int zone_lo, unsigned int zone_hi,
     unsigned int order, unsigned int memflags,
     struct domain *d)
 {
-    unsigned int first_node, i, j, zone = 0, nodemask_retry = 0;
-    unsigned int node = (uint8_t)((memflags >> _MEMF_node) - 1);
+    unsigned int first_node, i, j, zone = 0, nodemask_retry = 0, nr_refill;
+    unsigned int node = (uint8_t)((memflags >> _MEMF_node) - 1), dirty;
     unsigned long request = 1UL << order;
     struct page_info *pg;
     nodemask_t nodemask = (d != NULL ) ? d->node_affinity : node_online_map;
-    bool_t need_tlbflush = 0;
+    bool_t need_tlbflush = 0, need_scrub;
     uint32_t tlbflush_timestamp = 0;
+    PAGE_LIST_HEAD(refill);
 
     if ( node == NUMA_NO_NODE )
     {
@@ -592,6 +1088,20 @@ static struct page_info *alloc_heap_pages(
     if ( unlikely(order > MAX_ORDER) )
         return NULL;
 
+    if ( (pg = pcp_alloc(node, zone_lo, zone_hi, order, d)) != NULL )
+    {
+        if ( d != NULL )
+            d->last_alloc_node = node;
+
+        for ( i = 0; i < (1 << order); i++ )
+            init_alloc_page(&pg[i], &need_tlbflush, &tlbflush_timestamp);
+
+        if ( need_tlbflush )
+            flush_alloc_tlb(tlbflush_timestamp);
+
+        return pg;
+    }
+
     spin_lock(&heap_lock);
 
     /*
@@ -621,17 +1131,30 @@ static struct page_info *alloc_heap_pages(
      */
     for ( ; ; )
     {
-        zone = zone_hi;
-        do {
-            /* Check if target node can support the allocation. */
-            if ( !avail[node] || (avail[node][zone] < request) )
-                continue;
-
-            /* Find smallest order which can satisfy the request. */
-            for ( j = order; j <= MAX_ORDER; j++ )
-                if ( (pg = page_list_remove_head(&heap(node, zone, j))) )
-                    goto found;
-        } while ( zone-- > zone_lo ); /* careful: unsigned zone may wrap */
+        /*
+         * Find smallest order which can satisfy the request, in any zone of
+         * the node, preferring chunks which are already scrubbed.  Single
+         * pages are cheap enough to scrub that it isn't worth breaking up a
+         * larger chunk to avoid it.  Requests above SCRUB_INLINE_MAX_ORDER
+         * never take dirty chunks: they fail instead, and the caller falls
+         * back to smaller orders while idle CPUs catch up with scrubbing.
+         */
+        for ( dirty = 0; dirty <= (order <= SCRUB_INLINE_MAX_ORDER); dirty++ )
+        {
+            zone = zone_hi;
+            do {
+                /* Check if target node can support the allocation. */
+                if ( !avail[node] || (avail[node][zone] < request) )
+                    continue;
+
+                for ( j = order; j <= MAX_ORDER; j++ )
+                    if ( !page_list_empty(&heap(node, zone, j)) &&
+                         (dirty || !order ||
+                          !page_need_scrub(page_list_first(
+                              &heap(node, zone, j)))) )
+                        goto found;
+            } while ( zone-- > zone_lo ); /* careful: unsigned zone may wrap */
+        }
 
         if ( memflags & MEMF_exact_node )
             goto not_found;
@@ -674,17 +1197,20 @@ static struct page_info *alloc_heap_pages(
     return NULL;
 
  found: 
+    pg = page_list_first(&heap(node, zone, j));
+    need_scrub = page_need_scrub(pg);
+    heap_del(pg, node, zone, j);
+
     /* We may have to halve the chunk a number of times. */
-    while ( j != order )
-    {
-        PFN_ORDER(pg) = --j;
-        page_list_add_tail(pg, &heap(node, zone, j));
-        pg += 1 << j;
-    }
+    pg = split_heap_chunk(pg, node, zone, j, order);
 
     ASSERT(avail[node][zone] >= request);
     avail[node][zone] -= request;
     total_avail_pages -= request;
+
+    /* Take a batch more while we hold the lock, to refill the local cache. */
+    nr_refill = pcp_take_batch(node, zone, order, &refill);
+
     ASSERT(total_avail_pages >= 0);
 
     check_low_mem_virq();
@@ -695,40 +1221,42 @@ static struct page_info *alloc_heap_pages(
     for ( i = 0; i < (1 << order); i++ )
     {
         /* Reference count must continuously be zero for free pages. */
-        BUG_ON(pg[i].count_info != PGC_state_free);
+        BUG_ON((pg[i].count_info & ~PGC_need_scrub) != PGC_state_free);
         pg[i].count_info = PGC_state_inuse;
 
-        if ( pg[i].u.free.need_tlbflush &&
-             (pg[i].tlbflush_timestamp <= tlbflush_current_time()) &&
-             (!need_tlbflush ||
-              (pg[i].tlbflush_timestamp > tlbflush_timestamp)) )
-        {
-            need_tlbflush = 1;
-            tlbflush_timestamp = pg[i].tlbflush_timestamp;
-        }
-
-        /* Initialise fields which have other uses for free pages. */
-        pg[i].u.inuse.type_info = 0;
-        page_set_owner(&pg[i], NULL);
-
-        /* Ensure cache and RAM are consistent for platforms where the
-         * guest can control its own visibility of/through the cache.
-         */
-        flush_page_to_ram(page_to_mfn(&pg[i]));
+        init_alloc_page(&pg[i], &need_tlbflush, &tlbflush_timestamp);
     }
 
     spin_unlock(&heap_lock);
 
-    if ( need_tlbflush )
-    {
-        cpumask_t mask = cpu_online_map;
-        tlbflush_filter(mask, tlbflush_timestamp);
-        if ( !cpumask_empty(&mask) )
+    /* No clean memory was to hand: scrub what we got. */
+    if ( need_scrub )
+        for ( i = 0; i < (1 << order); i++ )
         {
-            perfc_incr(need_flush_tlb_flush);
-            flush_tlb_mask(&mask);
+            scrub_one_page(&pg[i]);
+            flush_page_to_ram(page_to_mfn(&pg[i]));
         }
-    }
+
+    pcp_refill(&refill, order, nr_refill);
+
+    if ( need_tlbflush )
+        flush_alloc_tlb(tlbflush_timestamp);
+
+    return pg;
+}
+
+static struct page_info *alloc_heap_pages(
+    unsigned int zone_lo, unsigned int zone_hi,
+    unsigned int order, unsigned int memflags,
+    struct domain *d)
+{
+    struct page_info *pg;
+
+    pg = __alloc_heap_pages(zone_lo, zone_hi, order, memflags, d);
+
+    /* Memory sitting in per-CPU caches may still satisfy the request. */
+    if ( unlikely(pg == NULL) && pcp_drain_all() )
+        pg = __alloc_heap_pages(zone_lo, zone_hi, order, memflags, d);
 
     return pg;
 }
@@ -740,12 +1268,13 @@ static int reserve_offlined_page(struct page_info *head)
     int zone = page_to_zone(head), i, head_order = PFN_ORDER(head), count = 0;
     struct page_info *cur_head;
     int cur_order;
+    unsigned long need_scrub = head->count_info & PGC_need_scrub;
 
     ASSERT(spin_is_locked(&heap_lock));
 
     cur_head = head;
 
-    page_list_del(head, &heap(node, zone, head_order));
+    heap_del(head, node, zone, head_order);
 
     while ( cur_head < (head + (1 << head_order)) )
     {
@@ -781,44 +1310,112 @@ static int reserve_offlined_page(struct page_info *head)
             {
             merge:
                 /* We don't consider merging outside the head_order. */
-                page_list_add_tail(cur_head, &heap(node, zone, cur_order));
-                PFN_ORDER(cur_head) = cur_order;
+                cur_head->count_info =
+                    (cur_head->count_info & ~PGC_need_scrub) | need_scrub;
+                heap_add(cur_head, node, zone, cur_order);
                 cur_head += (1 << cur_order);
                 break;
-            }
+            }
+        }
+    }
+
+    for ( cur_head = head; cur_head < head + ( 1UL << head_order); cur_head++ )
+    {
+        if ( !page_state_is(cur_head, offlined) )
+            continue;
+
+        avail[node][zone]--;
+        total_avail_pages--;
+        ASSERT(total_avail_pages >= 0);
+
+        /* Remember to scrub it, should it be brought back online. */
+        cur_head->count_info |= need_scrub;
+
+        page_list_add_tail(cur_head,
+                           test_bit(_PGC_broken, &cur_head->count_info) ?
+                           &page_broken_list : &page_offlined_list);
+
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ * Return a 2^@order chunk to the buddy lists, merging it where possible.
+ * Chunks are only merged with buddies in the same scrub state, so that
+ * scrubbed memory isn't lost into a chunk still needing a scrub.
+ */
+static void merge_free_heap_pages(struct page_info *pg, unsigned int order,
+                                  unsigned int node, unsigned int zone,
+                                  bool_t tainted)
+{
+    unsigned long mask;
+    bool_t need_scrub = page_need_scrub(pg);
+
+    ASSERT(spin_is_locked(&heap_lock));
+
+    avail[node][zone] += 1 << order;
+    total_avail_pages += 1 << order;
+
+    if ( opt_tmem )
+        midsize_alloc_zone_pages = max(
+            midsize_alloc_zone_pages, total_avail_pages / MIDSIZE_ALLOC_FRAC);
+
+    /* Merge chunks as far as possible. */
+    while ( order < MAX_ORDER )
+    {
+        mask = 1UL << order;
+
+        if ( (page_to_mfn(pg) & mask) )
+        {
+            /* Merge with predecessor block? */
+            if ( !mfn_valid(page_to_mfn(pg-mask)) ||
+                 !page_state_is(pg-mask, free) ||
+                 (PFN_ORDER(pg-mask) != order) ||
+                 (phys_to_nid(page_to_maddr(pg-mask)) != node) ||
+                 (page_need_scrub(pg-mask) != need_scrub) )
+                break;
+            pg->count_info &= ~PGC_need_scrub;
+            pg -= mask;
+            heap_del(pg, node, zone, order);
+        }
+        else
+        {
+            /* Merge with successor block? */
+            if ( !mfn_valid(page_to_mfn(pg+mask)) ||
+                 !page_state_is(pg+mask, free) ||
+                 (PFN_ORDER(pg+mask) != order) ||
+                 (phys_to_nid(page_to_maddr(pg+mask)) != node) ||
+                 (page_need_scrub(pg+mask) != need_scrub) )
+                break;
+            heap_del(pg + mask, node, zone, order);
+            (pg + mask)->count_info &= ~PGC_need_scrub;
         }
-    }
-
-    for ( cur_head = head; cur_head < head + ( 1UL << head_order); cur_head++ )
-    {
-        if ( !page_state_is(cur_head, offlined) )
-            continue;
-
-        avail[node][zone]--;
-        total_avail_pages--;
-        ASSERT(total_avail_pages >= 0);
-
-        page_list_add_tail(cur_head,
-                           test_bit(_PGC_broken, &cur_head->count_info) ?
-                           &page_broken_list : &page_offlined_list);
 
-        count++;
+        order++;
     }
 
-    return count;
+    heap_add(pg, node, zone, order);
+
+    if ( tainted )
+        reserve_offlined_page(pg);
 }
 
-/* Free 2^@order set of pages. */
+/* Free 2^@order set of pages, whose contents may need scrubbing. */
 static void free_heap_pages(
-    struct page_info *pg, unsigned int order)
+    struct page_info *pg, unsigned int order, bool_t need_scrub)
 {
-    unsigned long mask, mfn = page_to_mfn(pg);
+    unsigned long mfn = page_to_mfn(pg);
     unsigned int i, node = phys_to_nid(page_to_maddr(pg)), tainted = 0;
     unsigned int zone = page_to_zone(pg);
 
     ASSERT(order <= MAX_ORDER);
     ASSERT(node >= 0);
 
+    if ( !need_scrub && pcp_free(pg, order) )
+        return;
+
     spin_lock(&heap_lock);
 
     for ( i = 0; i < (1 << order); i++ )
@@ -852,50 +1449,158 @@ static void free_heap_pages(
         set_gpfn_from_mfn(mfn + i, INVALID_M2P_ENTRY);
     }
 
-    avail[node][zone] += 1 << order;
-    total_avail_pages += 1 << order;
+    if ( need_scrub )
+        pg->count_info |= PGC_need_scrub;
 
-    if ( opt_tmem )
-        midsize_alloc_zone_pages = max(
-            midsize_alloc_zone_pages, total_avail_pages / MIDSIZE_ALLOC_FRAC);
+    merge_free_heap_pages(pg, order, node, zone, tainted);
 
-    /* Merge chunks as far as possible. */
-    while ( order < MAX_ORDER )
+    spin_unlock(&heap_lock);
+}
+
+/*************************
+ * BACKGROUND SCRUBBING
+ *
+ * Memory freed by dying domains goes back to the heap unscrubbed, and is
+ * scrubbed by idle CPUs local to its node, a bounded chunk at a time, so
+ * that tearing down a large guest neither holds up the destroying CPU nor
+ * sits on heap_lock.  Allocations only scrub memory themselves when no
+ * clean memory is to hand.
+ */
+
+/* Largest chunk taken off the heap to be scrubbed in one go (1MB). */
+#define SCRUB_CHUNK_ORDER 8
+/* Pages scrubbed between checks for pending work. */
+#define SCRUB_BATCH       16
+
+/* Return an aligned 2^@order block being scrubbed to the heap. */
+static void scrub_release(struct page_info *pg, unsigned int order,
+                          bool_t need_scrub)
+{
+    unsigned int i, node = phys_to_nid(page_to_maddr(pg));
+    unsigned int zone = page_to_zone(pg);
+    bool_t tainted = 0;
+
+    ASSERT(spin_is_locked(&heap_lock));
+
+    for ( i = 0; i < (1 << order); i++ )
     {
-        mask = 1UL << order;
+        pg[i].count_info =
+            ((pg[i].count_info & PGC_broken) |
+             (page_state_is(&pg[i], offlining)
+              ? PGC_state_offlined : PGC_state_free));
+        if ( page_state_is(&pg[i], offlined) )
+            tainted = 1;
+    }
 
-        if ( (page_to_mfn(pg) & mask) )
-        {
-            /* Merge with predecessor block? */
-            if ( !mfn_valid(page_to_mfn(pg-mask)) ||
-                 !page_state_is(pg-mask, free) ||
-                 (PFN_ORDER(pg-mask) != order) ||
-                 (phys_to_nid(page_to_maddr(pg-mask)) != node) )
-                break;
-            pg -= mask;
-            page_list_del(pg, &heap(node, zone, order));
-        }
-        else
+    if ( need_scrub )
+        pg->count_info |= PGC_need_scrub;
+
+    merge_free_heap_pages(pg, order, node, zone, tainted);
+}
+
+/*
+ * Take a chunk of @node's free memory waiting to be scrubbed off the heap,
+ * scrub it, and give it back; returns whether there was any.
+ */
+static bool_t scrub_node_chunk(unsigned int node)
+{
+    unsigned int cpu = smp_processor_id();
+    unsigned int zone, j, order, done, off;
+    struct page_info *pg = NULL;
+
+    spin_lock(&heap_lock);
+
+    /* Smallest chunks first, as they are the most likely to coalesce. */
+    for ( zone = 0; zone < NR_ZONES && !pg; zone++ )
+        for ( j = 0; j <= MAX_ORDER; j++ )
         {
-            /* Merge with successor block? */
-            if ( !mfn_valid(page_to_mfn(pg+mask)) ||
-                 !page_state_is(pg+mask, free) ||
-                 (PFN_ORDER(pg+mask) != order) ||
-                 (phys_to_nid(page_to_maddr(pg+mask)) != node) )
+            if ( page_list_empty(&heap(node, zone, j)) )
+                continue;
+            pg = page_list_last(&heap(node, zone, j));
+            if ( page_need_scrub(pg) )
                 break;
-            page_list_del(pg + mask, &heap(node, zone, order));
+            pg = NULL;
         }
 
-        order++;
+    if ( pg == NULL )
+    {
+        spin_unlock(&heap_lock);
+        return 0;
     }
 
-    PFN_ORDER(pg) = order;
-    page_list_add_tail(pg, &heap(node, zone, order));
+    zone--;
+    order = min_t(unsigned int, j, SCRUB_CHUNK_ORDER);
+    heap_del(pg, node, zone, j);
+    pg = split_heap_chunk(pg, node, zone, j, order);
 
-    if ( tainted )
-        reserve_offlined_page(pg);
+    /* Off the heap while being scrubbed, it mustn't be merged or handed out. */
+    avail[node][zone] -= 1UL << order;
+    total_avail_pages -= 1UL << order;
+    for ( done = 0; done < (1U << order); done++ )
+        pg[done].count_info = PGC_state_inuse;
+
+    spin_unlock(&heap_lock);
+
+    for ( done = 0; done < (1U << order); done++ )
+    {
+        if ( done && !(done % SCRUB_BATCH) && softirq_pending(cpu) )
+            break;
+        scrub_one_page(&pg[done]);
+    }
+
+    spin_lock(&heap_lock);
+
+    if ( !done )
+        scrub_release(pg, order, 1);
+    else
+    {
+        /* Scrubbed blocks, largest first, keep themselves aligned... */
+        for ( off = 0, j = order + 1; j-- > 0; )
+            if ( done & (1U << j) )
+            {
+                scrub_release(pg + off, j, 0);
+                off += 1U << j;
+            }
+        /* ...as do the remaining ones, sized by the alignment reached. */
+        while ( off < (1U << order) )
+        {
+            j = find_first_set_bit(off);
+            scrub_release(pg + off, j, 1);
+            off += 1U << j;
+        }
+    }
 
     spin_unlock(&heap_lock);
+
+    return 1;
+}
+
+/*
+ * Scrub some free memory of the local node, if there is any waiting.  Called
+ * from the idle loop; returns whether any work was done, in which case the
+ * caller shouldn't enter a low-power state.
+ */
+bool_t scrub_free_pages(void)
+{
+    unsigned int cpu = smp_processor_id(), node = cpu_to_node(cpu);
+
+    if ( (node >= MAX_NUMNODES) || !node_need_scrub[node] ||
+         !cpu_is_haltable(cpu) )
+        return 0;
+
+    return scrub_node_chunk(node);
+}
+
+/* Number of free pages still waiting to be scrubbed. */
+unsigned long scrub_pending_pages(void)
+{
+    unsigned int node;
+    unsigned long nr = 0;
+
+    for_each_online_node ( node )
+        nr += node_need_scrub[node];
+
+    return nr;
 }
 
 
@@ -1004,6 +1709,9 @@ int offline_page(unsigned long mfn, int broken, uint32_t *status)
         return 0;
     }
 
+    /* A free page may be sitting in a per-CPU cache rather than the heap. */
+    pcp_drain_all();
+
     spin_lock(&heap_lock);
 
     old_info = mark_page_offline(pg, broken);
@@ -1110,12 +1818,14 @@ unsigned int online_page(unsigned long mfn, uint32_t *status)
 
         x = y;
         nx = (x & ~PGC_state) | PGC_state_inuse;
+        if ( (x & PGC_state) == PGC_state_offlined )
+            nx &= ~PGC_need_scrub;
     } while ( (y = cmpxchg(&pg->count_info, x, nx)) != x );
 
     spin_unlock(&heap_lock);
 
     if ( (y & PGC_state) == PGC_state_offlined )
-        free_heap_pages(pg, 0);
+        free_heap_pages(pg, 0, !!(y & PGC_need_scrub));
 
     return ret;
 }
@@ -1147,6 +1857,69 @@ int query_page_offline(unsigned long mfn, uint32_t *status)
     return 0;
 }
 
+/*
+ * Pages set up between two takings of heap_lock by init_heap_pages() (1GB
+ * with 4kB pages), so that nodes being set up in parallel don't serialise
+ * on it.
+ */
+#define INIT_HEAP_BATCH (1UL << 18)
+
+/*
+ * Get a chunk ready to be handed to the heap, without heap_lock.  Its head
+ * is left in use until init_heap_flush(), so that the buddy allocator won't
+ * merge with it meanwhile; the other pages are never looked at as buddies.
+ * Returns 0 if the chunk has pages being offlined, or broken ones, which
+ * must go through free_heap_pages().
+ */
+static bool_t init_heap_chunk(struct page_info *pg, unsigned int order)
+{
+    unsigned long mfn = page_to_mfn(pg);
+    unsigned int i;
+
+    for ( i = 0; i < (1 << order); i++ )
+        if ( (pg[i].count_info & PGC_broken) ||
+             !page_state_is(&pg[i], inuse) )
+            return 0;
+
+    for ( i = 0; i < (1 << order); i++ )
+    {
+        pg[i].count_info = i ? PGC_state_free : PGC_state_inuse;
+
+        /* If a page has no owner it will need no safety TLB flush. */
+        pg[i].u.free.need_tlbflush = (page_get_owner(&pg[i]) != NULL);
+        if ( pg[i].u.free.need_tlbflush )
+            pg[i].tlbflush_timestamp = tlbflush_current_time();
+
+        /* This page is not a guest frame any more. */
+        page_set_owner(&pg[i], NULL); /* set_gpfn_from_mfn snoops pg owner */
+        set_gpfn_from_mfn(mfn + i, INVALID_M2P_ENTRY);
+    }
+    PFN_ORDER(pg) = order;
+
+    return 1;
+}
+
+/* Hand a batch of chunks readied by init_heap_chunk() to the heap. */
+static void init_heap_flush(struct page_list_head *batch)
+{
+    struct page_info *pg;
+
+    if ( page_list_empty(batch) )
+        return;
+
+    spin_lock(&heap_lock);
+
+    while ( (pg = page_list_remove_head(batch)) != NULL )
+    {
+        pg->count_info = PGC_state_free;
+        merge_free_heap_pages(pg, PFN_ORDER(pg),
+                              phys_to_nid(page_to_maddr(pg)),
+                              page_to_zone(pg), 0);
+    }
+
+    spin_unlock(&heap_lock);
+}
+
 /*
  * Hand the specified arbitrary page range to the specified heap zone
  * checking the node_id of the previous page.  If they differ and the
@@ -1156,12 +1929,16 @@ int query_page_offline(unsigned long mfn, uint32_t *status)
 static void init_heap_pages(
     struct page_info *pg, unsigned long nr_pages)
 {
-    unsigned long i;
+    unsigned long i, mfn, batched = 0;
+    unsigned int order;
+    PAGE_LIST_HEAD(batch);
 
-    for ( i = 0; i < nr_pages; i++ )
+    for ( i = 0; i < nr_pages; i += 1UL << order )
     {
         unsigned int nid = phys_to_nid(page_to_maddr(pg+i));
 
+        order = 0;
+
         if ( unlikely(!avail[nid]) )
         {
             unsigned long s = page_to_mfn(pg + i);
@@ -1171,6 +1948,10 @@ static void init_heap_pages(
                               (find_first_set_bit(e) <= find_first_set_bit(s));
             unsigned long n;
 
+            /* Setting up the node may allocate: the heap must be whole. */
+            init_heap_flush(&batch);
+            batched = 0;
+
             n = init_node_heap(nid, page_to_mfn(pg+i), nr_pages - i,
                                &use_tail);
             BUG_ON(i + n > nr_pages);
@@ -1184,7 +1965,124 @@ static void init_heap_pages(
             nr_pages -= n;
         }
 
-        free_heap_pages(pg+i, 0);
+        /*
+         * Hand over the largest aligned chunk which fits the range and the
+         * node, rather than a page at a time.
+         */
+        mfn = page_to_mfn(pg + i);
+        while ( mfn && (order < MAX_ORDER) &&
+                !(mfn & ((2UL << order) - 1)) &&
+                (i + (2UL << order) <= nr_pages) &&
+                (phys_to_nid(page_to_maddr(pg + i + (2UL << order) - 1)) ==
+                 nid) )
+            order++;
+
+        if ( !init_heap_chunk(pg + i, order) )
+        {
+            free_heap_pages(pg + i, order, 0);
+            continue;
+        }
+
+        page_list_add_tail(pg + i, &batch);
+        batched += 1UL << order;
+        if ( batched >= INIT_HEAP_BATCH )
+        {
+            init_heap_flush(&batch);
+            batched = 0;
+        }
+    }
+
+    init_heap_flush(&batch);
+}
+
+/*
+ * On NUMA hosts, the memory of all nodes but the boot CPU's is handed to the
+ * heap only after SMP bringup, by a CPU local to each node, all in parallel.
+ */
+static bool_t __initdata opt_parallel_heap_init = 1;
+boolean_param("parallel_heap_init", opt_parallel_heap_init);
+
+static bool_t __initdata heap_init_deferred;
+
+/* Hand the pages of @node within [@s, @e) to the heap. */
+static void __init init_node_pages(
+    unsigned int node, unsigned long s, unsigned long e)
+{
+    unsigned long n;
+
+    s = max(s, node_start_pfn(node));
+    e = min(e, node_end_pfn(node));
+
+    while ( s < e )
+    {
+        while ( (s < e) && (phys_to_nid(pfn_to_paddr(s)) != node) )
+            s++;
+        for ( n = s; (n < e) && (phys_to_nid(pfn_to_paddr(n)) == node); n++ )
+            continue;
+        if ( n > s )
+            init_heap_pages(mfn_to_page(s), n - s);
+        s = n;
+    }
+}
+
+static atomic_t __initdata node_work_pending;
+static void (*__initdata node_work_fn)(unsigned int node);
+
+static void __init node_work_tasklet(unsigned long node)
+{
+    node_work_fn(node);
+    smp_mb();
+    atomic_dec(&node_work_pending);
+}
+
+/*
+ * Run @fn for each node in @nodes, on a CPU of that node where there is one
+ * online, and on this CPU otherwise; return once all have completed.
+ */
+static void __init run_on_nodes(const nodemask_t *nodes,
+                                void (*fn)(unsigned int node))
+{
+    static struct tasklet __initdata node_work[MAX_NUMNODES];
+    nodemask_t local = NODE_MASK_NONE;
+    cpumask_t cpus;
+    unsigned int node, cpu;
+
+    node_work_fn = fn;
+
+    for_each_node_mask ( node, *nodes )
+    {
+        cpumask_and(&cpus, &node_to_cpumask(node), &cpu_online_map);
+        cpu = cpumask_first(&cpus);
+        if ( (cpu >= nr_cpu_ids) ||
+             cpumask_test_cpu(smp_processor_id(), &cpus) )
+        {
+            node_set(node, local);
+            continue;
+        }
+        atomic_inc(&node_work_pending);
+        tasklet_init(&node_work[node], node_work_tasklet, node);
+        tasklet_schedule_on_cpu(&node_work[node], cpu);
+    }
+
+    for_each_node_mask ( node, local )
+        fn(node);
+
+    while ( atomic_read(&node_work_pending) )
+    {
+        process_pending_softirqs();
+        cpu_relax();
+    }
+}
+
+static void __init heap_init_node(unsigned int node)
+{
+    unsigned int i;
+
+    for ( i = 0; i < nr_bootmem_regions; i++ )
+    {
+        struct bootmem_region *r = &bootmem_region_list[i];
+        if ( r->s < r->e )
+            init_node_pages(node, r->s, r->e);
     }
 }
 
@@ -1211,7 +2109,7 @@ static unsigned long avail_heap_pages(
 
 unsigned long total_free_pages(void)
 {
-    return total_avail_pages - midsize_alloc_zone_pages;
+    return total_avail_pages + pcp_cached_pages(-1) - midsize_alloc_zone_pages;
 }
 
 void __init end_boot_allocator(void)
@@ -1230,13 +2128,27 @@ void __init end_boot_allocator(void)
             break;
         }
     }
+
+    /*
+     * The boot CPU's node must have its heap (and statically allocated heap
+     * metadata) before other nodes can be set up concurrently.
+     */
+    heap_init_deferred = opt_parallel_heap_init &&
+                         (num_online_nodes() > 1) &&
+                         avail[cpu_to_node(0)];
+
     for ( i = nr_bootmem_regions; i-- > 0; )
     {
         struct bootmem_region *r = &bootmem_region_list[i];
-        if ( r->s < r->e )
+        if ( r->s >= r->e )
+            continue;
+        if ( heap_init_deferred )
+            init_node_pages(cpu_to_node(0), r->s, r->e);
+        else
             init_heap_pages(mfn_to_page(r->s), r->e - r->s);
     }
-    init_heap_pages(virt_to_page(bootmem_region_list), 1);
+    if ( !heap_init_deferred )
+        init_heap_pages(virt_to_page(bootmem_region_list), 1);
 
     if ( !dma_bitsize && (num_online_nodes() > 1) )
     {
@@ -1253,17 +2165,43 @@ void __init end_boot_allocator(void)
     printk("Domain heap initialised");
     if ( dma_bitsize )
         printk(" DMA width %u bits", dma_bitsize);
+    if ( heap_init_deferred )
+        printk(" (node%u only)", cpu_to_node(0));
     printk("\n");
 }
 
+/* Hand the memory of the remaining nodes to the heap, after SMP bringup. */
+void __init heap_init_late(void)
+{
+    nodemask_t nodes = node_online_map;
+
+    if ( !heap_init_deferred )
+        return;
+
+    node_clear(cpu_to_node(0), nodes);
+    run_on_nodes(&nodes, heap_init_node);
+
+    init_heap_pages(virt_to_page(bootmem_region_list), 1);
+    heap_init_deferred = 0;
+
+    printk("Domain heap initialised on all nodes\n");
+}
+
+static void __init scrub_heap_node(unsigned int node)
+{
+    while ( node_need_scrub[node] && scrub_node_chunk(node) )
+        process_pending_softirqs();
+}
+
 /*
- * Scrub all unallocated pages in all heap zones. This function is more
- * convoluted than appears necessary because we do not want to continuously
- * hold the lock while scrubbing very large memory areas.
+ * Scrub all unallocated pages in all heap zones.  Every free chunk is marked
+ * as needing a scrub, and each node's memory is then scrubbed by a CPU local
+ * to it, all in parallel, taking heap_lock only to take chunks off the heap
+ * and give them back.
  */
 void __init scrub_heap_pages(void)
 {
-    unsigned long mfn;
+    unsigned int node, zone, order;
     struct page_info *pg;
 
     if ( !opt_bootscrub )
@@ -1271,28 +2209,31 @@ void __init scrub_heap_pages(void)
 
     printk("Scrubbing Free RAM: ");
 
-    for ( mfn = first_valid_mfn; mfn < max_page; mfn++ )
-    {
-        process_pending_softirqs();
-
-        pg = mfn_to_page(mfn);
+    spin_lock(&heap_lock);
 
-        /* Quick lock-free check. */
-        if ( !mfn_valid(mfn) || !page_state_is(pg, free) )
+    for_each_online_node ( node )
+    {
+        if ( !avail[node] )
             continue;
+        for ( zone = 0; zone < NR_ZONES; zone++ )
+            for ( order = 0; order <= MAX_ORDER; order++ )
+            {
+                struct page_list_head *list = &heap(node, zone, order);
+
+                /* Clean chunks sit at the head of the list. */
+                while ( !page_list_empty(list) &&
+                        !page_need_scrub(pg = page_list_first(list)) )
+                {
+                    heap_del(pg, node, zone, order);
+                    pg->count_info |= PGC_need_scrub;
+                    heap_add(pg, node, zone, order);
+                }
+            }
+    }
 
-        /* Every 100MB, print a progress dot. */
-        if ( (mfn % ((100*1024*1024)/PAGE_SIZE)) == 0 )
-            printk(".");
-
-        spin_lock(&heap_lock);
-
-        /* Re-check page status with lock held. */
-        if ( page_state_is(pg, free) )
-            scrub_one_page(pg);
+    spin_unlock(&heap_lock);
 
-        spin_unlock(&heap_lock);
-    }
+    run_on_nodes(&node_online_map, scrub_heap_node);
 
     printk("done.\n");
 
@@ -1357,7 +2298,7 @@ void free_xenheap_pages(void *v, unsigned int order)
 
     memguard_guard_range(v, 1 << (order + PAGE_SHIFT));
 
-    free_heap_pages(virt_to_page(v), order);
+    free_heap_pages(virt_to_page(v), order, 0);
 }
 
 #else
@@ -1411,7 +2352,7 @@ void free_xenheap_pages(void *v, unsigned int order)
     for ( i = 0; i < (1u << order); i++ )
         pg[i].count_info &= ~PGC_xen_heap;
 
-    free_heap_pages(pg, order);
+    free_heap_pages(pg, order, 0);
 }
 
 #endif
@@ -1515,7 +2456,7 @@ struct page_info *alloc_domheap_pages(
 
     if ( (d != NULL) && assign_pages(d, pg, order, memflags) )
     {
-        free_heap_pages(pg, order);
+        free_heap_pages(pg, order, 0);
         return NULL;
     }
     
@@ -1561,25 +2502,21 @@ void free_domheap_pages(struct page_info *pg, unsigned int order)
         /*
          * Normally we expect a domain to clear pages before freeing them, if 
          * it cares about the secrecy of their contents. However, after a 
-         * domain has died we assume responsibility for erasure.
+         * domain has died we assume responsibility for erasure: the pages
+         * are scrubbed in the background, or on their next allocation.
          */
-        if ( unlikely(d->is_dying) )
-            for ( i = 0; i < (1 << order); i++ )
-                scrub_one_page(&pg[i]);
-
-        free_heap_pages(pg, order);
+        free_heap_pages(pg, order, !!d->is_dying);
     }
     else if ( unlikely(d == dom_cow) )
     {
         ASSERT(order == 0); 
-        scrub_one_page(pg);
-        free_heap_pages(pg, 0);
+        free_heap_pages(pg, 0, 1);
         drop_dom_ref = 0;
     }
     else
     {
         /* Freeing anonymous domain-heap pages. */
-        free_heap_pages(pg, order);
+        free_heap_pages(pg, order, 0);
         drop_dom_ref = 0;
     }
 
@@ -1605,12 +2542,13 @@ unsigned long avail_domheap_pages(void)
 {
     return avail_heap_pages(MEMZONE_XEN + 1,
                             NR_ZONES - 1,
-                            -1);
+                            -1) + pcp_cached_pages(-1);
 }
 
 unsigned long avail_node_heap_pages(unsigned int nodeid)
 {
-    return avail_heap_pages(MEMZONE_XEN, NR_ZONES -1, nodeid);
+    return avail_heap_pages(MEMZONE_XEN, NR_ZONES -1, nodeid) +
+           pcp_cached_pages(nodeid);
 }
 
 
@@ -1639,6 +2577,10 @@ static void pagealloc_info(unsigned char key)
     }
 
     printk("    Dom heap: %lukB free\n", total << (PAGE_SHIFT-10));
+    printk("    Per-CPU caches: %lukB\n",
+           pcp_cached_pages(-1) << (PAGE_SHIFT-10));
+    printk("    Scrub pending: %lukB\n",
+           scrub_pending_pages() << (PAGE_SHIFT-10));
 }
 
 static struct keyhandler pagealloc_info_keyhandler = {
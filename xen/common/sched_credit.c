@@ -122,6 +122,8 @@
  */
 static int __read_mostly sched_credit_tslice_ms = CSCHED_DEFAULT_TSLICE_MS;
 integer_param("sched_credit_tslice_ms", sched_credit_tslice_ms);
+static bool_t __read_mostly sched_credit_tickless;
+boolean_param("sched_credit_tickless", sched_credit_tickless);
 
 /*
  * Physical CPU
@@ -134,6 +136,14 @@ struct csched_pcpu {
     unsigned int idle_bias;
     /* Store this here to avoid having too many cpumask_var_t-s on stack */
     cpumask_var_t balance_mask;
+    /* Active VCPUs this PCPU does the accounting of, see csched_acct() */
+    spinlock_t acct_lock;
+    struct list_head active_vcpu;
+    unsigned int acct_epoch;
+    int credit_balance;
+    struct list_head pcpu_elem;
+    /* Tickless mode: ticker not armed since then */
+    s_time_t tick_stop_time;
 };
 
 /*
@@ -156,6 +166,7 @@ struct csched_vcpu {
     atomic_t credit;
     unsigned int residual;
     s_time_t start_time;   /* When we were scheduled (used for credit) */
+    struct csched_pcpu *acct_pcpu; /* Whose active_vcpu list we are on */
     unsigned flags;
     int16_t pri;
 #ifdef CSCHED_STATS
@@ -175,15 +186,18 @@ struct csched_vcpu {
  * Domain
  */
 struct csched_dom {
-    struct list_head active_vcpu;
     struct list_head active_sdom_elem;
     struct domain *dom;
     /* cpumask translated from the domain's node-affinity.
      * Basically, the CPUs we prefer to be scheduled on. */
     cpumask_var_t node_affinity_cpumask;
-    uint16_t active_vcpu_count;
+    atomic_t active_vcpu_count;
     uint16_t weight;
     uint16_t cap;
+    /* Per-VCPU credit and cap, as of the last accounting period */
+    uint16_t acct_active;
+    int acct_credit;
+    int acct_cap;
 };
 
 /*
@@ -193,6 +207,7 @@ struct csched_private {
     /* lock for the whole pluggable scheduler, nests inside cpupool_lock */
     spinlock_t lock;
     struct list_head active_sdom;
+    struct list_head pcpus;
     uint32_t ncpus;
     struct timer  master_ticker;
     unsigned int master;
@@ -202,7 +217,11 @@ struct csched_private {
     uint32_t credit;
     int credit_balance;
     uint32_t runq_sort;
+    unsigned int acct_epoch;
     unsigned ratelimit_us;
+    bool_t tickless;
+    cpumask_var_t tickless_cpus;
+    cpumask_var_t waiters;
     /* Period of master and tick in milliseconds */
     unsigned tslice_ms, tick_period_us, ticks_per_tslice;
     unsigned credits_per_tslice;
@@ -291,6 +310,59 @@ static void csched_set_node_affinity(
 #define for_each_csched_balance_step(step) \
     for ( (step) = 0; (step) <= CSCHED_BALANCE_CPU_AFFINITY; (step)++ )
 
+/*
+ * Topology levels, from the closest to the farthest from a given PCPU.
+ * Load balancing walks them in this order, so that work is stolen from
+ * SMT siblings first, then from PCPUs sharing the last level cache, then
+ * from the same node and, only as a last resort, from the rest of the
+ * system. We have no explicit knowledge of the last level cache, so we
+ * take it to be shared by the PCPUs of the same socket and node, which
+ * holds both for sockets with one node and for multi-node sockets.
+ */
+#define CSCHED_TOPO_SMT         0
+#define CSCHED_TOPO_LLC         1
+#define CSCHED_TOPO_NODE        2
+#define CSCHED_TOPO_SYSTEM      3
+#define CSCHED_TOPO_LEVELS      4
+
+#define for_each_csched_topo_level(lvl) \
+    for ( (lvl) = CSCHED_TOPO_SMT; (lvl) < CSCHED_TOPO_LEVELS; (lvl)++ )
+
+/* The PCPUs which are within level lvl of cpu, cpu itself included */
+static inline void
+csched_topo_cpumask(unsigned int cpu, int lvl, cpumask_t *mask)
+{
+    switch ( lvl )
+    {
+    case CSCHED_TOPO_SMT:
+        cpumask_copy(mask, per_cpu(cpu_sibling_mask, cpu));
+        break;
+    case CSCHED_TOPO_LLC:
+        cpumask_and(mask, per_cpu(cpu_core_mask, cpu),
+                    &node_to_cpumask(cpu_to_node(cpu)));
+        break;
+    case CSCHED_TOPO_NODE:
+        cpumask_copy(mask, &node_to_cpumask(cpu_to_node(cpu)));
+        break;
+    default:
+        cpumask_copy(mask, &cpu_online_map);
+        break;
+    }
+}
+
+/* The closest level at which cpu and peer share something */
+static inline int
+csched_topo_level(unsigned int cpu, unsigned int peer)
+{
+    if ( cpumask_test_cpu(peer, per_cpu(cpu_sibling_mask, cpu)) )
+        return CSCHED_TOPO_SMT;
+    if ( cpu_to_node(peer) != cpu_to_node(cpu) )
+        return CSCHED_TOPO_SYSTEM;
+    if ( cpumask_test_cpu(peer, per_cpu(cpu_core_mask, cpu)) )
+        return CSCHED_TOPO_LLC;
+    return CSCHED_TOPO_NODE;
+}
+
 
 /*
  * vcpu-affinity balancing is always necessary and must never be skipped.
@@ -479,6 +551,120 @@ __runq_tickle(unsigned int cpu, struct csched_vcpu *new)
     }
 }
 
+/*
+ * Tickless mode
+ *
+ * The tick exists to charge the running VCPU, to enforce caps, to
+ * time-share the PCPU among the VCPUs on its runq and, through the
+ * priorities the accounting computes, to have busy PCPUs steal from each
+ * other. A PCPU can do without it, and without a time slice, as long as
+ * nothing waits in its runq, the VCPU it runs is uncapped and already
+ * accounted for, and the pool is not contended, i.e., has idle PCPUs or
+ * nothing waiting anywhere. The accounting master catches up with the
+ * accounting work of the PCPUs not ticking.
+ *
+ * prv->waiters, the PCPUs with VCPUs waiting in their runq, is updated
+ * whenever a VCPU is queued and at each scheduling decision, so it errs,
+ * if at all, on the side of ticking. prv->tickless_cpus are the PCPUs not
+ * ticking. The barriers in csched_tick_update() and csched_tick_stop()
+ * make sure a PCPU never stops ticking in a contended pool.
+ */
+static inline int
+csched_pool_contended(const struct csched_private *prv)
+{
+    return !cpumask_empty(prv->waiters) && cpumask_empty(prv->idlers);
+}
+
+/*
+ * Does cpu need to tick while running svc? Called with cpu's runqueue lock
+ * held.
+ */
+static inline int
+csched_tick_needed(const struct csched_private *prv, unsigned int cpu,
+                   const struct csched_vcpu *svc)
+{
+    if ( !IS_RUNQ_IDLE(cpu) || csched_pool_contended(prv) )
+        return 1;
+
+    return !is_idle_vcpu(svc->vcpu) &&
+           (svc->sdom->cap != 0 || list_empty(&svc->active_vcpu_elem));
+}
+
+/*
+ * Rearm cpu's tick, if it was stopped. If kick is set, also make cpu go
+ * through the scheduler, as the VCPU running there has no time slice.
+ */
+static void
+csched_tick_restart(struct csched_private *prv, unsigned int cpu, bool_t kick)
+{
+    struct csched_pcpu * const spc = CSCHED_PCPU(cpu);
+    s_time_t now;
+
+    if ( likely(!cpumask_test_cpu(cpu, prv->tickless_cpus)) ||
+         !cpumask_test_and_clear_cpu(cpu, prv->tickless_cpus) )
+        return;
+
+    now = NOW();
+    SCHED_STAT_CRANK(tick_restarted);
+    perfc_add(tick_skipped,
+              (now - spc->tick_stop_time) / MICROSECS(prv->tick_period_us));
+
+    set_timer(&spc->ticker, now + MICROSECS(prv->tick_period_us));
+    if ( kick )
+        cpu_raise_softirq(cpu, SCHEDULE_SOFTIRQ);
+}
+
+/*
+ * Stop cpu's tick, unless the pool got contended meanwhile. Returns 1 if
+ * cpu is (now) not ticking. Called with cpu's runqueue lock held.
+ */
+static int
+csched_tick_stop(struct csched_private *prv, unsigned int cpu)
+{
+    if ( cpumask_test_cpu(cpu, prv->tickless_cpus) )
+        return 1;
+
+    CSCHED_PCPU(cpu)->tick_stop_time = NOW();
+    cpumask_set_cpu(cpu, prv->tickless_cpus);
+    smp_mb();
+    if ( unlikely(csched_pool_contended(prv)) )
+    {
+        cpumask_clear_cpu(cpu, prv->tickless_cpus);
+        return 0;
+    }
+
+    SCHED_STAT_CRANK(tick_stopped);
+    return 1;
+}
+
+/*
+ * Called, with cpu's runqueue lock held, after cpu's runq or idleness
+ * may have changed. Restarts the ticks that are needed again: cpu's, if
+ * something now waits there, and everyone's, if the pool got contended.
+ */
+static void
+csched_tick_update(struct csched_private *prv, unsigned int cpu, bool_t kick)
+{
+    unsigned int i;
+
+    if ( IS_RUNQ_IDLE(cpu) )
+    {
+        if ( cpumask_test_cpu(cpu, prv->waiters) )
+            cpumask_clear_cpu(cpu, prv->waiters);
+    }
+    else
+    {
+        if ( !cpumask_test_cpu(cpu, prv->waiters) )
+            cpumask_set_cpu(cpu, prv->waiters);
+        csched_tick_restart(prv, cpu, kick);
+    }
+
+    smp_mb();
+    if ( !cpumask_empty(prv->tickless_cpus) && csched_pool_contended(prv) )
+        for_each_cpu ( i, prv->tickless_cpus )
+            csched_tick_restart(prv, i, i != cpu || kick);
+}
+
 static void
 csched_free_pdata(const struct scheduler *ops, void *pcpu, int cpu)
 {
@@ -495,11 +681,31 @@ csched_free_pdata(const struct scheduler *ops, void *pcpu, int cpu)
     prv->ncpus--;
     cpumask_clear_cpu(cpu, prv->idlers);
     cpumask_clear_cpu(cpu, prv->cpus);
+    cpumask_clear_cpu(cpu, prv->tickless_cpus);
+    cpumask_clear_cpu(cpu, prv->waiters);
     if ( (prv->master == cpu) && (prv->ncpus > 0) )
     {
         prv->master = cpumask_first(prv->cpus);
         migrate_timer(&prv->master_ticker, prv->master);
     }
+
+    /* Hand the accounting of our active VCPUs over to another PCPU */
+    list_del(&spc->pcpu_elem);
+    if ( !list_empty(&spc->active_vcpu) )
+    {
+        struct csched_pcpu *nspc;
+        struct csched_vcpu *svc;
+
+        BUG_ON( list_empty(&prv->pcpus) );
+        nspc = list_entry(prv->pcpus.next, struct csched_pcpu, pcpu_elem);
+        spin_lock(&nspc->acct_lock);
+        spin_lock(&spc->acct_lock);
+        list_for_each_entry( svc, &spc->active_vcpu, active_vcpu_elem )
+            svc->acct_pcpu = nspc;
+        list_splice_init(&spc->active_vcpu, &nspc->active_vcpu);
+        spin_unlock(&spc->acct_lock);
+        spin_unlock(&nspc->acct_lock);
+    }
     kill_timer(&spc->ticker);
     if ( prv->ncpus == 0 )
         kill_timer(&prv->master_ticker);
@@ -547,6 +753,10 @@ csched_alloc_pdata(const struct scheduler *ops, int cpu)
 
     INIT_LIST_HEAD(&spc->runq);
     spc->runq_sort_last = prv->runq_sort;
+    spin_lock_init(&spc->acct_lock);
+    INIT_LIST_HEAD(&spc->active_vcpu);
+    spc->acct_epoch = prv->acct_epoch;
+    list_add_tail(&spc->pcpu_elem, &prv->pcpus);
     spc->idle_bias = nr_cpu_ids - 1;
     if ( per_cpu(schedule_data, cpu).sched_priv == NULL )
         per_cpu(schedule_data, cpu).sched_priv = spc;
@@ -605,11 +815,33 @@ unsigned int get_vcpu_migration_delay(void)
     return vcpu_migration_delay;
 }
 
+/*
+ * Delay, in microseconds, before a VCPU can be moved away from the PCPUs
+ * sharing its last level cache, i.e., to another socket or node. Such a
+ * migration loses the whole cache footprint, and possibly memory locality
+ * too, so it is resisted for longer than migrations within the socket.
+ */
+static unsigned int __read_mostly vcpu_migration_delay_llc = 1000;
+integer_param("vcpu_migration_delay_llc", vcpu_migration_delay_llc);
+
+/*
+ * How hot a VCPU is depends on how far it is being moved: SMT siblings
+ * share all the caches, so moving there is free; within the last level
+ * cache, vcpu_migration_delay applies; farther than that, the larger of
+ * it and vcpu_migration_delay_llc does.
+ */
 static inline int
-__csched_vcpu_is_cache_hot(struct vcpu *v)
+__csched_vcpu_is_cache_hot(struct vcpu *v, int lvl)
 {
-    int hot = ((NOW() - v->last_run_time) <
-               ((uint64_t)vcpu_migration_delay * 1000u));
+    unsigned int delay = vcpu_migration_delay;
+    int hot;
+
+    if ( lvl == CSCHED_TOPO_SMT )
+        return 0;
+    if ( lvl > CSCHED_TOPO_LLC )
+        delay = max(delay, vcpu_migration_delay_llc);
+
+    hot = ((NOW() - v->last_run_time) < ((uint64_t)delay * 1000u));
 
     if ( hot )
         SCHED_STAT_CRANK(vcpu_hot);
@@ -618,7 +850,8 @@ __csched_vcpu_is_cache_hot(struct vcpu *v)
 }
 
 static inline int
-__csched_vcpu_is_migrateable(struct vcpu *vc, int dest_cpu, cpumask_t *mask)
+__csched_vcpu_is_migrateable(struct vcpu *vc, int dest_cpu, int lvl,
+                             cpumask_t *mask)
 {
     /*
      * Don't pick up work that's in the peer's scheduling tail or hot on
@@ -626,7 +859,7 @@ __csched_vcpu_is_migrateable(struct vcpu *vc, int dest_cpu, cpumask_t *mask)
      * on our CPU.
      */
     return !vc->is_running &&
-           !__csched_vcpu_is_cache_hot(vc) &&
+           !__csched_vcpu_is_cache_hot(vc, lvl) &&
            cpumask_test_cpu(dest_cpu, mask);
 }
 
@@ -720,30 +953,26 @@ _csched_cpu_pick(const struct scheduler *ops, struct vcpu *vc, bool_t commit)
             cpumask_t cpu_idlers;
             cpumask_t nxt_idlers;
             int nxt, weight_cpu, weight_nxt;
-            int migrate_factor;
+            int migrate_factor, lvl;
 
             nxt = cpumask_cycle(cpu, &cpus);
 
-            if ( cpumask_test_cpu(cpu, per_cpu(cpu_core_mask, nxt)) )
-            {
-                /* We're on the same socket, so check the busy-ness of threads.
-                 * Migrate if # of idlers is less at all */
-                ASSERT( cpumask_test_cpu(nxt, per_cpu(cpu_core_mask, cpu)) );
-                migrate_factor = 1;
-                cpumask_and(&cpu_idlers, &idlers, per_cpu(cpu_sibling_mask,
-                            cpu));
-                cpumask_and(&nxt_idlers, &idlers, per_cpu(cpu_sibling_mask,
-                            nxt));
-            }
-            else
-            {
-                /* We're on different sockets, so check the busy-ness of cores.
-                 * Migrate only if the other core is twice as idle */
-                ASSERT( !cpumask_test_cpu(nxt, per_cpu(cpu_core_mask, cpu)) );
-                migrate_factor = 2;
-                cpumask_and(&cpu_idlers, &idlers, per_cpu(cpu_core_mask, cpu));
-                cpumask_and(&nxt_idlers, &idlers, per_cpu(cpu_core_mask, nxt));
-            }
+            /*
+             * Compare the busy-ness of the groups cpu and nxt belong to, one
+             * level below the one at which they meet: threads of the same
+             * core, cores of the same socket, sockets of the same node, or
+             * nodes. Within the last level cache, migrate if # of idlers
+             * is less at all; farther, only if the other group is twice as
+             * idle.
+             */
+            lvl = csched_topo_level(cpu, nxt);
+            migrate_factor = lvl <= CSCHED_TOPO_LLC ? 1 : 2;
+            if ( lvl > CSCHED_TOPO_SMT )
+                lvl--;
+            csched_topo_cpumask(cpu, lvl, &cpu_idlers);
+            cpumask_and(&cpu_idlers, &cpu_idlers, &idlers);
+            csched_topo_cpumask(nxt, lvl, &nxt_idlers);
+            cpumask_and(&nxt_idlers, &nxt_idlers, &idlers);
 
             weight_cpu = cpumask_weight(&cpu_idlers);
             weight_nxt = cpumask_weight(&nxt_idlers);
@@ -782,23 +1011,35 @@ csched_cpu_pick(const struct scheduler *ops, struct vcpu *vc)
     return _csched_cpu_pick(ops, vc, 1);
 }
 
+/*
+ * An active VCPU is on the active_vcpu list of the PCPU it was running on
+ * when it became active, which does its accounting until it goes idle
+ * again, wherever it runs meanwhile. Its domain is on the active_sdom list
+ * as long as it has active VCPUs.
+ *
+ * Locking: prv->lock nests outside the PCPUs' acct_lock-s. acct_pcpu is
+ * set with both held, and cleared when the VCPU goes idle with only the
+ * acct_lock held. So, with prv->lock held, a non-NULL acct_pcpu stays valid
+ * and its acct_lock must be taken to look at active_vcpu_elem.
+ */
 static inline void
-__csched_vcpu_acct_start(struct csched_private *prv, struct csched_vcpu *svc)
+__csched_vcpu_acct_start(struct csched_private *prv, struct csched_vcpu *svc,
+                         struct csched_pcpu *spc)
 {
     struct csched_dom * const sdom = svc->sdom;
     unsigned long flags;
 
     spin_lock_irqsave(&prv->lock, flags);
+    spin_lock(&spc->acct_lock);
 
     if ( list_empty(&svc->active_vcpu_elem) )
     {
         SCHED_VCPU_STAT_CRANK(svc, state_active);
         SCHED_STAT_CRANK(acct_vcpu_active);
 
-        sdom->active_vcpu_count++;
-        list_add(&svc->active_vcpu_elem, &sdom->active_vcpu);
-        /* Make weight per-vcpu */
-        prv->weight += sdom->weight;
+        atomic_inc(&sdom->active_vcpu_count);
+        svc->acct_pcpu = spc;
+        list_add(&svc->active_vcpu_elem, &spc->active_vcpu);
         if ( list_empty(&sdom->active_sdom_elem) )
         {
             list_add(&sdom->active_sdom_elem, &prv->active_sdom);
@@ -806,14 +1047,18 @@ __csched_vcpu_acct_start(struct csched_private *prv, struct csched_vcpu *svc)
     }
 
     TRACE_3D(TRC_CSCHED_ACCOUNT_START, sdom->dom->domain_id,
-             svc->vcpu->vcpu_id, sdom->active_vcpu_count);
+             svc->vcpu->vcpu_id, atomic_read(&sdom->active_vcpu_count));
 
+    spin_unlock(&spc->acct_lock);
     spin_unlock_irqrestore(&prv->lock, flags);
 }
 
+/*
+ * Called with the acct_lock of svc->acct_pcpu held. The domain is taken off
+ * the active_sdom list by csched_acct(), if this was its last active VCPU.
+ */
 static inline void
-__csched_vcpu_acct_stop_locked(struct csched_private *prv,
-    struct csched_vcpu *svc)
+__csched_vcpu_acct_stop_locked(struct csched_vcpu *svc)
 {
     struct csched_dom * const sdom = svc->sdom;
 
@@ -822,17 +1067,13 @@ __csched_vcpu_acct_stop_locked(struct csched_private *prv,
     SCHED_VCPU_STAT_CRANK(svc, state_idle);
     SCHED_STAT_CRANK(acct_vcpu_idle);
 
-    BUG_ON( prv->weight < sdom->weight );
-    sdom->active_vcpu_count--;
+    BUG_ON( atomic_read(&sdom->active_vcpu_count) <= 0 );
+    atomic_dec(&sdom->active_vcpu_count);
     list_del_init(&svc->active_vcpu_elem);
-    prv->weight -= sdom->weight;
-    if ( list_empty(&sdom->active_vcpu) )
-    {
-        list_del_init(&sdom->active_sdom_elem);
-    }
+    svc->acct_pcpu = NULL;
 
     TRACE_3D(TRC_CSCHED_ACCOUNT_STOP, sdom->dom->domain_id,
-             svc->vcpu->vcpu_id, sdom->active_vcpu_count);
+             svc->vcpu->vcpu_id, atomic_read(&sdom->active_vcpu_count));
 }
 
 static void
@@ -868,7 +1109,7 @@ csched_vcpu_acct(struct csched_private *prv, unsigned int cpu)
      */
     if ( list_empty(&svc->active_vcpu_elem) )
     {
-        __csched_vcpu_acct_start(prv, svc);
+        __csched_vcpu_acct_start(prv, svc, CSCHED_PCPU(cpu));
     }
     else if ( _csched_cpu_pick(ops, current, 0) != cpu )
     {
@@ -906,7 +1147,11 @@ csched_vcpu_insert(const struct scheduler *ops, struct vcpu *vc)
     struct csched_vcpu *svc = vc->sched_priv;
 
     if ( !__vcpu_on_runq(svc) && vcpu_runnable(vc) && !vc->is_running )
+    {
         __runq_insert(vc->processor, svc);
+        if ( CSCHED_PRIV(ops)->tickless )
+            csched_tick_update(CSCHED_PRIV(ops), vc->processor, 1);
+    }
 }
 
 static void
@@ -925,6 +1170,7 @@ csched_vcpu_remove(const struct scheduler *ops, struct vcpu *vc)
     struct csched_private *prv = CSCHED_PRIV(ops);
     struct csched_vcpu * const svc = CSCHED_VCPU(vc);
     struct csched_dom * const sdom = svc->sdom;
+    struct csched_pcpu *spc;
     unsigned long flags;
 
     SCHED_STAT_CRANK(vcpu_destroy);
@@ -940,8 +1186,18 @@ csched_vcpu_remove(const struct scheduler *ops, struct vcpu *vc)
 
     spin_lock_irqsave(&(prv->lock), flags);
 
-    if ( !list_empty(&svc->active_vcpu_elem) )
-        __csched_vcpu_acct_stop_locked(prv, svc);
+    /*
+     * csched_acct_pcpu() may retire the VCPU concurrently, holding only the
+     * acct_lock, so check again once we have it.
+     */
+    spc = svc->acct_pcpu;
+    if ( spc != NULL )
+    {
+        spin_lock(&spc->acct_lock);
+        if ( !list_empty(&svc->active_vcpu_elem) )
+            __csched_vcpu_acct_stop_locked(svc);
+        spin_unlock(&spc->acct_lock);
+    }
 
     spin_unlock_irqrestore(&(prv->lock), flags);
 
@@ -1016,6 +1272,8 @@ csched_vcpu_wake(const struct scheduler *ops, struct vcpu *vc)
 
     /* Put the VCPU on the runq and tickle CPUs */
     __runq_insert(cpu, svc);
+    if ( CSCHED_PRIV(ops)->tickless )
+        csched_tick_update(CSCHED_PRIV(ops), cpu, 1);
     __runq_tickle(cpu, svc);
 }
 
@@ -1051,15 +1309,9 @@ csched_dom_cntl(
     {
         ASSERT(op->cmd == XEN_DOMCTL_SCHEDOP_putinfo);
 
+        /* The new weight counts from the next accounting period */
         if ( op->u.credit.weight != 0 )
-        {
-            if ( !list_empty(&sdom->active_sdom_elem) )
-            {
-                prv->weight -= sdom->weight * sdom->active_vcpu_count;
-                prv->weight += op->u.credit.weight * sdom->active_vcpu_count;
-            }
             sdom->weight = op->u.credit.weight;
-        }
 
         if ( op->u.credit.cap != (uint16_t)~0U )
             sdom->cap = op->u.credit.cap;
@@ -1130,7 +1382,6 @@ csched_alloc_domdata(const struct scheduler *ops, struct domain *dom)
     cpumask_setall(sdom->node_affinity_cpumask);
 
     /* Initialize credit and weight */
-    INIT_LIST_HEAD(&sdom->active_vcpu);
     INIT_LIST_HEAD(&sdom->active_sdom_elem);
     sdom->dom = dom;
     sdom->weight = CSCHED_DEFAULT_WEIGHT;
@@ -1158,7 +1409,16 @@ csched_dom_init(const struct scheduler *ops, struct domain *dom)
 static void
 csched_free_domdata(const struct scheduler *ops, void *data)
 {
+    struct csched_private *prv = CSCHED_PRIV(ops);
     struct csched_dom *sdom = data;
+    unsigned long flags;
+
+    /* With no active VCPUs, but not yet noticed by csched_acct() */
+    spin_lock_irqsave(&prv->lock, flags);
+    BUG_ON( atomic_read(&sdom->active_vcpu_count) != 0 );
+    if ( !list_empty(&sdom->active_sdom_elem) )
+        list_del_init(&sdom->active_sdom_elem);
+    spin_unlock_irqrestore(&prv->lock, flags);
 
     free_cpumask_var(sdom->node_affinity_cpumask);
     xfree(data);
@@ -1221,15 +1481,132 @@ csched_runq_sort(struct csched_private *prv, unsigned int cpu)
     pcpu_schedule_unlock_irqrestore(lock, flags, cpu);
 }
 
+/*
+ * Accounting is split in two steps, so that its cost on any one PCPU does
+ * not grow with the total number of VCPUs:
+ *
+ *  - csched_acct(), on the master PCPU, once every accounting period, works
+ *    out the fair share of each active domain, and from it the credit each
+ *    of its active VCPUs earns in the period (acct_credit). This only walks
+ *    the active domains;
+ *
+ *  - csched_acct_pcpu(), on every PCPU, at its first tick in the period,
+ *    hands out that credit to the active VCPUs on its own active_vcpu list,
+ *    recomputing their priority, parking or unparking them, and taking them
+ *    off the list when they stop earning. This only takes the PCPU's own
+ *    acct_lock.
+ *
+ * PCPUs with their tick suspended are caught up by the master, at the
+ * beginning of the next period. Their active VCPUs are mostly blocked ones
+ * which, earning credit while not consuming it, soon stop being active.
+ */
+static bool_t
+csched_acct_pcpu(struct csched_private *prv, struct csched_pcpu *spc)
+{
+    struct list_head *iter_vcpu, *next_vcpu;
+    struct csched_vcpu *svc;
+    struct csched_dom *sdom;
+    unsigned long flags;
+    unsigned int epoch = prv->acct_epoch;
+    int credit_balance = 0;
+    int credit_fair;
+    int credit;
+    bool_t done = 0;
+
+    spin_lock_irqsave(&spc->acct_lock, flags);
+
+    if ( spc->acct_epoch == epoch )
+        goto out;
+    spc->acct_epoch = epoch;
+    smp_rmb();
+    done = 1;
+
+    SCHED_STAT_CRANK(acct_pcpu);
+
+    list_for_each_safe( iter_vcpu, next_vcpu, &spc->active_vcpu )
+    {
+        svc = list_entry(iter_vcpu, struct csched_vcpu, active_vcpu_elem);
+        sdom = svc->sdom;
+        BUG_ON( svc->acct_pcpu != spc );
+
+        /* Increment credit */
+        credit_fair = sdom->acct_credit;
+        atomic_add(credit_fair, &svc->credit);
+        credit = atomic_read(&svc->credit);
+
+        /*
+         * Recompute priority or, if VCPU is idling, remove it from
+         * the active list.
+         */
+        if ( credit < 0 )
+        {
+            svc->pri = CSCHED_PRI_TS_OVER;
+
+            /* Park running VCPUs of capped-out domains */
+            if ( sdom->cap != 0U &&
+                 credit < -sdom->acct_cap &&
+                 !test_and_set_bit(CSCHED_FLAG_VCPU_PARKED, &svc->flags) )
+            {
+                SCHED_STAT_CRANK(vcpu_park);
+                vcpu_pause_nosync(svc->vcpu);
+            }
+
+            /* Lower bound on credits */
+            if ( credit < -prv->credits_per_tslice )
+            {
+                SCHED_STAT_CRANK(acct_min_credit);
+                credit = -prv->credits_per_tslice;
+                atomic_set(&svc->credit, credit);
+            }
+        }
+        else
+        {
+            svc->pri = CSCHED_PRI_TS_UNDER;
+
+            /* Unpark any capped domains whose credits go positive */
+            if ( test_and_clear_bit(CSCHED_FLAG_VCPU_PARKED, &svc->flags) )
+            {
+                /*
+                 * It's important to unset the flag AFTER the unpause()
+                 * call to make sure the VCPU's priority is not boosted
+                 * if it is woken up here.
+                 */
+                SCHED_STAT_CRANK(vcpu_unpark);
+                vcpu_unpause(svc->vcpu);
+            }
+
+            /* Upper bound on credits means VCPU stops earning */
+            if ( credit > prv->credits_per_tslice )
+            {
+                __csched_vcpu_acct_stop_locked(svc);
+                /* Divide credits in half, so that when it starts
+                 * accounting again, it starts a little bit "ahead" */
+                credit /= 2;
+                atomic_set(&svc->credit, credit);
+            }
+        }
+
+        SCHED_VCPU_STAT_SET(svc, credit_last, credit);
+        SCHED_VCPU_STAT_SET(svc, credit_incr, credit_fair);
+        credit_balance += credit;
+    }
+
+    spc->credit_balance = credit_balance;
+
+ out:
+    spin_unlock_irqrestore(&spc->acct_lock, flags);
+
+    return done;
+}
+
 static void
 csched_acct(void* dummy)
 {
     struct csched_private *prv = dummy;
     unsigned long flags;
-    struct list_head *iter_vcpu, *next_vcpu;
     struct list_head *iter_sdom, *next_sdom;
-    struct csched_vcpu *svc;
     struct csched_dom *sdom;
+    struct csched_pcpu *spc;
     uint32_t credit_total;
     uint32_t weight_total;
     uint32_t weight_left;
@@ -1238,12 +1615,49 @@ csched_acct(void* dummy)
     uint32_t credit_cap;
     int credit_balance;
     int credit_xtra;
-    int credit;
 
 
     spin_lock_irqsave(&prv->lock, flags);
 
-    weight_total = prv->weight;
+    /*
+     * Catch up with the PCPUs that did not get to do their share of the
+     * last period's accounting, and collect the credit balance.
+     */
+    credit_balance = 0;
+    list_for_each_entry( spc, &prv->pcpus, pcpu_elem )
+    {
+        /*
+         * Don't go by acct_epoch alone: the PCPU may still be walking its
+         * list, reading the acct_credit and acct_cap we are about to
+         * update. Taking its acct_lock waits for it to be done.
+         */
+        if ( csched_acct_pcpu(prv, spc) )
+            SCHED_STAT_CRANK(acct_pcpu_catchup);
+        credit_balance += spc->credit_balance;
+    }
+    prv->credit_balance = credit_balance;
+
+    /*
+     * Take a snapshot of how many active VCPUs each domain has, as that
+     * changes under our feet, and drop the domains that have none left.
+     */
+    weight_total = 0;
+    list_for_each_safe( iter_sdom, next_sdom, &prv->active_sdom )
+    {
+        sdom = list_entry(iter_sdom, struct csched_dom, active_sdom_elem);
+
+        sdom->acct_active = atomic_read(&sdom->active_vcpu_count);
+        if ( sdom->acct_active == 0 )
+        {
+            list_del_init(&sdom->active_sdom_elem);
+            continue;
+        }
+
+        /* Make weight per-vcpu */
+        weight_total += sdom->weight * sdom->acct_active;
+    }
+    prv->weight = weight_total;
+
     credit_total = prv->credit;
 
     /* Converge balance towards 0 when it drops negative */
@@ -1264,7 +1678,6 @@ csched_acct(void* dummy)
     SCHED_STAT_CRANK(acct_run);
 
     weight_left = weight_total;
-    credit_balance = 0;
     credit_xtra = 0;
     credit_cap = 0U;
 
@@ -1273,11 +1686,11 @@ csched_acct(void* dummy)
         sdom = list_entry(iter_sdom, struct csched_dom, active_sdom_elem);
 
         BUG_ON( is_idle_domain(sdom->dom) );
-        BUG_ON( sdom->active_vcpu_count == 0 );
+        BUG_ON( sdom->acct_active == 0 );
         BUG_ON( sdom->weight == 0 );
-        BUG_ON( (sdom->weight * sdom->active_vcpu_count) > weight_left );
+        BUG_ON( (sdom->weight * sdom->acct_active) > weight_left );
 
-        weight_left -= ( sdom->weight * sdom->active_vcpu_count );
+        weight_left -= ( sdom->weight * sdom->acct_active );
 
         /*
          * A domain's fair share is computed using its weight in competition
@@ -1287,12 +1700,12 @@ csched_acct(void* dummy)
          * for one full accounting period. We allow a domain to earn more
          * only when the system-wide credit balance is negative.
          */
-        credit_peak = sdom->active_vcpu_count * prv->credits_per_tslice;
+        credit_peak = sdom->acct_active * prv->credits_per_tslice;
         if ( prv->credit_balance < 0 )
         {
             credit_peak += ( ( -prv->credit_balance
                                * sdom->weight
-                               * sdom->active_vcpu_count) +
+                               * sdom->acct_active) +
                              (weight_total - 1)
                            ) / weight_total;
         }
@@ -1304,13 +1717,13 @@ csched_acct(void* dummy)
                 credit_peak = credit_cap;
 
             /* FIXME -- set cap per-vcpu as well...? */
-            credit_cap = ( credit_cap + ( sdom->active_vcpu_count - 1 )
-                         ) / sdom->active_vcpu_count;
+            credit_cap = ( credit_cap + ( sdom->acct_active - 1 )
+                         ) / sdom->acct_active;
         }
 
         credit_fair = ( ( credit_total
                           * sdom->weight
-                          * sdom->active_vcpu_count )
+                          * sdom->acct_active )
                         + (weight_total - 1)
                       ) / weight_total;
 
@@ -1345,78 +1758,14 @@ csched_acct(void* dummy)
         }
 
         /* Compute fair share per VCPU */
-        credit_fair = ( credit_fair + ( sdom->active_vcpu_count - 1 )
-                      ) / sdom->active_vcpu_count;
-
-
-        list_for_each_safe( iter_vcpu, next_vcpu, &sdom->active_vcpu )
-        {
-            svc = list_entry(iter_vcpu, struct csched_vcpu, active_vcpu_elem);
-            BUG_ON( sdom != svc->sdom );
-
-            /* Increment credit */
-            atomic_add(credit_fair, &svc->credit);
-            credit = atomic_read(&svc->credit);
-
-            /*
-             * Recompute priority or, if VCPU is idling, remove it from
-             * the active list.
-             */
-            if ( credit < 0 )
-            {
-                svc->pri = CSCHED_PRI_TS_OVER;
-
-                /* Park running VCPUs of capped-out domains */
-                if ( sdom->cap != 0U &&
-                     credit < -credit_cap &&
-                     !test_and_set_bit(CSCHED_FLAG_VCPU_PARKED, &svc->flags) )
-                {
-                    SCHED_STAT_CRANK(vcpu_park);
-                    vcpu_pause_nosync(svc->vcpu);
-                }
-
-                /* Lower bound on credits */
-                if ( credit < -prv->credits_per_tslice )
-                {
-                    SCHED_STAT_CRANK(acct_min_credit);
-                    credit = -prv->credits_per_tslice;
-                    atomic_set(&svc->credit, credit);
-                }
-            }
-            else
-            {
-                svc->pri = CSCHED_PRI_TS_UNDER;
-
-                /* Unpark any capped domains whose credits go positive */
-                if ( test_and_clear_bit(CSCHED_FLAG_VCPU_PARKED, &svc->flags) )
-                {
-                    /*
-                     * It's important to unset the flag AFTER the unpause()
-                     * call to make sure the VCPU's priority is not boosted
-                     * if it is woken up here.
-                     */
-                    SCHED_STAT_CRANK(vcpu_unpark);
-                    vcpu_unpause(svc->vcpu);
-                }
-
-                /* Upper bound on credits means VCPU stops earning */
-                if ( credit > prv->credits_per_tslice )
-                {
-                    __csched_vcpu_acct_stop_locked(prv, svc);
-                    /* Divide credits in half, so that when it starts
-                     * accounting again, it starts a little bit "ahead" */
-                    credit /= 2;
-                    atomic_set(&svc->credit, credit);
-                }
-            }
-
-            SCHED_VCPU_STAT_SET(svc, credit_last, credit);
-            SCHED_VCPU_STAT_SET(svc, credit_incr, credit_fair);
-            credit_balance += credit;
-        }
+        sdom->acct_credit = ( credit_fair + ( sdom->acct_active - 1 )
+                            ) / sdom->acct_active;
+        sdom->acct_cap = credit_cap;
     }
 
-    prv->credit_balance = credit_balance;
+    /* Let the PCPUs hand out the credits, at their next tick */
+    smp_wmb();
+    prv->acct_epoch++;
 
     spin_unlock_irqrestore(&prv->lock, flags);
 
@@ -1434,9 +1783,18 @@ csched_tick(void *_cpu)
     unsigned int cpu = (unsigned long)_cpu;
     struct csched_pcpu *spc = CSCHED_PCPU(cpu);
     struct csched_private *prv = CSCHED_PRIV(per_cpu(scheduler, cpu));
+    unsigned long flags;
+    spinlock_t *lock;
+    bool_t stop;
 
     spc->tick++;
 
+    /*
+     * Our share of the accounting period's work, if not done yet
+     */
+    if ( spc->acct_epoch != prv->acct_epoch )
+        csched_acct_pcpu(prv, spc);
+
     /*
      * Accounting for running VCPU
      */
@@ -1452,11 +1810,30 @@ csched_tick(void *_cpu)
      */
     csched_runq_sort(prv, cpu);
 
+    /*
+     * In tickless mode, stop ticking if there is nothing left to do for
+     * us. Whoever queues a VCPU here will restart us.
+     */
+    if ( prv->tickless )
+    {
+        lock = pcpu_schedule_lock_irqsave(cpu, &flags);
+
+        stop = cpumask_test_cpu(cpu, prv->tickless_cpus) ||
+               (!csched_tick_needed(prv, cpu,
+                                    CSCHED_VCPU(curr_on_cpu(cpu))) &&
+                csched_tick_stop(prv, cpu));
+
+        pcpu_schedule_unlock_irqrestore(lock, flags, cpu);
+
+        if ( stop )
+            return;
+    }
+
     set_timer(&spc->ticker, NOW() + MICROSECS(prv->tick_period_us) );
 }
 
 static struct csched_vcpu *
-csched_runq_steal(int peer_cpu, int cpu, int pri, int balance_step)
+csched_runq_steal(int peer_cpu, int cpu, int pri, int balance_step, int lvl)
 {
     const struct csched_pcpu * const peer_pcpu = CSCHED_PCPU(peer_cpu);
     const struct vcpu * const peer_vcpu = curr_on_cpu(peer_cpu);
@@ -1502,13 +1879,15 @@ csched_runq_steal(int peer_cpu, int cpu, int pri, int balance_step)
                 continue;
 
             csched_balance_cpumask(vc, balance_step, csched_balance_mask);
-            if ( __csched_vcpu_is_migrateable(vc, cpu, csched_balance_mask) )
+            if ( __csched_vcpu_is_migrateable(vc, cpu, lvl,
+                                              csched_balance_mask) )
             {
                 /* We got a candidate. Grab it! */
                 TRACE_3D(TRC_CSCHED_STOLEN_VCPU, peer_cpu,
                          vc->domain->domain_id, vc->vcpu_id);
                 SCHED_VCPU_STAT_CRANK(speer, migrate_q);
                 SCHED_STAT_CRANK(migrate_queued);
+                perfc_incra(migrate_queued_level, lvl);
                 WARN_ON(vc->is_urgent);
                 __runq_remove(speer);
                 vc->processor = cpu;
@@ -1526,10 +1905,9 @@ csched_load_balance(struct csched_private *prv, int cpu,
     struct csched_vcpu *snext, bool_t *stolen)
 {
     struct csched_vcpu *speer;
-    cpumask_t workers;
+    cpumask_t workers, busy;
     cpumask_t *online;
-    int peer_cpu, peer_node, bstep;
-    int node = cpu_to_node(cpu);
+    int peer_cpu, first_cpu, bstep, lvl;
 
     BUG_ON( cpu != snext->vcpu->processor );
     online = cpupool_scheduler_cpumask(per_cpu(cpupool, cpu));
@@ -1555,23 +1933,32 @@ csched_load_balance(struct csched_private *prv, int cpu,
     for_each_csched_balance_step( bstep )
     {
         /*
-         * We peek at the non-idling CPUs in a node-wise fashion. In fact,
-         * it is more likely that we find some node-affine work on our same
-         * node, not to mention that migrating vcpus within the same node
-         * could well expected to be cheaper than across-nodes (memory
-         * stays local, there might be some node-wide cache[s], etc.).
+         * We peek at the non-idling CPUs walking up the topology, from our
+         * SMT siblings to the rest of the system (see CSCHED_TOPO_*). The
+         * closer the peer, the cheaper the migration: caches are shared,
+         * memory stays local and, for the same reason, vcpus are allowed
+         * to be hotter on closer peers (see __csched_vcpu_is_cache_hot()).
+         *
+         * busy starts as the non-idling CPUs and loses the ones of each
+         * level as that is visited, so no CPU is looked at twice.
          */
-        peer_node = node;
-        do
+        cpumask_andnot(&busy, online, prv->idlers);
+        cpumask_clear_cpu(cpu, &busy);
+
+        for_each_csched_topo_level( lvl )
         {
-            /* Find out what the !idle are in this node */
-            cpumask_andnot(&workers, online, prv->idlers);
-            cpumask_and(&workers, &workers, &node_to_cpumask(peer_node));
-            cpumask_clear_cpu(cpu, &workers);
+            /* Find out what the !idle are at this level */
+            csched_topo_cpumask(cpu, lvl, &workers);
+            cpumask_and(&workers, &workers, &busy);
+            cpumask_andnot(&busy, &busy, &workers);
 
-            peer_cpu = cpumask_first(&workers);
+            /*
+             * Start right after us, so that the CPUs at this level do not
+             * all pick on the same peer first.
+             */
+            first_cpu = peer_cpu = cpumask_cycle(cpu, &workers);
             if ( peer_cpu >= nr_cpu_ids )
-                goto next_node;
+                continue;
             do
             {
                 /*
@@ -1592,7 +1979,8 @@ csched_load_balance(struct csched_private *prv, int cpu,
 
                 /* Any work over there to steal? */
                 speer = cpumask_test_cpu(peer_cpu, online) ?
-                    csched_runq_steal(peer_cpu, cpu, snext->pri, bstep) : NULL;
+                    csched_runq_steal(peer_cpu, cpu, snext->pri, bstep, lvl) :
+                    NULL;
                 pcpu_schedule_unlock(lock, peer_cpu);
 
                 /* As soon as one vcpu is found, balancing ends */
@@ -1604,11 +1992,8 @@ csched_load_balance(struct csched_private *prv, int cpu,
 
                 peer_cpu = cpumask_cycle(peer_cpu, &workers);
 
-            } while( peer_cpu != cpumask_first(&workers) );
-
- next_node:
-            peer_node = cycle_node(peer_node, node_online_map);
-        } while( peer_node != node );
+            } while( peer_cpu != first_cpu );
+        }
     }
 
  out:
@@ -1736,6 +2121,19 @@ csched_schedule(
         snext->start_time += now;
 
 out:
+    /*
+     * In tickless mode, snext runs with no time slice if it has nobody to
+     * share the PCPUs with, else we need our tick back.
+     */
+    if ( prv->tickless )
+    {
+        csched_tick_update(prv, cpu, 0);
+        if ( csched_tick_needed(prv, cpu, snext) )
+            csched_tick_restart(prv, cpu, 0);
+        else if ( csched_tick_stop(prv, cpu) )
+            tslice = -1;
+    }
+
     /*
      * Return task to run next...
      */
@@ -1819,8 +2217,9 @@ csched_dump_pcpu(const struct scheduler *ops, int cpu)
 static void
 csched_dump(const struct scheduler *ops)
 {
-    struct list_head *iter_sdom, *iter_svc;
+    struct list_head *iter_svc;
     struct csched_private *prv = CSCHED_PRIV(ops);
+    struct csched_pcpu *spc;
     int loop;
     unsigned long flags;
 
@@ -1840,7 +2239,9 @@ csched_dump(const struct scheduler *ops)
            "\tratelimit          = %dus\n"
            "\tcredits per msec   = %d\n"
            "\tticks per tslice   = %d\n"
-           "\tmigration delay    = %uus\n",
+           "\tmigration delay    = %uus\n"
+           "\tLLC migr. delay    = %uus\n"
+           "\ttickless           = %s\n",
            prv->ncpus,
            prv->master,
            prv->credit,
@@ -1852,19 +2253,24 @@ csched_dump(const struct scheduler *ops)
            prv->ratelimit_us,
            CSCHED_CREDITS_PER_MSEC,
            prv->ticks_per_tslice,
-           vcpu_migration_delay);
+           vcpu_migration_delay,
+           vcpu_migration_delay_llc,
+           prv->tickless ? "yes" : "no");
 
     cpumask_scnprintf(idlers_buf, sizeof(idlers_buf), prv->idlers);
     printk("idlers: %s\n", idlers_buf);
+    if ( prv->tickless )
+    {
+        cpumask_scnprintf(idlers_buf, sizeof(idlers_buf), prv->tickless_cpus);
+        printk("tickless: %s\n", idlers_buf);
+    }
 
     printk("active vcpus:\n");
     loop = 0;
-    list_for_each( iter_sdom, &prv->active_sdom )
+    list_for_each_entry( spc, &prv->pcpus, pcpu_elem )
     {
-        struct csched_dom *sdom;
-        sdom = list_entry(iter_sdom, struct csched_dom, active_sdom_elem);
-
-        list_for_each( iter_svc, &sdom->active_vcpu )
+        spin_lock(&spc->acct_lock);
+        list_for_each( iter_svc, &spc->active_vcpu )
         {
             struct csched_vcpu *svc;
             svc = list_entry(iter_svc, struct csched_vcpu, active_vcpu_elem);
@@ -1872,6 +2278,7 @@ csched_dump(const struct scheduler *ops)
             printk("\t%3d: ", ++loop);
             csched_dump_vcpu(svc);
         }
+        spin_unlock(&spc->acct_lock);
     }
 #undef idlers_buf
 
@@ -1887,9 +2294,13 @@ csched_init(struct scheduler *ops)
     if ( prv == NULL )
         return -ENOMEM;
     if ( !zalloc_cpumask_var(&prv->cpus) ||
-         !zalloc_cpumask_var(&prv->idlers) )
+         !zalloc_cpumask_var(&prv->idlers) ||
+         !zalloc_cpumask_var(&prv->tickless_cpus) ||
+         !zalloc_cpumask_var(&prv->waiters) )
     {
         free_cpumask_var(prv->cpus);
+        free_cpumask_var(prv->idlers);
+        free_cpumask_var(prv->tickless_cpus);
         xfree(prv);
         return -ENOMEM;
     }
@@ -1897,6 +2308,7 @@ csched_init(struct scheduler *ops)
     ops->sched_data = prv;
     spin_lock_init(&prv->lock);
     INIT_LIST_HEAD(&prv->active_sdom);
+    INIT_LIST_HEAD(&prv->pcpus);
     prv->master = UINT_MAX;
 
     if ( sched_credit_tslice_ms > XEN_SYSCTL_CSCHED_TSLICE_MAX
@@ -1921,6 +2333,8 @@ csched_init(struct scheduler *ops)
     }
     else
         prv->ratelimit_us = sched_ratelimit_us;
+
+    prv->tickless = sched_credit_tickless;
     return 0;
 }
 
@@ -1934,6 +2348,8 @@ csched_deinit(const struct scheduler *ops)
     {
         free_cpumask_var(prv->cpus);
         free_cpumask_var(prv->idlers);
+        free_cpumask_var(prv->tickless_cpus);
+        free_cpumask_var(prv->waiters);
         xfree(prv);
     }
 }
@@ -1957,6 +2373,10 @@ static void csched_tick_resume(const struct scheduler *ops, unsigned int cpu)
 
     prv = CSCHED_PRIV(ops);
 
+    /* In tickless mode, a stopped tick stays so until there is work */
+    if ( cpumask_test_cpu(cpu, prv->tickless_cpus) )
+        return;
+
     set_timer(&spc->ticker, now + MICROSECS(prv->tick_period_us)
             - now % MICROSECS(prv->tick_period_us) );
 }
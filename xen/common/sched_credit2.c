@@ -25,6 +25,7 @@
 #include <xen/errno.h>
 #include <xen/trace.h>
 #include <xen/cpu.h>
+#include <xen/rbtree.h>
 
 #define d2printk(x...)
 //#define d2printk printk
@@ -45,6 +46,7 @@
 #define TRC_CSCHED2_RUNQ_ASSIGN      TRC_SCHED_CLASS_EVT(CSCHED2, 10)
 #define TRC_CSCHED2_UPDATE_VCPU_LOAD TRC_SCHED_CLASS_EVT(CSCHED2, 11)
 #define TRC_CSCHED2_UPDATE_RUNQ_LOAD TRC_SCHED_CLASS_EVT(CSCHED2, 12)
+#define TRC_CSCHED2_RUNQ_CANDIDATE   TRC_SCHED_CLASS_EVT(CSCHED2, 13)
 
 /*
  * WARNING: This is still in an experimental phase.  Status and work can be found at the
@@ -166,6 +168,15 @@
 int opt_migrate_resist=500;
 integer_param("sched_credit2_migrate_resist", opt_migrate_resist);
 
+/*
+ * Tickless mode: with nobody waiting on the runqueue, let the running vcpu
+ * go on until it runs out of credit, rather than for at most MAX_TIMER, and
+ * leave idle cpus with no timer at all. See runq_tickle() for how the
+ * time slices are restored once a competitor shows up.
+ */
+static bool_t __read_mostly opt_tickless;
+boolean_param("sched_credit2_tickless", opt_tickless);
+
 /*
  * Useful macros
  */
@@ -203,12 +214,14 @@ struct csched2_runqueue_data {
     spinlock_t lock;      /* Lock for this runqueue. */
     cpumask_t active;      /* CPUs enabled for this runqueue */
 
-    struct list_head runq; /* Ordered list of runnable vms */
+    struct rb_root runq;   /* Runnable vms, ordered by credit (highest first) */
     struct list_head svc;  /* List of all vcpus assigned to this runqueue */
     unsigned int max_weight;
 
     cpumask_t idle,        /* Currently idle */
-        tickled;           /* Another cpu in the queue is already targeted for this one */
+        smt_idle,          /* Idle, and so are all of its sibling threads */
+        tickled,           /* Another cpu in the queue is already targeted for this one */
+        tickless;          /* Running with an unbounded time slice */
     int load;              /* Instantaneous load: Length of queue  + num non-idle threads */
     s_time_t load_last_update;  /* Last time average was updated */
     s_time_t avgload;           /* Decaying queue load */
@@ -237,7 +250,8 @@ struct csched2_private {
 struct csched2_vcpu {
     struct list_head rqd_elem;  /* On the runqueue data list */
     struct list_head sdom_elem; /* On the domain vcpu list */
-    struct list_head runq_elem; /* On the runqueue         */
+    struct rb_node runq_elem;   /* On the runqueue         */
+    unsigned long runq_cpus;    /* Processors found in our runq subtree */
     struct csched2_runqueue_data *rqd; /* Up-pointer to the runqueue */
 
     /* Up-pointers */
@@ -299,13 +313,38 @@ static s_time_t c2t(struct csched2_runqueue_data *rqd, s_time_t credit, struct c
 static /*inline*/ int
 __vcpu_on_runq(struct csched2_vcpu *svc)
 {
-    return !list_empty(&svc->runq_elem);
+    return !RB_EMPTY_NODE(&svc->runq_elem);
 }
 
 static /*inline*/ struct csched2_vcpu *
-__runq_elem(struct list_head *elem)
+__runq_elem(struct rb_node *elem)
+{
+    return rb_entry(elem, struct csched2_vcpu, runq_elem);
+}
+
+/*
+ * The runqueue is an rbtree sorted by credit, highest credit leftmost,
+ * and FIFO among vcpus with equal credit.  Each node is augmented with
+ * a summary of the processors of the vcpus in its subtree (folded
+ * modulo BITS_PER_LONG), so that runq_candidate() can skip whole
+ * subtrees which cannot contain a vcpu local to the picking cpu.
+ *
+ * A vcpu's processor only changes while it is off the runqueue, and
+ * credit resets preserve the relative order of all vcpus, so neither
+ * the sort order nor the summaries ever need fixing up in place.
+ */
+#define RUNQ_CPU_BIT(_cpu)  (1UL << ((_cpu) % BITS_PER_LONG))
+
+static void
+runq_augment(struct rb_node *node, void *unused)
 {
-    return list_entry(elem, struct csched2_vcpu, runq_elem);
+    struct csched2_vcpu *svc = __runq_elem(node);
+
+    svc->runq_cpus = RUNQ_CPU_BIT(svc->vcpu->processor);
+    if ( node->rb_left )
+        svc->runq_cpus |= __runq_elem(node->rb_left)->runq_cpus;
+    if ( node->rb_right )
+        svc->runq_cpus |= __runq_elem(node->rb_right)->runq_cpus;
 }
 
 static void
@@ -408,9 +447,9 @@ update_load(const struct scheduler *ops,
 }
 
 static int
-__runq_insert(struct list_head *runq, struct csched2_vcpu *svc)
+__runq_insert(struct rb_root *runq, struct csched2_vcpu *svc)
 {
-    struct list_head *iter;
+    struct rb_node **link = &runq->rb_node, *parent = NULL;
     int pos = 0;
 
     d2printk("rqi %pv\n", svc->vcpu);
@@ -421,19 +460,30 @@ __runq_insert(struct list_head *runq, struct csched2_vcpu *svc)
     BUG_ON(svc->vcpu->is_running);
     BUG_ON(test_bit(__CSFLAG_scheduled, &svc->flags));
 
-    list_for_each( iter, runq )
+    /*
+     * pos counts the vcpus we stepped past on the way down: it is 0 iff
+     * svc ends up at the head of the queue, and a lower bound on its
+     * position otherwise.
+     */
+    while ( *link )
     {
-        struct csched2_vcpu * iter_svc = __runq_elem(iter);
+        struct csched2_vcpu * iter_svc = __runq_elem(*link);
 
+        parent = *link;
         if ( svc->credit > iter_svc->credit )
+            link = &parent->rb_left;
+        else
         {
-            d2printk(" p%d %pv\n", pos, iter_svc->vcpu);
-            break;
+            link = &parent->rb_right;
+            pos++;
         }
-        pos++;
     }
 
-    list_add_tail(&svc->runq_elem, iter);
+    d2printk(" p%d %pv\n", pos, svc->vcpu);
+
+    rb_link_node(&svc->runq_elem, parent, link);
+    rb_insert_color(&svc->runq_elem, runq);
+    rb_augment_insert(&svc->runq_elem, runq_augment, NULL);
 
     return pos;
 }
@@ -441,7 +491,7 @@ __runq_insert(struct list_head *runq, struct csched2_vcpu *svc)
 static void
 runq_insert(const struct scheduler *ops, unsigned int cpu, struct csched2_vcpu *svc)
 {
-    struct list_head * runq = &RQD(ops, cpu)->runq;
+    struct rb_root * runq = &RQD(ops, cpu)->runq;
     int pos = 0;
 
     ASSERT( spin_is_locked(per_cpu(schedule_data, cpu).schedule_lock) );
@@ -470,8 +520,36 @@ runq_insert(const struct scheduler *ops, unsigned int cpu, struct csched2_vcpu *
 static inline void
 __runq_remove(struct csched2_vcpu *svc)
 {
+    struct rb_node *deepest;
+
     BUG_ON( !__vcpu_on_runq(svc) );
-    list_del_init(&svc->runq_elem);
+
+    deepest = rb_augment_erase_begin(&svc->runq_elem);
+    rb_erase(&svc->runq_elem, &svc->rqd->runq);
+    RB_CLEAR_NODE(&svc->runq_elem);
+    rb_augment_erase_end(deepest, runq_augment, NULL);
+}
+
+/*
+ * Keep the smt_idle mask in sync with idle: a cpu is smt-idle when it
+ * and all of its sibling threads in this runqueue are idle.
+ */
+static inline void
+smt_idle_mask_set(unsigned int cpu, struct csched2_runqueue_data *rqd)
+{
+    const cpumask_t *siblings = per_cpu(cpu_sibling_mask, cpu);
+    cpumask_t mask;
+
+    cpumask_and(&mask, siblings, &rqd->active);
+    if ( cpumask_subset(&mask, &rqd->idle) )
+        cpumask_or(&rqd->smt_idle, &rqd->smt_idle, &mask);
+}
+
+static inline void
+smt_idle_mask_clear(unsigned int cpu, struct csched2_runqueue_data *rqd)
+{
+    cpumask_andnot(&rqd->smt_idle, &rqd->smt_idle,
+                   per_cpu(cpu_sibling_mask, cpu));
 }
 
 void burn_credits(struct csched2_runqueue_data *rqd, struct csched2_vcpu *, s_time_t);
@@ -486,6 +564,7 @@ runq_tickle(const struct scheduler *ops, unsigned int cpu, struct csched2_vcpu *
     struct csched2_runqueue_data *rqd = RQD(ops, cpu);
     cpumask_t mask;
     struct csched2_vcpu * cur;
+    bool_t waiter = 1;
 
     d2printk("rqt %pv curr %pv\n", new->vcpu, current);
 
@@ -502,14 +581,22 @@ runq_tickle(const struct scheduler *ops, unsigned int cpu, struct csched2_vcpu *
         goto tickle;
     }
     
-    /* Get a mask of idle, but not tickled */
-    cpumask_andnot(&mask, &rqd->idle, &rqd->tickled);
-    
+    /*
+     * Get a mask of idle, but not tickled, preferring cpus whose
+     * sibling threads are idle too, so we don't end up sharing a core
+     * while another one sits empty.
+     */
+    cpumask_andnot(&mask, &rqd->smt_idle, &rqd->tickled);
+    if ( cpumask_empty(&mask) )
+        cpumask_andnot(&mask, &rqd->idle, &rqd->tickled);
+
     /* If it's not empty, choose one */
     i = cpumask_cycle(cpu, &mask);
     if ( i < nr_cpu_ids )
     {
+        SCHED_STAT_CRANK(csched2_tickle_idle);
         ipid = i;
+        waiter = 0;
         goto tickle;
     }
 
@@ -574,7 +661,18 @@ tickle:
     cpu_raise_softirq(ipid, SCHEDULE_SOFTIRQ);
 
 no_tickle:
-    return;
+    /*
+     * Unless new goes to an idle cpu, whoever was running with an unbounded
+     * time slice now has competition (new, or whatever it preempts): make
+     * them go through the scheduler to get a proper one.
+     */
+    if ( waiter && unlikely(!cpumask_empty(&rqd->tickless)) )
+    {
+        cpumask_andnot(&mask, &rqd->tickless, &rqd->tickled);
+        cpumask_clear(&rqd->tickless);
+        perfc_add(csched2_tickless_kick, cpumask_weight(&mask));
+        cpumask_raise_softirq(&mask, SCHEDULE_SOFTIRQ);
+    }
 }
 
 /*
@@ -764,7 +862,7 @@ csched2_alloc_vdata(const struct scheduler *ops, struct vcpu *vc, void *dd)
 
     INIT_LIST_HEAD(&svc->rqd_elem);
     INIT_LIST_HEAD(&svc->sdom_elem);
-    INIT_LIST_HEAD(&svc->runq_elem);
+    RB_CLEAR_NODE(&svc->runq_elem);
 
     svc->sdom = dd;
     svc->vcpu = vc;
@@ -902,7 +1000,7 @@ csched2_vcpu_remove(const struct scheduler *ops, struct vcpu *vc)
     struct csched2_dom * const sdom = svc->sdom;
 
     BUG_ON( sdom == NULL );
-    BUG_ON( !list_empty(&svc->runq_elem) );
+    BUG_ON( __vcpu_on_runq(svc) );
 
     if ( ! is_idle_vcpu(vc) )
     {
@@ -1538,16 +1636,24 @@ csched2_runtime(const struct scheduler *ops, int cpu, struct csched2_vcpu *snext
     s_time_t time; 
     int rt_credit; /* Proposed runtime measured in credits */
     struct csched2_runqueue_data *rqd = RQD(ops, cpu);
-    struct list_head *runq = &rqd->runq;
+    struct rb_node *head = rb_first(&rqd->runq);
 
     if ( is_idle_vcpu(snext->vcpu) )
+    {
+        if ( opt_tickless && !head )
+        {
+            SCHED_STAT_CRANK(csched2_tickless_idle);
+            return -1;
+        }
         return CSCHED2_MAX_TIMER;
+    }
 
     /* General algorithm:
      * 1) Run until snext's credit will be 0
      * 2) But if someone is waiting, run until snext's credit is equal
      * to his
-     * 3) But never run longer than MAX_TIMER or shorter than MIN_TIMER.
+     * 3) But never run longer than MAX_TIMER or shorter than MIN_TIMER,
+     * unless in tickless mode, with noone waiting: then just 1) applies.
      */
 
     /* 1) Basic time: Run until credit is 0. */
@@ -1555,9 +1661,9 @@ csched2_runtime(const struct scheduler *ops, int cpu, struct csched2_vcpu *snext
 
     /* 2) If there's someone waiting whose credit is positive,
      * run until your credit ~= his */
-    if ( ! list_empty(runq) )
+    if ( head )
     {
-        struct csched2_vcpu *swait = __runq_elem(runq->next);
+        struct csched2_vcpu *swait = __runq_elem(head);
 
         if ( ! is_idle_vcpu(swait->vcpu)
              && swait->credit > 0 )
@@ -1582,7 +1688,15 @@ csched2_runtime(const struct scheduler *ops, int cpu, struct csched2_vcpu *snext
         if ( time < CSCHED2_MIN_TIMER )
             time = CSCHED2_MIN_TIMER;
         else if ( time > CSCHED2_MAX_TIMER )
-            time = CSCHED2_MAX_TIMER;
+        {
+            if ( opt_tickless && !head )
+            {
+                SCHED_STAT_CRANK(csched2_tickless_slice);
+                cpumask_set_cpu(cpu, &rqd->tickless);
+            }
+            else
+                time = CSCHED2_MAX_TIMER;
+        }
     }
 
     return time;
@@ -1590,6 +1704,47 @@ csched2_runtime(const struct scheduler *ops, int cpu, struct csched2_vcpu *snext
 
 void __dump_execstate(void *unused);
 
+/*
+ * Find the first vcpu, in runqueue order, in the subtree rooted at node
+ * which is on processor cpu and has more than min_credit credit.
+ *
+ * Subtrees whose processor summary lacks cpu's bit are skipped, as is
+ * everything to the right of a vcpu with too little credit.  The
+ * recursion only goes left, so its depth is bounded by the tree height.
+ */
+static struct csched2_vcpu *
+__runq_first_local(struct rb_node *node, int cpu, int min_credit,
+                   unsigned int *visited)
+{
+    while ( node )
+    {
+        struct csched2_vcpu *svc = __runq_elem(node), *found;
+
+        (*visited)++;
+
+        if ( !(svc->runq_cpus & RUNQ_CPU_BIT(cpu)) )
+            return NULL;
+
+        if ( node->rb_left )
+        {
+            found = __runq_first_local(node->rb_left, cpu, min_credit,
+                                       visited);
+            if ( found )
+                return found;
+        }
+
+        if ( svc->credit <= min_credit )
+            return NULL;
+
+        if ( svc->vcpu->processor == cpu )
+            return svc;
+
+        node = node->rb_right;
+    }
+
+    return NULL;
+}
+
 /*
  * Find a candidate.
  */
@@ -1598,8 +1753,13 @@ runq_candidate(struct csched2_runqueue_data *rqd,
                struct csched2_vcpu *scurr,
                int cpu, s_time_t now)
 {
-    struct list_head *iter;
-    struct csched2_vcpu *snext = NULL;
+    struct rb_node *head;
+    struct csched2_vcpu *svc, *snext = NULL;
+    unsigned int visited = 1;
+    s_time_t start = 0;
+
+    if ( unlikely(tb_init_done) )
+        start = NOW();
 
     /* Default to current if runnable, idle otherwise */
     if ( vcpu_runnable(scurr->vcpu) )
@@ -1607,24 +1767,45 @@ runq_candidate(struct csched2_runqueue_data *rqd,
     else
         snext = CSCHED2_VCPU(idle_vcpu[cpu]);
 
-    list_for_each( iter, &rqd->runq )
-    {
-        struct csched2_vcpu * svc = list_entry(iter, struct csched2_vcpu, runq_elem);
+    head = rb_first(&rqd->runq);
+    if ( !head )
+        goto out;
 
-        /* If this is on a different processor, don't pull it unless
-         * its credit is at least CSCHED2_MIGRATE_RESIST higher. */
-        if ( svc->vcpu->processor != cpu
-             && snext->credit + CSCHED2_MIGRATE_RESIST > svc->credit )
-            continue;
+    svc = __runq_elem(head);
 
-        /* If the next one on the list has more credit than current
-         * (or idle, if current is not runnable), choose it. */
-        if ( svc->credit > snext->credit )
-            snext = svc;
+    /*
+     * If the head of the queue is on a different processor, don't pull
+     * it unless its credit is at least CSCHED2_MIGRATE_RESIST higher.
+     * Nobody further down the queue can do better than that, so the
+     * only other option is the first vcpu which is already ours.
+     */
+    if ( svc->vcpu->processor != cpu
+         && snext->credit + CSCHED2_MIGRATE_RESIST > svc->credit )
+        svc = __runq_first_local(rqd->runq.rb_node, cpu, snext->credit,
+                                 &visited);
 
-        /* In any case, if we got this far, break. */
-        break;
+    /* If that one has more credit than current (or idle, if current
+     * is not runnable), choose it. */
+    if ( svc && svc->credit > snext->credit )
+        snext = svc;
+
+ out:
+    SCHED_STAT_CRANK(csched2_runq_candidate);
+    perfc_add(csched2_runq_candidate_visited, visited);
 
+    /* TRACE */ {
+        struct {
+            unsigned dom:16,vcpu:16;
+            unsigned visited;
+            unsigned latency;
+        } d;
+        d.dom = snext->vcpu->domain->domain_id;
+        d.vcpu = snext->vcpu->vcpu_id;
+        d.visited = visited;
+        d.latency = start ? NOW() - start : 0;
+        trace_var(TRC_CSCHED2_RUNQ_CANDIDATE, 1,
+                  sizeof(d),
+                  (unsigned char *)&d);
     }
 
     return snext;
@@ -1686,6 +1867,10 @@ csched2_schedule(
     if ( cpumask_test_cpu(cpu, &rqd->tickled) )
         cpumask_clear_cpu(cpu, &rqd->tickled);
 
+    /* csched2_runtime() will tell whether we still can go tickless */
+    if ( cpumask_test_cpu(cpu, &rqd->tickless) )
+        cpumask_clear_cpu(cpu, &rqd->tickless);
+
     /* Update credits */
     burn_credits(rqd, scurr, now);
 
@@ -1751,7 +1936,10 @@ csched2_schedule(
 
         /* Clear the idle mask if necessary */
         if ( cpumask_test_cpu(cpu, &rqd->idle) )
+        {
             cpumask_clear_cpu(cpu, &rqd->idle);
+            smt_idle_mask_clear(cpu, rqd);
+        }
 
         snext->start_time = now;
 
@@ -1767,7 +1955,10 @@ csched2_schedule(
     {
         /* Update the idle mask if necessary */
         if ( !cpumask_test_cpu(cpu, &rqd->idle) )
+        {
             cpumask_set_cpu(cpu, &rqd->idle);
+            smt_idle_mask_set(cpu, rqd);
+        }
         /* Make sure avgload gets updated periodically even
          * if there's no activity */
         update_load(ops, rqd, NULL, 0, now);
@@ -1800,7 +1991,8 @@ csched2_dump_vcpu(struct csched2_vcpu *svc)
 static void
 csched2_dump_pcpu(const struct scheduler *ops, int cpu)
 {
-    struct list_head *runq, *iter;
+    struct rb_root *runq;
+    struct rb_node *iter;
     struct csched2_vcpu *svc;
     int loop;
     char cpustr[100];
@@ -1823,7 +2015,7 @@ csched2_dump_pcpu(const struct scheduler *ops, int cpu)
     }
 
     loop = 0;
-    list_for_each( iter, runq )
+    for ( iter = rb_first(runq); iter; iter = rb_next(iter) )
     {
         svc = __runq_elem(iter);
         if ( svc )
@@ -1899,7 +2091,7 @@ static void activate_runqueue(struct csched2_private *prv, int rqi)
     rqd->max_weight = 1;
     rqd->id = rqi;
     INIT_LIST_HEAD(&rqd->svc);
-    INIT_LIST_HEAD(&rqd->runq);
+    rqd->runq = RB_ROOT;
     spin_lock_init(&rqd->lock);
 
     cpumask_set_cpu(rqi, &prv->active_queues);
@@ -1972,6 +2164,7 @@ static void init_pcpu(const struct scheduler *ops, int cpu)
     
     cpumask_set_cpu(cpu, &rqd->idle);
     cpumask_set_cpu(cpu, &rqd->active);
+    smt_idle_mask_set(cpu, rqd);
 
     /* _Not_ pcpu_schedule_unlock(): per_cpu().schedule_lock changed! */
     spin_unlock(old_lock);
@@ -2023,6 +2216,7 @@ csched2_free_pdata(const struct scheduler *ops, void *pcpu, int cpu)
     printk("Removing cpu %d from runqueue %d\n", cpu, rqi);
 
     cpumask_clear_cpu(cpu, &rqd->idle);
+    cpumask_clear_cpu(cpu, &rqd->smt_idle);
     cpumask_clear_cpu(cpu, &rqd->active);
 
     if ( cpumask_empty(&rqd->active) )
@@ -2101,6 +2295,7 @@ csched2_init(struct scheduler *ops)
     printk(" load_window_shift: %d\n", opt_load_window_shift);
     printk(" underload_balance_tolerance: %d\n", opt_underload_balance_tolerance);
     printk(" overload_balance_tolerance: %d\n", opt_overload_balance_tolerance);
+    printk(" tickless: %d\n", opt_tickless);
 
     if ( opt_load_window_shift < LOADAVG_WINDOW_SHIFT_MIN )
     {
@@ -0,0 +1,1156 @@
+/*****************************************************************************
+ * Preemptive Global Earliest Deadline First (EDF) scheduler for Xen
+ *
+ * Each vcpu is a deferrable server with a (period, budget) pair: it may
+ * run for up to budget within each period, and its deadline is the end of
+ * the current period.  Runnable vcpus of all the pcpus of a cpupool wait
+ * in a single queue, ordered by deadline, and each pcpu runs the earliest
+ * deadline vcpu which may run on it.  Vcpus which used up their budget
+ * wait on a depleted queue for their next period.
+ *
+ * Budget is only consumed while running, so a vcpu which blocks keeps what
+ * it has left until the end of its period.  It is replenished, and the
+ * deadline moved one period forward, by a timer firing at the earliest
+ * deadline among the vcpus of the pool (the replenishment queue), rather
+ * than by polling in the scheduler, so that a vcpu gets its budget back,
+ * and may preempt, exactly when its period begins.
+ *
+ * This gives each vcpu a guaranteed share of budget/period of a pcpu, with
+ * a scheduling latency bounded by period - budget, as long as the total
+ * utilisation of the pool is schedulable under global EDF.
+ */
+
+#include <xen/config.h>
+#include <xen/init.h>
+#include <xen/lib.h>
+#include <xen/sched.h>
+#include <xen/domain.h>
+#include <xen/delay.h>
+#include <xen/event.h>
+#include <xen/time.h>
+#include <xen/perfc.h>
+#include <xen/sched-if.h>
+#include <xen/softirq.h>
+#include <asm/atomic.h>
+#include <xen/errno.h>
+#include <xen/trace.h>
+#include <xen/cpu.h>
+#include <xen/keyhandler.h>
+#include <xen/guest_access.h>
+
+/*
+ * RTDS tracing events.  Check include/public/trace.h for more details.
+ */
+#define TRC_RTDS_TICKLE           TRC_SCHED_CLASS_EVT(RTDS, 1)
+#define TRC_RTDS_RUNQ_PICK        TRC_SCHED_CLASS_EVT(RTDS, 2)
+#define TRC_RTDS_BUDGET_BURN      TRC_SCHED_CLASS_EVT(RTDS, 3)
+#define TRC_RTDS_BUDGET_REPLENISH TRC_SCHED_CLASS_EVT(RTDS, 4)
+#define TRC_RTDS_SCHED_TASKLET    TRC_SCHED_CLASS_EVT(RTDS, 5)
+
+/*
+ * Default and minimum parameters, in microseconds.  Below the minimum,
+ * the overhead of scheduling and replenishing would dominate.
+ */
+#define RTDS_DEFAULT_PERIOD     10000
+#define RTDS_DEFAULT_BUDGET     4000
+#define RTDS_MIN_PERIOD         10
+#define RTDS_MIN_BUDGET         10
+
+/*
+ * Flags
+ */
+/* The vcpu is running, or its context is still being saved. */
+#define __RTDS_scheduled            1
+/* Put the vcpu on the runq once its context is saved. */
+#define __RTDS_delayed_runq_add     2
+/* The vcpu used up its budget, and is waiting for replenishment. */
+#define __RTDS_depleted             3
+
+/*
+ * Useful macros
+ */
+#define RTDS_PRIV(_ops)     \
+    ((struct rt_private *)((_ops)->sched_data))
+#define RTDS_VCPU(_vcpu)    ((struct rt_vcpu *) (_vcpu)->sched_priv)
+#define RTDS_DOM(_dom)      ((struct rt_dom *) (_dom)->sched_priv)
+
+/*
+ * System-wide private data; prv->lock is the schedule lock of all the
+ * pcpus of the pool, and protects all of the below, as well as the
+ * rt_vcpu and rt_dom structures.
+ */
+struct rt_private {
+    spinlock_t lock;
+    struct list_head sdom;      /* list of domains, for dumping */
+    struct list_head runq;      /* runnable vcpus, by deadline */
+    struct list_head depletedq; /* vcpus with no budget left, unordered */
+    struct list_head replq;     /* runnable vcpus, by next replenishment */
+    cpumask_t tickled;          /* pcpus told to reschedule */
+    cpumask_t cpus;             /* pcpus of the pool */
+    struct timer repl_timer;    /* fires at the head of replq */
+    bool_t repl_timer_init;
+};
+
+/*
+ * Virtual CPU
+ */
+struct rt_vcpu {
+    struct list_head q_elem;     /* on the runq or depletedq */
+    struct list_head replq_elem; /* on the replq */
+    struct list_head sdom_elem;  /* on the domain's vcpu list */
+
+    /* Up-pointers */
+    struct rt_dom *sdom;
+    struct vcpu *vcpu;
+
+    /* Parameters, in nanoseconds */
+    s_time_t period;
+    s_time_t budget;
+
+    /* State of the current period, in nanoseconds */
+    s_time_t cur_budget;
+    s_time_t last_start;        /* when it was last put, or charged, on a pcpu */
+    s_time_t cur_deadline;
+
+    unsigned flags;
+};
+
+/*
+ * Domain
+ */
+struct rt_dom {
+    struct list_head vcpu;      /* vcpus of the domain */
+    struct list_head sdom_elem; /* on prv->sdom */
+    struct domain *dom;
+    s_time_t period;            /* parameters for all vcpus (putinfo) */
+    s_time_t budget;
+};
+
+static inline struct rt_vcpu *__q_elem(struct list_head *elem)
+{
+    return list_entry(elem, struct rt_vcpu, q_elem);
+}
+
+static inline struct rt_vcpu *__replq_elem(struct list_head *elem)
+{
+    return list_entry(elem, struct rt_vcpu, replq_elem);
+}
+
+static inline int __vcpu_on_q(const struct rt_vcpu *svc)
+{
+    return !list_empty(&svc->q_elem);
+}
+
+static inline int __vcpu_on_replq(const struct rt_vcpu *svc)
+{
+    return !list_empty(&svc->replq_elem);
+}
+
+static inline int __vcpu_running(const struct rt_vcpu *svc)
+{
+    return curr_on_cpu(svc->vcpu->processor) == svc->vcpu;
+}
+
+static inline bool_t rt_params_valid(uint32_t period, uint32_t budget)
+{
+    return period >= RTDS_MIN_PERIOD && budget >= RTDS_MIN_BUDGET &&
+           budget <= period;
+}
+
+/*
+ * Debug related code, dump vcpu/cpu information
+ */
+static void
+rt_dump_vcpu(const struct rt_vcpu *svc)
+{
+    cpumask_scnprintf(keyhandler_scratch, sizeof(keyhandler_scratch),
+                      svc->vcpu->cpu_affinity);
+    printk("[%5d.%-2u] cpu %u, (%"PRI_stime", %"PRI_stime"),"
+           " cur_b=%"PRI_stime" cur_d=%"PRI_stime" last_start=%"PRI_stime"\n"
+           " \t\t onQ=%d runnable=%d flags=%x affinity=%s\n",
+           svc->vcpu->domain->domain_id,
+           svc->vcpu->vcpu_id,
+           svc->vcpu->processor,
+           svc->period,
+           svc->budget,
+           svc->cur_budget,
+           svc->cur_deadline,
+           svc->last_start,
+           __vcpu_on_q(svc),
+           vcpu_runnable(svc->vcpu),
+           svc->flags,
+           keyhandler_scratch);
+}
+
+static void
+rt_dump_pcpu(const struct scheduler *ops, int cpu)
+{
+    struct rt_vcpu *svc = RTDS_VCPU(curr_on_cpu(cpu));
+
+    if ( svc && !is_idle_vcpu(svc->vcpu) )
+        rt_dump_vcpu(svc);
+    else
+        printk("idle\n");
+}
+
+static void
+rt_dump(const struct scheduler *ops)
+{
+    struct list_head *iter_sdom, *iter_svc;
+    struct rt_private *prv = RTDS_PRIV(ops);
+    struct rt_vcpu *svc;
+    unsigned long flags;
+
+    spin_lock_irqsave(&prv->lock, flags);
+
+    printk("Global RunQueue info:\n");
+    list_for_each ( iter_svc, &prv->runq )
+        rt_dump_vcpu(__q_elem(iter_svc));
+
+    printk("Global DepletedQueue info:\n");
+    list_for_each ( iter_svc, &prv->depletedq )
+        rt_dump_vcpu(__q_elem(iter_svc));
+
+    printk("Global Replenishment Events info:\n");
+    list_for_each ( iter_svc, &prv->replq )
+        rt_dump_vcpu(__replq_elem(iter_svc));
+
+    printk("Domain info:\n");
+    list_for_each ( iter_sdom, &prv->sdom )
+    {
+        struct rt_dom *sdom = list_entry(iter_sdom, struct rt_dom, sdom_elem);
+
+        printk("\tdomain: %d (%"PRI_stime", %"PRI_stime")\n",
+               sdom->dom->domain_id, sdom->period, sdom->budget);
+
+        list_for_each ( iter_svc, &sdom->vcpu )
+        {
+            svc = list_entry(iter_svc, struct rt_vcpu, sdom_elem);
+            rt_dump_vcpu(svc);
+        }
+    }
+
+    spin_unlock_irqrestore(&prv->lock, flags);
+}
+
+/*
+ * Move the deadline to the end of the period containing now, and give the
+ * vcpu a full budget for it.  Periods during which the vcpu was not
+ * runnable are skipped altogether: the server is deferrable, not
+ * cumulative.
+ */
+static void
+rt_update_deadline(s_time_t now, struct rt_vcpu *svc)
+{
+    ASSERT(now >= svc->cur_deadline);
+    ASSERT(svc->period != 0);
+
+    svc->cur_deadline += ((now - svc->cur_deadline) / svc->period + 1) *
+                         svc->period;
+    svc->cur_budget = svc->budget;
+
+    perfc_incr(rtds_replenish);
+
+    if ( unlikely(tb_init_done) )
+    {
+        struct {
+            unsigned vcpu:16, dom:16;
+            unsigned cur_deadline_lo, cur_deadline_hi;
+            unsigned cur_budget_lo, cur_budget_hi;
+        } d;
+        d.dom = svc->vcpu->domain->domain_id;
+        d.vcpu = svc->vcpu->vcpu_id;
+        d.cur_deadline_lo = (unsigned) svc->cur_deadline;
+        d.cur_deadline_hi = (unsigned) (svc->cur_deadline >> 32);
+        d.cur_budget_lo = (unsigned) svc->cur_budget;
+        d.cur_budget_hi = (unsigned) (svc->cur_budget >> 32);
+        trace_var(TRC_RTDS_BUDGET_REPLENISH, 1,
+                  sizeof(d),
+                  (unsigned char *) &d);
+    }
+}
+
+/*
+ * Insert svc into a deadline ordered queue, after those with the same
+ * deadline.  Returns whether it ended up at the head.
+ */
+static int
+deadline_queue_insert(struct rt_vcpu * (*qelem)(struct list_head *),
+                      struct rt_vcpu *svc, struct list_head *elem,
+                      struct list_head *queue)
+{
+    struct list_head *iter;
+    int first = 1;
+
+    list_for_each ( iter, queue )
+    {
+        if ( svc->cur_deadline < qelem(iter)->cur_deadline )
+            break;
+        first = 0;
+    }
+    list_add_tail(elem, iter);
+
+    return first;
+}
+
+static inline void
+__q_remove(struct rt_vcpu *svc)
+{
+    ASSERT(__vcpu_on_q(svc));
+    list_del_init(&svc->q_elem);
+}
+
+/*
+ * Runnable vcpus with budget go on the runq, by deadline; those without
+ * go on the depletedq, until they are replenished.
+ */
+static void
+runq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
+{
+    struct rt_private *prv = RTDS_PRIV(ops);
+
+    ASSERT(spin_is_locked(&prv->lock));
+    ASSERT(!__vcpu_on_q(svc));
+    ASSERT(__vcpu_on_replq(svc));
+
+    if ( svc->cur_budget > 0 )
+        deadline_queue_insert(__q_elem, svc, &svc->q_elem, &prv->runq);
+    else
+        list_add(&svc->q_elem, &prv->depletedq);
+}
+
+static void
+replq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
+{
+    struct rt_private *prv = RTDS_PRIV(ops);
+
+    ASSERT(!__vcpu_on_replq(svc));
+
+    /* A new earliest replenishment: move the timer forward. */
+    if ( deadline_queue_insert(__replq_elem, svc, &svc->replq_elem,
+                               &prv->replq) )
+        set_timer(&prv->repl_timer, svc->cur_deadline);
+}
+
+static void
+replq_remove(const struct scheduler *ops, struct rt_vcpu *svc)
+{
+    struct rt_private *prv = RTDS_PRIV(ops);
+    bool_t first = (prv->replq.next == &svc->replq_elem);
+
+    ASSERT(__vcpu_on_replq(svc));
+
+    list_del_init(&svc->replq_elem);
+
+    /* Removing the earliest replenishment: move the timer back. */
+    if ( first )
+    {
+        if ( !list_empty(&prv->replq) )
+            set_timer(&prv->repl_timer,
+                      __replq_elem(prv->replq.next)->cur_deadline);
+        else
+            stop_timer(&prv->repl_timer);
+    }
+}
+
+/*
+ * Charge the current vcpu for the time it ran since it was last charged.
+ */
+static void
+burn_budget(const struct scheduler *ops, struct rt_vcpu *svc, s_time_t now)
+{
+    s_time_t delta;
+
+    if ( is_idle_vcpu(svc->vcpu) )
+        return;
+
+    delta = now - svc->last_start;
+    if ( delta < 0 )
+    {
+        printk("%s, ATTENTION: now is behind last_start! delta=%"PRI_stime"\n",
+               __func__, delta);
+        svc->last_start = now;
+        return;
+    }
+
+    svc->cur_budget -= delta;
+    svc->last_start = now;
+
+    if ( svc->cur_budget <= 0 )
+    {
+        svc->cur_budget = 0;
+        set_bit(__RTDS_depleted, &svc->flags);
+        perfc_incr(rtds_depleted);
+    }
+
+    if ( unlikely(tb_init_done) )
+    {
+        struct {
+            unsigned vcpu:16, dom:16;
+            unsigned cur_budget_lo, cur_budget_hi;
+            int delta;
+        } d;
+        d.dom = svc->vcpu->domain->domain_id;
+        d.vcpu = svc->vcpu->vcpu_id;
+        d.cur_budget_lo = (unsigned) svc->cur_budget;
+        d.cur_budget_hi = (unsigned) (svc->cur_budget >> 32);
+        d.delta = delta;
+        trace_var(TRC_RTDS_BUDGET_BURN, 1,
+                  sizeof(d),
+                  (unsigned char *) &d);
+    }
+}
+
+/*
+ * The earliest deadline vcpu on the runq which may run on cpu, if any.
+ */
+static struct rt_vcpu *
+runq_pick(const struct scheduler *ops, unsigned int cpu)
+{
+    struct rt_private *prv = RTDS_PRIV(ops);
+    struct list_head *iter;
+    struct rt_vcpu *svc = NULL;
+
+    list_for_each ( iter, &prv->runq )
+    {
+        struct rt_vcpu *iter_svc = __q_elem(iter);
+        struct vcpu *v = iter_svc->vcpu;
+
+        if ( !cpumask_test_cpu(cpu, v->cpu_affinity) ||
+             !cpumask_test_cpu(cpu,
+                               cpupool_scheduler_cpumask(v->domain->cpupool)) )
+            continue;
+
+        ASSERT(iter_svc->cur_budget > 0);
+        svc = iter_svc;
+        break;
+    }
+
+    if ( unlikely(tb_init_done) && svc != NULL )
+    {
+        struct {
+            unsigned vcpu:16, dom:16;
+            unsigned cur_deadline_lo, cur_deadline_hi;
+            unsigned cur_budget_lo, cur_budget_hi;
+        } d;
+        d.dom = svc->vcpu->domain->domain_id;
+        d.vcpu = svc->vcpu->vcpu_id;
+        d.cur_deadline_lo = (unsigned) svc->cur_deadline;
+        d.cur_deadline_hi = (unsigned) (svc->cur_deadline >> 32);
+        d.cur_budget_lo = (unsigned) svc->cur_budget;
+        d.cur_budget_hi = (unsigned) (svc->cur_budget >> 32);
+        trace_var(TRC_RTDS_RUNQ_PICK, 1,
+                  sizeof(d),
+                  (unsigned char *) &d);
+    }
+
+    return svc;
+}
+
+/*
+ * Find a pcpu for new to run on, and tell it to reschedule: in order of
+ * preference, the pcpu it last ran on if that is idle, any idle pcpu, or
+ * the pcpu running the latest deadline vcpu, if that is later than new's.
+ * Pcpus already told to reschedule are left alone, as they will pick the
+ * head of the runq anyway.
+ */
+static void
+runq_tickle(const struct scheduler *ops, struct rt_vcpu *new)
+{
+    struct rt_private *prv = RTDS_PRIV(ops);
+    struct rt_vcpu *latest = NULL;
+    unsigned int cpu, cpu_to_tickle = new->vcpu->processor;
+    cpumask_t not_tickled;
+
+    if ( is_idle_vcpu(new->vcpu) || new->cur_budget <= 0 )
+        return;
+
+    cpumask_and(&not_tickled,
+                cpupool_scheduler_cpumask(new->vcpu->domain->cpupool),
+                new->vcpu->cpu_affinity);
+    cpumask_andnot(&not_tickled, &not_tickled, &prv->tickled);
+
+    if ( cpumask_test_cpu(cpu_to_tickle, &not_tickled) &&
+         is_idle_vcpu(curr_on_cpu(cpu_to_tickle)) )
+        goto tickle;
+
+    for_each_cpu ( cpu, &not_tickled )
+    {
+        struct vcpu *curr = curr_on_cpu(cpu);
+
+        if ( is_idle_vcpu(curr) )
+        {
+            cpu_to_tickle = cpu;
+            goto tickle;
+        }
+
+        if ( latest == NULL ||
+             RTDS_VCPU(curr)->cur_deadline > latest->cur_deadline )
+        {
+            latest = RTDS_VCPU(curr);
+            cpu_to_tickle = cpu;
+        }
+    }
+
+    if ( latest == NULL || new->cur_deadline >= latest->cur_deadline )
+        return;
+
+    perfc_incr(rtds_tickle_preempt);
+
+ tickle:
+    if ( unlikely(tb_init_done) )
+    {
+        struct {
+            unsigned cpu:16, pad:16;
+        } d;
+        d.cpu = cpu_to_tickle;
+        d.pad = 0;
+        trace_var(TRC_RTDS_TICKLE, 0,
+                  sizeof(d),
+                  (unsigned char *) &d);
+    }
+
+    cpumask_set_cpu(cpu_to_tickle, &prv->tickled);
+    cpu_raise_softirq(cpu_to_tickle, SCHEDULE_SOFTIRQ);
+}
+
+/*
+ * Replenish the budget of the vcpus whose period ended, requeue them, and
+ * tickle pcpus for those which may now preempt someone.
+ */
+static void
+repl_timer_handler(void *data)
+{
+    const struct scheduler *ops = data;
+    struct rt_private *prv = RTDS_PRIV(ops);
+    struct list_head *iter, *tmp;
+    struct rt_vcpu *svc;
+    s_time_t now;
+    LIST_HEAD(replenished);
+
+    spin_lock_irq(&prv->lock);
+
+    now = NOW();
+
+    list_for_each_safe ( iter, tmp, &prv->replq )
+    {
+        svc = __replq_elem(iter);
+
+        if ( now < svc->cur_deadline )
+            break;
+
+        list_del(&svc->replq_elem);
+        list_add(&svc->replq_elem, &replenished);
+
+        /* Charge what it used of the old budget before refilling it. */
+        if ( __vcpu_running(svc) )
+            burn_budget(ops, svc, now);
+        rt_update_deadline(now, svc);
+
+        if ( __vcpu_on_q(svc) )
+        {
+            __q_remove(svc);
+            runq_insert(ops, svc);
+        }
+    }
+
+    list_for_each_safe ( iter, tmp, &replenished )
+    {
+        svc = __replq_elem(iter);
+
+        list_del(&svc->replq_elem);
+        deadline_queue_insert(__replq_elem, svc, &svc->replq_elem,
+                              &prv->replq);
+
+        if ( __vcpu_running(svc) )
+        {
+            clear_bit(__RTDS_depleted, &svc->flags);
+            /* Its deadline moved: someone on the runq may now beat it. */
+            if ( !list_empty(&prv->runq) &&
+                 __q_elem(prv->runq.next)->cur_deadline < svc->cur_deadline )
+                runq_tickle(ops, __q_elem(prv->runq.next));
+        }
+        else if ( test_and_clear_bit(__RTDS_depleted, &svc->flags) &&
+                  __vcpu_on_q(svc) )
+            runq_tickle(ops, svc);
+    }
+
+    if ( !list_empty(&prv->replq) )
+        set_timer(&prv->repl_timer, __replq_elem(prv->replq.next)->cur_deadline);
+
+    spin_unlock_irq(&prv->lock);
+}
+
+static int
+rt_init(struct scheduler *ops)
+{
+    struct rt_private *prv = xzalloc(struct rt_private);
+
+    printk("Initializing RTDS scheduler\n"
+           "WARNING: This is experimental software in development.\n"
+           "Use at your own risk.\n");
+
+    if ( prv == NULL )
+        return -ENOMEM;
+
+    spin_lock_init(&prv->lock);
+    INIT_LIST_HEAD(&prv->sdom);
+    INIT_LIST_HEAD(&prv->runq);
+    INIT_LIST_HEAD(&prv->depletedq);
+    INIT_LIST_HEAD(&prv->replq);
+
+    ops->sched_data = prv;
+
+    return 0;
+}
+
+static void
+rt_deinit(const struct scheduler *ops)
+{
+    struct rt_private *prv = RTDS_PRIV(ops);
+
+    if ( prv->repl_timer_init )
+        kill_timer(&prv->repl_timer);
+    xfree(prv);
+}
+
+/*
+ * Point the schedule lock of the pcpu to the global lock; the first pcpu
+ * of the pool also hosts the replenishment timer.
+ */
+static void *
+rt_alloc_pdata(const struct scheduler *ops, int cpu)
+{
+    struct rt_private *prv = RTDS_PRIV(ops);
+    spinlock_t *old_lock;
+    unsigned long flags;
+
+    old_lock = pcpu_schedule_lock_irqsave(cpu, &flags);
+    per_cpu(schedule_data, cpu).schedule_lock = &prv->lock;
+    /* _Not_ pcpu_schedule_unlock(): per_cpu().schedule_lock changed! */
+    spin_unlock_irqrestore(old_lock, flags);
+
+    spin_lock_irqsave(&prv->lock, flags);
+    if ( !prv->repl_timer_init )
+    {
+        init_timer(&prv->repl_timer, repl_timer_handler, (void *)ops, cpu);
+        prv->repl_timer_init = 1;
+    }
+    cpumask_set_cpu(cpu, &prv->cpus);
+    spin_unlock_irqrestore(&prv->lock, flags);
+
+    return (void *)1;
+}
+
+static void
+rt_free_pdata(const struct scheduler *ops, void *pcpu, int cpu)
+{
+    struct rt_private *prv = RTDS_PRIV(ops);
+    struct schedule_data *sd = &per_cpu(schedule_data, cpu);
+    unsigned long flags;
+
+    spin_lock_irqsave(&prv->lock, flags);
+
+    cpumask_clear_cpu(cpu, &prv->cpus);
+    cpumask_clear_cpu(cpu, &prv->tickled);
+
+    if ( prv->repl_timer.cpu == cpu )
+    {
+        if ( !cpumask_empty(&prv->cpus) )
+            migrate_timer(&prv->repl_timer, cpumask_any(&prv->cpus));
+        else
+        {
+            /* Can't kill it with our lock held: the handler takes it. */
+            spin_unlock_irqrestore(&prv->lock, flags);
+            kill_timer(&prv->repl_timer);
+            spin_lock_irqsave(&prv->lock, flags);
+            prv->repl_timer_init = 0;
+        }
+    }
+
+    /* Unless the new scheduler already moved it, restore the default lock. */
+    if ( sd->schedule_lock == &prv->lock )
+    {
+        ASSERT(!spin_is_locked(&sd->_lock));
+        sd->schedule_lock = &sd->_lock;
+    }
+
+    spin_unlock_irqrestore(&prv->lock, flags);
+}
+
+static void *
+rt_alloc_domdata(const struct scheduler *ops, struct domain *dom)
+{
+    unsigned long flags;
+    struct rt_dom *sdom;
+    struct rt_private * prv = RTDS_PRIV(ops);
+
+    sdom = xzalloc(struct rt_dom);
+    if ( sdom == NULL )
+        return NULL;
+
+    INIT_LIST_HEAD(&sdom->vcpu);
+    INIT_LIST_HEAD(&sdom->sdom_elem);
+    sdom->dom = dom;
+    sdom->period = MICROSECS(RTDS_DEFAULT_PERIOD);
+    sdom->budget = MICROSECS(RTDS_DEFAULT_BUDGET);
+
+    spin_lock_irqsave(&prv->lock, flags);
+    list_add_tail(&sdom->sdom_elem, &prv->sdom);
+    spin_unlock_irqrestore(&prv->lock, flags);
+
+    return sdom;
+}
+
+static void
+rt_free_domdata(const struct scheduler *ops, void *data)
+{
+    unsigned long flags;
+    struct rt_dom *sdom = data;
+    struct rt_private *prv = RTDS_PRIV(ops);
+
+    spin_lock_irqsave(&prv->lock, flags);
+    list_del_init(&sdom->sdom_elem);
+    spin_unlock_irqrestore(&prv->lock, flags);
+
+    xfree(data);
+}
+
+static int
+rt_dom_init(const struct scheduler *ops, struct domain *dom)
+{
+    struct rt_dom *sdom;
+
+    if ( is_idle_domain(dom) )
+        return 0;
+
+    sdom = rt_alloc_domdata(ops, dom);
+    if ( sdom == NULL )
+        return -ENOMEM;
+
+    dom->sched_priv = sdom;
+
+    return 0;
+}
+
+static void
+rt_dom_destroy(const struct scheduler *ops, struct domain *dom)
+{
+    rt_free_domdata(ops, RTDS_DOM(dom));
+}
+
+static void *
+rt_alloc_vdata(const struct scheduler *ops, struct vcpu *vc, void *dd)
+{
+    struct rt_vcpu *svc;
+
+    svc = xzalloc(struct rt_vcpu);
+    if ( svc == NULL )
+        return NULL;
+
+    INIT_LIST_HEAD(&svc->q_elem);
+    INIT_LIST_HEAD(&svc->replq_elem);
+    INIT_LIST_HEAD(&svc->sdom_elem);
+    svc->flags = 0U;
+    svc->sdom = dd;
+    svc->vcpu = vc;
+
+    if ( !is_idle_vcpu(vc) )
+    {
+        BUG_ON( svc->sdom == NULL );
+        svc->period = svc->sdom->period;
+        svc->budget = svc->sdom->budget;
+    }
+    else
+    {
+        BUG_ON( svc->sdom != NULL );
+        svc->period = MICROSECS(RTDS_DEFAULT_PERIOD);
+        svc->budget = MICROSECS(RTDS_DEFAULT_BUDGET);
+    }
+
+    /* The first insert or wakeup starts the first period. */
+    svc->cur_deadline = 0;
+    svc->cur_budget = 0;
+
+    SCHED_STAT_CRANK(vcpu_init);
+
+    return svc;
+}
+
+static void
+rt_free_vdata(const struct scheduler *ops, void *priv)
+{
+    struct rt_vcpu *svc = priv;
+
+    xfree(svc);
+}
+
+static void
+rt_vcpu_insert(const struct scheduler *ops, struct vcpu *vc)
+{
+    struct rt_vcpu *svc = RTDS_VCPU(vc);
+    spinlock_t *lock;
+    s_time_t now;
+
+    /* Idle vcpus are not on any queue. */
+    if ( is_idle_vcpu(vc) )
+        return;
+
+    lock = vcpu_schedule_lock_irq(vc);
+
+    now = NOW();
+    if ( now >= svc->cur_deadline )
+        rt_update_deadline(now, svc);
+
+    if ( !__vcpu_on_q(svc) && vcpu_runnable(vc) && !vc->is_running )
+    {
+        replq_insert(ops, svc);
+        runq_insert(ops, svc);
+        runq_tickle(ops, svc);
+    }
+
+    list_add_tail(&svc->sdom_elem, &svc->sdom->vcpu);
+
+    vcpu_schedule_unlock_irq(lock, vc);
+}
+
+static void
+rt_vcpu_remove(const struct scheduler *ops, struct vcpu *vc)
+{
+    struct rt_vcpu * const svc = RTDS_VCPU(vc);
+    spinlock_t *lock;
+
+    BUG_ON( svc->sdom == NULL );
+
+    SCHED_STAT_CRANK(vcpu_destroy);
+
+    lock = vcpu_schedule_lock_irq(vc);
+    if ( __vcpu_on_q(svc) )
+        __q_remove(svc);
+    if ( __vcpu_on_replq(svc) )
+        replq_remove(ops, svc);
+    list_del_init(&svc->sdom_elem);
+    vcpu_schedule_unlock_irq(lock, vc);
+}
+
+static int
+rt_cpu_pick(const struct scheduler *ops, struct vcpu *vc)
+{
+    cpumask_t cpus;
+    int cpu;
+
+    cpumask_and(&cpus, cpupool_scheduler_cpumask(vc->domain->cpupool),
+                vc->cpu_affinity);
+
+    cpu = cpumask_test_cpu(vc->processor, &cpus)
+          ? vc->processor
+          : cpumask_cycle(vc->processor, &cpus);
+    ASSERT( !cpumask_empty(&cpus) && cpumask_test_cpu(cpu, &cpus) );
+
+    return cpu;
+}
+
+/*
+ * Pick the earliest deadline vcpu which may run here, keeping the current
+ * one if it still has budget and its deadline is no later; it then runs
+ * until it uses up its budget, or a replenishment or wakeup preempts it.
+ */
+static struct task_slice
+rt_schedule(const struct scheduler *ops, s_time_t now, bool_t tasklet_work_scheduled)
+{
+    const int cpu = smp_processor_id();
+    struct rt_private *prv = RTDS_PRIV(ops);
+    struct rt_vcpu * const scurr = RTDS_VCPU(current);
+    struct rt_vcpu *snext = NULL;
+    struct task_slice ret = { .migrated = 0 };
+
+    cpumask_clear_cpu(cpu, &prv->tickled);
+
+    /* Does nothing for the idle vcpu. */
+    burn_budget(ops, scurr, now);
+
+    if ( tasklet_work_scheduled )
+    {
+        if ( unlikely(tb_init_done) )
+            trace_var(TRC_RTDS_SCHED_TASKLET, 0, 0, NULL);
+        snext = RTDS_VCPU(idle_vcpu[cpu]);
+    }
+    else
+    {
+        snext = runq_pick(ops, cpu);
+        if ( snext == NULL )
+            snext = RTDS_VCPU(idle_vcpu[cpu]);
+
+        if ( !is_idle_vcpu(current) &&
+             vcpu_runnable(current) &&
+             scurr->cur_budget > 0 &&
+             (is_idle_vcpu(snext->vcpu) ||
+              scurr->cur_deadline <= snext->cur_deadline) )
+            snext = scurr;
+    }
+
+    if ( snext != scurr &&
+         !is_idle_vcpu(current) &&
+         vcpu_runnable(current) )
+        set_bit(__RTDS_delayed_runq_add, &scurr->flags);
+
+    snext->last_start = now;
+    ret.time = -1; /* The idle vcpu runs until tickled. */
+    if ( !is_idle_vcpu(snext->vcpu) )
+    {
+        if ( snext != scurr )
+        {
+            __q_remove(snext);
+            set_bit(__RTDS_scheduled, &snext->flags);
+        }
+        if ( snext->vcpu->processor != cpu )
+        {
+            snext->vcpu->processor = cpu;
+            ret.migrated = 1;
+        }
+        ret.time = snext->cur_budget;
+    }
+
+    ret.task = snext->vcpu;
+
+    return ret;
+}
+
+static void
+rt_vcpu_sleep(const struct scheduler *ops, struct vcpu *vc)
+{
+    struct rt_vcpu * const svc = RTDS_VCPU(vc);
+
+    BUG_ON( is_idle_vcpu(vc) );
+    SCHED_STAT_CRANK(vcpu_sleep);
+
+    if ( curr_on_cpu(vc->processor) == vc )
+        cpu_raise_softirq(vc->processor, SCHEDULE_SOFTIRQ);
+    else if ( __vcpu_on_q(svc) )
+    {
+        __q_remove(svc);
+        replq_remove(ops, svc);
+    }
+    else if ( test_bit(__RTDS_delayed_runq_add, &svc->flags) )
+        clear_bit(__RTDS_delayed_runq_add, &svc->flags);
+}
+
+static void
+rt_vcpu_wake(const struct scheduler *ops, struct vcpu *vc)
+{
+    struct rt_vcpu * const svc = RTDS_VCPU(vc);
+    s_time_t now;
+
+    BUG_ON( is_idle_vcpu(vc) );
+
+    if ( unlikely(curr_on_cpu(vc->processor) == vc) )
+    {
+        SCHED_STAT_CRANK(vcpu_wake_running);
+        return;
+    }
+
+    if ( unlikely(__vcpu_on_q(svc)) )
+    {
+        SCHED_STAT_CRANK(vcpu_wake_onrunq);
+        return;
+    }
+
+    if ( likely(vcpu_runnable(vc)) )
+        SCHED_STAT_CRANK(vcpu_wake_runnable);
+    else
+        SCHED_STAT_CRANK(vcpu_wake_not_runnable);
+
+    /*
+     * Waking up in a later period, it gets a new deadline and budget;
+     * within the same one, it keeps what it had left.
+     */
+    now = NOW();
+    if ( now >= svc->cur_deadline )
+    {
+        rt_update_deadline(now, svc);
+        clear_bit(__RTDS_depleted, &svc->flags);
+        if ( __vcpu_on_replq(svc) )
+            replq_remove(ops, svc);
+    }
+
+    if ( !__vcpu_on_replq(svc) )
+        replq_insert(ops, svc);
+
+    /*
+     * If the context hasn't been saved for this vcpu yet, we can't put it
+     * on the runq.  Instead, context_saved() will.
+     */
+    if ( unlikely(test_bit(__RTDS_scheduled, &svc->flags)) )
+    {
+        set_bit(__RTDS_delayed_runq_add, &svc->flags);
+        return;
+    }
+
+    runq_insert(ops, svc);
+    runq_tickle(ops, svc);
+}
+
+static void
+rt_context_saved(const struct scheduler *ops, struct vcpu *vc)
+{
+    struct rt_vcpu *svc = RTDS_VCPU(vc);
+    spinlock_t *lock = vcpu_schedule_lock_irq(vc);
+
+    clear_bit(__RTDS_scheduled, &svc->flags);
+
+    if ( is_idle_vcpu(vc) )
+        goto out;
+
+    if ( test_and_clear_bit(__RTDS_delayed_runq_add, &svc->flags) &&
+         likely(vcpu_runnable(vc)) )
+    {
+        runq_insert(ops, svc);
+        runq_tickle(ops, svc);
+    }
+    else if ( !vcpu_runnable(vc) && __vcpu_on_replq(svc) )
+        replq_remove(ops, svc);
+
+ out:
+    vcpu_schedule_unlock_irq(lock, vc);
+}
+
+/*
+ * New parameters take effect at the next replenishment; the current
+ * period only loses any budget beyond the new one.
+ */
+static void
+rt_vcpu_set_params(struct rt_vcpu *svc, s_time_t period, s_time_t budget)
+{
+    svc->period = period;
+    svc->budget = budget;
+    if ( svc->cur_budget > budget )
+        svc->cur_budget = budget;
+}
+
+static int
+rt_dom_cntl(
+    const struct scheduler *ops,
+    struct domain *d,
+    struct xen_domctl_scheduler_op *op)
+{
+    struct rt_private *prv = RTDS_PRIV(ops);
+    struct rt_dom * const sdom = RTDS_DOM(d);
+    struct list_head *iter;
+    xen_domctl_schedparam_vcpu_t local;
+    unsigned long flags;
+    unsigned int i;
+    int rc = 0;
+
+    switch ( op->cmd )
+    {
+    case XEN_DOMCTL_SCHEDOP_getinfo:
+        spin_lock_irqsave(&prv->lock, flags);
+        op->u.rtds.period = sdom->period / MICROSECS(1);
+        op->u.rtds.budget = sdom->budget / MICROSECS(1);
+        spin_unlock_irqrestore(&prv->lock, flags);
+        break;
+
+    case XEN_DOMCTL_SCHEDOP_putinfo:
+        if ( !rt_params_valid(op->u.rtds.period, op->u.rtds.budget) )
+            return -EINVAL;
+
+        spin_lock_irqsave(&prv->lock, flags);
+        sdom->period = MICROSECS(op->u.rtds.period);
+        sdom->budget = MICROSECS(op->u.rtds.budget);
+        list_for_each ( iter, &sdom->vcpu )
+            rt_vcpu_set_params(list_entry(iter, struct rt_vcpu, sdom_elem),
+                               sdom->period, sdom->budget);
+        spin_unlock_irqrestore(&prv->lock, flags);
+        break;
+
+    case XEN_DOMCTL_SCHEDOP_getvcpuinfo:
+    case XEN_DOMCTL_SCHEDOP_putvcpuinfo:
+        /* No preemption: bound the loop by the domain's size. */
+        if ( op->u.v.nr_vcpus > d->max_vcpus )
+            return -EINVAL;
+
+        for ( i = 0; i < op->u.v.nr_vcpus; i++ )
+        {
+            struct rt_vcpu *svc;
+
+            if ( copy_from_guest_offset(&local, op->u.v.vcpus, i, 1) )
+            {
+                rc = -EFAULT;
+                break;
+            }
+
+            if ( local.vcpuid >= d->max_vcpus ||
+                 d->vcpu[local.vcpuid] == NULL )
+            {
+                rc = -EINVAL;
+                break;
+            }
+            svc = RTDS_VCPU(d->vcpu[local.vcpuid]);
+
+            if ( op->cmd == XEN_DOMCTL_SCHEDOP_getvcpuinfo )
+            {
+                spin_lock_irqsave(&prv->lock, flags);
+                local.u.rtds.period = svc->period / MICROSECS(1);
+                local.u.rtds.budget = svc->budget / MICROSECS(1);
+                spin_unlock_irqrestore(&prv->lock, flags);
+
+                if ( __copy_to_guest_offset(op->u.v.vcpus, i, &local, 1) )
+                {
+                    rc = -EFAULT;
+                    break;
+                }
+            }
+            else
+            {
+                if ( !rt_params_valid(local.u.rtds.period,
+                                      local.u.rtds.budget) )
+                {
+                    rc = -EINVAL;
+                    break;
+                }
+
+                spin_lock_irqsave(&prv->lock, flags);
+                rt_vcpu_set_params(svc, MICROSECS(local.u.rtds.period),
+                                   MICROSECS(local.u.rtds.budget));
+                spin_unlock_irqrestore(&prv->lock, flags);
+            }
+        }
+        break;
+
+    default:
+        rc = -EINVAL;
+        break;
+    }
+
+    return rc;
+}
+
+const struct scheduler sched_rtds_def = {
+    .name           = "SMP RTDS Scheduler",
+    .opt_name       = "rtds",
+    .sched_id       = XEN_SCHEDULER_RTDS,
+    .sched_data     = NULL,
+
+    .dump_cpu_state = rt_dump_pcpu,
+    .dump_settings  = rt_dump,
+    .init           = rt_init,
+    .deinit         = rt_deinit,
+    .alloc_pdata    = rt_alloc_pdata,
+    .free_pdata     = rt_free_pdata,
+    .alloc_domdata  = rt_alloc_domdata,
+    .free_domdata   = rt_free_domdata,
+    .init_domain    = rt_dom_init,
+    .destroy_domain = rt_dom_destroy,
+    .alloc_vdata    = rt_alloc_vdata,
+    .free_vdata     = rt_free_vdata,
+    .insert_vcpu    = rt_vcpu_insert,
+    .remove_vcpu    = rt_vcpu_remove,
+
+    .adjust         = rt_dom_cntl,
+
+    .pick_cpu       = rt_cpu_pick,
+    .do_schedule    = rt_schedule,
+    .sleep          = rt_vcpu_sleep,
+    .wake           = rt_vcpu_wake,
+    .context_saved  = rt_context_saved,
+};
@@ -263,7 +263,7 @@ long do_sysctl(XEN_GUEST_HANDLE_PARAM(xen_sysctl_t) u_sysctl)
         pi->total_pages = total_pages;
         /* Protected by lock */
         get_outstanding_claims(&pi->free_pages, &pi->outstanding_pages);
-        pi->scrub_pages = 0;
+        pi->scrub_pages = scrub_pending_pages();
         pi->cpu_khz = cpu_khz;
         arch_do_physinfo(pi);
 
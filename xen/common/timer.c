@@ -29,10 +29,17 @@
 static unsigned int timer_slop __read_mostly = 50000; /* 50 us */
 integer_param("timer_slop", timer_slop);
 
+/* Keep active timers on a hierarchical timer wheel rather than a heap. */
+static bool_t __read_mostly opt_timer_wheel;
+boolean_param("timer_wheel", opt_timer_wheel);
+
+struct timer_wheel;
+
 struct timers {
     spinlock_t     lock;
     struct timer **heap;
     struct timer  *list;
+    struct timer_wheel *wheel;
     struct timer  *running;
     struct list_head inactive;
 } __cacheline_aligned;
@@ -167,6 +174,162 @@ static int add_to_list(struct timer **pprev, struct timer *t)
 }
 
 
+/****************************************************************************
+ * TIMER WHEEL OPERATIONS.
+ *
+ * WHEEL_LEVELS wheels of WHEEL_SIZE slots, a slot of level n covering
+ * WHEEL_SIZE^n ticks.  Timers are filed by expiry relative to the wheel's
+ * current tick, and each level's slots are cascaded into the levels below
+ * as the level below wraps, so that insertion and removal are O(1).
+ */
+
+#define WHEEL_TICK_SHIFT 16     /* 65.5us ticks, about timer_slop. */
+#define WHEEL_BITS       6
+#define WHEEL_SIZE       (1U << WHEEL_BITS)
+#define WHEEL_MASK       (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS     6      /* 2^52ns (52 days) ahead before clamping. */
+#define WHEEL_SPAN       (1ULL << (WHEEL_BITS * WHEEL_LEVELS))
+
+struct timer_wheel {
+    /* Tick up to which timers have been executed. */
+    uint64_t         clk;
+    unsigned int     nr_timers;
+    /* Earliest deadline last computed; sooner timers need a softirq. */
+    s_time_t         deadline;
+    unsigned long    pending[WHEEL_LEVELS][BITS_TO_LONGS(WHEEL_SIZE)];
+    struct list_head slot[WHEEL_LEVELS][WHEEL_SIZE];
+};
+
+static inline uint64_t wheel_tick(s_time_t t)
+{
+    return (t < 0) ? 0 : ((uint64_t)t >> WHEEL_TICK_SHIFT);
+}
+
+/* First non-empty slot of @level at or (circularly) after @idx, if any. */
+static unsigned int wheel_next_slot(
+    struct timer_wheel *w, unsigned int level, unsigned int idx)
+{
+    unsigned int slot = find_next_bit(w->pending[level], WHEEL_SIZE, idx);
+
+    if ( slot >= WHEEL_SIZE )
+        slot = find_first_bit(w->pending[level], WHEEL_SIZE);
+
+    return slot;
+}
+
+static void wheel_file(struct timer_wheel *w, struct timer *t)
+{
+    uint64_t idx = max(wheel_tick(t->expires), w->clk);
+    uint64_t delta = idx - w->clk;
+    unsigned int level;
+
+    for ( level = 0; level < WHEEL_LEVELS - 1; level++ )
+        if ( delta < (1ULL << (WHEEL_BITS * (level + 1))) )
+            break;
+    if ( delta >= WHEEL_SPAN )
+        idx = w->clk + WHEEL_SPAN - 1;
+
+    t->wheel_level = level;
+    t->wheel_slot = (idx >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    list_add_tail(&t->wheel, &w->slot[level][t->wheel_slot]);
+    __set_bit(t->wheel_slot, w->pending[level]);
+}
+
+/* Add new entry @t to wheel. Return TRUE if new earliest deadline. */
+static int add_to_wheel(struct timer_wheel *w, struct timer *t)
+{
+    /* An empty wheel may not have been run for a while: catch it up. */
+    if ( w->nr_timers++ == 0 )
+        w->clk = max(w->clk, wheel_tick(NOW()));
+
+    wheel_file(w, t);
+
+    return (t->expires < w->deadline);
+}
+
+/* Delete @t from wheel. A deadline left early just costs a spurious softirq. */
+static int remove_from_wheel(struct timer_wheel *w, struct timer *t)
+{
+    list_del(&t->wheel);
+    if ( list_empty(&w->slot[t->wheel_level][t->wheel_slot]) )
+        __clear_bit(t->wheel_slot, w->pending[t->wheel_level]);
+    w->nr_timers--;
+
+    return 0;
+}
+
+/* Re-file the timers of the slots which the current tick has just reached. */
+static void cascade_wheel(struct timer_wheel *w)
+{
+    unsigned int level, idx;
+    struct timer *t;
+    LIST_HEAD(cascade);
+
+    for ( level = 1; level < WHEEL_LEVELS; level++ )
+    {
+        idx = (w->clk >> (WHEEL_BITS * level)) & WHEEL_MASK;
+        list_splice_init(&w->slot[level][idx], &cascade);
+        __clear_bit(idx, w->pending[level]);
+
+        while ( !list_empty(&cascade) )
+        {
+            t = list_entry(cascade.next, struct timer, wheel);
+            list_del(&t->wheel);
+            wheel_file(w, t);
+        }
+
+        if ( idx != 0 )
+            break;
+    }
+}
+
+/* Earliest timer of @slot due before @now, if any. */
+static struct timer *wheel_due(struct list_head *slot, s_time_t now)
+{
+    struct timer *t, *due = NULL;
+
+    list_for_each_entry ( t, slot, wheel )
+        if ( (t->expires < now) &&
+             ((due == NULL) || (t->expires < due->expires)) )
+            due = t;
+
+    return due;
+}
+
+/*
+ * Earliest deadline: that of the first timer on the bottom wheel, or the
+ * time at which a higher level next cascades, if sooner.
+ */
+static s_time_t wheel_deadline(struct timer_wheel *w)
+{
+    s_time_t deadline = STIME_MAX;
+    unsigned int level, idx;
+    uint64_t cur;
+    struct timer *t;
+
+    if ( w->nr_timers == 0 )
+        return STIME_MAX;
+
+    idx = wheel_next_slot(w, 0, w->clk & WHEEL_MASK);
+    if ( idx < WHEEL_SIZE )
+        list_for_each_entry ( t, &w->slot[0][idx], wheel )
+            deadline = min(deadline, t->expires);
+
+    for ( level = 1; level < WHEEL_LEVELS; level++ )
+    {
+        cur = (w->clk >> (WHEEL_BITS * level)) + 1;
+        idx = wheel_next_slot(w, level, cur & WHEEL_MASK);
+        if ( idx >= WHEEL_SIZE )
+            continue;
+        cur += (idx - cur) & WHEEL_MASK;
+        deadline = min_t(s_time_t, deadline,
+                         cur << (WHEEL_BITS * level + WHEEL_TICK_SHIFT));
+    }
+
+    return deadline;
+}
+
+
 /****************************************************************************
  * TIMER OPERATIONS.
  */
@@ -184,6 +347,9 @@ static int remove_entry(struct timer *t)
     case TIMER_STATUS_in_list:
         rc = remove_from_list(&timers->list, t);
         break;
+    case TIMER_STATUS_in_wheel:
+        rc = remove_from_wheel(timers->wheel, t);
+        break;
     default:
         rc = 0;
         BUG();
@@ -200,6 +366,12 @@ static int add_entry(struct timer *t)
 
     ASSERT(t->status == TIMER_STATUS_invalid);
 
+    if ( timers->wheel != NULL )
+    {
+        t->status = TIMER_STATUS_in_wheel;
+        return add_to_wheel(timers->wheel, t);
+    }
+
     /* Try to add to heap. t->heap_offset indicates whether we succeed. */
     t->heap_offset = 0;
     t->status = TIMER_STATUS_in_heap;
@@ -277,7 +449,7 @@ static inline void timer_unlock(struct timer *timer)
 static bool_t active_timer(struct timer *timer)
 {
     ASSERT(timer->status >= TIMER_STATUS_inactive);
-    ASSERT(timer->status <= TIMER_STATUS_in_list);
+    ASSERT(timer->status <= TIMER_STATUS_in_wheel);
     return (timer->status >= TIMER_STATUS_in_heap);
 }
 
@@ -428,6 +600,39 @@ static void execute_timer(struct timers *ts, struct timer *t)
 }
 
 
+static void run_wheel(struct timers *ts, s_time_t now)
+{
+    struct timer_wheel *w = ts->wheel;
+    uint64_t target = wheel_tick(now);
+    unsigned int next;
+    struct timer *t;
+
+    if ( w->nr_timers == 0 )
+        w->clk = max(w->clk, target);
+
+    for ( ; ; )
+    {
+        /* Execute ready timers of the current tick. */
+        while ( (t = wheel_due(&w->slot[0][w->clk & WHEEL_MASK], now)) )
+        {
+            remove_from_wheel(w, t);
+            execute_timer(ts, t);
+        }
+
+        if ( w->clk >= target )
+            break;
+
+        /* Skip empty slots, as far as the next cascade. */
+        next = (w->clk & WHEEL_MASK) + 1;
+        if ( next < WHEEL_SIZE )
+            next = min_t(unsigned int, WHEEL_SIZE,
+                         find_next_bit(w->pending[0], WHEEL_SIZE, next));
+        w->clk = min(target, (w->clk & ~(uint64_t)WHEEL_MASK) + next);
+        if ( !(w->clk & WHEEL_MASK) )
+            cascade_wheel(w);
+    }
+}
+
 static void timer_softirq_action(void)
 {
     struct timer  *t, **heap, *next;
@@ -437,6 +642,14 @@ static void timer_softirq_action(void)
     ts = &this_cpu(timers);
     heap = ts->heap;
 
+    if ( ts->wheel != NULL )
+    {
+        spin_lock_irq(&ts->lock);
+        run_wheel(ts, NOW());
+        deadline = ts->wheel->deadline = wheel_deadline(ts->wheel);
+        goto out;
+    }
+
     /* If we overflowed the heap, try to allocate a larger heap. */
     if ( unlikely(ts->list != NULL) )
     {
@@ -492,6 +705,8 @@ static void timer_softirq_action(void)
         deadline = heap[1]->expires;
     if ( (ts->list != NULL) && (ts->list->expires < deadline) )
         deadline = ts->list->expires;
+
+ out:
     this_cpu(timer_deadline) =
         (deadline == STIME_MAX) ? 0 : deadline + timer_slop;
 
@@ -535,6 +750,12 @@ static void dump_timerq(unsigned char key)
             dump_timer(ts->heap[j], now);
         for ( t = ts->list, j = 0; t != NULL; t = t->list_next, j++ )
             dump_timer(t, now);
+        if ( ts->wheel != NULL )
+            for ( j = 0; j < WHEEL_LEVELS * WHEEL_SIZE; j++ )
+                list_for_each_entry ( t, &ts->wheel->slot[j / WHEEL_SIZE]
+                                                         [j % WHEEL_SIZE],
+                                      wheel )
+                    dump_timer(t, now);
         spin_unlock_irqrestore(&ts->lock, flags);
     }
 }
@@ -545,6 +766,22 @@ static struct keyhandler dump_timerq_keyhandler = {
     .desc = "dump timer queues"
 };
 
+/* Return any active timer of @ts, or NULL if there are none. */
+static struct timer *first_entry(struct timers *ts)
+{
+    struct timer_wheel *w = ts->wheel;
+    unsigned int level, idx;
+
+    if ( w == NULL )
+        return GET_HEAP_SIZE(ts->heap) ? ts->heap[1] : ts->list;
+
+    for ( level = 0; level < WHEEL_LEVELS; level++ )
+        if ( (idx = wheel_next_slot(w, level, 0)) < WHEEL_SIZE )
+            return list_entry(w->slot[level][idx].next, struct timer, wheel);
+
+    return NULL;
+}
+
 static void migrate_timers_from_cpu(unsigned int old_cpu)
 {
     unsigned int new_cpu = cpumask_any(&cpu_online_map);
@@ -568,8 +805,7 @@ static void migrate_timers_from_cpu(unsigned int old_cpu)
         spin_lock(&old_ts->lock);
     }
 
-    while ( (t = GET_HEAP_SIZE(old_ts->heap)
-             ? old_ts->heap[1] : old_ts->list) != NULL )
+    while ( (t = first_entry(old_ts)) != NULL )
     {
         remove_entry(t);
         write_atomic(&t->cpu, new_cpu);
@@ -593,11 +829,34 @@ static void migrate_timers_from_cpu(unsigned int old_cpu)
 
 static struct timer *dummy_heap;
 
+static int init_wheel(struct timers *ts)
+{
+    struct timer_wheel *w = ts->wheel;
+    unsigned int level, idx;
+
+    if ( (w == NULL) && ((w = xmalloc(struct timer_wheel)) == NULL) )
+        return -ENOMEM;
+
+    w->clk = wheel_tick(NOW());
+    w->nr_timers = 0;
+    w->deadline = STIME_MAX;
+    for ( level = 0; level < WHEEL_LEVELS; level++ )
+    {
+        bitmap_zero(w->pending[level], WHEEL_SIZE);
+        for ( idx = 0; idx < WHEEL_SIZE; idx++ )
+            INIT_LIST_HEAD(&w->slot[level][idx]);
+    }
+
+    ts->wheel = w;
+    return 0;
+}
+
 static int cpu_callback(
     struct notifier_block *nfb, unsigned long action, void *hcpu)
 {
     unsigned int cpu = (unsigned long)hcpu;
     struct timers *ts = &per_cpu(timers, cpu);
+    int rc = 0;
 
     switch ( action )
     {
@@ -605,6 +864,8 @@ static int cpu_callback(
         INIT_LIST_HEAD(&ts->inactive);
         spin_lock_init(&ts->lock);
         ts->heap = &dummy_heap;
+        if ( opt_timer_wheel )
+            rc = init_wheel(ts);
         break;
     case CPU_UP_CANCELED:
     case CPU_DEAD:
@@ -614,7 +875,7 @@ static int cpu_callback(
         break;
     }
 
-    return NOTIFY_DONE;
+    return !rc ? NOTIFY_DONE : notifier_from_errno(rc);
 }
 
 static struct notifier_block cpu_nfb = {
@@ -635,7 +896,8 @@ void __init timer_init(void)
     SET_HEAP_SIZE(&dummy_heap, 0);
     SET_HEAP_LIMIT(&dummy_heap, 0);
 
-    cpu_callback(&cpu_nfb, CPU_UP_PREPARE, cpu);
+    if ( cpu_callback(&cpu_nfb, CPU_UP_PREPARE, cpu) != NOTIFY_DONE )
+        BUG();
     register_cpu_notifier(&cpu_nfb);
 
     register_keyhandler('a', &dump_timerq_keyhandler);
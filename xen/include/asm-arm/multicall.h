@@ -3,6 +3,8 @@
 
 extern void do_multicall_call(struct multicall_entry *call);
 
+#define multicall_fast_call(_call) 0
+
 #endif /* __ASM_ARM_MULTICALL_H__ */
 /*
  * Local variables:
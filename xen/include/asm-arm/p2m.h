@@ -109,6 +109,10 @@ void guest_physmap_remove_page(struct domain *d,
                                unsigned long gpfn,
                                unsigned long mfn, unsigned int page_order);
 
+/* No batching of p2m updates: each is complete when it returns. */
+static inline void guest_physmap_batch_begin(struct domain *d) {}
+static inline void guest_physmap_batch_end(struct domain *d) {}
+
 unsigned long gmfn_to_mfn(struct domain *d, unsigned long gpfn);
 
 /*
@@ -231,6 +231,11 @@ void hvm_vcpu_reset_state(struct vcpu *v, uint16_t cs, uint16_t ip);
 int prepare_ring_for_helper(struct domain *d, unsigned long gmfn, 
                             struct page_info **_page, void **_va);
 void destroy_ring_for_helper(void **_va, struct page_info *page);
+int prepare_ring_frames_for_helper(struct domain *d, unsigned long gmfn,
+                                   unsigned int nr, struct page_info **pages,
+                                   void **_va);
+void destroy_ring_frames_for_helper(void **_va, struct page_info **pages,
+                                    unsigned int nr);
 
 bool_t hvm_send_assist_req(ioreq_t *p);
 
@@ -252,7 +257,7 @@ int vmsi_deliver(
     uint8_t dest, uint8_t dest_mode,
     uint8_t delivery_mode, uint8_t trig_mode);
 struct hvm_pirq_dpci;
-void vmsi_deliver_pirq(struct domain *d, const struct hvm_pirq_dpci *);
+void vmsi_deliver_pirq(struct domain *d, struct hvm_pirq_dpci *);
 int hvm_girq_dest_2_vcpu_id(struct domain *d, uint8_t dest, uint8_t dest_mode);
 
 #define hvm_paging_enabled(v) \
@@ -356,6 +361,8 @@ bool_t hvm_has_dm(struct domain *d);
 bool_t hvm_io_pending(struct vcpu *v);
 void hvm_do_resume(struct vcpu *v);
 void hvm_migrate_pirqs(struct vcpu *v);
+void hvm_migrate_pirq_to(struct hvm_pirq_dpci *pirq_dpci,
+                         const struct vcpu *v);
 
 void hvm_inject_trap(struct hvm_trap *trap);
 void hvm_inject_hw_exception(unsigned int trapnr, int errcode);
@@ -37,7 +37,8 @@ typedef union {
         emt         :   3,  /* bits 5:3 - EPT Memory type */
         ipat        :   1,  /* bit 6 - Ignore PAT memory type */
         sp          :   1,  /* bit 7 - Is this a superpage? */
-        rsvd1       :   2,  /* bits 9:8 - Reserved for future use */
+        a           :   1,  /* bit 8 - Access bit */
+        d           :   1,  /* bit 9 - Dirty bit */
         recalc      :   1,  /* bit 10 - Software available 1 */
         snp         :   1,  /* bit 11 - VT-d snoop control in shared
                                EPT/VT-d usage */
@@ -74,6 +75,7 @@ typedef enum {
 #define EPTE_EMT_MASK           0x38
 #define EPTE_IGMT_MASK          0x40
 #define EPTE_AVAIL1_SHIFT       8
+#define EPTE_A_SHIFT            8
 #define EPTE_EMT_SHIFT          3
 #define EPTE_IGMT_SHIFT         6
 #define EPTE_RWX_MASK           0x7
@@ -185,6 +187,7 @@ static inline unsigned long pi_get_pir(struct pi_desc *pi_desc, int group)
 #define EXIT_REASON_XSETBV              55
 #define EXIT_REASON_APIC_WRITE          56
 #define EXIT_REASON_INVPCID             58
+#define EXIT_REASON_PML_FULL            62
 
 /*
  * Interruption-information format
@@ -259,6 +262,8 @@ extern uint8_t posted_intr_vector;
     (vmx_ept_vpid_cap & VMX_EPT_SUPERPAGE_2MB)
 #define cpu_has_vmx_ept_invept_single_context   \
     (vmx_ept_vpid_cap & VMX_EPT_INVEPT_SINGLE_CONTEXT)
+#define cpu_has_vmx_ept_ad                      \
+    (vmx_ept_vpid_cap & VMX_EPT_AD_BIT)
 
 #define EPT_2MB_SHIFT     16
 #define EPT_1GB_SHIFT     17
@@ -67,4 +67,41 @@
             : "rax", "rcx", "rdx", "rsi", "rdi",             \
               "r8",  "r9",  "r10", "r11" )                   \
 
+/*
+ * Dispatch the sub-calls which PV guests batch most heavily directly rather
+ * than through the hypercall table.  Evaluates to non-zero (with the result
+ * stored) if the call was handled here.  Native entries only: the compat
+ * handlers for these operations need their arguments translated.
+ */
+#define multicall_fast_call(_call)                                      \
+    ({                                                                  \
+        bool_t handled_ = 1;                                            \
+        switch ( (_call)->op )                                          \
+        {                                                               \
+        case __HYPERVISOR_mmu_update:                                   \
+            (_call)->result = do_mmu_update(                            \
+                guest_handle_from_ptr((_call)->args[0], mmu_update_t),  \
+                (_call)->args[1],                                       \
+                guest_handle_from_ptr((_call)->args[2], uint),          \
+                (_call)->args[3]);                                      \
+            break;                                                      \
+        case __HYPERVISOR_update_va_mapping:                            \
+            (_call)->result = do_update_va_mapping(                     \
+                (_call)->args[0], (_call)->args[1], (_call)->args[2]);  \
+            break;                                                      \
+        case __HYPERVISOR_grant_table_op:                               \
+            (_call)->result = do_grant_table_op(                        \
+                (_call)->args[0],                                       \
+                guest_handle_from_ptr((_call)->args[1], void),          \
+                (_call)->args[2]);                                      \
+            break;                                                      \
+        default:                                                        \
+            handled_ = 0;                                               \
+            break;                                                      \
+        }                                                               \
+        if ( handled_ )                                                 \
+            perfc_incr(multicall_fast_calls);                           \
+        handled_;                                                       \
+    })
+
 #endif /* __ASM_X86_MULTICALL_H__ */
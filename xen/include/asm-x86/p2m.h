@@ -29,6 +29,8 @@
 
 #include <xen/config.h>
 #include <xen/paging.h>
+#include <xen/tasklet.h>
+#include <xen/timer.h>
 #include <asm/mem_sharing.h>
 #include <asm/page.h>    /* for pagetable_t */
 
@@ -222,12 +224,23 @@ struct p2m_domain {
     /* Host p2m: Global log-dirty mode enabled for the domain. */
     bool_t             global_logdirty;
 
+    /* Host p2m: 2M regions (gfn >> PAGE_ORDER_2M) whose superpages were
+     * split in global log-dirty mode, to be coalesced when it ends. */
+    struct rangeset   *split_ranges;
+
     /* Host p2m: when this flag is set, don't flush all the nested-p2m 
      * tables on every host-p2m change.  The setter of this flag 
      * is responsible for performing the full flush before releasing the
      * host p2m's lock. */
     int                defer_nested_flush;
 
+    /* Host p2m: while non-zero (see guest_physmap_batch_begin()), TLB
+     * flushes are only recorded in need_flush, and freed p2m pages are
+     * held on deferred_pages, until the batch ends. */
+    unsigned int       defer_flush;
+    bool_t             need_flush;
+    struct page_list_head deferred_pages;
+
     /* Pages used to construct the p2m */
     struct page_list_head pages;
 
@@ -250,6 +263,15 @@ struct p2m_domain {
                                                   unsigned long first_gfn,
                                                   unsigned long last_gfn);
     void               (*memory_type_changed)(struct p2m_domain *p2m);
+    void               (*enable_hardware_log_dirty)(struct p2m_domain *p2m);
+    void               (*disable_hardware_log_dirty)(struct p2m_domain *p2m);
+    void               (*flush_hardware_cached_dirty)(struct p2m_domain *p2m);
+    void               (*coalesce_superpages)(struct p2m_domain *p2m);
+    void               (*flush_tlb)(struct p2m_domain *p2m);
+    int                (*track_accessed)(struct p2m_domain *p2m);
+    void               (*scan_accessed)(struct p2m_domain *p2m,
+                                        unsigned long gfn, unsigned int nr,
+                                        unsigned long *bitmap);
     
     void               (*write_p2m_entry)(struct p2m_domain *p2m,
                                           unsigned long gfn, l1_pgentry_t *p,
@@ -285,6 +307,10 @@ struct p2m_domain {
         long             count,        /* # of pages in cache lists         */
                          entry_count;  /* # of pages in p2m marked pod      */
         unsigned long    reclaim_single; /* Last gpfn of a scan */
+        unsigned long    reclaim_bg;   /* Last gpfn of a background scan */
+        struct tasklet   reclaim_tasklet; /* Background zero-page reclaim */
+        struct timer     reclaim_timer; /* Rate limit on reclaim_tasklet  */
+        s_time_t         reclaim_next; /* Earliest time of next run       */
         unsigned long    max_guest;    /* gpfn of max guest demand-populate */
 #define POD_HISTORY_MAX 128
         /* gpfn of last guest superpage demand-populated */
@@ -505,6 +531,15 @@ void guest_physmap_remove_page(struct domain *d,
                                unsigned long gfn,
                                unsigned long mfn, unsigned int page_order);
 
+/* Apply a run of guest_physmap_* updates under one lock acquisition,
+ * with TLB flushes deferred to the end of the batch.  Guest pages
+ * unmapped within the batch must not be freed until it has ended. */
+void guest_physmap_batch_begin(struct domain *d);
+void guest_physmap_batch_end(struct domain *d);
+
+/* Carry out a TLB flush deferred by a batch, before freeing memory. */
+void p2m_tlb_flush_sync(struct p2m_domain *p2m);
+
 /* Set a p2m range as populate-on-demand */
 int guest_physmap_mark_populate_on_demand(struct domain *d, unsigned long gfn,
                                           unsigned int order);
@@ -525,6 +560,14 @@ int p2m_change_type_one(struct domain *d, unsigned long gfn,
 /* Report a change affecting memory types. */
 void p2m_memory_type_changed(struct domain *d);
 
+/* Hardware-assisted dirty logging (e.g. VMX PML), where available. */
+void p2m_enable_hardware_log_dirty(struct domain *d);
+void p2m_disable_hardware_log_dirty(struct domain *d);
+void p2m_flush_hardware_cached_dirty(struct domain *d);
+
+/* Re-map runs of small pages by superpages where possible. */
+void p2m_coalesce_superpages(struct domain *d);
+
 int p2m_is_logdirty_range(struct p2m_domain *, unsigned long start,
                           unsigned long end);
 
@@ -540,6 +583,9 @@ int clear_mmio_p2m_entry(struct domain *d, unsigned long gfn);
 /* Dump PoD information about the domain */
 void p2m_pod_dump_data(struct domain *d);
 
+/* Set up the populate-on-demand state of a p2m */
+void p2m_pod_init(struct p2m_domain *p2m);
+
 /* Move all pages from the populate-on-demand cache to the domain page_list
  * (usually in preparation for domain destruction) */
 void p2m_pod_empty_cache(struct domain *d);
@@ -584,6 +630,9 @@ void p2m_mem_paging_populate(struct domain *d, unsigned long gfn);
 int p2m_mem_paging_prep(struct domain *d, unsigned long gfn, uint64_t buffer);
 /* Resume normal operation (in case a domain was paused) */
 void p2m_mem_paging_resume(struct domain *d);
+/* Test and clear the accessed state of a range of frames */
+int p2m_mem_paging_scan_accessed(struct domain *d, unsigned long gfn,
+                                 unsigned int nr, uint64_t buffer);
 
 /* Send mem event based on the access (gla is -1ull if not available).  Handles
  * the rw2rx conversion. Boolean return value indicates if access rights have 
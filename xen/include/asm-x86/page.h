@@ -213,6 +213,9 @@ void copy_page_sse2(void *, const void *);
 #define copy_page(_t,_f)    (cpu_has_xmm2 ?                             \
                              copy_page_sse2(_t, _f) :                   \
                              (void)memcpy(_t, _f, PAGE_SIZE))
+bool_t page_is_zero_sse2(const void *);
+bool_t page_is_zero_avx2(const void *);
+bool_t page_is_zero(const void *);
 
 /* Convert between Xen-heap virtual addresses and machine addresses. */
 #define __pa(x)             (virt_to_maddr(x))
@@ -72,6 +72,8 @@ PERFCOUNTER(shadow_validate_gl4e_calls, "calls to shadow_validate_gl4e")
 PERFCOUNTER(shadow_hash_lookups,   "calls to shadow_hash_lookup")
 PERFCOUNTER(shadow_hash_lookup_head, "shadow hash hit in bucket head")
 PERFCOUNTER(shadow_hash_lookup_miss, "shadow hash misses")
+PERFCOUNTER(shadow_hash_lookup_steps, "shadow hash chain entries examined")
+PERFCOUNTER(shadow_hash_resizes,   "shadow hash table resizes")
 PERFCOUNTER(shadow_get_shadow_status, "calls to get_shadow_status")
 PERFCOUNTER(shadow_hash_inserts,   "calls to shadow_hash_insert")
 PERFCOUNTER(shadow_hash_deletes,   "calls to shadow_hash_delete")
@@ -137,5 +139,22 @@ PERFCOUNTER(realmode_emulations, "realmode instructions emulated")
 PERFCOUNTER(realmode_exits,      "vmexits from realmode")
 
 PERFCOUNTER(pauseloop_exits, "vmexits from Pause-Loop Detection")
+PERFCOUNTER(pml_flushes,     "PML buffer flushes")
+PERFCOUNTER(pml_entries,     "PML entries moved to log-dirty")
+
+PERFCOUNTER(ept_coalesce_2m, "EPT 4k runs coalesced to 2M")
+PERFCOUNTER(ept_coalesce_1g, "EPT 2M runs coalesced to 1G")
+PERFCOUNTER(ept_split_untracked, "EPT log-dirty splits not tracked")
+
+PERFCOUNTER(p2m_flushes_deferred, "p2m flushes deferred in batches")
+PERFCOUNTER(p2m_batch_flushes,    "p2m batch flushes")
+
+PERFCOUNTER(pod_reclaim_runs,     "PoD background reclaim runs")
+PERFCOUNTER(pod_reclaim_pages,    "PoD pages reclaimed in background")
+PERFCOUNTER(pod_emergency_sweeps, "PoD emergency sweeps")
+
+PERFCOUNTER(dpci_msi_local,       "passthrough MSIs to a local vcpu")
+PERFCOUNTER(dpci_msi_remote,      "passthrough MSIs to a remote vcpu")
+PERFCOUNTER(dpci_msi_follow,      "passthrough MSIs moved after their vcpu")
 
 /*#endif*/ /* __XEN_PERFC_DEFN_H__ */
@@ -86,6 +86,12 @@ int shadow_disable_log_dirty(struct domain *d);
 /* shadow code to call when bitmap is being cleaned */
 void shadow_clean_dirty_bitmap(struct domain *d);
 
+/* shadow code to call when dirty ranges are being cleaned; returns 0 if
+ * shadow_clean_dirty_bitmap() is needed instead */
+int shadow_clean_dirty_ranges(struct domain *d,
+                              const xen_domctl_dirty_range_t *r,
+                              unsigned int n, unsigned long *budget);
+
 /* Update all the things that are derived from the guest's CR0/CR3/CR4.
  * Called to initialize paging structures if the paging mode
  * has changed, and when bringing up a VCPU for the first time. */
@@ -36,7 +36,7 @@
 #include "grant_table.h"
 #include "hvm/save.h"
 
-#define XEN_DOMCTL_INTERFACE_VERSION 0x0000000a
+#define XEN_DOMCTL_INTERFACE_VERSION 0x0000000b
 
 /*
  * NB. xen_domctl.domain is an IN/OUT parameter for this operation.
@@ -192,6 +192,15 @@ struct xen_domctl_getpageframeinfo3 {
 #define XEN_DOMCTL_SHADOW_OP_CLEAN       11
  /* Return the bitmap but do not modify internal copy. */
 #define XEN_DOMCTL_SHADOW_OP_PEEK        12
+ /*
+  * As CLEAN, but return runs of dirty pfns rather than a bitmap, and for
+  * HAP guests write-protect again only the pages which were dirtied.
+  * Reports the dirty pfns from first_pfn up to pages, stopping early when
+  * dirty_ranges is full or the call has run for long enough: call again
+  * from the updated first_pfn until it reaches pages.  Only the pfns
+  * reported are cleaned.
+  */
+#define XEN_DOMCTL_SHADOW_OP_CLEAN_RANGES 13
 
 /* Memory allocation accessors. */
 #define XEN_DOMCTL_SHADOW_OP_GET_ALLOCATION   30
@@ -233,6 +242,13 @@ struct xen_domctl_shadow_op_stats {
 typedef struct xen_domctl_shadow_op_stats xen_domctl_shadow_op_stats_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_shadow_op_stats_t);
 
+struct xen_domctl_dirty_range {
+    uint64_aligned_t first_pfn;
+    uint64_aligned_t nr_pfns;
+};
+typedef struct xen_domctl_dirty_range xen_domctl_dirty_range_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_dirty_range_t);
+
 struct xen_domctl_shadow_op {
     /* IN variables. */
     uint32_t       op;       /* XEN_DOMCTL_SHADOW_OP_* */
@@ -247,6 +263,11 @@ struct xen_domctl_shadow_op {
     XEN_GUEST_HANDLE_64(uint8) dirty_bitmap;
     uint64_aligned_t pages; /* Size of buffer. Updated with actual size. */
     struct xen_domctl_shadow_op_stats stats;
+
+    /* OP_CLEAN_RANGES (also uses pages and stats) */
+    XEN_GUEST_HANDLE_64(xen_domctl_dirty_range_t) dirty_ranges;
+    uint64_aligned_t first_pfn; /* IN/OUT: first pfn not yet reported */
+    uint32_t       nr_ranges;   /* IN: size of buffer. OUT: ranges used. */
 };
 typedef struct xen_domctl_shadow_op xen_domctl_shadow_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_shadow_op_t);
@@ -321,9 +342,30 @@ DEFINE_XEN_GUEST_HANDLE(xen_domctl_max_vcpus_t);
 #define XEN_SCHEDULER_CREDIT   5
 #define XEN_SCHEDULER_CREDIT2  6
 #define XEN_SCHEDULER_ARINC653 7
+#define XEN_SCHEDULER_RTDS     8
 /* Set or get info? */
 #define XEN_DOMCTL_SCHEDOP_putinfo 0
 #define XEN_DOMCTL_SCHEDOP_getinfo 1
+/* Per-vcpu parameters, for the schedulers which have them (RTDS). */
+#define XEN_DOMCTL_SCHEDOP_putvcpuinfo 2
+#define XEN_DOMCTL_SCHEDOP_getvcpuinfo 3
+
+/* RTDS period and budget, in microseconds. */
+struct xen_domctl_sched_rtds {
+    uint32_t period;
+    uint32_t budget;
+};
+typedef struct xen_domctl_sched_rtds xen_domctl_sched_rtds_t;
+
+struct xen_domctl_schedparam_vcpu {
+    union {
+        xen_domctl_sched_rtds_t rtds;
+    } u;
+    uint32_t vcpuid;
+};
+typedef struct xen_domctl_schedparam_vcpu xen_domctl_schedparam_vcpu_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_schedparam_vcpu_t);
+
 struct xen_domctl_scheduler_op {
     uint32_t sched_id;  /* XEN_SCHEDULER_* */
     uint32_t cmd;       /* XEN_DOMCTL_SCHEDOP_* */
@@ -342,6 +384,13 @@ struct xen_domctl_scheduler_op {
         struct xen_domctl_sched_credit2 {
             uint16_t weight;
         } credit2;
+        xen_domctl_sched_rtds_t rtds;
+        /* XEN_DOMCTL_SCHEDOP_{put,get}vcpuinfo */
+        struct {
+            XEN_GUEST_HANDLE_64(xen_domctl_schedparam_vcpu_t) vcpus;
+            uint32_t nr_vcpus;  /* At most the domain's max_vcpus. */
+            uint32_t padding;
+        } v;
     } u;
 };
 typedef struct xen_domctl_scheduler_op xen_domctl_scheduler_op_t;
@@ -790,12 +839,18 @@ struct xen_domctl_gdbsx_domstatus {
 #define XEN_DOMCTL_MEM_EVENT_OP_SHARING_DISABLE   1
 
 /* Use for teardown/setup of helper<->hypervisor interface for paging, 
- * access and sharing.*/
+ * access and sharing.
+ *
+ * On *_ENABLE, the ring is nr_frames consecutive gfns starting at the
+ * ring's HVM param (0 is taken as 1, at most MEM_EVENT_RING_MAX_FRAMES).
+ * Rings large enough to hold two requests per vCPU also keep a slot back
+ * for each running vCPU, so that guest vCPUs need not wait for room. */
 struct xen_domctl_mem_event_op {
     uint32_t       op;           /* XEN_DOMCTL_MEM_EVENT_OP_*_* */
     uint32_t       mode;         /* XEN_DOMCTL_MEM_EVENT_OP_* */
 
     uint32_t port;              /* OUT: event channel for ring */
+    uint32_t nr_frames;         /* IN: size of the ring, in pages */
 };
 typedef struct xen_domctl_mem_event_op xen_domctl_mem_event_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_mem_event_op_t);
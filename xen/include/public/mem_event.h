@@ -69,6 +69,9 @@ typedef struct mem_event_st {
 
 DEFINE_RING_TYPES(mem_event, mem_event_request_t, mem_event_response_t);
 
+/* Largest ring, in pages, XEN_DOMCTL_mem_event_op will set up. */
+#define MEM_EVENT_RING_MAX_FRAMES   16
+
 #endif
 
 /*
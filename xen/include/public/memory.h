@@ -371,13 +371,24 @@ typedef struct xen_pod_target xen_pod_target_t;
 #define XENMEM_paging_op_nominate           0
 #define XENMEM_paging_op_evict              1
 #define XENMEM_paging_op_prep               2
+/*
+ * Report which of the nr gfns from gfn on have been accessed since the
+ * last scan of them, and clear their accessed state.  buffer points to an
+ * array of (nr + 7) / 8 uint8_t, bit (i % 8) of byte (i / 8) being set if
+ * gfn + i was accessed.  Fails with -EOPNOTSUPP where the hardware does not
+ * track accesses.
+ */
+#define XENMEM_paging_op_scan_accessed      3
+#define XENMEM_paging_scan_max              4096
 
 struct xen_mem_event_op {
     uint8_t     op;         /* XENMEM_*_op_* */
     domid_t     domain;
-    
+    /* PAGING_SCAN_ACCESSED IN: number of gfns (<= XENMEM_paging_scan_max) */
+    uint32_t    nr;
 
     /* PAGING_PREP IN: buffer to immediately fill page in */
+    /* PAGING_SCAN_ACCESSED OUT: uint8_t accessed bitmap */
     uint64_aligned_t    buffer;
     /* Other OPs */
     uint64_aligned_t    gfn;           /* IN:  gfn of page being operated on */
@@ -445,6 +456,8 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_access_op_t);
 #define XENMEM_sharing_op_debug_gref        6
 #define XENMEM_sharing_op_add_physmap       7
 #define XENMEM_sharing_op_audit             8
+#define XENMEM_sharing_op_nominate_range    9
+#define XENMEM_sharing_op_share_batch       10
 
 #define XENMEM_SHARING_OP_S_HANDLE_INVALID  (-10)
 #define XENMEM_SHARING_OP_C_HANDLE_INVALID  (-9)
@@ -462,6 +475,19 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_access_op_t);
 #define XENMEM_SHARING_OP_FIELD_GET_GREF(field)        \
     ((field) & (~XENMEM_SHARING_OP_FIELD_IS_GREF_FLAG))
 
+/* One pair of pages to share, for OP_SHARE_BATCH. */
+struct xen_mem_sharing_batch_entry {
+    uint64_aligned_t source_gfn;    /* IN: the gfn of the source page */
+    uint64_aligned_t source_handle; /* IN: handle to the source page */
+    uint64_aligned_t client_gfn;    /* IN: the client gfn */
+    uint64_aligned_t client_handle; /* IN: handle to the client page */
+    domid_t  client_domain;         /* IN: the client domain id */
+    uint16_t pad;                   /* IN: must be zero */
+    int32_t  rc;                    /* OUT: result of sharing the pair */
+};
+typedef struct xen_mem_sharing_batch_entry xen_mem_sharing_batch_entry_t;
+DEFINE_XEN_GUEST_HANDLE(xen_mem_sharing_batch_entry_t);
+
 struct xen_mem_sharing_op {
     uint8_t     op;     /* XENMEM_sharing_op_* */
     domid_t     domain;
@@ -481,6 +507,23 @@ struct xen_mem_sharing_op {
             uint64_aligned_t client_handle; /* IN: handle to the client page */
             domid_t  client_domain; /* IN: the client domain id */
         } share; 
+        /*
+         * The range and batch ops may be preempted, in which case they
+         * continue from 'done', which callers set to 0 to start with.
+         */
+        struct mem_sharing_op_range {     /* OP_NOMINATE_RANGE */
+            uint64_aligned_t first_gfn;   /* IN: first gfn to nominate */
+            uint32_t nr;                  /* IN: number of gfns */
+            uint32_t done;                /* IN/OUT: gfns nominated so far */
+            /* OUT: the handles, or 0 for gfns that could not be nominated */
+            XEN_GUEST_HANDLE_64(uint64) handles;
+        } range;
+        struct mem_sharing_op_batch {     /* OP_SHARE_BATCH */
+            uint32_t nr;                  /* IN: number of entries */
+            uint32_t done;                /* IN/OUT: entries shared so far */
+            /* IN/OUT: the pairs to share, each with its result */
+            XEN_GUEST_HANDLE_64(xen_mem_sharing_batch_entry_t) entries;
+        } batch;
         struct mem_sharing_op_debug {     /* OP_DEBUG_xxx */
             union {
                 uint64_aligned_t gfn;      /* IN: gfn to debug          */
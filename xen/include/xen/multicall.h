@@ -17,6 +17,8 @@
 #define MCSF_call_preempted  (1<<_MCSF_call_preempted)
 struct mc_state {
     unsigned long flags;
+    /* Calls made by earlier entries of a multicall being continued. */
+    unsigned int  calls_done;
     union {
         struct multicall_entry call;
 #ifdef CONFIG_COMPAT
@@ -8,6 +8,8 @@ PERFCOUNTER_ARRAY(hypercalls,           "hypercalls", NR_hypercalls)
 
 PERFCOUNTER(calls_to_multicall,         "calls to multicall")
 PERFCOUNTER(calls_from_multicall,       "calls from multicall")
+PERFCOUNTER_ARRAY(multicall_batch,      "multicall batch size (log2)", 8)
+PERFCOUNTER(multicall_fast_calls,       "multicall fast-path calls")
 
 PERFCOUNTER(irqs,                   "#interrupts")
 PERFCOUNTER(ipis,                   "#IPIs")
@@ -26,6 +28,8 @@ PERFCOUNTER(vcpu_destroy,           "sched: vcpu_destroy")
 PERFCOUNTER(delay_ms,               "csched: delay")
 PERFCOUNTER(vcpu_check,             "csched: vcpu_check")
 PERFCOUNTER(acct_run,               "csched: acct_run")
+PERFCOUNTER(acct_pcpu,              "csched: acct_pcpu")
+PERFCOUNTER(acct_pcpu_catchup,      "csched: acct_pcpu_catchup")
 PERFCOUNTER(acct_no_work,           "csched: acct_no_work")
 PERFCOUNTER(acct_balance,           "csched: acct_balance")
 PERFCOUNTER(acct_reorder,           "csched: acct_reorder")
@@ -47,10 +51,31 @@ PERFCOUNTER(load_balance_other,     "csched: load_balance_other")
 PERFCOUNTER(steal_trylock_failed,   "csched: steal_trylock_failed")
 PERFCOUNTER(steal_peer_idle,        "csched: steal_peer_idle")
 PERFCOUNTER(migrate_queued,         "csched: migrate_queued")
+PERFCOUNTER_ARRAY(migrate_queued_level, "csched: migrate_queued by topology level", 4)
 PERFCOUNTER(migrate_running,        "csched: migrate_running")
 PERFCOUNTER(migrate_kicked_away,    "csched: migrate_kicked_away")
 PERFCOUNTER(vcpu_hot,               "csched: vcpu_hot")
+PERFCOUNTER(tick_stopped,           "csched: tick_stopped")
+PERFCOUNTER(tick_restarted,         "csched: tick_restarted")
+PERFCOUNTER(tick_skipped,           "csched: ticks skipped (tickless)")
+
+/* credit2 specific counters */
+PERFCOUNTER(csched2_runq_candidate, "csched2: runq_candidate")
+PERFCOUNTER(csched2_runq_candidate_visited, "csched2: runq_candidate nodes visited")
+PERFCOUNTER(csched2_tickle_idle,    "csched2: tickle_idle")
+PERFCOUNTER(csched2_tickless_idle,  "csched2: idle with no timer (tickless)")
+PERFCOUNTER(csched2_tickless_slice, "csched2: unbounded time slices (tickless)")
+PERFCOUNTER(csched2_tickless_kick,  "csched2: tickless cpus kicked")
+
+/* RTDS specific counters */
+PERFCOUNTER(rtds_replenish,         "rtds: budget replenishments")
+PERFCOUNTER(rtds_depleted,          "rtds: budget depletions")
+PERFCOUNTER(rtds_tickle_preempt,    "rtds: tickle_preempt")
 
 PERFCOUNTER(need_flush_tlb_flush,   "PG_need_flush tlb flushes")
+PERFCOUNTER(pcp_alloc_hit,          "page_alloc: per-cpu cache hits")
+PERFCOUNTER(pcp_free_hit,           "page_alloc: per-cpu cache frees")
+PERFCOUNTER(pcp_refill,             "page_alloc: per-cpu cache refills")
+PERFCOUNTER(pcp_drain,              "page_alloc: per-cpu cache drains")
 
 /*#endif*/ /* __XEN_PERFC_DEFN_H__ */
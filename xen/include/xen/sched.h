@@ -86,6 +86,7 @@ struct evtchn
 #define ECS_PIRQ         4 /* Channel is bound to a physical IRQ line.       */
 #define ECS_VIRQ         5 /* Channel is bound to a virtual IRQ line.        */
 #define ECS_IPI          6 /* Channel is bound to a virtual IPI line.        */
+    spinlock_t lock;       /* Serialises sends against (un)binding.  */
     u8  state;             /* ECS_* */
     u8  xen_consumer:XEN_CONSUMER_BITS; /* Consumer in Xen if nonzero */
     u8  pending:1;
@@ -254,12 +255,17 @@ struct mem_event_domain
 {
     /* ring lock */
     spinlock_t ring_lock;
-    /* The ring has 64 entries */
-    unsigned char foreign_producers;
-    unsigned char target_producers;
-    /* shared ring page */
+    /* slots claimed but not yet filled */
+    unsigned int foreign_producers;
+    unsigned int target_producers;
+    /* shared ring pages, mapped contiguously */
     void *ring_page;
-    struct page_info *ring_pg_struct;
+    struct page_info *ring_pg_struct[MEM_EVENT_RING_MAX_FRAMES];
+    unsigned int nr_frames;
+    /* a slot is kept back for each vCPU not blocked on the ring */
+    bool_t vcpu_slots;
+    /* vCPUs which claimed their own slot (vcpu_slots only) */
+    unsigned long *vcpu_claims;
     /* front-end ring */
     mem_event_front_ring_t front_ring;
     /* event channel port (vcpu0 only) */